@@ -13,9 +13,10 @@
 PicoI2SPIO I2S;
 
 // Constructor
-PicoI2SPIO::PicoI2SPIO()
-    : pio_(pio0), sm_(0), dma_ch_(0), initialized_(false),
-      sample_rate_(48000), bit_depth_(16),
+PicoI2SPIO::PicoI2SPIO(i2s_instance_t* inst)
+    : inst_(inst != nullptr ? inst : i2s_get_default_instance()),
+      pio_(pio0), sm_(0), dma_ch_(0), initialized_(false),
+      sample_rate_(48000), bit_depth_(16), tdm_slots_(8), channels_(2),
       callback_16_(nullptr), callback_32_(nullptr), callback_float_(nullptr),
       callback_active_(false), callback_buffer_16_(nullptr),
       callback_buffer_32_(nullptr), callback_float_left_(nullptr),
@@ -50,7 +51,12 @@ bool PicoI2SPIO::beginAdvanced(uint data_pin, uint clock_pin_base, uint mclk_pin
         return false;
     }
 
-    if (sample_rate < 8000 || sample_rate > 384000) {
+    // DoP carries DSD in 24bit samples at up to 705.6kHz (DSD256)
+    if (mode == MODE_DSD && bit_depth == 16) {
+        return false;
+    }
+
+    if (sample_rate < 8000 || sample_rate > (mode == MODE_DSD ? 705600u : 384000u)) {
         return false;
     }
 
@@ -60,16 +66,43 @@ bool PicoI2SPIO::beginAdvanced(uint data_pin, uint clock_pin_base, uint mclk_pin
     dma_ch_ = dma_ch;
     sample_rate_ = sample_rate;
     bit_depth_ = bit_depth;
+    channels_ = (mode == MODE_TDM) ? tdm_slots_ : 2;
 
     // Configure I2S
-    i2s_mclk_set_pin(data_pin, clock_pin_base, mclk_pin);
-    i2s_mclk_set_config(pio, sm, dma_ch, use_core1, clock_mode, mode);
-    i2s_mclk_init(sample_rate);
+    i2s_inst_mclk_set_pin(inst_, data_pin, clock_pin_base, mclk_pin);
+    i2s_inst_mclk_set_config(inst_, pio, sm, dma_ch, use_core1, clock_mode, mode);
+    if (i2s_inst_mclk_init(inst_, sample_rate) == false) {
+        return false;
+    }
 
     initialized_ = true;
     return true;
 }
 
+// Supply the queue memory, required for instances other than the default one
+bool PicoI2SPIO::setBuffer(void* mem, size_t size, uint32_t frames, uint8_t depth) {
+    return i2s_inst_set_buffer(inst_, mem, size, frames, depth);
+}
+
+// TDM frame layout
+bool PicoI2SPIO::setTDM(uint8_t slots, uint8_t slot_bits) {
+    if (i2s_inst_set_tdm(inst_, slots, slot_bits) == false) {
+        return false;
+    }
+    tdm_slots_ = slots;
+    return true;
+}
+
+// i2s, left or right justified slots
+bool PicoI2SPIO::setFormat(I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits) {
+    return i2s_inst_set_format(inst_, format, slot_bits, sample_bits);
+}
+
+// Packed 16 bit frames, halves queue memory and DMA traffic
+void PicoI2SPIO::setPacked(bool enable) {
+    i2s_inst_set_packed(inst_, enable);
+}
+
 // Stop I2S output
 void PicoI2SPIO::end() {
     if (!initialized_) {
@@ -147,7 +180,7 @@ bool PicoI2SPIO::processCallback() {
     }
 
     // Check if buffer has space
-    if (i2s_get_buf_length() >= I2S_TARGET_LEVEL) {
+    if (i2s_inst_get_buf_length(inst_) >= I2S_TARGET_LEVEL) {
         return false;
     }
 
@@ -236,7 +269,7 @@ bool PicoI2SPIO::write(const uint8_t* data, size_t bytes) {
 
     // Make a mutable copy for the C library
     uint8_t* mutable_data = const_cast<uint8_t*>(data);
-    return i2s_enqueue(mutable_data, bytes, bit_depth_);
+    return i2s_inst_enqueue(inst_, mutable_data, bytes, bit_depth_);
 }
 
 bool PicoI2SPIO::write(const int16_t* samples, size_t count) {
@@ -280,8 +313,8 @@ int PicoI2SPIO::availableForWrite() {
         return 0;
     }
 
-    int8_t used = i2s_get_buf_length();
-    return (I2S_BUF_DEPTH - used) * I2S_DATA_LEN * (bit_depth_ / 8);
+    int8_t used = i2s_inst_get_buf_length(inst_);
+    return (i2s_inst_get_buf_depth(inst_) - used) * i2s_inst_get_buf_frames(inst_) * channels_ * (bit_depth_ / 8);
 }
 
 bool PicoI2SPIO::isFull() {
@@ -289,7 +322,7 @@ bool PicoI2SPIO::isFull() {
         return true;
     }
 
-    return i2s_get_buf_length() >= I2S_BUF_DEPTH;
+    return i2s_inst_get_buf_length(inst_) >= i2s_inst_get_buf_depth(inst_);
 }
 
 void PicoI2SPIO::flush() {
@@ -298,7 +331,7 @@ void PicoI2SPIO::flush() {
     }
 
     // Wait until buffer is empty
-    while (i2s_get_buf_length() > 0) {
+    while (i2s_inst_get_buf_length(inst_) > 0) {
         delay(1);
     }
 }
@@ -360,7 +393,7 @@ void PicoI2SPIO::setVolumeDB(int8_t db) {
     if (db > 0) db = 0;
     if (db < -100) db = -100;
 
-    i2s_volume_change((-db) << 8, 0);  // Both channels
+    i2s_inst_volume_change(inst_, (-db) << 8, 0);  // Both channels
 }
 
 void PicoI2SPIO::setVolumeDB(int8_t left_db, int8_t right_db) {
@@ -369,8 +402,8 @@ void PicoI2SPIO::setVolumeDB(int8_t left_db, int8_t right_db) {
     if (right_db > 0) right_db = 0;
     if (right_db < -100) right_db = -100;
 
-    i2s_volume_change((-left_db) << 8, 1);   // Left channel
-    i2s_volume_change((-right_db) << 8, 2);  // Right channel
+    i2s_inst_volume_change(inst_, (-left_db) << 8, 1);   // Left channel
+    i2s_inst_volume_change(inst_, (-right_db) << 8, 2);  // Right channel
 }
 
 // Change sample rate
@@ -383,7 +416,9 @@ bool PicoI2SPIO::setSampleRate(uint32_t sample_rate) {
         return false;
     }
 
-    i2s_mclk_change_clock(sample_rate);
+    if (i2s_inst_mclk_change_clock(inst_, sample_rate) == false) {
+        return false;
+    }
     sample_rate_ = sample_rate;
     return true;
 }
@@ -14,16 +14,19 @@
 
 class PicoI2SPIO {
 private:
+    i2s_instance_t* inst_;
     PIO pio_;
     uint sm_;
     int dma_ch_;
     bool initialized_;
     uint32_t sample_rate_;
     uint8_t bit_depth_;
+    uint8_t tdm_slots_;
+    uint8_t channels_;
 
 public:
-    // Constructor
-    PicoI2SPIO();
+    // Constructor, nullptr drives the default instance, i2s_instance_create() gives a second output
+    PicoI2SPIO(i2s_instance_t* inst = nullptr);
 
     // Initialize with default pins
     bool begin(uint32_t sample_rate = 48000, uint8_t bit_depth = 16);
@@ -38,6 +41,18 @@ public:
                        CLOCK_MODE clock_mode, I2S_MODE mode,
                        uint32_t sample_rate, uint8_t bit_depth);
 
+    // Queue memory, call before begin on instances other than the default one
+    bool setBuffer(void* mem, size_t size, uint32_t frames, uint8_t depth);
+
+    // TDM slot count and width, call before begin with MODE_TDM
+    bool setTDM(uint8_t slots, uint8_t slot_bits);
+
+    // Justification and slot width, call before begin with MODE_I2S
+    bool setFormat(I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits);
+
+    // One FIFO word per frame with 16 bit slots, call before setBuffer and begin
+    void setPacked(bool enable);
+
     // Stop I2S output
     void end();
 
@@ -70,6 +85,7 @@ public:
     uint32_t getSampleRate() const { return sample_rate_; }
     uint8_t getBitDepth() const { return bit_depth_; }
     bool isInitialized() const { return initialized_; }
+    i2s_instance_t* getInstance() const { return inst_; }
 
     // Static callback for playback state
     static void setPlaybackHandler(void (*handler)(bool));
@@ -15,35 +15,236 @@
 #include "hardware/dma.h"
 #include "hardware/sync.h"
 #include "pico/multicore.h"
-#include "hardware/pll.h"
 #include "hardware/vreg.h"
+#include <string.h>
 
 #include "i2s.pio.h"
 #include "i2s.h"
+#include "i2s_clock.h"
+
+//Sent while the queue is empty, shared by all instances
+#define I2S_MUTE_LEN    (96 * 2)
+static int32_t i2s_mute_buff[I2S_MUTE_LEN];
+
+//DSD silence, 0x69 on both channels in the MODE_DSD word layout
+#define I2S_DSD_MUTE    0x3CC33CC3
+static const int32_t i2s_dsd_mute_buff[I2S_MUTE_LEN] = {[0 ... I2S_MUTE_LEN - 1] = I2S_DSD_MUTE};
+
+//S/PDIF preambles as line toggles of their 8 half cells, the first one in bit 0
+#define I2S_SPDIF_B     0x39
+#define I2S_SPDIF_M     0xC9
+#define I2S_SPDIF_W     0x69
+//Channel status and parity toggles in the second word of a subframe
+#define I2S_SPDIF_C     0xA0000000u
+//Frames per channel status block
+#define I2S_SPDIF_BLOCK 192
+
+//Biphase mark toggles of a byte, LSB first: each bit starts with a toggle, a 1 toggles again mid cell
+static uint16_t i2s_spdif_bmc[256];
+//S/PDIF silence, M and W preambles without channel status. Both are built by i2s_spdif_tables()
+static int32_t i2s_spdif_mute_buff[I2S_MUTE_LEN];
+
+//Chained DMA: ctrl_chan loads the data channel from a ring of control blocks,
+//reload_chan rewinds its write address and triggers it each time the data channel finishes
+#define I2S_CHAIN_LEN   16
+
+//Pointer sized so that the host build can hold host addresses, two words on the RP2040
+typedef struct {
+    uintptr_t transfer_count;
+    uintptr_t read_addr;
+} I2SDmaBlock;
+
+//Programs stay loaded across i2s_mclk_init calls and are reused when they match
+typedef struct {
+    PIO pio;
+    const pio_program_t* program;   //NULL: not loaded
+    uint offset;
+} I2SProgram;
 
-static spin_lock_t* queue_spin_lock;
-static bool clk_48khz;
-
-static uint i2s_dout_pin        = 18;
-static uint i2s_clk_pin_base    = 20;
-static uint i2s_mclk_pin        = 22;
-static PIO  i2s_pio             = pio0;
-static uint i2s_sm              = 0;
-
-static int i2s_dma_chan         = 0;
-static bool i2s_use_core1       = false;
-static CLOCK_MODE i2s_clock_mode = CLOCK_MODE_DEFAULT;
-static I2S_MODE i2s_mode        = MODE_I2S;
+/**
+ * @brief Word layout written to the i2s buffer
+ */
+typedef enum {
+    I2S_OUT_LR,     //L, R
+    I2S_OUT_EXDF,   //LR bits alternately rearranged
+    I2S_OUT_DUAL,   //LR bits alternately rearranged, followed by the inverted pair
+    I2S_OUT_DSD,    //DoP payload, LR bits alternately rearranged in the upper half of two words
+    I2S_OUT_PACKED, //Upper 16 bits of L and R in one word, L in the upper half
+    I2S_OUT_SPDIF,  //Biphase mark line toggles of the L and R subframes, two words each
+    I2S_OUT_COUNT
+} I2S_OUT;
 
-static int8_t i2s_buf_length;
-static uint8_t enqueue_pos;
-static uint8_t dequeue_pos;
+/**
+ * @brief Fused unpack, volume and store kernel
+ *
+ * @param dst Destination in i2s buffer word layout
+ * @param src Source samples, L/R interleaved little endian
+ * @param frames Number of stereo frames
+ * @param ml L channel volume
+ * @param mr R channel volume
+ */
+typedef void (*I2SKernel)(int32_t* dst, const uint8_t* src, uint32_t frames, int32_t ml, int32_t mr);
+
+//State of one output
+struct i2s_instance {
+    //Chained DMA ring first, it is aligned to its size for the control channel ring
+    I2SDmaBlock chain[I2S_CHAIN_LEN] __attribute__((aligned(I2S_CHAIN_LEN * sizeof(I2SDmaBlock))));
+    bool chain_packet[I2S_CHAIN_LEN];
+    uint8_t chain_reclaim;
+    uint8_t chain_write;
+    uintptr_t chain_target;
+    bool use_chain;
+    int ctrl_chan;
+    int reload_chan;
+
+    uint dout_pin;
+    uint clk_pin_base;
+    uint mclk_pin;
+    PIO  pio;
+    uint sm;
+
+    int dma_chan;
+    bool use_core1;
+    CLOCK_MODE clock_mode;
+    I2S_MODE mode;
+    uint8_t tdm_slots;
+    uint8_t tdm_slot_bits;
+    I2S_FORMAT format;          //MODE_I2S justification
+    uint8_t slot_bits;
+    uint8_t sample_bits;
+    bool use_packed;            //i2s_set_packed, in effect where i2s_packed() allows it
+
+    //DMA_IRQ_0 + irq_index, one per instance
+    uint irq_index;
+    bool in_use;
+
+    //Single producer / single consumer queue
+    //enqueue_count is written only by the producer, dequeue_count and release_count only by the consumer
+    volatile uint32_t enqueue_count;
+    volatile uint32_t dequeue_count;
+    volatile uint32_t release_count;
+    volatile uint32_t enqueue_frames;
+    volatile uint32_t dequeue_frames;
+    uint8_t enqueue_pos;
+    uint8_t dequeue_pos;
+    bool dequeue_held;
+    bool enqueue_acquired;
+    bool mute;                  //Consumer is sending mute until the queue refills to start_level
+    const int32_t* mute_buff;   //i2s_mute_buff, i2s_dsd_mute_buff in MODE_DSD, i2s_spdif_mute_buff in MODE_SPDIF
+
+    //Streaming writer, fills the slot at enqueue_pos across i2s_write calls
+    uint32_t write_period;
+    uint32_t write_filled;
+    bool write_open;
+    uint8_t write_carry[I2S_TDM_MAX_SLOTS * 4];
+    uint8_t write_carry_len;
+    uint8_t write_resolution;
+
+    //Telemetry, underrun and level fields are written only by the consumer, overruns only by the producer
+    I2S_STATS stats;
+    bool stats_playing;
+    uint64_t last_underrun_us;
+    uint64_t last_overrun_us;
+
+    //Rate switch
+    uint32_t audio_clock;
+    uint offset_mclk;
+    bool use_gpout;
+    int gpout;                  //clk_gpout0-3 driving MCLK instead of the MCLK state machine
+    bool mclk_sm;               //MCLK state machine running on sm + 1
+    uint offset;                //Entry of the data program
+
+    I2SProgram program_data;
+    I2SProgram program_mclk;
+    pio_program_t tdm_program;  //i2s_tdm patched for tdm_slots and tdm_slot_bits
+    uint16_t tdm_instructions[sizeof(i2s_tdm_program_instructions) / sizeof(uint16_t)];
+    pio_program_t format_program;   //i2s_data, i2s_lj or i2s_rj patched for slot_bits and sample_bits
+    uint16_t format_instructions[sizeof(i2s_rj_program_instructions) / sizeof(uint16_t)];
+
+    //Restart
+    bool running;
+    bool dma_claimed;           //Data channel claimed by i2s_chain_init, not by the caller
+    irq_handler_t irq_handler;
+    uint32_t init_start_us;
+    uint32_t init_us;
+    volatile uint32_t first_packet_us;
+
+    //slave mode
+    bool slave;
+    volatile bool clock_lost;
+    bool clock_timer_active;
+    repeating_timer_t clock_timer;
+    uint32_t clock_seen_seq;
+    uint32_t clock_seen_us;
+    uint64_t last_clock_loss_us;
+    volatile bool switching;
+    uint32_t ramp_len;          //Frames faded in after a rate switch
+    uint32_t ramp_pos;
+
+    //Capture, a second queue DMA fills from the RX FIFO of cap_sm
+    //cap_write_count is written only by the capture interrupt, cap_read_count and cap_release_count only by the consumer
+    int cap_chan;               //-1: no capture
+    uint cap_pin;
+    uint cap_sm;
+    uint cap_offset;
+    bool cap_active;            //Set up by the last i2s_mclk_init
+    int32_t* cap_buf;
+    uint32_t cap_frames;
+    uint8_t cap_depth;
+    uint8_t cap_dma_pos;        //Slot DMA is writing
+    uint8_t cap_read_pos;
+    bool cap_held;
+    volatile uint32_t cap_write_count;
+    volatile uint32_t cap_read_count;
+    volatile uint32_t cap_release_count;
+    I2SProgram program_capture;
+    pio_program_t capture_program;  //i2s_capture patched for the clock pins
+    uint16_t capture_instructions[sizeof(i2s_capture_program_instructions) / sizeof(uint16_t)];
+
+    //Output timestamps, written by the consumer only, readers retry while ts_seq is odd or changes
+    volatile uint32_t ts_seq;
+    volatile uint32_t ts_frames;
+    volatile uint32_t ts_time_us;
+    volatile uint32_t ts_pending;
+    volatile uint32_t ts_epoch;
+    volatile uint32_t ts_epoch_us;      //Output (re)start, earlier timestamps belong to the previous epoch
+    uint32_t ts_dma_frames;             //Frames of the transfer i2s_handler started
+
+    //Buffers carved out of the arena by i2s_buffer_layout()
+    uint8_t* arena;
+    size_t arena_size;
+    uint32_t buf_frames;
+    uint8_t buf_depth;
+    uint8_t start_level;
+
+    int32_t* buf;
+    uint32_t slot_len;
+    uint32_t* sample;
+    uint32_t frame_len;
+    int32_t* dma_buff[2];
+
+    int32_t mul_l;
+    int32_t mul_r;
+
+    I2S_OUT out;
+    const I2SKernel* kernel;
+
+    //S/PDIF channel status, bit n of the block is bit n % 32 of word n / 32
+    //spdif_frame is the block position of the next frame published, written only by the producer
+    uint32_t spdif_status[I2S_SPDIF_BLOCK / 32];
+    uint32_t spdif_frame;
+
+    ExternalFunction playback_handler;
+    Core1MainFunction core1_main_funcion;
+};
 
-static int32_t i2s_buf[I2S_BUF_DEPTH][I2S_DATA_LEN];
-static uint32_t i2s_sample[I2S_BUF_DEPTH];
+#ifndef I2S_NO_DEFAULT_BUFFER
+//Only the default instance falls back to it
+static int32_t i2s_default_buffer[I2S_BUFFER_SIZE(I2S_DATA_FRAMES, I2S_BUF_DEPTH) / sizeof(int32_t)];
+#endif
 
-static int32_t mul_l;
-static int32_t mul_r;
+//Instance the default core1 main function serves, only one instance can use core1
+static i2s_instance_t* volatile i2s_core1_inst;
 
 //-100dB ~ 0dB (1dB step)
 static const int32_t db_to_vol[101] = {
@@ -69,726 +270,3062 @@ static const int32_t db_to_vol[101] = {
 static inline void default_playback_handler(bool state){
     gpio_put(PICO_DEFAULT_LED_PIN, state);
 }
-static ExternalFunction playback_handler = default_playback_handler;
 
 /**
  * @brief Notify i2s playback state changes
  *
+ * @param inst Instance
  * @param state Playback state true:playback started false:playback stopped
  */
-static inline void set_playback_state(bool state){
-    playback_handler(state);
+static inline void set_playback_state(i2s_instance_t* inst, bool state){
+    inst->playback_handler(state);
 }
 
 /**
- * @brief Set system clock to 271MHz
+ * @brief Apply Q29 volume to a sample
  *
- * @note 44.1kHz family 271 / 12 = 22.583MHz
+ * @param x Sample
+ * @param mul Volume from db_to_vol
  */
-static void set_sys_clock_271000khz(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    pll_init(pll_sys, 2, 1626 * MHZ, 6, 1);
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, 271 * MHZ);
+static __force_inline int32_t i2s_apply_volume(int32_t x, int32_t mul){
+    return (int32_t)(((int64_t)x * mul) >> 29u);
 }
 
 /**
- * @brief Set system clock to 135.5MHz
+ * @brief Store one frame as two EXDF words
  *
- * @note 44.1kHz family 135.5 / 6 = 22.583MHz
+ * @param d Destination (2 words)
+ * @param l L channel
+ * @param r R channel
+ * @note LR bits are alternately rearranged, upper 32bits first
  */
-static void set_sys_clock_135500khz(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    pll_init(pll_sys, 2, 1626 * MHZ, 6, 1);
-    clock_configure_int_divider(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, 271 * MHZ, 2);
+static __force_inline void i2s_store_exdf(int32_t* d, int32_t l, int32_t r){
+    uint64_t merged = (part1by1_32(l) << 1) | part1by1_32(r);
+
+    d[0] = (uint32_t)(merged >> 32);
+    d[1] = (uint32_t)(merged & 0xFFFFFFFF);
 }
 
 /**
- * @brief Set system clock to 295MHz
+ * @brief Invert a sample without overflow
  *
- * @note 48kHz family 295 / 12 = 24.583MHz
+ * @param x Sample
  */
-static void set_sys_clock_295000khz(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    pll_init(pll_sys, 2, 1770 * MHZ, 6, 1);
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, 295 * MHZ);
+static __force_inline int32_t i2s_invert(int32_t x){
+    return x == INT32_MIN ? INT32_MAX : -x;
 }
 
 /**
- * @brief Set system clock to 147.5MHz
+ * @brief Store one frame as four dual mono words
  *
- * @note 48kHz family 147.5 / 6 = 24.583MHz
+ * @param d Destination (4 words)
+ * @param l L channel
+ * @param r R channel
+ * @note The second pair carries the inverted samples
  */
-static void set_sys_clock_147500khz(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    pll_init(pll_sys, 2, 1770 * MHZ, 6, 1);
-    clock_configure_int_divider(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, 295 * MHZ, 2);
+static __force_inline void i2s_store_dual(int32_t* d, int32_t l, int32_t r){
+    i2s_store_exdf(d, l, r);
+    i2s_store_exdf(d + 2, i2s_invert(l), i2s_invert(r));
 }
 
 /**
- * @brief Set system clock to gpin0
+ * @brief Check the DoP marker of one frame
  *
- * @note gpin0 = 45.1584MHz
+ * @param l L channel, left justified
+ * @param r R channel, left justified
+ * @return true The upper byte is 0x05 or 0xFA on both channels
  */
-static void set_sys_clock_gpin0(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    clock_configure_gpin(clk_sys, 20, 45158400, 45158400);
+static __force_inline bool i2s_dop_marker(int32_t l, int32_t r){
+    uint32_t marker = (uint32_t)l >> 24;
+
+    return (marker == 0x05 || marker == 0xFA) && marker == (uint32_t)r >> 24;
 }
 
 /**
- * @brief Set system clock to gpin1
+ * @brief Store the DSD bits of one DoP frame as two words
  *
- * @note gpin1 = 49.152MHz
+ * @param d Destination (2 words)
+ * @param l L channel, left justified DoP sample
+ * @param r R channel, left justified DoP sample
+ * @note 16 bits of each channel, oldest first. L goes to the even bits (DSDL=data_pin), 8 bit pairs per word.
+ * Frames without a marker become DSD silence
  */
-static void set_sys_clock_gpin1(void){
-    while (running_on_fpga()) tight_loop_contents();
-    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    clock_configure_gpin(clk_sys, 22, 49152 * KHZ, 49152 * KHZ);
+static __force_inline void i2s_store_dsd(int32_t* d, int32_t l, int32_t r){
+    uint32_t bits;
+
+    if (i2s_dop_marker(l, r) == false){
+        d[0] = I2S_DSD_MUTE;
+        d[1] = I2S_DSD_MUTE;
+        return;
+    }
+    bits = (uint32_t)((part1by1_32((uint32_t)l << 8) | part1by1_32((uint32_t)r << 8) << 1) >> 32);
+    d[0] = (int32_t)(bits & 0xFFFF0000);
+    d[1] = (int32_t)(bits << 16);
 }
 
 /**
- * @brief Handler for retrieving data from i2s buffer
+ * @brief Pack the upper 16 bits of one frame into one word
  *
- * @note Called when use_core1 is false
+ * @param l L channel, goes to the upper half
+ * @param r R channel, goes to the lower half
  */
-static void __isr __time_critical_func(i2s_handler)(){
-	static bool mute;
-	static int32_t mute_buff[96 * 2] = {0};
-	static uint32_t mute_len = sizeof(mute_buff) / sizeof(int32_t);
-	
-	if (i2s_buf_length == 0){
-        mute = true;
-        set_playback_state(false);
-    }
-	else if (i2s_buf_length >= I2S_START_LEVEL && mute == true){
-        mute = false;
-        set_playback_state(true);
-    }
+static __force_inline int32_t i2s_pack16(int32_t l, int32_t r){
+    return (int32_t)(((uint32_t)l & 0xFFFF0000) | (uint32_t)r >> 16);
+}
 
-	if (mute == false){
-		dma_channel_transfer_from_buffer_now(i2s_dma_chan, i2s_buf[dequeue_pos], i2s_sample[dequeue_pos]);
-		dequeue_pos++;
-		if (dequeue_pos >= I2S_BUF_DEPTH){
-            dequeue_pos = 0;
-        }
-		i2s_buf_length--;
-	}
-	else{
-		dma_channel_transfer_from_buffer_now(i2s_dma_chan, mute_buff, mute_len);
-	}
-    
-   	dma_hw->ints0 = 1u << i2s_dma_chan;
+/**
+ * @brief Even parity of a word
+ *
+ * @param x Word
+ * @note Folded to a nibble, 0x6996 is the parity table of the 16 nibbles
+ */
+static __force_inline uint32_t i2s_parity(uint32_t x){
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    return (0x6996u >> (x & 0xF)) & 1;
 }
 
 /**
- * @brief Main function for core1
+ * @brief Store one S/PDIF subframe as two words of line toggles
  *
- * @note Called when use_core1 is true
+ * @param d Destination (2 words)
+ * @param x Sample, the upper 24 bits are sent
+ * @param preamble I2S_SPDIF_M or I2S_SPDIF_W
+ * @note Time slot s is half cells 2s and 2s + 1, sent from bit 0 of the first word. Slots 4-27 carry the sample LSB first,
+ * validity, user data and channel status are 0 and the parity bit makes slots 4-31 even. i2s_spdif_stamp() adds the rest
  */
-static void defalut_core1_main(void){
-    int32_t* buff;
-    int dma_sample[2], sample;
-    bool mute = false;
-    int32_t mute_buff[96 * 2] = {0};
-    uint32_t mute_len = sizeof(mute_buff) / sizeof(int32_t);
-    int8_t buf_length;
-    static int32_t dma_buff[2][I2S_DATA_LEN];
-    uint8_t dma_use = 0;
+static __force_inline void i2s_spdif_subframe(int32_t* d, int32_t x, uint32_t preamble){
+    uint32_t bits = ((uint32_t)x >> 4) & 0x0FFFFFF0;
 
-    while (1){
-        buf_length = i2s_get_buf_length();
+    bits |= i2s_parity(bits) << 31;
+    d[0] = (int32_t)((uint32_t)i2s_spdif_bmc[(bits >> 8) & 0xFF] << 16 | (i2s_spdif_bmc[bits & 0xFF] & 0xFF00) | preamble);
+    d[1] = (int32_t)((uint32_t)i2s_spdif_bmc[bits >> 24] << 16 | i2s_spdif_bmc[(bits >> 16) & 0xFF]);
+}
 
-        if (buf_length == 0){
-            mute = true;
-            set_playback_state(false);
-        }
-        else if (buf_length >= I2S_START_LEVEL && mute == true){
-            mute = false;
-            set_playback_state(true);
-        }
+/**
+ * @brief Store one frame as two S/PDIF subframes
+ *
+ * @param d Destination (4 words)
+ * @param l L channel, subframe 1 (M preamble)
+ * @param r R channel, subframe 2 (W preamble)
+ */
+static __force_inline void i2s_store_spdif(int32_t* d, int32_t l, int32_t r){
+    i2s_spdif_subframe(d, l, I2S_SPDIF_M);
+    i2s_spdif_subframe(d + 2, r, I2S_SPDIF_W);
+}
 
-        if (mute == true){
-            buff = mute_buff;
-            sample = mute_len;
-        }
-        else if (i2s_dequeue(&buff, &sample) == false){
-            buff = mute_buff;
-            sample = mute_len;
+/**
+ * @brief Load one little endian sample as a left justified int32
+ *
+ * @param p Source bytes
+ * @param resolution Sample bit depth (16, 24, 32)
+ */
+static __force_inline int32_t i2s_load_sample(const uint8_t* p, const uint resolution){
+    if (resolution == 16){
+        return (int32_t)((uint32_t)p[0] << 16 | (uint32_t)p[1] << 24);
+    }
+    else if (resolution == 24){
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+    }
+    return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Apply volume to one frame and store it in the i2s buffer word layout
+ *
+ * @return int32_t* Next destination
+ */
+static __force_inline int32_t* i2s_kernel_put(int32_t* d, int32_t l, int32_t r, int32_t ml, int32_t mr, const I2S_OUT out, const bool gain){
+    if (gain){
+        l = i2s_apply_volume(l, ml);
+        r = i2s_apply_volume(r, mr);
+    }
+
+    if (out == I2S_OUT_EXDF){
+        i2s_store_exdf(d, l, r);
+        return d + 2;
+    }
+    else if (out == I2S_OUT_DSD){
+        i2s_store_dsd(d, l, r);
+        return d + 2;
+    }
+    else if (out == I2S_OUT_DUAL){
+        i2s_store_dual(d, l, r);
+        return d + 4;
+    }
+    else if (out == I2S_OUT_PACKED){
+        d[0] = i2s_pack16(l, r);
+        return d + 1;
+    }
+    else if (out == I2S_OUT_SPDIF){
+        i2s_store_spdif(d, l, r);
+        return d + 4;
+    }
+    d[0] = l;
+    d[1] = r;
+    return d + 2;
+}
+
+/**
+ * @brief Body of the fused kernels, specialised by the constant arguments
+ *
+ * @note Word aligned sources are read two frames per iteration with 32bit loads
+ * @note (16bit: 1 word/frame, 24bit: 3 words/2 frames, 32bit: 2 words/frame)
+ */
+static __force_inline void i2s_kernel_body(int32_t* d, const uint8_t* src, uint32_t frames, int32_t ml, int32_t mr,
+                                           const uint resolution, const I2S_OUT out, const bool gain){
+    uint32_t i = 0;
+
+    if (((uintptr_t)src & 3) == 0){
+        const uint32_t* w = (const uint32_t*)src;
+
+        if (resolution == 16 && out == I2S_OUT_PACKED && gain == false){
+            //A little endian L/R int16 pair only swaps halves
+            for (; i + 2 <= frames; i += 2){
+                uint32_t w0 = w[0];
+                uint32_t w1 = w[1];
+                w += 2;
+                d[0] = (int32_t)(w0 << 16 | w0 >> 16);
+                d[1] = (int32_t)(w1 << 16 | w1 >> 16);
+                d += 2;
+            }
         }
-        
-        //Store in i2s buffer
-        if (i2s_mode == MODE_EXDF){
-            //Rearrange
-            int l = 0;
-            for (int i = 0, j = 0; i < sample; i += 2) {
-                uint64_t left  = part1by1_32(buff[i]);
-                uint64_t right = part1by1_32(buff[i + 1]);
-                
-                uint64_t merged = (left << 1) | right;
-        
-                dma_buff[dma_use][i] = (uint32_t)(merged >> 32);     // Upper 32bits
-                dma_buff[dma_use][i + 1] = (uint32_t)(merged & 0xFFFFFFFF); // Lower 32bits
+        else if (resolution == 16){
+            for (; i + 2 <= frames; i += 2){
+                uint32_t w0 = w[0];
+                uint32_t w1 = w[1];
+                w += 2;
+                d = i2s_kernel_put(d, (int32_t)(w0 << 16), (int32_t)(w0 & 0xFFFF0000), ml, mr, out, gain);
+                d = i2s_kernel_put(d, (int32_t)(w1 << 16), (int32_t)(w1 & 0xFFFF0000), ml, mr, out, gain);
             }
         }
-        else if (i2s_mode == MODE_PT8211_DUAL || i2s_mode == MODE_I2S_DUAL){
-            //Rearrange
-            for (int i = 0, j = 0; i < sample; i += 2) {
-                //
-                uint64_t tmp1, tmp2, merged;
-                int32_t d_r, d_l;
-                tmp1 = part1by1_32(buff[i]);
-                tmp2 = part1by1_32(buff[i + 1]);
-                
-                merged = (tmp1 << 1) | tmp2;
-        
-                dma_buff[dma_use][j++] = (uint32_t)(merged >> 32);     // Upper 32bits
-                dma_buff[dma_use][j++] = (uint32_t)(merged & 0xFFFFFFFF); // Lower 32bits
-
-                //Invert
-                if (buff[i] == INT32_MIN){
-                    d_l = INT32_MAX;
-                }
-                else{
-                    d_l = -buff[i];
-                }
-                if (buff[i + 1] == INT32_MIN){
-                    d_r = INT32_MAX;
-                }
-                else{
-                    d_r = -buff[i + 1];
-                }
-                tmp1 = part1by1_32(d_l);
-                tmp2 = part1by1_32(d_r);
-                
-                merged = (tmp1 << 1) | tmp2;
-        
-                dma_buff[dma_use][j++] = (uint32_t)(merged >> 32);     // Upper 32bits
-                dma_buff[dma_use][j++] = (uint32_t)(merged & 0xFFFFFFFF); // Lower 32bits
+        else if (resolution == 24){
+            for (; i + 2 <= frames; i += 2){
+                uint32_t w0 = w[0];
+                uint32_t w1 = w[1];
+                uint32_t w2 = w[2];
+                w += 3;
+                d = i2s_kernel_put(d, (int32_t)(w0 << 8), (int32_t)((w0 >> 24) << 8 | w1 << 16), ml, mr, out, gain);
+                d = i2s_kernel_put(d, (int32_t)((w1 >> 16) << 8 | w2 << 24), (int32_t)(w2 & 0xFFFFFF00), ml, mr, out, gain);
             }
-            sample *= 2;
         }
         else {
-            for (int i = 0; i < sample; i++){
-                dma_buff[dma_use][i] = buff[i];
+            for (; i + 2 <= frames; i += 2){
+                uint32_t w0 = w[0];
+                uint32_t w1 = w[1];
+                uint32_t w2 = w[2];
+                uint32_t w3 = w[3];
+                w += 4;
+                d = i2s_kernel_put(d, (int32_t)w0, (int32_t)w1, ml, mr, out, gain);
+                d = i2s_kernel_put(d, (int32_t)w2, (int32_t)w3, ml, mr, out, gain);
             }
         }
-        dma_sample[dma_use] = sample;
+        src = (const uint8_t*)w;
+    }
 
-        dma_channel_wait_for_finish_blocking(i2s_dma_chan);
-        dma_channel_transfer_from_buffer_now(i2s_dma_chan, dma_buff[dma_use], dma_sample[dma_use]);
-        dma_use ^= 1;
+    //Unaligned source or last frame
+    for (; i < frames; i++){
+        int32_t l = i2s_load_sample(src, resolution);
+        int32_t r = i2s_load_sample(src + resolution / 8, resolution);
+        src += resolution / 4;
+        d = i2s_kernel_put(d, l, r, ml, mr, out, gain);
     }
 }
-static Core1MainFunction core1_main_funcion = defalut_core1_main;
 
-void i2s_mclk_set_pin(uint data_pin, uint clock_pin_base, uint mclk_pin){
-    i2s_dout_pin = data_pin;
-    i2s_clk_pin_base = clock_pin_base;
-    i2s_mclk_pin = mclk_pin;
+#define I2S_KERNEL(name, resolution, out, gain) \
+static void __time_critical_func(name)(int32_t* dst, const uint8_t* src, uint32_t frames, int32_t ml, int32_t mr){ \
+    i2s_kernel_body(dst, src, frames, ml, mr, resolution, out, gain); \
 }
 
-//When using low jitter mode, call before uart, i2s, spi configuration
-void i2s_mclk_set_config(PIO pio, uint sm, int dma_ch, bool use_core1, CLOCK_MODE clock_mode, I2S_MODE mode){
-    i2s_pio = pio;
-    i2s_sm = sm;
-    i2s_dma_chan = dma_ch;
-    i2s_use_core1 = use_core1;
-    i2s_clock_mode = clock_mode;
-    i2s_mode = mode;
+I2S_KERNEL(i2s_kernel_lr_16,          16, I2S_OUT_LR,   false)
+I2S_KERNEL(i2s_kernel_lr_24,          24, I2S_OUT_LR,   false)
+I2S_KERNEL(i2s_kernel_lr_32,          32, I2S_OUT_LR,   false)
+I2S_KERNEL(i2s_kernel_exdf_16,        16, I2S_OUT_EXDF, false)
+I2S_KERNEL(i2s_kernel_exdf_24,        24, I2S_OUT_EXDF, false)
+I2S_KERNEL(i2s_kernel_exdf_32,        32, I2S_OUT_EXDF, false)
+I2S_KERNEL(i2s_kernel_dual_16,        16, I2S_OUT_DUAL, false)
+I2S_KERNEL(i2s_kernel_dual_24,        24, I2S_OUT_DUAL, false)
+I2S_KERNEL(i2s_kernel_dual_32,        32, I2S_OUT_DUAL, false)
+I2S_KERNEL(i2s_kernel_dsd_16,         16, I2S_OUT_DSD,  false)
+I2S_KERNEL(i2s_kernel_dsd_24,         24, I2S_OUT_DSD,  false)
+I2S_KERNEL(i2s_kernel_dsd_32,         32, I2S_OUT_DSD,  false)
+I2S_KERNEL(i2s_kernel_packed_16,      16, I2S_OUT_PACKED, false)
+I2S_KERNEL(i2s_kernel_packed_24,      24, I2S_OUT_PACKED, false)
+I2S_KERNEL(i2s_kernel_packed_32,      32, I2S_OUT_PACKED, false)
+I2S_KERNEL(i2s_kernel_spdif_16,       16, I2S_OUT_SPDIF, false)
+I2S_KERNEL(i2s_kernel_spdif_24,       24, I2S_OUT_SPDIF, false)
+I2S_KERNEL(i2s_kernel_spdif_32,       32, I2S_OUT_SPDIF, false)
+I2S_KERNEL(i2s_kernel_lr_16_gain,     16, I2S_OUT_LR,   true)
+I2S_KERNEL(i2s_kernel_lr_24_gain,     24, I2S_OUT_LR,   true)
+I2S_KERNEL(i2s_kernel_lr_32_gain,     32, I2S_OUT_LR,   true)
+I2S_KERNEL(i2s_kernel_exdf_16_gain,   16, I2S_OUT_EXDF, true)
+I2S_KERNEL(i2s_kernel_exdf_24_gain,   24, I2S_OUT_EXDF, true)
+I2S_KERNEL(i2s_kernel_exdf_32_gain,   32, I2S_OUT_EXDF, true)
+I2S_KERNEL(i2s_kernel_dual_16_gain,   16, I2S_OUT_DUAL, true)
+I2S_KERNEL(i2s_kernel_dual_24_gain,   24, I2S_OUT_DUAL, true)
+I2S_KERNEL(i2s_kernel_dual_32_gain,   32, I2S_OUT_DUAL, true)
+I2S_KERNEL(i2s_kernel_packed_16_gain, 16, I2S_OUT_PACKED, true)
+I2S_KERNEL(i2s_kernel_packed_24_gain, 24, I2S_OUT_PACKED, true)
+I2S_KERNEL(i2s_kernel_packed_32_gain, 32, I2S_OUT_PACKED, true)
+I2S_KERNEL(i2s_kernel_spdif_16_gain,  16, I2S_OUT_SPDIF, true)
+I2S_KERNEL(i2s_kernel_spdif_24_gain,  24, I2S_OUT_SPDIF, true)
+I2S_KERNEL(i2s_kernel_spdif_32_gain,  32, I2S_OUT_SPDIF, true)
+
+//[0dB or volume][output layout][resolution 16, 24, 32], a DSD bitstream has no volume
+static const I2SKernel i2s_kernels[2][I2S_OUT_COUNT][3] = {
+    {
+        {i2s_kernel_lr_16,      i2s_kernel_lr_24,       i2s_kernel_lr_32},
+        {i2s_kernel_exdf_16,    i2s_kernel_exdf_24,     i2s_kernel_exdf_32},
+        {i2s_kernel_dual_16,    i2s_kernel_dual_24,     i2s_kernel_dual_32},
+        {i2s_kernel_dsd_16,     i2s_kernel_dsd_24,      i2s_kernel_dsd_32},
+        {i2s_kernel_packed_16,  i2s_kernel_packed_24,   i2s_kernel_packed_32},
+        {i2s_kernel_spdif_16,   i2s_kernel_spdif_24,    i2s_kernel_spdif_32},
+    },
+    {
+        {i2s_kernel_lr_16_gain,     i2s_kernel_lr_24_gain,      i2s_kernel_lr_32_gain},
+        {i2s_kernel_exdf_16_gain,   i2s_kernel_exdf_24_gain,    i2s_kernel_exdf_32_gain},
+        {i2s_kernel_dual_16_gain,   i2s_kernel_dual_24_gain,    i2s_kernel_dual_32_gain},
+        {i2s_kernel_dsd_16,         i2s_kernel_dsd_24,          i2s_kernel_dsd_32},
+        {i2s_kernel_packed_16_gain, i2s_kernel_packed_24_gain,  i2s_kernel_packed_32_gain},
+        {i2s_kernel_spdif_16_gain,  i2s_kernel_spdif_24_gain,   i2s_kernel_spdif_32_gain},
+    },
+};
 
-    //Separate clk_peri from clk_sys in advance
-    if (i2s_clock_mode == CLOCK_MODE_LOW_JITTER_OC){
-        vreg_set_voltage(VREG_VOLTAGE_1_20);
-    }
-    if (i2s_clock_mode != CLOCK_MODE_DEFAULT){
-        clock_configure_undivided(clk_peri, 0, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
-    }
+/**
+ * @brief Select the kernel row for the output layout and volume
+ *
+ * @note Called at configuration time and on volume change
+ */
+static void i2s_select_kernel(i2s_instance_t* inst){
+    bool gain = inst->mul_l != db_to_vol[0] || inst->mul_r != db_to_vol[0];
+
+    inst->kernel = i2s_kernels[gain][inst->out];
 }
 
-void i2s_mclk_init(uint32_t audio_clock){
-    pio_sm_config sm_config, sm_config_mclk;
-    PIO pio = i2s_pio;
-    uint sm = i2s_sm;
-    uint data_pin = i2s_dout_pin;
-    uint clock_pin_base = i2s_clk_pin_base;
-    uint offset, offset_mclk;
+/**
+ * @brief Samples per frame of the packets
+ *
+ * @return uint 2, or the slot count in MODE_TDM
+ */
+static inline uint i2s_channels(const i2s_instance_t* inst){
+    return inst->mode == MODE_TDM ? inst->tdm_slots : 2;
+}
 
-    //Notify playback state via GPIO25
-    if (playback_handler == default_playback_handler){
-        gpio_init(PICO_DEFAULT_LED_PIN);
-        gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
-    }
+/**
+ * @brief Frames go to the FIFO as one word
+ *
+ * @return true i2s_set_packed with 16 bit slots: MODE_PT8211, or master MODE_I2S with 16 bit slots
+ */
+static inline bool i2s_packed(const i2s_instance_t* inst){
+    return inst->use_packed == true &&
+           (inst->mode == MODE_PT8211 || (inst->mode == MODE_I2S && inst->slave == false && inst->slot_bits == 16));
+}
 
-    //data pin
-    pio_gpio_init(pio, data_pin);
-    if (i2s_mode == MODE_EXDF || i2s_mode == MODE_PT8211_DUAL || i2s_mode == MODE_I2S_DUAL){
-        pio_gpio_init(pio, data_pin + 1);
-    }
+/**
+ * @brief Number of slots the producer can still fill
+ *
+ * @note Slots handed to the consumer stay in use until they are released
+ */
+static inline uint32_t i2s_queue_free(i2s_instance_t* inst){
+    uint32_t used = inst->enqueue_count - inst->release_count;
+    __mem_fence_acquire();
+    return inst->buf_depth - used;
+}
 
-    //clock pin
-    pio_gpio_init(pio, clock_pin_base);
-    pio_gpio_init(pio, clock_pin_base + 1);
+/**
+ * @brief Count a packet rejected because the queue is full
+ */
+static inline void i2s_stats_overrun(i2s_instance_t* inst){
+    inst->stats.overruns++;
+    inst->last_overrun_us = time_us_64();
+}
 
-    //mclk pin
-    if (i2s_mode == MODE_EXDF){
-        pio_gpio_init(pio, clock_pin_base + 2);
+/**
+ * @brief Count the queue running dry during playback
+ *
+ * @param inst Instance
+ * @param level Queue level seen by the consumer
+ */
+static inline void __time_critical_func(i2s_stats_underrun)(i2s_instance_t* inst, int8_t level){
+    if (level == 0 && inst->stats_playing == true){
+        inst->stats_playing = false;
+        //The queue is drained on purpose during a rate switch
+        if (inst->switching == false){
+            inst->stats.underruns++;
+            inst->last_underrun_us = time_us_64();
+        }
     }
-    else if(i2s_mode == MODE_I2S || i2s_mode == MODE_I2S_DUAL){
-        pio_gpio_init(pio, i2s_mclk_pin);
+}
 
-        pio_sm_set_consecutive_pindirs(pio, sm + 1, i2s_mclk_pin, 1, true);
-        offset_mclk = pio_add_program(pio, &i2s_mclk_program);
-        sm_config_mclk = i2s_mclk_program_get_default_config(offset_mclk);
-        sm_config_set_set_pins(&sm_config_mclk, i2s_mclk_pin, 1);
-    }
-
-
-    switch (i2s_mode){
-    case MODE_I2S:
-        offset = pio_add_program(pio, &i2s_data_program);
-        sm_config = i2s_data_program_get_default_config(offset);
-        break;
-    case MODE_PT8211:
-        offset = pio_add_program(pio, &i2s_pt8211_program);
-        sm_config = i2s_pt8211_program_get_default_config(offset);
-        break;
-    case MODE_EXDF:
-        offset = pio_add_program(pio, &i2s_exdf_program);
-        sm_config = i2s_exdf_program_get_default_config(offset);
-        break;
-    case MODE_I2S_DUAL:
-        offset = pio_add_program(pio, &i2s_data_dual_program);
-        sm_config = i2s_data_dual_program_get_default_config(offset);
-        break;
-    case MODE_PT8211_DUAL:
-        offset = pio_add_program(pio, &i2s_pt8211_dual_program);
-        sm_config = i2s_pt8211_dual_program_get_default_config(offset);
-        break;
-    default:
-        break;
-    }
-
-    if (i2s_mode == MODE_EXDF || i2s_mode == MODE_PT8211_DUAL || i2s_mode == MODE_I2S_DUAL){
-        sm_config_set_out_pins(&sm_config, data_pin, 2);
+/**
+ * @brief Gather the even bits, inverse of part1by1_32
+ *
+ * @param x Input
+ */
+static inline uint32_t i2s_compact1by1(uint64_t x){
+    x &= 0x5555555555555555ULL;
+    x = (x | (x >> 1))  & 0x3333333333333333ULL;
+    x = (x | (x >> 2))  & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4))  & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8))  & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return (uint32_t)x;
+}
+
+/**
+ * @brief Read the sample back from an S/PDIF subframe
+ *
+ * @param d Subframe (2 words)
+ * @note The mid cell toggles of slots 4-27
+ */
+static inline int32_t i2s_spdif_sample(const int32_t* d){
+    uint64_t cells = (uint64_t)(uint32_t)d[1] << 32 | (uint32_t)d[0];
+
+    return (int32_t)((i2s_compact1by1(cells >> 1) & 0x0FFFFFF0) << 4);
+}
+
+/**
+ * @brief Read one frame back from the i2s buffer word layout
+ *
+ * @param inst Instance
+ * @param d Frame
+ * @param l L channel
+ * @param r R channel
+ */
+static void i2s_load_frame(i2s_instance_t* inst, const int32_t* d, int32_t* l, int32_t* r){
+    uint64_t merged;
+
+    if (inst->out == I2S_OUT_LR){
+        *l = d[0];
+        *r = d[1];
+        return;
     }
-    else{
-        sm_config_set_out_pins(&sm_config, data_pin, 1);
+    if (inst->out == I2S_OUT_PACKED){
+        *l = (int32_t)((uint32_t)d[0] & 0xFFFF0000);
+        *r = (int32_t)((uint32_t)d[0] << 16);
+        return;
     }
-    sm_config_set_sideset_pins(&sm_config, clock_pin_base);
-    sm_config_set_out_shift(&sm_config, false, false, 32);
-    sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_TX);
+    if (inst->out == I2S_OUT_SPDIF){
+        *l = i2s_spdif_sample(d);
+        *r = i2s_spdif_sample(d + 2);
+        return;
+    }
+    //EXDF and the first pair of dual mono
+    merged = (uint64_t)(uint32_t)d[0] << 32 | (uint32_t)d[1];
+    *l = (int32_t)i2s_compact1by1(merged >> 1);
+    *r = (int32_t)i2s_compact1by1(merged);
+}
 
-    queue_spin_lock = spin_lock_init(spin_lock_claim_unused(true));
+/**
+ * @brief Apply a Q16 gain to a sample
+ *
+ * @param x Sample
+ * @param gain 0~65536
+ */
+static inline int32_t i2s_apply_gain(int32_t x, int32_t gain){
+    return (int32_t)(((int64_t)x * gain) >> 16);
+}
 
-    i2s_buf_length = 0;
-    enqueue_pos = 0;
-    dequeue_pos = 0;
+/**
+ * @brief Fade in the first frames after a rate switch
+ *
+ * @param inst Instance
+ * @param d Slot
+ * @param frames Number of frames in the slot
+ */
+static void i2s_ramp_up(i2s_instance_t* inst, int32_t* d, uint32_t frames){
+    uint pairs = i2s_channels(inst) / 2;
+    int32_t l, r, gain;
+
+    for (uint32_t i = 0; i < frames && inst->ramp_pos < inst->ramp_len; i++){
+        gain = (int32_t)(((inst->ramp_pos + 1) << 16) / inst->ramp_len);
+        for (uint p = 0; p < pairs; p++){
+            i2s_load_frame(inst, d, &l, &r);
+            d = i2s_kernel_put(d, i2s_apply_gain(l, gain), i2s_apply_gain(r, gain), 0, 0, inst->out, false);
+        }
+        inst->ramp_pos++;
+    }
+}
 
-    if (i2s_clock_mode == CLOCK_MODE_DEFAULT){
-        float div;
-        div = (float)clock_get_hz(clk_sys) / (float)(audio_clock * 128);
-        sm_config_set_clkdiv(&sm_config, div);
+/**
+ * @brief Add the block start and the channel status to S/PDIF frames
+ *
+ * @param inst Instance
+ * @param d Frames in the I2S_OUT_SPDIF layout
+ * @param frames Number of frames
+ * @note The block runs on across packets, its first frame gets the B preamble. A channel status bit of 1 toggles
+ * the C and parity cells of both subframes, so the parity stays even
+ */
+static void i2s_spdif_stamp(i2s_instance_t* inst, int32_t* d, uint32_t frames){
+    uint32_t pos = inst->spdif_frame;
 
-        //mclk
-        if (i2s_mode == MODE_I2S || i2s_mode == MODE_I2S_DUAL){
-            if (audio_clock % 48000 == 0){
-                div = (float)clock_get_hz(clk_sys) / (49.152f * (float)MHZ);
-                clk_48khz == true;
-            }
-            else{
-                div = (float)clock_get_hz(clk_sys) / (45.1584f * (float)MHZ);
-                clk_48khz == false;
-            }
-            sm_config_set_clkdiv(&sm_config_mclk, div);
+    for (uint32_t i = 0; i < frames; i++, d += 4){
+        if (pos == 0){
+            d[0] ^= I2S_SPDIF_B ^ I2S_SPDIF_M;
         }
-    }
-    else{
-        //Change sys_clk
-        if (audio_clock % 48000 == 0){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    set_sys_clock_147500khz();
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    set_sys_clock_295000khz();
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    set_sys_clock_gpin1();
-                    break;
-            }
-            clk_48khz = true;
+        if ((inst->spdif_status[pos / 32] >> (pos % 32)) & 1){
+            d[1] ^= I2S_SPDIF_C;
+            d[3] ^= I2S_SPDIF_C;
         }
-        else {
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    set_sys_clock_135500khz();
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    set_sys_clock_271000khz();
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    set_sys_clock_gpin0();
-                    break;
-            }
-            clk_48khz = false;
+        if (++pos == I2S_SPDIF_BLOCK){
+            pos = 0;
         }
+    }
+    inst->spdif_frame = pos;
+}
 
-        //mclk output
-        if (i2s_mode == MODE_I2S || i2s_mode == MODE_I2S_DUAL){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    sm_config_set_clkdiv_int_frac8(&sm_config_mclk, 3, 0);
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    sm_config_set_clkdiv_int_frac8(&sm_config_mclk, 6, 0);
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    sm_config_set_clkdiv_int_frac8(&sm_config_mclk, 1, 0);
-                    break;
-            }
-        }
+/**
+ * @brief Publish the slot at enqueue_pos to the consumer
+ */
+static inline void i2s_queue_push(i2s_instance_t* inst){
+    uint32_t frames = inst->sample[inst->enqueue_pos] / inst->frame_len;
 
-        //Change pio frequency
-        uint dev;
-        if (clk_48khz == true){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    dev = 6 * 192000 / audio_clock;
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    dev = 12 * 192000 / audio_clock;
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    dev = 2 * 192000 / audio_clock;
-                    break;
-            }
-        }
-        else {
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    dev = 6 * 176400 / audio_clock;
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    dev = 12 * 176400 / audio_clock;
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    dev = 2 * 176400 / audio_clock;
-                    break;
-            }
-        }
-        sm_config_set_clkdiv_int_frac8(&sm_config, dev, 0);
+    if (inst->ramp_pos < inst->ramp_len){
+        i2s_ramp_up(inst, inst->buf + inst->enqueue_pos * inst->slot_len, frames);
+    }
+    if (inst->out == I2S_OUT_SPDIF){
+        i2s_spdif_stamp(inst, inst->buf + inst->enqueue_pos * inst->slot_len, frames);
     }
 
-    //mclk start
-    if(i2s_mode == MODE_I2S || i2s_mode == MODE_I2S_DUAL){
-        pio_sm_init(pio, sm + 1, offset_mclk, &sm_config_mclk);
-        pio_sm_set_enabled(pio, sm + 1, true);
+    inst->enqueue_pos++;
+    if (inst->enqueue_pos >= inst->buf_depth){
+        inst->enqueue_pos = 0;
     }
+    __mem_fence_release();
+    inst->enqueue_frames = inst->enqueue_frames + frames;
+    inst->enqueue_count = inst->enqueue_count + 1;
+}
 
-    pio_sm_init(pio, sm, offset, &sm_config);
+/**
+ * @brief Take the oldest published slot
+ *
+ * @param inst Instance
+ * @param buff Slot data
+ * @param sample Number of words in the slot
+ * @return true Success
+ * @return false Failed (buffer empty)
+ * @note The slot must be handed back with i2s_queue_release() once it has been read
+ */
+static inline bool __time_critical_func(i2s_queue_pop)(i2s_instance_t* inst, int32_t** buff, uint32_t* sample){
+    if (inst->enqueue_count == inst->dequeue_count){
+        return false;
+    }
+    __mem_fence_acquire();
+
+    *buff = inst->buf + inst->dequeue_pos * inst->slot_len;
+    *sample = inst->sample[inst->dequeue_pos];
+    inst->dequeue_frames = inst->dequeue_frames + *sample / inst->frame_len;
+    inst->dequeue_pos++;
+    if (inst->dequeue_pos >= inst->buf_depth){
+        inst->dequeue_pos = 0;
+    }
 
-    uint pin_mask;
-    if (i2s_mode == MODE_EXDF){
-        pin_mask = (3u << data_pin) | (7u << clock_pin_base);
+    //Level including this packet
+    uint8_t level = (uint8_t)(inst->enqueue_count - inst->dequeue_count);
+    inst->stats.level_hist[level < I2S_STATS_HIST_LEN ? level : I2S_STATS_HIST_LEN - 1]++;
+    if (level < inst->stats.level_min){
+        inst->stats.level_min = level;
     }
-    else if (i2s_mode == MODE_PT8211_DUAL || i2s_mode == MODE_I2S_DUAL){
-        pin_mask = (3u << data_pin) | (3u << clock_pin_base);
+    if (level > inst->stats.level_max){
+        inst->stats.level_max = level;
     }
-    else{
-        pin_mask = (1u << data_pin) | (3u << clock_pin_base);
+    inst->stats.packets++;
+    inst->stats_playing = true;
+    if (inst->first_packet_us == UINT32_MAX){
+        inst->first_packet_us = time_us_32() - inst->init_start_us;
     }
-    pio_sm_set_pindirs_with_mask(pio, sm, pin_mask, pin_mask);
-    pio_sm_exec(pio, sm, pio_encode_jmp(offset));
-    pio_sm_set_pins(pio, sm, 0);
-    pio_sm_clear_fifos(pio, sm);
-    pio_sm_set_enabled(pio, sm, true);
 
+    inst->dequeue_count = inst->dequeue_count + 1;
 
-    //dma init
-    dma_channel_config conf = dma_channel_get_default_config(i2s_dma_chan);
-    
-    channel_config_set_read_increment(&conf, true);
-    channel_config_set_write_increment(&conf, false);
-    channel_config_set_transfer_data_size(&conf, DMA_SIZE_32);
-    channel_config_set_dreq(&conf, pio_get_dreq(pio, sm, true));
-    
-    dma_channel_configure(
-        i2s_dma_chan,
-        &conf,
-        &i2s_pio->txf[i2s_sm],
-        NULL,
-        0,
-        false
-    );
+    return true;
+}
 
-    dma_channel_set_irq0_enabled(i2s_dma_chan, true);
-    if (i2s_use_core1 == false){
-        irq_set_exclusive_handler(DMA_IRQ_0, i2s_handler);
-        irq_set_priority(DMA_IRQ_0, 0);
-        irq_set_enabled(DMA_IRQ_0, true);
-        i2s_handler();
-    }
+/**
+ * @brief Return the oldest popped slot to the producer
+ */
+static inline void __time_critical_func(i2s_queue_release)(i2s_instance_t* inst){
+    __mem_fence_release();
+    inst->release_count = inst->release_count + 1;
+}
 
-    //core1スタート
-    if (i2s_use_core1 == true){
-        multicore_launch_core1(core1_main_funcion);
+/**
+ * @brief Hand every published slot back to the producer unplayed
+ *
+ * @note Consumer side, call with the DMA interrupt masked when not called from it
+ */
+static void __time_critical_func(i2s_queue_drop)(i2s_instance_t* inst){
+    while (inst->enqueue_count != inst->dequeue_count){
+        __mem_fence_acquire();
+        inst->dequeue_frames = inst->dequeue_frames + inst->sample[inst->dequeue_pos] / inst->frame_len;
+        inst->dequeue_pos++;
+        if (inst->dequeue_pos >= inst->buf_depth){
+            inst->dequeue_pos = 0;
+        }
+        inst->dequeue_count = inst->dequeue_count + 1;
+        i2s_queue_release(inst);
     }
 }
 
-void i2s_mclk_change_clock(uint32_t audio_clock){
-    //Change frequency
-    if (i2s_clock_mode == CLOCK_MODE_DEFAULT){
-        float div;
-        div = (float)clock_get_hz(clk_sys) / (float)(audio_clock * 128);
-        pio_sm_set_clkdiv(i2s_pio, i2s_sm, div);
+/**
+ * @brief Record a DMA completion
+ *
+ * @param inst Instance
+ * @param now time_us_32() at the completion
+ * @param frames Frames of the finished transfer
+ * @param pending Frames of the transfer started after it, 0 if unknown
+ */
+static inline void __time_critical_func(i2s_timestamp)(i2s_instance_t* inst, uint32_t now, uint32_t frames, uint32_t pending){
+    inst->ts_seq = inst->ts_seq + 1;
+    __mem_fence_release();
+    inst->ts_frames = inst->ts_frames + frames;
+    inst->ts_time_us = now;
+    inst->ts_pending = pending;
+    __mem_fence_release();
+    inst->ts_seq = inst->ts_seq + 1;
+}
 
-        //mclk
-        if (i2s_mode == MODE_I2S || i2s_mode == MODE_I2S_DUAL){
-            if (audio_clock % 48000 == 0 && clk_48khz == false){
-                div = (float)clock_get_hz(clk_sys) / (49.152f * (float)MHZ);
-                pio_sm_set_clkdiv(i2s_pio, i2s_sm + 1, div);
-                clk_48khz == true;
-            }
-            else if (audio_clock % 48000 == 0 && clk_48khz == true){
-                div = (float)clock_get_hz(clk_sys) / (45.1584f * (float)MHZ);
-                pio_sm_set_clkdiv(i2s_pio, i2s_sm + 1, div);
-                clk_48khz == false;
-            }
-        }
-    }
-    else{
-        //Change sys_clk
-        if (audio_clock % 48000 == 0 && clk_48khz == false){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    set_sys_clock_147500khz();
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    set_sys_clock_295000khz();
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    set_sys_clock_gpin1();
-                    break;
-            }
-            clk_48khz = true;
-        }
-        else if (audio_clock % 48000 != 0 && clk_48khz == true){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    set_sys_clock_135500khz();
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    set_sys_clock_271000khz();
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    set_sys_clock_gpin0();
-                    break;
-            }
-            clk_48khz = false;
-        }
+/**
+ * @brief Start a new timestamp epoch
+ *
+ * @note Called while nothing is output
+ */
+static void i2s_timestamp_restart(i2s_instance_t* inst){
+    inst->ts_epoch_us = time_us_32();
+    __mem_fence_release();
+    inst->ts_epoch = inst->ts_epoch + 1;
+}
 
-        //Change pio frequency
-        uint dev;
-        if (clk_48khz == true){
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    dev = 6 * 192000 / audio_clock;
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    dev = 12 * 192000 / audio_clock;
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    dev = 2 * 192000 / audio_clock;
-                    break;
-            }
-        }
-        else {
-            switch (i2s_clock_mode){
-                case CLOCK_MODE_LOW_JITTER:
-                    dev = 6 * 176400 / audio_clock;
-                    break;
-                case CLOCK_MODE_LOW_JITTER_OC:
-                    dev = 12 * 176400 / audio_clock;
-                    break;
-                case CLOCK_MODE_EXTERNAL:
-                    dev = 2 * 176400 / audio_clock;
-                    break;
-            }
-        }
-        pio_sm_set_clkdiv_int_frac(i2s_pio, i2s_sm, dev, 0);
-    }
+/**
+ * @brief Point a control block at a buffer
+ *
+ * @param inst Instance
+ * @param n Control block
+ * @param buff Buffer
+ * @param sample Number of words
+ * @note Blocks written here are at least one ahead of the one the control channel reads next
+ */
+static inline void __time_critical_func(i2s_chain_set)(i2s_instance_t* inst, uint8_t n, const int32_t* buff, uint32_t sample){
+    inst->chain[n].read_addr = (uintptr_t)buff;
+    inst->chain[n].transfer_count = sample;
 }
 
-//Stack USB received data in i2s buffer
-bool i2s_enqueue(uint8_t* in, int sample, uint8_t resolution){
-    int i, j;
-    static int32_t lch_buf[I2S_DATA_LEN / 2];
-    static int32_t rch_buf[I2S_DATA_LEN / 2];
-
-	if (i2s_get_buf_length() < I2S_BUF_DEPTH){
-        if (resolution == 16){
-            int16_t *d = (int16_t*)in;
-            sample /= 2;
-            for (i = 0; i < sample / 2; i++){
-                lch_buf[i] = *d++ << 16;
-                rch_buf[i] = *d++ << 16;
+/**
+ * @brief Handler for reclaiming finished control blocks
+ *
+ * @param inst Instance
+ * @note Called when use_core1 is false and chained DMA is enabled
+ * @note Output does not depend on this handler, it only has to run before DMA comes around the ring
+ */
+static void __isr __time_critical_func(i2s_chain_handler)(i2s_instance_t* inst){
+    const uint8_t mask = I2S_CHAIN_LEN - 1;
+    uint8_t pos, playing, scheduled;
+    uint32_t frames = 0;
+    bool passed = false;
+    int32_t* buff;
+    uint32_t sample;
+    int8_t buf_length;
+
+    dma_irqn_acknowledge_channel(inst->irq_index, inst->dma_chan);
+
+    //The control channel reads pos next, DMA is sending the block before it
+    pos = ((uintptr_t)dma_hw->ch[inst->ctrl_chan].read_addr - (uintptr_t)inst->chain) / sizeof(I2SDmaBlock) & mask;
+    playing = (pos - 1) & mask;
+
+    //Blocks before that are finished, their slots go back to the producer
+    while (inst->chain_reclaim != playing){
+        if (inst->chain_reclaim == inst->chain_write){
+            passed = true;
+        }
+        frames += inst->chain[inst->chain_reclaim].transfer_count / inst->frame_len;
+        if (inst->chain_packet[inst->chain_reclaim] == true){
+            inst->chain_packet[inst->chain_reclaim] = false;
+            i2s_queue_release(inst);
+        }
+        i2s_chain_set(inst, inst->chain_reclaim, inst->mute_buff, I2S_MUTE_LEN);
+        inst->chain_reclaim = (inst->chain_reclaim + 1) & mask;
+    }
+    if (frames != 0){
+        //Blocks are scheduled ahead, what is pending is not tracked
+        i2s_timestamp(inst, time_us_32(), frames, 0);
+    }
+
+    //Nothing scheduled after the playing block, DMA sends inst->mute at pos
+    if (passed || inst->chain_write == playing || inst->chain_write == pos){
+        inst->chain_write = (pos + 1) & mask;
+        scheduled = 0;
+    }
+    else {
+        scheduled = (inst->chain_write - pos) & mask;
+    }
+
+    //Audio queued while the external clocks were missing is stale
+    if (inst->clock_lost == true){
+        i2s_queue_drop(inst);
+    }
+
+    buf_length = i2s_inst_get_buf_length(inst);
+    i2s_stats_underrun(inst, scheduled);
+    if (scheduled == 0 && buf_length == 0){
+        inst->mute = true;
+        set_playback_state(inst, false);
+    }
+    else if (buf_length >= inst->start_level && inst->mute == true){
+        inst->mute = false;
+        set_playback_state(inst, true);
+    }
+
+    while (inst->mute == false && inst->chain_write != playing && i2s_queue_pop(inst, &buff, &sample) == true){
+        i2s_chain_set(inst, inst->chain_write, buff, sample);
+        inst->chain_packet[inst->chain_write] = true;
+        inst->chain_write = (inst->chain_write + 1) & mask;
+    }
+}
+
+/**
+ * @brief Handler for retrieving data from i2s buffer
+ *
+ * @param inst Instance
+ * @note Called when use_core1 is false
+ */
+static void __isr __time_critical_func(i2s_handler)(i2s_instance_t* inst){
+	int32_t* buff;
+	uint32_t sample;
+	int8_t buf_length;
+
+	uint32_t now = time_us_32();
+	uint32_t finished = inst->ts_dma_frames;
+
+	//The packet that just finished is no longer read by DMA
+	if (inst->dequeue_held == true){
+        i2s_queue_release(inst);
+        inst->dequeue_held = false;
+    }
+
+	//Audio queued while the external clocks were missing is stale
+	if (inst->clock_lost == true){
+        i2s_queue_drop(inst);
+    }
+
+	buf_length = i2s_inst_get_buf_length(inst);
+	i2s_stats_underrun(inst, buf_length);
+	if (buf_length == 0){
+        inst->mute = true;
+        set_playback_state(inst, false);
+    }
+	else if (buf_length >= inst->start_level && inst->mute == true){
+        inst->mute = false;
+        set_playback_state(inst, true);
+    }
+
+	if (inst->mute == false && i2s_queue_pop(inst, &buff, &sample) == true){
+		dma_channel_transfer_from_buffer_now(inst->dma_chan, buff, sample);
+		inst->dequeue_held = true;
+	}
+	else{
+		dma_channel_transfer_from_buffer_now(inst->dma_chan, inst->mute_buff, I2S_MUTE_LEN);
+		sample = I2S_MUTE_LEN;
+	}
+	inst->ts_dma_frames = sample / inst->frame_len;
+	i2s_timestamp(inst, now, finished, inst->ts_dma_frames);
+    
+   	dma_irqn_acknowledge_channel(inst->irq_index, inst->dma_chan);
+}
+
+/**
+ * @brief Capture slot
+ *
+ * @param inst Instance
+ * @param n Slot
+ */
+static inline int32_t* i2s_capture_slot(i2s_instance_t* inst, uint8_t n){
+    return inst->cap_buf + n * inst->cap_frames * 2;
+}
+
+/**
+ * @brief Handler for publishing captured packets
+ *
+ * @param inst Instance
+ * @note The next transfer starts first, the RX FIFO only holds 4 frames.
+ * When every other slot is still queued or held, the packet just captured is dropped and its slot captured again
+ */
+static void __isr __time_critical_func(i2s_capture_handler)(i2s_instance_t* inst){
+    uint8_t next = inst->cap_dma_pos + 1 >= inst->cap_depth ? 0 : inst->cap_dma_pos + 1;
+    bool room;
+
+    dma_irqn_acknowledge_channel(inst->irq_index, inst->cap_chan);
+
+    room = inst->cap_write_count - inst->cap_release_count < (uint32_t)inst->cap_depth - 1;
+    __mem_fence_acquire();
+    if (room == false){
+        next = inst->cap_dma_pos;
+    }
+    dma_channel_transfer_to_buffer_now(inst->cap_chan, i2s_capture_slot(inst, next), inst->cap_frames * 2);
+
+    if (room == true){
+        inst->cap_dma_pos = next;
+        __mem_fence_release();
+        inst->cap_write_count = inst->cap_write_count + 1;
+    }
+    else{
+        inst->stats.capture_overruns++;
+    }
+}
+
+/**
+ * @brief Main function for core1
+ *
+ * @note Called when use_core1 is true, serves i2s_core1_inst
+ */
+static void defalut_core1_main(void){
+    i2s_instance_t* inst = i2s_core1_inst;
+    int32_t* buff;
+    int dma_sample[2], sample;
+    uint32_t dma_frames[2] = {0, 0};
+    bool mute = false;
+    int32_t mute_buff[I2S_MUTE_LEN];
+    uint32_t mute_len = sizeof(mute_buff) / sizeof(int32_t);
+    int8_t buf_length;
+    uint8_t dma_use = 0;
+
+    memcpy(mute_buff, inst->mute_buff, sizeof(mute_buff));
+
+    //Must fit in the DMA buffers carved for the packet capacity, in whole frames
+    if (mute_len > inst->buf_frames * inst->frame_len){
+        mute_len = inst->buf_frames * inst->frame_len;
+    }
+
+    while (1){
+        buf_length = i2s_inst_get_buf_length(inst);
+        i2s_stats_underrun(inst, buf_length);
+
+        if (buf_length == 0){
+            mute = true;
+            set_playback_state(inst, false);
+            //Nothing is held while muted, i2s_inst_mclk_change_clock waits for every slot
+            if (inst->dequeue_held == true){
+                i2s_queue_release(inst);
+                inst->dequeue_held = false;
+            }
+        }
+        else if (buf_length >= inst->start_level && mute == true){
+            mute = false;
+            set_playback_state(inst, true);
+        }
+
+        if (mute == true){
+            buff = mute_buff;
+            sample = mute_len;
+        }
+        else if (i2s_inst_dequeue(inst, &buff, &sample) == false){
+            buff = mute_buff;
+            sample = mute_len;
+        }
+        
+        dma_frames[dma_use] = sample / inst->frame_len;
+
+        //Store in i2s buffer, volume is already applied
+        if (inst->mode == MODE_EXDF){
+            i2s_kernels[0][I2S_OUT_EXDF][2](inst->dma_buff[dma_use], (const uint8_t*)buff, sample / 2, 0, 0);
+        }
+        else if (inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL){
+            i2s_kernels[0][I2S_OUT_DUAL][2](inst->dma_buff[dma_use], (const uint8_t*)buff, sample / 2, 0, 0);
+            sample *= 2;
+        }
+        else {
+            for (int i = 0; i < sample; i++){
+                inst->dma_buff[dma_use][i] = buff[i];
+            }
+        }
+        dma_sample[dma_use] = sample;
+
+        //Copied out, the producer may reuse the slot now
+        if (inst->dequeue_held == true){
+            i2s_queue_release(inst);
+            inst->dequeue_held = false;
+        }
+
+        dma_channel_wait_for_finish_blocking(inst->dma_chan);
+        i2s_timestamp(inst, time_us_32(), dma_frames[dma_use ^ 1], dma_frames[dma_use]);
+        dma_channel_transfer_from_buffer_now(inst->dma_chan, inst->dma_buff[dma_use], dma_sample[dma_use]);
+        dma_use ^= 1;
+    }
+}
+
+//Pool of instances, the first one is what the functions without an instance use
+#define I2S_INSTANCE_DEFAULTS {                 \
+    .use_chain = false,                         \
+    .ctrl_chan = -1,                            \
+    .reload_chan = -1,                          \
+    .dout_pin = 18,                             \
+    .clk_pin_base = 20,                         \
+    .mclk_pin = 22,                             \
+    .pio = pio0,                                \
+    .sm = 0,                                    \
+    .dma_chan = 0,                              \
+    .use_core1 = false,                         \
+    .clock_mode = CLOCK_MODE_DEFAULT,           \
+    .mode = MODE_I2S,                           \
+    .tdm_slots = 8,                             \
+    .tdm_slot_bits = 32,                        \
+    .format = I2S_FORMAT_I2S,                   \
+    .slot_bits = 32,                            \
+    .sample_bits = 32,                          \
+    .use_gpout = false,                         \
+    .gpout = -1,                                \
+    .running = false,                           \
+    .first_packet_us = UINT32_MAX,              \
+    .slave = false,                             \
+    .cap_chan = -1,                             \
+    .buf_frames = I2S_DATA_FRAMES,              \
+    .buf_depth = I2S_BUF_DEPTH,                 \
+    .start_level = I2S_START_LEVEL,             \
+    .out = I2S_OUT_LR,                          \
+    .mute_buff = i2s_mute_buff,                 \
+    .playback_handler = default_playback_handler,   \
+    .core1_main_funcion = defalut_core1_main,   \
+}
+
+static i2s_instance_t i2s_instances[I2S_MAX_INSTANCES] = {
+    [0 ... I2S_MAX_INSTANCES - 1] = I2S_INSTANCE_DEFAULTS
+};
+static i2s_instance_t* const i2s_default = &i2s_instances[0];
+
+//The DMA interrupt of an instance enters through its own handler, capture completes on the same interrupt
+#define I2S_IRQ_HANDLERS(n) \
+static void __isr __time_critical_func(i2s_handler_##n)(void){ \
+    i2s_instance_t* inst = &i2s_instances[n]; \
+    if (inst->cap_active == true && dma_irqn_get_channel_status(n, inst->cap_chan) == true){ \
+        i2s_capture_handler(inst); \
+    } \
+    if (dma_irqn_get_channel_status(n, inst->dma_chan) == true){ \
+        i2s_handler(inst); \
+    } \
+} \
+static void __isr __time_critical_func(i2s_chain_handler_##n)(void){ \
+    i2s_instance_t* inst = &i2s_instances[n]; \
+    if (inst->cap_active == true && dma_irqn_get_channel_status(n, inst->cap_chan) == true){ \
+        i2s_capture_handler(inst); \
+    } \
+    if (dma_irqn_get_channel_status(n, inst->dma_chan) == true){ \
+        i2s_chain_handler(inst); \
+    } \
+}
+
+I2S_IRQ_HANDLERS(0)
+I2S_IRQ_HANDLERS(1)
+
+static const irq_handler_t i2s_handlers[I2S_MAX_INSTANCES] = {i2s_handler_0, i2s_handler_1};
+static const irq_handler_t i2s_chain_handlers[I2S_MAX_INSTANCES] = {i2s_chain_handler_0, i2s_chain_handler_1};
+
+/**
+ * @brief Lay out the i2s buffers for the current configuration
+ *
+ * @param inst Instance
+ * @param mem Memory region to carve, NULL to only compute the size
+ * @param frames Packet capacity in frames
+ * @param depth Queue depth in packets
+ * @return size_t Number of bytes used
+ * @note Dual modes and MODE_SPDIF store twice the words per frame, MODE_TDM a word per slot, packed frames one word,
+ * core1 needs two DMA buffers
+ */
+static size_t i2s_buffer_layout(i2s_instance_t* inst, uint8_t* mem, uint32_t frames, uint8_t depth){
+    uint32_t slot_len = frames * i2s_channels(inst);
+    uint32_t dma_len = frames * i2s_channels(inst);
+    size_t size = 0;
+
+    if (i2s_packed(inst)){
+        slot_len = frames;
+        dma_len = frames;
+    }
+    else if (inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL){
+        dma_len *= 2;
+        //Rearranged on core1 when use_core1 is true
+        if (inst->use_core1 == false){
+            slot_len *= 2;
+        }
+    }
+    else if (inst->mode == MODE_SPDIF){
+        //Two words per subframe, encoded on enqueue
+        slot_len *= 2;
+        dma_len *= 2;
+    }
+
+    //queue
+    if (mem != NULL){
+        inst->buf = (int32_t*)(mem + size);
+        inst->slot_len = slot_len;
+        inst->frame_len = slot_len / frames;
+    }
+    size += depth * slot_len * sizeof(int32_t);
+
+    if (mem != NULL){
+        inst->sample = (uint32_t*)(mem + size);
+    }
+    size += depth * sizeof(uint32_t);
+
+    //core1 dma buffers
+    if (inst->use_core1 == true && inst->core1_main_funcion == defalut_core1_main){
+        if (mem != NULL){
+            inst->dma_buff[0] = (int32_t*)(mem + size);
+            inst->dma_buff[1] = inst->dma_buff[0] + dma_len;
+        }
+        size += 2 * dma_len * sizeof(int32_t);
+    }
+
+    return size;
+}
+
+/**
+ * @brief Start the control channel from block 0 of a ring of mute blocks
+ *
+ * @note Packets still in the ring go back to the producer. The control, reload and data channels must be idle
+ */
+static void i2s_chain_start(i2s_instance_t* inst){
+    //From the oldest block, so slots are released in the order they were popped
+    for (int i = 0; i < I2S_CHAIN_LEN; i++){
+        uint8_t n = (inst->chain_reclaim + i) & (I2S_CHAIN_LEN - 1);
+        if (inst->chain_packet[n] == true){
+            inst->chain_packet[n] = false;
+            i2s_queue_release(inst);
+        }
+        i2s_chain_set(inst, n, inst->mute_buff, I2S_MUTE_LEN);
+    }
+    inst->chain_reclaim = 0;
+    inst->chain_write = 0;
+
+    dma_channel_set_write_addr(inst->ctrl_chan, (void*)inst->chain_target, false);
+    dma_channel_set_trans_count(inst->ctrl_chan, 2, false);
+    dma_channel_set_read_addr(inst->ctrl_chan, inst->chain, true);
+}
+
+/**
+ * @brief Start the data channel from the control block ring
+ *
+ * @param inst Instance
+ * @param data_conf Data channel configuration
+ * @note The reclaim handler runs at a lower priority than i2s_handler, output does not wait for it
+ */
+static void i2s_chain_init(i2s_instance_t* inst, dma_channel_config* data_conf){
+    dma_channel_config conf;
+
+    //The data channel is normally claimed by the caller, make sure it is not handed out again
+    if (dma_channel_is_claimed(inst->dma_chan) == false){
+        dma_channel_claim(inst->dma_chan);
+        inst->dma_claimed = true;
+    }
+    if (inst->ctrl_chan < 0){
+        inst->ctrl_chan = dma_claim_unused_channel(true);
+    }
+    if (inst->reload_chan < 0){
+        inst->reload_chan = dma_claim_unused_channel(true);
+    }
+
+    for (int i = 0; i < I2S_CHAIN_LEN; i++){
+        inst->chain_packet[i] = false;
+    }
+    inst->chain_reclaim = 0;
+    inst->chain_target = (uintptr_t)&dma_hw->ch[inst->dma_chan].al3_transfer_count;
+
+    //control: 2 words from the ring to al3_transfer_count, al3_read_addr_trig of the data channel
+    conf = dma_channel_get_default_config(inst->ctrl_chan);
+    channel_config_set_transfer_data_size(&conf, DMA_SIZE_32);
+    channel_config_set_read_increment(&conf, true);
+    channel_config_set_write_increment(&conf, true);
+    channel_config_set_ring(&conf, false, __builtin_ctz(sizeof(inst->chain)));
+    dma_channel_configure(inst->ctrl_chan, &conf, (void*)inst->chain_target, inst->chain, 2, false);
+
+    //reload: rewind the control channel write address, which also triggers it
+    conf = dma_channel_get_default_config(inst->reload_chan);
+    channel_config_set_transfer_data_size(&conf, DMA_SIZE_32);
+    channel_config_set_read_increment(&conf, false);
+    channel_config_set_write_increment(&conf, false);
+    dma_channel_configure(inst->reload_chan, &conf, &dma_hw->ch[inst->ctrl_chan].al2_write_addr_trig, &inst->chain_target, 1, false);
+
+    //data: chain to reload after every block
+    channel_config_set_chain_to(data_conf, inst->reload_chan);
+    dma_channel_set_config(inst->dma_chan, data_conf, false);
+
+    inst->irq_handler = i2s_chain_handlers[inst->irq_index];
+    irq_set_exclusive_handler(DMA_IRQ_0 + inst->irq_index, inst->irq_handler);
+    irq_set_priority(DMA_IRQ_0 + inst->irq_index, PICO_DEFAULT_IRQ_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0 + inst->irq_index, true);
+
+    i2s_chain_start(inst);
+}
+
+/**
+ * @brief Start capture from the next whole frame
+ *
+ * @param inst Instance
+ * @note Call with the DMA interrupt masked. A packet partly captured is started over in the same slot
+ */
+static void i2s_capture_restart(i2s_instance_t* inst){
+    pio_sm_set_enabled(inst->pio, inst->cap_sm, false);
+    dma_channel_abort(inst->cap_chan);
+    dma_irqn_acknowledge_channel(inst->irq_index, inst->cap_chan);
+
+    pio_sm_clear_fifos(inst->pio, inst->cap_sm);
+    pio_sm_restart(inst->pio, inst->cap_sm);
+    pio_sm_exec(inst->pio, inst->cap_sm, pio_encode_jmp(inst->cap_offset));
+
+    dma_channel_transfer_to_buffer_now(inst->cap_chan, i2s_capture_slot(inst, inst->cap_dma_pos), inst->cap_frames * 2);
+    pio_sm_set_enabled(inst->pio, inst->cap_sm, true);
+}
+
+/**
+ * @brief Restart output after the external clocks stopped
+ *
+ * @note The state machine waits at its entry for the next whole frame and DMA starts over with mute,
+ * so whatever was cut off when the clocks stopped is not played
+ */
+static void i2s_slave_resync(i2s_instance_t* inst){
+    irq_set_enabled(DMA_IRQ_0 + inst->irq_index, false);
+    pio_sm_set_enabled(inst->pio, inst->sm, false);
+    if (inst->use_chain == true){
+        dma_channel_abort(inst->ctrl_chan);
+        dma_channel_abort(inst->reload_chan);
+    }
+    dma_channel_abort(inst->dma_chan);
+    //Abort can raise the completion interrupt
+    dma_irqn_acknowledge_channel(inst->irq_index, inst->dma_chan);
+
+    pio_sm_clear_fifos(inst->pio, inst->sm);
+    pio_sm_restart(inst->pio, inst->sm);
+    pio_sm_exec(inst->pio, inst->sm, pio_encode_jmp(inst->offset));
+    pio_sm_set_pins(inst->pio, inst->sm, 0);
+    if (inst->cap_active == true){
+        i2s_capture_restart(inst);
+    }
+
+    //Nothing from the old epoch is finished, and the queue running dry here is not an underrun
+    inst->stats_playing = false;
+    inst->ts_dma_frames = 0;
+    i2s_timestamp_restart(inst);
+    if (inst->use_chain == true){
+        i2s_chain_start(inst);
+    }
+    else{
+        i2s_handler(inst);
+    }
+
+    pio_sm_set_enabled(inst->pio, inst->sm, true);
+    irq_set_enabled(DMA_IRQ_0 + inst->irq_index, true);
+}
+
+/**
+ * @brief Clock loss detector of slave mode
+ *
+ * @note Runs every I2S_SLAVE_CHECK_US for the instance in user_data, DMA not moving for longer than a transfer means the clocks stopped
+ */
+static bool i2s_clock_check(repeating_timer_t* rt){
+    i2s_instance_t* inst = (i2s_instance_t*)rt->user_data;
+    uint32_t now = time_us_32();
+    uint32_t seq = inst->ts_seq;
+    uint32_t frames = I2S_MUTE_LEN / inst->frame_len;
+    uint32_t timeout;
+
+    if (seq != inst->clock_seen_seq || inst->switching == true){
+        inst->clock_seen_seq = seq;
+        inst->clock_seen_us = now;
+        inst->clock_lost = false;
+        return true;
+    }
+    if (inst->clock_lost == true){
+        return true;
+    }
+
+    if (inst->buf_frames > frames){
+        frames = inst->buf_frames;
+    }
+    timeout = (uint32_t)((uint64_t)frames * 1000000 / inst->audio_clock) + I2S_SLAVE_TIMEOUT_US;
+    if (now - inst->clock_seen_us > timeout){
+        inst->clock_lost = true;
+        inst->stats.clock_losses++;
+        inst->last_clock_loss_us = time_us_64();
+        set_playback_state(inst, false);
+        i2s_slave_resync(inst);
+        //Starting the mute transfer is not the clocks coming back
+        inst->clock_seen_seq = inst->ts_seq;
+    }
+    return true;
+}
+
+/**
+ * @brief GPOUT clock generator of a pin
+ *
+ * @param pin GPIO
+ * @return int clk_gpout0-3, -1 if the pin has none
+ */
+static int i2s_gpout_index(uint pin){
+    switch (pin){
+    case 21: return clk_gpout0;
+    case 23: return clk_gpout1;
+    case 24: return clk_gpout2;
+    case 25: return clk_gpout3;
+    default: return -1;
+    }
+}
+
+/**
+ * @brief Set the MCLK GPOUT divider
+ *
+ * @param inst Instance
+ * @param div8 clk_sys / MCLK in 1/256 steps
+ * @note Call while the generator is stopped. Integer dividers get duty cycle correction so odd ones stay at 50%
+ */
+static void i2s_gpout_set_div(i2s_instance_t* inst, uint32_t div8){
+    clocks_hw->clk[inst->gpout].div = div8;
+    if ((div8 & 0xff) == 0){
+        hw_set_bits(&clocks_hw->clk[inst->gpout].ctrl, CLOCKS_CLK_GPOUT0_CTRL_DC50_BITS);
+    }
+    else{
+        hw_clear_bits(&clocks_hw->clk[inst->gpout].ctrl, CLOCKS_CLK_GPOUT0_CTRL_DC50_BITS);
+    }
+}
+
+/**
+ * @brief Start or stop the MCLK GPOUT generator
+ *
+ * @param inst Instance
+ * @param enable true: start from the beginning of its period false: stop low
+ */
+static inline void i2s_gpout_enable(i2s_instance_t* inst, bool enable){
+    if (enable == true){
+        hw_set_bits(&clocks_hw->clk[inst->gpout].ctrl, CLOCKS_CLK_GPOUT0_CTRL_ENABLE_BITS);
+    }
+    else{
+        hw_clear_bits(&clocks_hw->clk[inst->gpout].ctrl, CLOCKS_CLK_GPOUT0_CTRL_ENABLE_BITS);
+    }
+}
+
+/**
+ * @brief Load a program unless it is already loaded
+ *
+ * @param p Program slot
+ * @param pio PIO to load into
+ * @param program Program
+ * @return uint Offset of the program
+ * @note A different program in the slot is removed first
+ */
+static uint i2s_program_load(I2SProgram* p, PIO pio, const pio_program_t* program){
+    if (p->program == program && p->pio == pio){
+        return p->offset;
+    }
+    if (p->program != NULL){
+        pio_remove_program(p->pio, p->program, p->offset);
+    }
+    p->offset = pio_add_program(pio, program);
+    p->pio = pio;
+    p->program = program;
+    return p->offset;
+}
+
+static void i2s_program_unload(I2SProgram* p){
+    if (p->program != NULL){
+        pio_remove_program(p->pio, p->program, p->offset);
+        p->program = NULL;
+    }
+}
+
+/**
+ * @brief Patch i2s_tdm for the slot count and width
+ *
+ * @param inst Instance
+ * @return const pio_program_t* Program to load
+ * @note set y takes slots - 2 and set x slot bits - 3. A loaded copy with other counts is removed first
+ */
+static const pio_program_t* i2s_tdm_program_build(i2s_instance_t* inst){
+    uint16_t instr[sizeof(inst->tdm_instructions) / sizeof(uint16_t)];
+
+    for (uint i = 0; i < sizeof(instr) / sizeof(uint16_t); i++){
+        instr[i] = i2s_tdm_program_instructions[i];
+        if ((instr[i] & 0xe0e0) == pio_encode_set(pio_y, 0)){
+            instr[i] = (instr[i] & ~0x1f) | (inst->tdm_slots - 2);
+        }
+        else if ((instr[i] & 0xe0e0) == pio_encode_set(pio_x, 0)){
+            instr[i] = (instr[i] & ~0x1f) | (inst->tdm_slot_bits - 3);
+        }
+    }
+
+    if (memcmp(instr, inst->tdm_instructions, sizeof(instr)) != 0){
+        if (inst->program_data.program == &inst->tdm_program){
+            i2s_program_unload(&inst->program_data);
+        }
+        memcpy(inst->tdm_instructions, instr, sizeof(instr));
+    }
+    inst->tdm_program = i2s_tdm_program;
+    inst->tdm_program.instructions = inst->tdm_instructions;
+    return &inst->tdm_program;
+}
+
+/**
+ * @brief MODE_I2S runs the default i2s framing
+ *
+ * @param inst Instance
+ * @return true i2s with 32 bit slots, the slave and capture programs expect it
+ */
+static inline bool i2s_format_default(const i2s_instance_t* inst){
+    return inst->format == I2S_FORMAT_I2S && inst->slot_bits == 32;
+}
+
+/**
+ * @brief Program of the MODE_I2S format or MODE_PT8211 before patching
+ *
+ * @param inst Instance
+ * @return const pio_program_t* i2s_data, i2s_lj, i2s_rj or i2s_pt8211
+ * @note I2S_FORMAT_RJ without padding is left justified
+ */
+static const pio_program_t* i2s_format_program_base(const i2s_instance_t* inst){
+    if (inst->mode == MODE_PT8211){
+        return &i2s_pt8211_program;
+    }
+    else if (inst->format == I2S_FORMAT_I2S){
+        return &i2s_data_program;
+    }
+    else if (inst->format == I2S_FORMAT_LJ || inst->sample_bits == inst->slot_bits){
+        return &i2s_lj_program;
+    }
+    return &i2s_rj_program;
+}
+
+/**
+ * @brief Patch the MODE_I2S or MODE_PT8211 program for the slot and sample width and for packed frames
+ *
+ * @param inst Instance
+ * @return const pio_program_t* Program to load
+ * @note set x takes data bits - 3 and set y (i2s_rj only) pad bits - 2. Packed frames keep the first pull,
+ * the R channel pull becomes a nop with the same side-set and delay. A loaded copy of another format is removed first
+ */
+static const pio_program_t* i2s_format_program_build(i2s_instance_t* inst){
+    const pio_program_t* base = i2s_format_program_base(inst);
+    uint16_t instr[sizeof(inst->format_instructions) / sizeof(uint16_t)] = {0};
+    uint data_bits = base == &i2s_rj_program ? inst->sample_bits : base == &i2s_pt8211_program ? 16 : inst->slot_bits;
+    bool pulled = false;
+
+    for (uint i = 0; i < base->length; i++){
+        instr[i] = base->instructions[i];
+        if ((instr[i] & 0xe0e0) == pio_encode_set(pio_y, 0)){
+            instr[i] = (instr[i] & ~0x1f) | (inst->slot_bits - inst->sample_bits - 2);
+        }
+        else if ((instr[i] & 0xe0e0) == pio_encode_set(pio_x, 0)){
+            instr[i] = (instr[i] & ~0x1f) | (data_bits - 3);
+        }
+        else if ((instr[i] & 0xe0ff) == pio_encode_pull(false, true)){
+            if (pulled == true && i2s_packed(inst)){
+                instr[i] = (instr[i] & 0x1f00) | pio_encode_nop();
+            }
+            pulled = true;
+        }
+    }
+
+    if (inst->format_program.length != base->length || memcmp(instr, inst->format_instructions, sizeof(instr)) != 0){
+        if (inst->program_data.program == &inst->format_program){
+            i2s_program_unload(&inst->program_data);
+        }
+        memcpy(inst->format_instructions, instr, sizeof(instr));
+    }
+    inst->format_program = *base;
+    inst->format_program.instructions = inst->format_instructions;
+    return &inst->format_program;
+}
+
+/**
+ * @brief Patch i2s_capture for the clock pins
+ *
+ * @param inst Instance
+ * @return const pio_program_t* Program to load
+ * @note wait gpio 0 becomes LRCLK and wait gpio 1 BCLK. A loaded copy for other pins is removed first
+ */
+static const pio_program_t* i2s_capture_program_build(i2s_instance_t* inst){
+    uint16_t instr[sizeof(inst->capture_instructions) / sizeof(uint16_t)];
+
+    for (uint i = 0; i < sizeof(instr) / sizeof(uint16_t); i++){
+        instr[i] = i2s_capture_program_instructions[i];
+        if ((instr[i] & 0xe060) == pio_encode_wait_gpio(false, 0)){
+            instr[i] = (instr[i] & ~0x1f) | (inst->clk_pin_base + (instr[i] & 0x1f));
+        }
+    }
+
+    if (memcmp(instr, inst->capture_instructions, sizeof(instr)) != 0){
+        i2s_program_unload(&inst->program_capture);
+        memcpy(inst->capture_instructions, instr, sizeof(instr));
+    }
+    inst->capture_program = i2s_capture_program;
+    inst->capture_program.instructions = inst->capture_instructions;
+    return &inst->capture_program;
+}
+
+/**
+ * @brief Remove the capture program and return its pin to the reset state
+ *
+ * @param inst Instance
+ * @note Capture must be stopped
+ */
+static void i2s_capture_unload(i2s_instance_t* inst){
+    if (inst->program_capture.program != NULL){
+        gpio_set_function(inst->cap_pin, GPIO_FUNC_NULL);
+        i2s_program_unload(&inst->program_capture);
+    }
+}
+
+/**
+ * @brief Set up the capture state machine and DMA
+ *
+ * @param inst Instance
+ * @note Called by i2s_mclk_init before the data state machine starts, capture begins with the first whole frame it sends.
+ * The queue starts empty
+ */
+static void i2s_capture_init(i2s_instance_t* inst){
+    PIO pio = inst->pio;
+    uint sm = inst->cap_sm;
+    pio_sm_config sm_config;
+    dma_channel_config conf;
+
+    //BCLK64fs i2s framing, the interrupt restarts DMA
+    hard_assert((inst->mode == MODE_I2S || inst->mode == MODE_I2S_DUAL) && inst->use_core1 == false);
+    hard_assert(i2s_format_default(inst));
+    hard_assert(inst->cap_buf != NULL && sm != inst->sm && (inst->mclk_sm == false || sm != inst->sm + 1));
+
+    inst->cap_offset = i2s_program_load(&inst->program_capture, pio, i2s_capture_program_build(inst));
+    pio_gpio_init(pio, inst->cap_pin);
+    pio_sm_set_consecutive_pindirs(pio, sm, inst->cap_pin, 1, false);
+
+    sm_config = i2s_capture_program_get_default_config(inst->cap_offset);
+    sm_config_set_in_pins(&sm_config, inst->cap_pin);
+    sm_config_set_in_shift(&sm_config, false, true, 32);
+    sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_RX);
+    //Polls the clock pins every clk_sys cycle
+    sm_config_set_clkdiv_int_frac8(&sm_config, 1, 0);
+    pio_sm_init(pio, sm, inst->cap_offset, &sm_config);
+
+    inst->cap_write_count = 0;
+    inst->cap_read_count = 0;
+    inst->cap_release_count = 0;
+    inst->cap_dma_pos = 0;
+    inst->cap_read_pos = 0;
+    inst->cap_held = false;
+
+    conf = dma_channel_get_default_config(inst->cap_chan);
+    channel_config_set_read_increment(&conf, false);
+    channel_config_set_write_increment(&conf, true);
+    channel_config_set_transfer_data_size(&conf, DMA_SIZE_32);
+    channel_config_set_dreq(&conf, pio_get_dreq(pio, sm, false));
+    dma_channel_configure(inst->cap_chan, &conf, inst->cap_buf, &pio->rxf[sm], 0, false);
+    dma_irqn_set_channel_enabled(inst->irq_index, inst->cap_chan, true);
+
+    inst->cap_active = true;
+    i2s_capture_restart(inst);
+}
+
+/**
+ * @brief GPIOs the mode drives or reads
+ *
+ * @param inst Instance
+ * @param mclk Include mclk_pin
+ * @param mask Set to one bit per GPIO, 0 when a pin is past the last GPIO
+ * @return false A pin is past the last GPIO or used twice
+ */
+static bool i2s_pin_mask(const i2s_instance_t* inst, bool mclk, uint64_t* mask){
+    uint data_pins = 1, clock_pins = 2;
+    uint64_t data, clock;
+
+    //EXDF outputs a third clock, S/PDIF carries its clock in the data
+    if (inst->mode == MODE_EXDF){
+        data_pins = 2;
+        clock_pins = 3;
+    }
+    else if (inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_DSD){
+        data_pins = 2;
+    }
+    else if (inst->mode == MODE_SPDIF){
+        clock_pins = 0;
+    }
+
+    *mask = 0;
+    if (inst->dout_pin > NUM_BANK0_GPIOS - data_pins || (clock_pins > 0 && inst->clk_pin_base > NUM_BANK0_GPIOS - clock_pins) ||
+        (mclk == true && inst->mclk_pin >= NUM_BANK0_GPIOS)){
+        return false;
+    }
+    data = ((1ull << data_pins) - 1) << inst->dout_pin;
+    clock = clock_pins > 0 ? ((1ull << clock_pins) - 1) << inst->clk_pin_base : 0;
+    *mask = data | clock;
+    if (mclk == true){
+        if (*mask & (1ull << inst->mclk_pin)){
+            return false;
+        }
+        *mask |= 1ull << inst->mclk_pin;
+    }
+    return (data & clock) == 0;
+}
+
+/**
+ * @brief Stop output and give up the DMA interrupt
+ *
+ * @param inst Instance
+ * @note Programs, DMA channels and pins stay claimed for the next i2s_mclk_init
+ */
+static void i2s_stop(i2s_instance_t* inst){
+    uint32_t mask = 1u << inst->sm;
+
+    if (inst->clock_timer_active == true){
+        cancel_repeating_timer(&inst->clock_timer);
+        inst->clock_timer_active = false;
+    }
+    if (inst->use_core1 == true){
+        multicore_reset_core1();
+        i2s_core1_inst = NULL;
+    }
+    if (inst->irq_handler != NULL){
+        irq_set_enabled(DMA_IRQ_0 + inst->irq_index, false);
+        irq_remove_handler(DMA_IRQ_0 + inst->irq_index, inst->irq_handler);
+        inst->irq_handler = NULL;
+    }
+
+    if (inst->mclk_sm == true){
+        mask |= 1u << (inst->sm + 1);
+    }
+    if (inst->cap_active == true){
+        mask |= 1u << inst->cap_sm;
+    }
+    pio_set_sm_mask_enabled(inst->pio, mask, false);
+    if (inst->gpout >= 0){
+        i2s_gpout_enable(inst, false);
+    }
+
+    //Control channels first, so nothing triggers the data channel again
+    if (inst->ctrl_chan >= 0){
+        dma_channel_abort(inst->ctrl_chan);
+    }
+    if (inst->reload_chan >= 0){
+        dma_channel_abort(inst->reload_chan);
+    }
+    dma_irqn_set_channel_enabled(inst->irq_index, inst->dma_chan, false);
+    dma_channel_abort(inst->dma_chan);
+    dma_irqn_acknowledge_channel(inst->irq_index, inst->dma_chan);
+    pio_sm_clear_fifos(inst->pio, inst->sm);
+    if (inst->cap_active == true){
+        dma_irqn_set_channel_enabled(inst->irq_index, inst->cap_chan, false);
+        dma_channel_abort(inst->cap_chan);
+        dma_irqn_acknowledge_channel(inst->irq_index, inst->cap_chan);
+        pio_sm_clear_fifos(inst->pio, inst->cap_sm);
+        inst->cap_active = false;
+    }
+    inst->running = false;
+}
+
+void i2s_inst_deinit(i2s_instance_t* inst){
+    uint64_t pin_mask;
+
+    if (inst->running == true){
+        i2s_stop(inst);
+    }
+    i2s_program_unload(&inst->program_data);
+    i2s_program_unload(&inst->program_mclk);
+    i2s_capture_unload(inst);
+
+    if (inst->ctrl_chan >= 0){
+        dma_channel_unclaim(inst->ctrl_chan);
+        inst->ctrl_chan = -1;
+    }
+    if (inst->reload_chan >= 0){
+        dma_channel_unclaim(inst->reload_chan);
+        inst->reload_chan = -1;
+    }
+    if (inst->dma_claimed == true){
+        dma_channel_unclaim(inst->dma_chan);
+        inst->dma_claimed = false;
+    }
+
+    //Pins go back to the reset state
+    i2s_pin_mask(inst, inst->mclk_sm == true || inst->gpout >= 0, &pin_mask);
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++){
+        if (pin_mask & (1ull << pin)){
+            gpio_set_function(pin, GPIO_FUNC_NULL);
+        }
+    }
+    if (inst->gpout >= 0){
+        clocks_hw->clk[inst->gpout].ctrl = 0;
+        inst->gpout = -1;
+    }
+    hw_clear_bits(&inst->pio->input_sync_bypass, 3u << inst->clk_pin_base);
+    inst->mclk_sm = false;
+}
+
+void i2s_inst_mclk_set_pin(i2s_instance_t* inst, uint data_pin, uint clock_pin_base, uint mclk_pin){
+    //The old pins go back to their reset function
+    if (inst->running == true){
+        i2s_inst_deinit(inst);
+    }
+    inst->dout_pin = data_pin;
+    inst->clk_pin_base = clock_pin_base;
+    inst->mclk_pin = mclk_pin;
+}
+
+//When using low jitter mode, call before uart, i2s, spi configuration
+void i2s_inst_mclk_set_config(i2s_instance_t* inst, PIO pio, uint sm, int dma_ch, bool use_core1, CLOCK_MODE clock_mode, I2S_MODE mode){
+    //Output runs on the old settings until here
+    if (inst->running == true){
+        i2s_stop(inst);
+    }
+    inst->pio = pio;
+    inst->sm = sm;
+    inst->dma_chan = dma_ch;
+    inst->use_core1 = use_core1;
+    inst->clock_mode = clock_mode;
+    inst->mode = mode;
+
+    //Separate clk_peri from clk_sys in advance
+    if (inst->clock_mode == CLOCK_MODE_LOW_JITTER_OC){
+        vreg_set_voltage(VREG_VOLTAGE_1_20);
+    }
+    if (inst->clock_mode != CLOCK_MODE_DEFAULT){
+        clock_configure_undivided(clk_peri, 0, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
+    }
+}
+
+/**
+ * @brief Whether an instance sets clk_sys
+ *
+ * @param inst Instance
+ * @note The low jitter modes switch clk_sys to their clock plan, which would move the dividers of every other output
+ */
+static inline bool i2s_owns_clk_sys(const i2s_instance_t* inst){
+    return inst->slave == false && inst->clock_mode != CLOCK_MODE_DEFAULT;
+}
+
+/**
+ * @brief Whether the mode outputs MCLK on mclk_pin
+ *
+ * @param inst Instance
+ */
+static inline bool i2s_has_mclk(const i2s_instance_t* inst){
+    return inst->mode == MODE_I2S || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_TDM || inst->mode == MODE_DSD;
+}
+
+/**
+ * @brief Whether MCLK comes from the GPOUT clock generator of mclk_pin
+ *
+ * @param inst Instance
+ */
+static inline bool i2s_uses_gpout(const i2s_instance_t* inst){
+    return inst->slave == false && i2s_has_mclk(inst) == true && inst->use_gpout == true;
+}
+
+/**
+ * @brief Whether a MODE_I2S slot width divides into the rate
+ *
+ * @param audio_clock Sampling frequency
+ * @param slot_bits Bits per slot
+ * @note A frame takes slot bits x 4 cycles of 128 per frame at the rate family, 24 bit slots need a rate divisible by 4
+ */
+static inline bool i2s_slot_rate_valid(uint32_t audio_clock, uint8_t slot_bits){
+    return (uint64_t)audio_clock * slot_bits % 32 == 0;
+}
+
+/**
+ * @brief Rate the dividers are computed for
+ *
+ * @param inst Instance
+ * @param audio_clock Sampling frequency
+ * @note The dividers give 128 data state machine cycles per frame, a MODE_TDM frame takes slots x slot bits x 2.
+ * That is a power of two multiple of 128, which keeps the MCLK of the rate family.
+ * A MODE_DSD frame is 16 DCLK (32 cycles), the DSD base rate 44.1kHz of DSD64 is a quarter of the DoP rate.
+ * A MODE_I2S frame takes slot bits x 4 cycles, a MODE_SPDIF frame 128 half cells of 2 cycles
+ */
+static inline uint32_t i2s_clock_rate(const i2s_instance_t* inst, uint32_t audio_clock){
+    if (inst->mode == MODE_TDM){
+        return audio_clock * (inst->tdm_slots * inst->tdm_slot_bits / 64);
+    }
+    else if (inst->mode == MODE_I2S && inst->slave == false){
+        //Checked by i2s_clock_prepare
+        return (uint32_t)((uint64_t)audio_clock * inst->slot_bits / 32);
+    }
+    else if (inst->mode == MODE_DSD){
+        return audio_clock / 4;
+    }
+    else if (inst->mode == MODE_SPDIF){
+        return audio_clock * 2;
+    }
+    return audio_clock;
+}
+
+//Dividers for a sampling frequency, worked out before any of them is applied
+typedef struct {
+    I2S_CLOCK_DIV div;          //CLOCK_MODE_DEFAULT
+    I2S_CLOCK_PLAN plan;        //Low jitter modes
+    uint32_t gpout_div8;        //clk_sys / MCLK of the GPOUT generator in 1/256 steps
+} I2SClockSetting;
+
+/**
+ * @brief Work out the dividers (and clock plan in the low jitter modes) for a sampling frequency
+ *
+ * @param inst Instance
+ * @param audio_clock Sampling frequency
+ * @param setting Filled in for i2s_set_clock
+ * @return true The rate can be reached, nothing is applied yet
+ * @return false The MODE_I2S slot width does not divide into the rate, no clock plan reaches the rate within
+ * I2S_CLOCK_MAX_ERROR_PPM, or CLOCK_MODE_DEFAULT needs a divider below 1 (the rate is too high for clk_sys, or MCLK
+ * too high for the GPOUT generator)
+ */
+static bool i2s_clock_prepare(const i2s_instance_t* inst, uint32_t audio_clock, I2SClockSetting* setting){
+    setting->gpout_div8 = 0;
+    //The master sets the rate
+    if (inst->slave == true){
+        return true;
+    }
+    if (inst->mode == MODE_I2S && i2s_slot_rate_valid(audio_clock, inst->slot_bits) == false){
+        return false;
+    }
+    //Fractional dividers of the current clk_sys, above 1
+    if (inst->clock_mode == CLOCK_MODE_DEFAULT){
+        const I2S_CLOCK_DIV* div = &setting->div;
+        if (i2s_clock_default_div(clock_get_hz(clk_sys), i2s_clock_rate(inst, audio_clock), &setting->div) == false){
+            return false;
+        }
+        if (i2s_uses_gpout(inst) == true){
+            setting->gpout_div8 = (uint32_t)(((uint64_t)div->sys_hz * 256 + div->mclk_hz / 2) / div->mclk_hz);
+        }
+    }
+    //A plan with integer dividers, clk_sys changes when it is applied
+    else{
+        if (i2s_clock_solve(i2s_clock_rate(inst, audio_clock), inst->clock_mode, i2s_has_mclk(inst), &setting->plan) == false){
+            return false;
+        }
+        //The generator divides by one MCLK period where the state machine takes two cycles
+        if (i2s_uses_gpout(inst) == true){
+            setting->gpout_div8 = (uint32_t)setting->plan.mclk_div * 2 << 8;
+        }
+    }
+    //The generator divides by 1 or more
+    return i2s_uses_gpout(inst) == false || setting->gpout_div8 >= 256;
+}
+
+/**
+ * @brief Build the biphase mark table and the S/PDIF silence
+ */
+static void i2s_spdif_tables(void){
+    for (uint i = 0; i < 256; i++){
+        i2s_spdif_bmc[i] = (uint16_t)(0x5555 | part1by1_32(i) << 1);
+    }
+    for (uint i = 0; i < I2S_MUTE_LEN; i += 4){
+        i2s_store_spdif(&i2s_spdif_mute_buff[i], 0, 0);
+    }
+}
+
+/**
+ * @brief Set the consumer channel status of an S/PDIF block for a sampling frequency
+ *
+ * @param inst Instance
+ * @param audio_clock Sampling frequency
+ * @note Byte 0: PCM, copy permitted. Byte 3: sampling frequency (not indicated for other rates). Byte 4: 24 bit words
+ */
+static void i2s_spdif_set_status(i2s_instance_t* inst, uint32_t audio_clock){
+    static const uint32_t rates[][2] = {
+        {44100, 0x0}, {48000, 0x2}, {32000, 0x3}, {22050, 0x4}, {24000, 0x6}, {88200, 0x8},
+        {768000, 0x9}, {96000, 0xA}, {176400, 0xC}, {192000, 0xE},
+    };
+    uint32_t code = 0x1;
+
+    for (uint i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        if (rates[i][0] == audio_clock){
+            code = rates[i][1];
+        }
+    }
+    memset(inst->spdif_status, 0, sizeof(inst->spdif_status));
+    inst->spdif_status[0] = 0x04 | code << 24;
+    inst->spdif_status[1] = 0x0B;
+}
+
+/**
+ * @brief Whether the mode runs with the other settings
+ *
+ * @param inst Instance
+ * @note Slave mode has programs for i2s (32 bit slots), PT8211 and the dual modes, and does not run on core1.
+ * MCLK from GPOUT needs a pin with a clock generator
+ */
+static bool i2s_mode_supported(const i2s_instance_t* inst){
+    if (inst->mode > MODE_SPDIF || inst->clock_mode > CLOCK_MODE_EXTERNAL){
+        return false;
+    }
+    if (inst->slave == true){
+        if (inst->mode == MODE_I2S){
+            return i2s_format_default(inst) && inst->use_core1 == false;
+        }
+        return (inst->mode == MODE_PT8211 || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_PT8211_DUAL) &&
+               inst->use_core1 == false;
+    }
+    //Only GPIO21, 23, 24 and 25 have a clock generator
+    if (i2s_uses_gpout(inst) == true && i2s_gpout_index(inst->mclk_pin) < 0){
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Memory the queue is carved from
+ *
+ * @param inst Instance
+ * @param mem Set to the arena, or the static buffer of the default instance
+ * @param size Set to the size of mem in bytes
+ * @return true mem holds the queue of the current configuration
+ * @return false No memory, or too little for the mode (i2s_set_buffer was called for another configuration)
+ */
+static bool i2s_buffer_arena(i2s_instance_t* inst, uint8_t** mem, size_t* size){
+    *mem = inst->arena;
+    *size = inst->arena_size;
+#ifndef I2S_NO_DEFAULT_BUFFER
+    if (*mem == NULL && inst == i2s_default){
+        *mem = (uint8_t*)i2s_default_buffer;
+        *size = sizeof(i2s_default_buffer);
+    }
+#endif
+    return *mem != NULL && i2s_buffer_layout(inst, NULL, inst->buf_frames, inst->buf_depth) <= *size;
+}
+
+/**
+ * @brief State machines an instance runs
+ *
+ * @param inst Instance
+ * @param mclk_sm Include the MCLK state machine on sm + 1
+ */
+static inline uint32_t i2s_sm_mask(const i2s_instance_t* inst, bool mclk_sm){
+    uint32_t mask = 1u << inst->sm;
+
+    if (mclk_sm == true){
+        mask |= 1u << (inst->sm + 1);
+    }
+    if (inst->cap_active == true){
+        mask |= 1u << inst->cap_sm;
+    }
+    return mask;
+}
+
+/**
+ * @brief Whether the DMA channel is one of those an instance runs
+ *
+ * @param inst Instance
+ * @param chan DMA channel
+ */
+static inline bool i2s_dma_uses(const i2s_instance_t* inst, int chan){
+    return chan == inst->dma_chan || chan == inst->ctrl_chan || chan == inst->reload_chan ||
+           (inst->cap_active == true && chan == inst->cap_chan);
+}
+
+/**
+ * @brief Whether the pins, state machines and DMA channels of the settings can be taken
+ *
+ * @param inst Instance
+ * @return true Free, or taken by inst itself
+ * @return false A pin, sm (sm + 1 with the MCLK state machine) or dma_chan is out of range or used twice, another
+ * running instance uses one of them, sm + 1 is claimed elsewhere, chained DMA finds no two unused channels, or
+ * clk_sys or core1 is already taken by another instance
+ */
+static bool i2s_resources_free(const i2s_instance_t* inst){
+    bool mclk = inst->slave == false && i2s_has_mclk(inst) == true;
+    bool mclk_sm = mclk == true && i2s_uses_gpout(inst) == false;
+    uint64_t pins, other_pins;
+    uint32_t sms;
+    int unused;
+
+    if (i2s_pin_mask(inst, mclk, &pins) == false){
+        return false;
+    }
+    //The MCLK state machine runs next to the data one
+    if (inst->sm >= NUM_PIO_STATE_MACHINES || (mclk_sm == true && inst->sm + 1 >= NUM_PIO_STATE_MACHINES)){
+        return false;
+    }
+    if (mclk_sm == true && pio_sm_is_claimed(inst->pio, inst->sm + 1) == true){
+        return false;
+    }
+    sms = i2s_sm_mask(inst, mclk_sm);
+
+    //The data channel is the caller's, chained DMA claims two more
+    if (inst->dma_chan < 0 || inst->dma_chan >= NUM_DMA_CHANNELS){
+        return false;
+    }
+    if (inst->use_core1 == false && inst->use_chain == true){
+        unused = (inst->ctrl_chan >= 0) + (inst->reload_chan >= 0);
+        for (int chan = 0; chan < NUM_DMA_CHANNELS && unused < 2; chan++){
+            unused += chan != inst->dma_chan && dma_channel_is_claimed(chan) == false;
+        }
+        if (unused < 2){
+            return false;
+        }
+    }
+
+    //Outputs share clk_sys and core1
+    for (int i = 0; i < I2S_MAX_INSTANCES; i++){
+        const i2s_instance_t* other = &i2s_instances[i];
+        if (other == inst || other->running == false){
+            continue;
+        }
+        if (i2s_owns_clk_sys(inst) == true || i2s_owns_clk_sys(other) == true){
+            return false;
+        }
+        i2s_pin_mask(other, other->mclk_sm == true || other->gpout >= 0, &other_pins);
+        if ((pins & other_pins) != 0 || i2s_dma_uses(other, inst->dma_chan) == true){
+            return false;
+        }
+        if (other->pio == inst->pio && (sms & i2s_sm_mask(other, other->mclk_sm)) != 0){
+            return false;
+        }
+    }
+    return inst->use_core1 == false || i2s_core1_inst == NULL || i2s_core1_inst == inst;
+}
+
+bool i2s_inst_mclk_init(i2s_instance_t* inst, uint32_t audio_clock){
+    pio_sm_config sm_config, sm_config_mclk;
+    PIO pio = inst->pio;
+    uint sm = inst->sm;
+    uint data_pin = inst->dout_pin;
+    uint clock_pin_base = inst->clk_pin_base;
+    //The mode switches below cover every mode i2s_mode_supported passes
+    uint offset = 0, offset_mclk = 0;
+    uint8_t* mem;
+    size_t mem_size;
+    I2SClockSetting clock;
+
+    //Checked before anything is touched, a running output goes on as it was
+    if (i2s_mode_supported(inst) == false || i2s_resources_free(inst) == false){
+        return false;
+    }
+    if (i2s_buffer_arena(inst, &mem, &mem_size) == false){
+        return false;
+    }
+    if (i2s_clock_prepare(inst, audio_clock, &clock) == false){
+        return false;
+    }
+
+    inst->init_start_us = time_us_32();
+    if (inst->running == true){
+        i2s_stop(inst);
+    }
+
+    //Notify playback state via GPIO25
+    if (inst->playback_handler == default_playback_handler){
+        gpio_init(PICO_DEFAULT_LED_PIN);
+        gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
+    }
+
+    //data pin
+    pio_gpio_init(pio, data_pin);
+    if (inst->mode == MODE_EXDF || inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_DSD){
+        pio_gpio_init(pio, data_pin + 1);
+    }
+
+    //clock pin, S/PDIF carries its clock in the data
+    if (inst->mode != MODE_SPDIF){
+        pio_gpio_init(pio, clock_pin_base);
+        pio_gpio_init(pio, clock_pin_base + 1);
+    }
+
+    //mclk pin
+    inst->gpout = -1;
+    inst->mclk_sm = false;
+    if (inst->slave == true){
+        //The master drives MCLK, BCLK and LRCLK, nothing to output
+    }
+    else if (inst->mode == MODE_EXDF){
+        pio_gpio_init(pio, clock_pin_base + 2);
+    }
+    else if (i2s_uses_gpout(inst) == true){
+        //clk_sys divided by the clock generator of the pin, stopped until the data state machine starts
+        inst->gpout = i2s_gpout_index(inst->mclk_pin);
+        clocks_hw->clk[inst->gpout].ctrl = CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS << CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_LSB;
+        gpio_set_function(inst->mclk_pin, GPIO_FUNC_GPCK);
+    }
+    else if(i2s_has_mclk(inst) == true){
+        pio_gpio_init(pio, inst->mclk_pin);
+        inst->mclk_sm = true;
+
+        pio_sm_set_consecutive_pindirs(pio, sm + 1, inst->mclk_pin, 1, true);
+        offset_mclk = i2s_program_load(&inst->program_mclk, pio, &i2s_mclk_program);
+        inst->offset_mclk = offset_mclk;
+        sm_config_mclk = i2s_mclk_program_get_default_config(offset_mclk);
+        sm_config_set_set_pins(&sm_config_mclk, inst->mclk_pin, 1);
+    }
+    if (inst->mclk_sm == false){
+        i2s_program_unload(&inst->program_mclk);
+    }
+
+    if (inst->slave == true){
+        switch (inst->mode){
+        case MODE_I2S:
+            //BCLK64fs i2s framing from the master
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_data_slave_program);
+            sm_config = i2s_data_slave_program_get_default_config(offset);
+            break;
+        case MODE_PT8211:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_pt8211_slave_program);
+            sm_config = i2s_pt8211_slave_program_get_default_config(offset);
+            break;
+        case MODE_I2S_DUAL:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_data_dual_slave_program);
+            sm_config = i2s_data_dual_slave_program_get_default_config(offset);
+            break;
+        case MODE_PT8211_DUAL:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_pt8211_dual_slave_program);
+            sm_config = i2s_pt8211_dual_slave_program_get_default_config(offset);
+            break;
+        default:
+            break;
+        }
+    }
+    else{
+        switch (inst->mode){
+        case MODE_I2S:
+            offset = i2s_program_load(&inst->program_data, pio, i2s_format_program_build(inst));
+            if (inst->format_program.length == i2s_rj_program.length){
+                sm_config = i2s_rj_program_get_default_config(offset);
+            }
+            else{
+                //i2s_data and i2s_lj wrap the same
+                sm_config = i2s_data_program_get_default_config(offset);
             }
+            break;
+        case MODE_PT8211:
+            offset = i2s_program_load(&inst->program_data, pio, i2s_format_program_build(inst));
+            sm_config = i2s_pt8211_program_get_default_config(offset);
+            break;
+        case MODE_EXDF:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_exdf_program);
+            sm_config = i2s_exdf_program_get_default_config(offset);
+            break;
+        case MODE_I2S_DUAL:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_data_dual_program);
+            sm_config = i2s_data_dual_program_get_default_config(offset);
+            break;
+        case MODE_PT8211_DUAL:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_pt8211_dual_program);
+            sm_config = i2s_pt8211_dual_program_get_default_config(offset);
+            break;
+        case MODE_TDM:
+            offset = i2s_program_load(&inst->program_data, pio, i2s_tdm_program_build(inst));
+            sm_config = i2s_tdm_program_get_default_config(offset);
+            break;
+        case MODE_DSD:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_dsd_program);
+            sm_config = i2s_dsd_program_get_default_config(offset);
+            break;
+        case MODE_SPDIF:
+            offset = i2s_program_load(&inst->program_data, pio, &i2s_spdif_program);
+            sm_config = i2s_spdif_program_get_default_config(offset);
+            break;
+        default:
+            break;
+        }
+    }
+    inst->offset = offset;
+
+    if (inst->mode == MODE_EXDF || inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_DSD){
+        sm_config_set_out_pins(&sm_config, data_pin, 2);
+    }
+    else{
+        sm_config_set_out_pins(&sm_config, data_pin, 1);
+    }
+    //The S/PDIF line is driven by side-set
+    sm_config_set_sideset_pins(&sm_config, inst->mode == MODE_SPDIF ? data_pin : clock_pin_base);
+    sm_config_set_out_shift(&sm_config, false, false, 32);
+    sm_config_set_fifo_join(&sm_config, PIO_FIFO_JOIN_TX);
+    if (inst->slave == true){
+        //Bits follow the external clocks, the OSR refills by itself at the end of every FIFO word
+        sm_config_set_in_pins(&sm_config, clock_pin_base);
+        sm_config_set_out_shift(&sm_config, false, true,
+                                (inst->mode == MODE_PT8211 && i2s_packed(inst) == false) || inst->mode == MODE_PT8211_DUAL ? 16 : 32);
+    }
+    else if (inst->mode == MODE_TDM){
+        //One FIFO word per slot, the OSR refills after the upper slot bits
+        sm_config_set_out_shift(&sm_config, false, true, inst->tdm_slot_bits);
+    }
+    else if (inst->mode == MODE_DSD){
+        //8 DCLK from the upper half of each FIFO word
+        sm_config_set_out_shift(&sm_config, false, true, 16);
+    }
+    else if (inst->mode == MODE_SPDIF){
+        //16 half cells per FIFO word, the first one in bit 0
+        sm_config_set_out_shift(&sm_config, true, true, 32);
+    }
+
+    //i2s buffer word layout, core1 rearranges while copying to its DMA buffers
+    if (inst->mode == MODE_EXDF && inst->use_core1 == false){
+        inst->out = I2S_OUT_EXDF;
+    }
+    else if ((inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL) && inst->use_core1 == false){
+        inst->out = I2S_OUT_DUAL;
+    }
+    else if (inst->mode == MODE_DSD){
+        //DoP is unpacked on enqueue, core1 copies the words as they are
+        inst->out = I2S_OUT_DSD;
+    }
+    else if (inst->mode == MODE_SPDIF){
+        //Encoded on enqueue as well
+        inst->out = I2S_OUT_SPDIF;
+        i2s_spdif_tables();
+        i2s_spdif_set_status(inst, audio_clock);
+        inst->spdif_frame = 0;
+    }
+    else if (i2s_packed(inst)){
+        inst->out = I2S_OUT_PACKED;
+    }
+    else{
+        inst->out = I2S_OUT_LR;
+    }
+    i2s_select_kernel(inst);
+    if (inst->out == I2S_OUT_DSD){
+        inst->mute_buff = i2s_dsd_mute_buff;
+    }
+    else if (inst->out == I2S_OUT_SPDIF){
+        inst->mute_buff = i2s_spdif_mute_buff;
+    }
+    else{
+        inst->mute_buff = i2s_mute_buff;
+    }
+
+    //buffer
+    i2s_buffer_layout(inst, mem, inst->buf_frames, inst->buf_depth);
+
+    inst->enqueue_count = 0;
+    inst->dequeue_count = 0;
+    inst->release_count = 0;
+    inst->enqueue_frames = 0;
+    inst->dequeue_frames = 0;
+    inst->enqueue_pos = 0;
+    inst->dequeue_pos = 0;
+    inst->dequeue_held = false;
+    inst->enqueue_acquired = false;
+    inst->write_filled = 0;
+    inst->write_open = false;
+    inst->write_carry_len = 0;
+    inst->stats_playing = false;
+    i2s_inst_reset_stats(inst);
+    inst->audio_clock = audio_clock;
+    inst->switching = false;
+    inst->ramp_len = 0;
+    inst->ramp_pos = 0;
+    inst->ts_frames = 0;
+    inst->ts_pending = 0;
+    inst->ts_dma_frames = 0;
+    inst->first_packet_us = UINT32_MAX;
+    i2s_timestamp_restart(inst);
+    //In slave mode the clocks count as present once DMA moves
+    inst->clock_lost = inst->slave;
+
+    if (inst->slave == true){
+        //Sample the external clocks every clk_sys cycle
+        sm_config_set_clkdiv_int_frac8(&sm_config, 1, 0);
+    }
+    else if (inst->clock_mode == CLOCK_MODE_DEFAULT){
+        const I2S_CLOCK_DIV* div = &clock.div;
+        i2s_clock_set_div(div);
+        sm_config_set_clkdiv_int_frac8(&sm_config, div->data_int, div->data_frac);
+
+        //mclk
+        if (inst->gpout >= 0){
+            i2s_gpout_set_div(inst, clock.gpout_div8);
+        }
+        else if (inst->mclk_sm == true){
+            sm_config_set_clkdiv_int_frac8(&sm_config_mclk, div->mclk_int, div->mclk_frac);
+        }
+    }
+    else{
+        //Change sys_clk to a plan with integer dividers
+        const I2S_CLOCK_PLAN* plan = &clock.plan;
+        i2s_clock_apply(plan);
+
+        //mclk output
+        if (inst->gpout >= 0){
+            i2s_gpout_set_div(inst, clock.gpout_div8);
+        }
+        else if (inst->mclk_sm == true){
+            sm_config_set_clkdiv_int_frac8(&sm_config_mclk, plan->mclk_div, 0);
+        }
+
+        //Change pio frequency
+        sm_config_set_clkdiv_int_frac8(&sm_config, plan->data_div, 0);
+    }
+
+    //mclk start
+    if(inst->mclk_sm == true){
+        pio_sm_init(pio, sm + 1, offset_mclk, &sm_config_mclk);
+        pio_sm_set_enabled(pio, sm + 1, true);
+    }
+
+    pio_sm_init(pio, sm, offset, &sm_config);
+
+    uint pin_mask;
+    if (inst->mode == MODE_EXDF){
+        pin_mask = (3u << data_pin) | (7u << clock_pin_base);
+    }
+    else if (inst->mode == MODE_PT8211_DUAL || inst->mode == MODE_I2S_DUAL || inst->mode == MODE_DSD){
+        pin_mask = (3u << data_pin) | (3u << clock_pin_base);
+    }
+    else if (inst->mode == MODE_SPDIF){
+        pin_mask = 1u << data_pin;
+    }
+    else{
+        pin_mask = (1u << data_pin) | (3u << clock_pin_base);
+    }
+    if (inst->slave == true){
+        //Clock pins are inputs. They skip the 2 cycle input synchronizer, data follows BCLK that much sooner
+        pio_sm_set_pindirs_with_mask(pio, sm, pin_mask & ~(3u << clock_pin_base), pin_mask);
+        hw_set_bits(&pio->input_sync_bypass, 3u << clock_pin_base);
+    }
+    else{
+        pio_sm_set_pindirs_with_mask(pio, sm, pin_mask, pin_mask);
+        hw_clear_bits(&pio->input_sync_bypass, 3u << clock_pin_base);
+    }
+    pio_sm_exec(pio, sm, pio_encode_jmp(offset));
+    pio_sm_set_pins(pio, sm, 0);
+    pio_sm_clear_fifos(pio, sm);
+    if (inst->cap_chan >= 0){
+        i2s_capture_init(inst);
+    }
+    else{
+        i2s_capture_unload(inst);
+    }
+    //GPOUT MCLK starts next to the data state machine, so it keeps the same phase to BCLK on every start
+    if (inst->gpout >= 0){
+        i2s_gpout_enable(inst, true);
+    }
+    pio_sm_set_enabled(pio, sm, true);
+
+
+    //dma init
+    dma_channel_config conf = dma_channel_get_default_config(inst->dma_chan);
+    
+    channel_config_set_read_increment(&conf, true);
+    channel_config_set_write_increment(&conf, false);
+    channel_config_set_transfer_data_size(&conf, DMA_SIZE_32);
+    channel_config_set_dreq(&conf, pio_get_dreq(pio, sm, true));
+    
+    dma_channel_configure(
+        inst->dma_chan,
+        &conf,
+        &inst->pio->txf[inst->sm],
+        NULL,
+        0,
+        false
+    );
+
+    dma_irqn_set_channel_enabled(inst->irq_index, inst->dma_chan, true);
+    if (inst->use_core1 == false && inst->use_chain == true){
+        i2s_chain_init(inst, &conf);
+    }
+    else if (inst->use_core1 == false){
+        inst->irq_handler = i2s_handlers[inst->irq_index];
+        irq_set_exclusive_handler(DMA_IRQ_0 + inst->irq_index, inst->irq_handler);
+        irq_set_priority(DMA_IRQ_0 + inst->irq_index, 0);
+        irq_set_enabled(DMA_IRQ_0 + inst->irq_index, true);
+        i2s_handler(inst);
+    }
+
+    //core1スタート
+    if (inst->use_core1 == true){
+        i2s_core1_inst = inst;
+        multicore_launch_core1(inst->core1_main_funcion);
+    }
+    inst->running = true;
+    inst->init_us = time_us_32() - inst->init_start_us;
+
+    //Clock loss detector
+    if (inst->clock_timer_active == true){
+        cancel_repeating_timer(&inst->clock_timer);
+        inst->clock_timer_active = false;
+    }
+    if (inst->slave == true){
+        inst->clock_seen_seq = inst->ts_seq;
+        inst->clock_seen_us = time_us_32();
+        inst->clock_timer_active = add_repeating_timer_us(-I2S_SLAVE_CHECK_US, i2s_clock_check, inst, &inst->clock_timer);
+    }
+    return true;
+}
+
+/**
+ * @brief Set the dividers (and clk_sys in the low jitter modes) for a sampling frequency
+ *
+ * @param inst Instance
+ * @param setting From i2s_clock_prepare
+ */
+static void i2s_set_clock(i2s_instance_t* inst, const I2SClockSetting* setting){
+    //The master sets the rate
+    if (inst->slave == true){
+        return;
+    }
+    if (inst->clock_mode == CLOCK_MODE_DEFAULT){
+        const I2S_CLOCK_DIV* div = &setting->div;
+        i2s_clock_set_div(div);
+        pio_sm_set_clkdiv_int_frac(inst->pio, inst->sm, div->data_int, div->data_frac);
+
+        //mclk follows the rate family
+        if (inst->gpout >= 0){
+            i2s_gpout_set_div(inst, setting->gpout_div8);
+        }
+        else if (inst->mclk_sm == true){
+            pio_sm_set_clkdiv_int_frac(inst->pio, inst->sm + 1, div->mclk_int, div->mclk_frac);
+        }
+    }
+    else{
+        //Change sys_clk when the plan needs other PLL settings
+        const I2S_CLOCK_PLAN* plan = &setting->plan;
+        i2s_clock_apply(plan);
+
+        //Change pio frequency
+        if (inst->gpout >= 0){
+            i2s_gpout_set_div(inst, setting->gpout_div8);
+        }
+        else if (inst->mclk_sm == true){
+            pio_sm_set_clkdiv_int_frac(inst->pio, inst->sm + 1, plan->mclk_div, 0);
+        }
+        pio_sm_set_clkdiv_int_frac(inst->pio, inst->sm, plan->data_div, 0);
+    }
+}
+
+/**
+ * @brief Number of frames for I2S_RAMP_US
+ *
+ * @param inst Instance
+ * @param audio_clock Sampling frequency
+ */
+static uint32_t i2s_ramp_frames(i2s_instance_t* inst, uint32_t audio_clock){
+    uint32_t frames = (uint32_t)((uint64_t)audio_clock * I2S_RAMP_US / 1000000);
+
+    if (frames == 0){
+        frames = 1;
+    }
+    return frames < inst->buf_frames ? frames : inst->buf_frames;
+}
+
+/**
+ * @brief Queue a fade from the last queued frame to zero
+ *
+ * @param inst Instance
+ * @param deadline Give up waiting for a free slot at this time
+ * @note Nothing is queued when the last packet has already been played
+ */
+static void i2s_ramp_down(i2s_instance_t* inst, uint64_t deadline){
+    uint8_t last = inst->enqueue_pos == 0 ? inst->buf_depth - 1 : inst->enqueue_pos - 1;
+    uint32_t frames = i2s_ramp_frames(inst, inst->audio_clock);
+    uint pairs = i2s_channels(inst) / 2;
+    int32_t l[I2S_TDM_MAX_SLOTS / 2], r[I2S_TDM_MAX_SLOTS / 2];
+    int32_t* d;
+    int32_t gain;
+
+    //A bitstream can not be faded, DSD silence follows it
+    if (inst->out == I2S_OUT_DSD || inst->release_count == inst->enqueue_count || inst->sample[last] < inst->frame_len){
+        return;
+    }
+    //Unreleased, so the producer has not reused it
+    d = inst->buf + last * inst->slot_len + inst->sample[last] - inst->frame_len;
+    for (uint p = 0; p < pairs; p++){
+        i2s_load_frame(inst, d + p * 2, &l[p], &r[p]);
+    }
+
+    while (i2s_queue_free(inst) == 0){
+        if (time_us_64() >= deadline){
+            return;
         }
-        else if (resolution == 24){
-            uint8_t *d = in;
-            int32_t e;
-            sample /= 3;
-            for (i = 0; i < sample / 2; i++){
-                e = 0;
-                e |= *d++ << 8;
-                e |= *d++ << 16;
-                e |= *d++ << 24;
-                lch_buf[i] = e;
-                e = 0;
-                e |= *d++ << 8;
-                e |= *d++ << 16;
-                e |= *d++ << 24;
-                rch_buf[i] = e;
-            }
+        tight_loop_contents();
+    }
+
+    d = inst->buf + inst->enqueue_pos * inst->slot_len;
+    for (uint32_t i = 0; i < frames; i++){
+        gain = (int32_t)(((frames - 1 - i) << 16) / frames);
+        for (uint p = 0; p < pairs; p++){
+            d = i2s_kernel_put(d, i2s_apply_gain(l[p], gain), i2s_apply_gain(r[p], gain), 0, 0, inst->out, false);
+        }
+    }
+    inst->sample[inst->enqueue_pos] = frames * inst->frame_len;
+    i2s_queue_push(inst);
+}
+
+bool i2s_inst_mclk_change_clock(i2s_instance_t* inst, uint32_t audio_clock){
+    uint32_t mask = 1u << inst->sm;
+    uint8_t start_level = inst->start_level;
+    uint32_t tail;
+    uint64_t deadline;
+    I2SClockSetting clock;
+
+    //Checked before the queue is played out, a rejected rate leaves the output running at the old one
+    if (inst->running == false || i2s_clock_prepare(inst, audio_clock, &clock) == false){
+        return false;
+    }
+
+    if (inst->mclk_sm == true){
+        mask |= 1u << (inst->sm + 1);
+    }
+    //Capture stops and resumes with the clocks it follows
+    if (inst->cap_active == true){
+        mask |= 1u << inst->cap_sm;
+    }
+
+    //Everything queued is old rate audio, play it out and fade to zero
+    inst->switching = true;
+    inst->ramp_pos = inst->ramp_len = 0;
+    i2s_inst_write_flush(inst);
+    inst->write_carry_len = 0;
+    deadline = time_us_64() + I2S_SWITCH_MARGIN_US +
+               (uint64_t)(i2s_inst_get_queued_frames(inst) + 3 * inst->buf_frames) * 1000000 / inst->audio_clock;
+
+    //Play whatever is queued, even below the start level
+    inst->start_level = 1;
+    i2s_ramp_down(inst, deadline);
+    while (inst->release_count != inst->enqueue_count && time_us_64() < deadline){
+        tight_loop_contents();
+    }
+
+    //Let the tail leave the PIO FIFO (and the DMA buffers of core1)
+    tail = 8 / 2 + 1;
+    if (inst->use_core1 == true){
+        tail += 2 * inst->buf_frames;
+    }
+    sleep_us((uint64_t)tail * 1000000 / inst->audio_clock + 1);
+
+    if (inst->slave == true){
+        //The master changes the rate on its own, start over at its next whole frame
+        inst->audio_clock = audio_clock;
+        i2s_slave_resync(inst);
+    }
+    else{
+        //Stopped state machines keep their state, DMA waits on DREQ
+        pio_set_sm_mask_enabled(inst->pio, mask, false);
+        if (inst->gpout >= 0){
+            i2s_gpout_enable(inst, false);
+        }
+        i2s_set_clock(inst, &clock);
+        inst->audio_clock = audio_clock;
+        i2s_timestamp_restart(inst);
+        if (inst->out == I2S_OUT_SPDIF){
+            i2s_spdif_set_status(inst, audio_clock);
+        }
+
+        //Start MCLK from the beginning of its period, dividers restart together
+        if (mask & (1u << (inst->sm + 1))){
+            pio_sm_exec(inst->pio, inst->sm + 1, pio_encode_jmp(inst->offset_mclk));
+        }
+        if (inst->gpout >= 0){
+            i2s_gpout_enable(inst, true);
+        }
+        pio_enable_sm_mask_in_sync(inst->pio, mask);
+    }
+
+    //Fade in the first packets at the new rate
+    inst->ramp_len = inst->out == I2S_OUT_DSD ? 0 : i2s_ramp_frames(inst, audio_clock);
+    inst->ramp_pos = 0;
+    inst->start_level = start_level;
+    inst->switching = false;
+    return true;
+}
+
+//Stack USB received data in i2s buffer
+bool i2s_inst_enqueue(i2s_instance_t* inst, uint8_t* in, int sample, uint8_t resolution){
+    uint channels = i2s_channels(inst);
+    uint32_t frames;
+
+    //DoP needs 24 bits
+    if ((resolution != 16 && resolution != 24 && resolution != 32) || (inst->out == I2S_OUT_DSD && resolution == 16)){
+        return false;
+    }
+
+    //Packet does not fit in a slot
+    frames = sample / (resolution / 8) / channels;
+    if (frames > inst->buf_frames){
+        return false;
+    }
+
+	if (i2s_queue_free(inst) > 0){
+        //The kernels take L/R pairs, a TDM frame is slots / 2 of them
+        inst->kernel[(resolution >> 3) - 2](inst->buf + inst->enqueue_pos * inst->slot_len, in, frames * channels / 2, inst->mul_l, inst->mul_r);
+        inst->sample[inst->enqueue_pos] = frames * inst->frame_len;
+        i2s_queue_push(inst);
+
+		return true;
+	}
+	else {
+        i2s_stats_overrun(inst);
+        return false;
+    }
+}
+
+int32_t* i2s_inst_enqueue_acquire(i2s_instance_t* inst, uint32_t* frames){
+    if (i2s_queue_free(inst) == 0){
+        i2s_stats_overrun(inst);
+        return NULL;
+    }
+
+    inst->enqueue_acquired = true;
+    *frames = inst->buf_frames;
+    return inst->buf + inst->enqueue_pos * inst->slot_len;
+}
+
+bool i2s_inst_enqueue_commit(i2s_instance_t* inst, uint32_t frames){
+    int32_t* slot = inst->buf + inst->enqueue_pos * inst->slot_len;
+    int32_t l, r;
+    int i;
+
+    if (inst->enqueue_acquired == false || frames > inst->buf_frames){
+        return false;
+    }
+    inst->enqueue_acquired = false;
+
+    //Volume processing and rearrangement in place
+    if (inst->out == I2S_OUT_DUAL || inst->out == I2S_OUT_SPDIF){
+        //Frame i grows into words i*4~i*4+3, walk backwards so unread frames are not overwritten
+        for (i = (int)frames - 1; i >= 0; i--){
+            l = i2s_apply_volume(slot[i * 2], inst->mul_l);
+            r = i2s_apply_volume(slot[i * 2 + 1], inst->mul_r);
+            i2s_kernel_put(&slot[i * 4], l, r, 0, 0, inst->out, false);
         }
-        else if (resolution == 32){
-            int32_t *d = (int32_t*)in;
-            sample /= 4;
-            for (i = 0; i < sample / 2; i++){
-                lch_buf[i] = *d++;
-                rch_buf[i] = *d++;
+    }
+    else if (inst->out == I2S_OUT_PACKED){
+        //One word per frame, written back where it was read
+        if (inst->kernel[2] != i2s_kernel_packed_32){
+            for (i = 0; i < (int)frames; i++){
+                i2s_load_frame(inst, &slot[i], &l, &r);
+                slot[i] = i2s_pack16(i2s_apply_volume(l, inst->mul_l), i2s_apply_volume(r, inst->mul_r));
             }
         }
+    }
+    else if (inst->kernel[2] != i2s_kernel_lr_32){
+        //Each frame is read before it is written
+        inst->kernel[2](slot, (const uint8_t*)slot, frames * i2s_channels(inst) / 2, inst->mul_l, inst->mul_r);
+    }
+    inst->sample[inst->enqueue_pos] = frames * inst->frame_len;
+
+    i2s_queue_push(inst);
+    return true;
+}
+
+bool i2s_dop_detect(const uint8_t* in, int sample, uint8_t resolution){
+    uint32_t frames, prev = 0;
+    int32_t l, r;
+
+    if (resolution != 24 && resolution != 32){
+        return false;
+    }
+
+    frames = sample / (resolution / 4);
+    for (uint32_t i = 0; i < frames; i++){
+        l = i2s_load_sample(in, resolution);
+        r = i2s_load_sample(in + resolution / 8, resolution);
+        in += resolution / 4;
+        //The marker alternates from frame to frame, either may come first
+        if (i2s_dop_marker(l, r) == false || ((uint32_t)l >> 24) == prev){
+            return false;
+        }
+        prev = (uint32_t)l >> 24;
+    }
+    return frames > 0;
+}
+
+/**
+ * @brief Publish the slot filled by i2s_write
+ */
+static void i2s_write_publish(i2s_instance_t* inst){
+    inst->sample[inst->enqueue_pos] = inst->write_filled * inst->frame_len;
+    inst->write_filled = 0;
+    inst->write_open = false;
+    i2s_queue_push(inst);
+}
+
+size_t i2s_inst_write(i2s_instance_t* inst, const uint8_t* in, size_t len, uint8_t resolution){
+    const uint8_t* p = in;
+    uint pairs = i2s_channels(inst) / 2;
+    uint32_t frame_bytes, period, n;
+    int32_t* slot;
+
+    if ((resolution != 16 && resolution != 24 && resolution != 32) || (inst->out == I2S_OUT_DSD && resolution == 16)){
+        return 0;
+    }
+
+    //A partial frame of another resolution can not be completed
+    if (resolution != inst->write_resolution){
+        inst->write_resolution = resolution;
+        inst->write_carry_len = 0;
+    }
+    frame_bytes = resolution / 4 * pairs;
+
+    period = inst->write_period;
+    if (period == 0 || period > inst->buf_frames){
+        period = inst->buf_frames;
+    }
 
-        //Volume processing
-        for (i = 0; i < sample / 2; i++){
-            lch_buf[i] = (int32_t)(((int64_t)lch_buf[i] * mul_l) >> 29u);
-            rch_buf[i] = (int32_t)(((int64_t)rch_buf[i] * mul_r) >> 29u);
+    while (len > 0){
+        if (inst->write_open == false){
+            if (i2s_queue_free(inst) == 0){
+                i2s_stats_overrun(inst);
+                break;
+            }
+            inst->write_open = true;
         }
+        slot = inst->buf + inst->enqueue_pos * inst->slot_len + inst->write_filled * inst->frame_len;
 
-        //Store in i2s buffer
-        if (i2s_mode == MODE_EXDF && i2s_use_core1 == false){
-            //Rearrange
-            for (int i = 0, j = 0; i < sample / 2; i++) {
-                uint64_t left  = part1by1_32(lch_buf[i]);
-                uint64_t right = part1by1_32(rch_buf[i]);
-                
-                uint64_t merged = (left << 1) | right;
-        
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged >> 32);     // 上位32bit
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged & 0xFFFFFFFF); // 下位32bit
+        //Complete the frame left over from the previous call
+        if (inst->write_carry_len > 0){
+            while (inst->write_carry_len < frame_bytes && len > 0){
+                inst->write_carry[inst->write_carry_len++] = *p++;
+                len--;
             }
+            if (inst->write_carry_len < frame_bytes){
+                break;
+            }
+            inst->kernel[(resolution >> 3) - 2](slot, inst->write_carry, pairs, inst->mul_l, inst->mul_r);
+            inst->write_carry_len = 0;
+            inst->write_filled++;
         }
-        else if ((i2s_mode == MODE_PT8211_DUAL || i2s_mode == MODE_I2S_DUAL) && i2s_use_core1 == false){
-            //Rearrange
-            for (int i = 0, j = 0; i < sample / 2; i++) {
-                //
-                uint64_t tmp1, tmp2, merged;
-                int32_t d_r, d_l;
-                tmp1 = part1by1_32(lch_buf[i]);
-                tmp2 = part1by1_32(rch_buf[i]);
-                
-                merged = (tmp1 << 1) | tmp2;
-        
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged >> 32);     // 上位32bit
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged & 0xFFFFFFFF); // 下位32bit
-
-                //Invert
-                if (lch_buf[i] == INT32_MIN){
-                    d_l = INT32_MAX;
-                }
-                else{
-                    d_l = -lch_buf[i];
-                }
-                if (rch_buf[i] == INT32_MIN){
-                    d_r = INT32_MAX;
-                }
-                else{
-                    d_r = -rch_buf[i];
-                }
-                tmp1 = part1by1_32(d_l);
-                tmp2 = part1by1_32(d_r);
-                
-                merged = (tmp1 << 1) | tmp2;
-        
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged >> 32);     // 上位32bit
-                i2s_buf[enqueue_pos][j++] = (uint32_t)(merged & 0xFFFFFFFF); // 下位32bit
+        else if (len < frame_bytes){
+            while (len > 0){
+                inst->write_carry[inst->write_carry_len++] = *p++;
+                len--;
             }
-            sample *= 2;
         }
         else {
-            j = 0;
-            for (i = 0; i < sample / 2; i++){
-                i2s_buf[enqueue_pos][j++] = lch_buf[i];
-                i2s_buf[enqueue_pos][j++] = rch_buf[i];
+            n = period - inst->write_filled;
+            if (n > len / frame_bytes){
+                n = len / frame_bytes;
             }
+            inst->kernel[(resolution >> 3) - 2](slot, p, n * pairs, inst->mul_l, inst->mul_r);
+            p += n * frame_bytes;
+            len -= n * frame_bytes;
+            inst->write_filled += n;
         }
-        
-        i2s_sample[enqueue_pos] = sample;
-		enqueue_pos++;
-		if (enqueue_pos >= I2S_BUF_DEPTH){
-            enqueue_pos = 0;
+
+        if (inst->write_filled >= period){
+            i2s_write_publish(inst);
         }
-        
-        uint32_t save = spin_lock_blocking(queue_spin_lock);
-        i2s_buf_length++;
-        spin_unlock(queue_spin_lock, save);
+    }
 
-		return true;
-	}
-	else return false;
+    return p - in;
 }
 
-bool i2s_dequeue(int32_t** buff, int* sample){
-    if (i2s_get_buf_length()){
-        *buff = i2s_buf[dequeue_pos];
-        *sample = i2s_sample[dequeue_pos];
+bool i2s_inst_write_flush(i2s_instance_t* inst){
+    if (inst->write_open == false || inst->write_filled == 0){
+        return false;
+    }
 
-        dequeue_pos++;
-        if (dequeue_pos >= I2S_BUF_DEPTH){
-            dequeue_pos = 0;
-        }
+    i2s_write_publish(inst);
+    return true;
+}
+
+bool i2s_inst_set_write_period(i2s_instance_t* inst, uint32_t frames){
+    if (frames == 0 || frames > inst->buf_frames){
+        return false;
+    }
+
+    inst->write_period = frames;
+    return true;
+}
+
+bool i2s_inst_get_timestamp(i2s_instance_t* inst, I2S_TIMESTAMP* ts){
+    uint32_t seq;
+
+    ts->epoch = inst->ts_epoch;
+    __mem_fence_acquire();
+    do {
+        seq = inst->ts_seq;
+        __mem_fence_acquire();
+        ts->frames = inst->ts_frames;
+        ts->time_us = inst->ts_time_us;
+        ts->pending = inst->ts_pending;
+        __mem_fence_acquire();
+    } while ((seq & 1) != 0 || seq != inst->ts_seq);
+    ts->audio_clock = inst->audio_clock;
+
+    return (int32_t)(ts->time_us - inst->ts_epoch_us) >= 0;
+}
+
+void i2s_inst_get_stats(i2s_instance_t* inst, I2S_STATS* stats){
+    uint64_t now = time_us_64();
+    uint64_t last = 0;
+    bool glitch = false;
+
+    *stats = inst->stats;
+    if (stats->level_min > stats->level_max){
+        stats->level_min = 0;
+    }
+
+    if (stats->underruns > 0){
+        last = inst->last_underrun_us;
+        glitch = true;
+    }
+    if (stats->overruns > 0 && (glitch == false || inst->last_overrun_us > last)){
+        last = inst->last_overrun_us;
+        glitch = true;
+    }
+    if (stats->clock_losses > 0 && (glitch == false || inst->last_clock_loss_us > last)){
+        last = inst->last_clock_loss_us;
+        glitch = true;
+    }
+    stats->since_glitch_us = glitch ? now - last : UINT64_MAX;
+    stats->init_us = inst->init_us;
+    stats->first_packet_us = inst->first_packet_us;
+}
+
+void i2s_inst_reset_stats(i2s_instance_t* inst){
+    I2S_STATS zero = {0};
+
+    inst->stats = zero;
+    inst->stats.level_min = UINT8_MAX;
+}
+
+bool i2s_inst_set_tdm(i2s_instance_t* inst, uint8_t slots, uint8_t slot_bits){
+    if ((slots != 4 && slots != 8 && slots != 16) || (slot_bits != 16 && slot_bits != 32)){
+        return false;
+    }
+
+    inst->tdm_slots = slots;
+    inst->tdm_slot_bits = slot_bits;
+    return true;
+}
+
+bool i2s_inst_set_format(i2s_instance_t* inst, I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits){
+    if (format > I2S_FORMAT_RJ || (slot_bits != 16 && slot_bits != 24 && slot_bits != 32) ||
+        (sample_bits != 16 && sample_bits != 24 && sample_bits != 32) || sample_bits > slot_bits){
+        return false;
+    }
+    //A running master output restarts at its rate with the new slots
+    if (inst->running == true && inst->slave == false && inst->mode == MODE_I2S &&
+        i2s_slot_rate_valid(inst->audio_clock, slot_bits) == false){
+        return false;
+    }
+
+    inst->format = format;
+    inst->slot_bits = slot_bits;
+    inst->sample_bits = sample_bits;
+    return true;
+}
+
+void i2s_inst_set_packed(i2s_instance_t* inst, bool enable){
+    inst->use_packed = enable;
+}
+
+void i2s_inst_set_chained_dma(i2s_instance_t* inst, bool enable){
+    inst->use_chain = enable;
+}
+
+void i2s_inst_set_mclk_gpout(i2s_instance_t* inst, bool enable){
+    inst->use_gpout = enable;
+}
 
-        uint32_t save = spin_lock_blocking(queue_spin_lock);
-        i2s_buf_length--;
-        spin_unlock(queue_spin_lock, save);
+void i2s_inst_set_slave(i2s_instance_t* inst, bool enable){
+    inst->slave = enable;
+}
+
+bool i2s_inst_get_clock_present(i2s_instance_t* inst){
+    return inst->clock_lost == false;
+}
+
+bool i2s_inst_set_buffer(i2s_instance_t* inst, void* mem, size_t size, uint32_t frames, uint8_t depth){
+    if (mem == NULL || ((uintptr_t)mem & 3) != 0 || frames == 0 || depth == 0 || depth > 127){
+        return false;
+    }
+    if (i2s_buffer_layout(inst, NULL, frames, depth) > size){
+        return false;
+    }
+
+    inst->arena = (uint8_t*)mem;
+    inst->arena_size = size;
+    inst->buf_frames = frames;
+    inst->buf_depth = depth;
+    inst->start_level = depth / 4 > 0 ? depth / 4 : 1;
+    return true;
+}
+
+size_t i2s_inst_get_buffer_size(i2s_instance_t* inst, uint32_t frames, uint8_t depth){
+    return i2s_buffer_layout(inst, NULL, frames, depth);
+}
+
+uint8_t i2s_inst_get_buf_depth(i2s_instance_t* inst){
+    return inst->buf_depth;
+}
+
+uint32_t i2s_inst_get_buf_frames(i2s_instance_t* inst){
+    return inst->buf_frames;
+}
+
+bool i2s_inst_dequeue(i2s_instance_t* inst, int32_t** buff, int* sample){
+    uint32_t len;
+
+    //The previous packet has been consumed by the caller
+    if (inst->dequeue_held == true){
+        i2s_queue_release(inst);
+        inst->dequeue_held = false;
+    }
 
+    if (i2s_queue_pop(inst, buff, &len) == true){
+        *sample = len;
+        inst->dequeue_held = true;
         return true;
     }
     else return false;
 }
 
-int8_t i2s_get_buf_length(void){
-    int8_t d;
+int8_t i2s_inst_get_buf_length(i2s_instance_t* inst){
+    return (int8_t)(inst->enqueue_count - inst->dequeue_count);
+}
+
+void i2s_inst_set_capture(i2s_instance_t* inst, uint din_pin, uint sm, int dma_ch){
+    //Output runs without capture until i2s_mclk_init
+    if (inst->running == true){
+        i2s_stop(inst);
+    }
+    i2s_capture_unload(inst);
+    inst->cap_pin = din_pin;
+    inst->cap_sm = sm;
+    inst->cap_chan = dma_ch;
+}
+
+bool i2s_inst_set_capture_buffer(i2s_instance_t* inst, void* mem, size_t size, uint32_t frames, uint8_t depth){
+    if (mem == NULL || ((uintptr_t)mem & 3) != 0 || frames == 0 || depth < 2 || depth > 127){
+        return false;
+    }
+    if (I2S_CAPTURE_BUFFER_SIZE(frames, depth) > size){
+        return false;
+    }
+
+    inst->cap_buf = (int32_t*)mem;
+    inst->cap_frames = frames;
+    inst->cap_depth = depth;
+    return true;
+}
+
+bool i2s_inst_capture_dequeue(i2s_instance_t* inst, int32_t** buff, int* sample){
+    //The previous packet has been consumed by the caller
+    if (inst->cap_held == true){
+        __mem_fence_release();
+        inst->cap_release_count = inst->cap_release_count + 1;
+        inst->cap_held = false;
+    }
 
-    uint32_t save = spin_lock_blocking(queue_spin_lock);
-	d = i2s_buf_length;
-    spin_unlock(queue_spin_lock, save);
+    if (inst->cap_read_count == inst->cap_write_count){
+        return false;
+    }
+    __mem_fence_acquire();
 
-    return d;
+    *buff = i2s_capture_slot(inst, inst->cap_read_pos);
+    *sample = inst->cap_frames * 2;
+    inst->cap_read_pos++;
+    if (inst->cap_read_pos >= inst->cap_depth){
+        inst->cap_read_pos = 0;
+    }
+    inst->cap_read_count = inst->cap_read_count + 1;
+    inst->cap_held = true;
+    return true;
 }
 
-void i2s_volume_change(int16_t v, int8_t ch){
+int8_t i2s_inst_capture_get_buf_length(i2s_instance_t* inst){
+    return (int8_t)(inst->cap_write_count - inst->cap_read_count);
+}
+
+uint32_t i2s_inst_get_queued_frames(i2s_instance_t* inst){
+    return inst->enqueue_frames - inst->dequeue_frames;
+}
+
+uint32_t i2s_inst_get_buffered_frames(i2s_instance_t* inst){
+    I2S_TIMESTAMP ts, check;
+    uint32_t queued, played;
+
+    //The queue and the timestamp have to be from the same transfer
+    do {
+        if (i2s_inst_get_timestamp(inst, &ts) == false){
+            return i2s_inst_get_queued_frames(inst);
+        }
+        queued = i2s_inst_get_queued_frames(inst);
+        i2s_inst_get_timestamp(inst, &check);
+    } while (check.frames != ts.frames || check.time_us != ts.time_us);
+
+    played = (uint32_t)((uint64_t)(time_us_32() - ts.time_us) * ts.audio_clock / 1000000);
+    return played < ts.pending ? queued + ts.pending - played : queued;
+}
+
+void i2s_inst_volume_change(i2s_instance_t* inst, int16_t v, int8_t ch){
     if (ch == 0){
-        mul_l = db_to_vol[-v >> 8];
-        mul_r = db_to_vol[-v >> 8];
+        inst->mul_l = db_to_vol[-v >> 8];
+        inst->mul_r = db_to_vol[-v >> 8];
     }
     else if (ch == 1){
-        mul_l = db_to_vol[-v >> 8];
+        inst->mul_l = db_to_vol[-v >> 8];
     }
     else if (ch == 2){
-        mul_r = db_to_vol[-v >> 8];
+        inst->mul_r = db_to_vol[-v >> 8];
+    }
+    i2s_select_kernel(inst);
+}
+
+void i2s_inst_set_playback_handler(i2s_instance_t* inst, ExternalFunction func){
+    inst->playback_handler = func;
+}
+
+void i2s_inst_set_core1_main_function(i2s_instance_t* inst, Core1MainFunction func){
+    inst->core1_main_funcion = func;
+}
+
+i2s_instance_t* i2s_get_default_instance(void){
+    return i2s_default;
+}
+
+i2s_instance_t* i2s_instance_create(void){
+    for (uint i = 1; i < I2S_MAX_INSTANCES; i++){
+        i2s_instance_t* inst = &i2s_instances[i];
+        if (inst->in_use == false){
+            *inst = (i2s_instance_t)I2S_INSTANCE_DEFAULTS;
+            inst->irq_index = i;
+            inst->in_use = true;
+            return inst;
+        }
+    }
+    return NULL;
+}
+
+void i2s_instance_destroy(i2s_instance_t* inst){
+    if (inst == NULL || inst == i2s_default){
+        return;
     }
+    i2s_inst_deinit(inst);
+    inst->in_use = false;
+}
+
+//Default instance
+void i2s_mclk_set_pin(uint data_pin, uint clock_pin_base, uint mclk_pin){
+    i2s_inst_mclk_set_pin(i2s_default, data_pin, clock_pin_base, mclk_pin);
+}
+
+void i2s_mclk_set_config(PIO pio, uint sm, int dma_ch, bool use_core1, CLOCK_MODE clock_mode, I2S_MODE mode){
+    i2s_inst_mclk_set_config(i2s_default, pio, sm, dma_ch, use_core1, clock_mode, mode);
+}
+
+bool i2s_set_tdm(uint8_t slots, uint8_t slot_bits){
+    return i2s_inst_set_tdm(i2s_default, slots, slot_bits);
+}
+
+bool i2s_set_format(I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits){
+    return i2s_inst_set_format(i2s_default, format, slot_bits, sample_bits);
+}
+
+void i2s_set_packed(bool enable){
+    i2s_inst_set_packed(i2s_default, enable);
+}
+
+void i2s_set_chained_dma(bool enable){
+    i2s_inst_set_chained_dma(i2s_default, enable);
+}
+
+void i2s_set_mclk_gpout(bool enable){
+    i2s_inst_set_mclk_gpout(i2s_default, enable);
+}
+
+void i2s_set_slave(bool enable){
+    i2s_inst_set_slave(i2s_default, enable);
+}
+
+bool i2s_get_clock_present(void){
+    return i2s_inst_get_clock_present(i2s_default);
+}
+
+bool i2s_mclk_init(uint32_t audio_clock){
+    return i2s_inst_mclk_init(i2s_default, audio_clock);
+}
+
+void i2s_deinit(void){
+    i2s_inst_deinit(i2s_default);
+}
+
+bool i2s_mclk_change_clock(uint32_t audio_clock){
+    return i2s_inst_mclk_change_clock(i2s_default, audio_clock);
+}
+
+bool i2s_set_buffer(void* mem, size_t size, uint32_t frames, uint8_t depth){
+    return i2s_inst_set_buffer(i2s_default, mem, size, frames, depth);
+}
+
+size_t i2s_get_buffer_size(uint32_t frames, uint8_t depth){
+    return i2s_inst_get_buffer_size(i2s_default, frames, depth);
+}
+
+uint8_t i2s_get_buf_depth(void){
+    return i2s_inst_get_buf_depth(i2s_default);
+}
+
+uint32_t i2s_get_buf_frames(void){
+    return i2s_inst_get_buf_frames(i2s_default);
+}
+
+bool i2s_enqueue(uint8_t* in, int sample, uint8_t resolution){
+    return i2s_inst_enqueue(i2s_default, in, sample, resolution);
+}
+
+int32_t* i2s_enqueue_acquire(uint32_t* frames){
+    return i2s_inst_enqueue_acquire(i2s_default, frames);
+}
+
+bool i2s_enqueue_commit(uint32_t frames){
+    return i2s_inst_enqueue_commit(i2s_default, frames);
+}
+
+size_t i2s_write(const uint8_t* in, size_t len, uint8_t resolution){
+    return i2s_inst_write(i2s_default, in, len, resolution);
+}
+
+bool i2s_write_flush(void){
+    return i2s_inst_write_flush(i2s_default);
+}
+
+bool i2s_set_write_period(uint32_t frames){
+    return i2s_inst_set_write_period(i2s_default, frames);
+}
+
+bool i2s_dequeue(int32_t** buff, int* sample){
+    return i2s_inst_dequeue(i2s_default, buff, sample);
+}
+
+int8_t i2s_get_buf_length(void){
+    return i2s_inst_get_buf_length(i2s_default);
+}
+
+uint32_t i2s_get_queued_frames(void){
+    return i2s_inst_get_queued_frames(i2s_default);
+}
+
+uint32_t i2s_get_buffered_frames(void){
+    return i2s_inst_get_buffered_frames(i2s_default);
+}
+
+void i2s_set_capture(uint din_pin, uint sm, int dma_ch){
+    i2s_inst_set_capture(i2s_default, din_pin, sm, dma_ch);
+}
+
+bool i2s_set_capture_buffer(void* mem, size_t size, uint32_t frames, uint8_t depth){
+    return i2s_inst_set_capture_buffer(i2s_default, mem, size, frames, depth);
+}
+
+bool i2s_capture_dequeue(int32_t** buff, int* sample){
+    return i2s_inst_capture_dequeue(i2s_default, buff, sample);
+}
+
+int8_t i2s_capture_get_buf_length(void){
+    return i2s_inst_capture_get_buf_length(i2s_default);
+}
+
+bool i2s_get_timestamp(I2S_TIMESTAMP* ts){
+    return i2s_inst_get_timestamp(i2s_default, ts);
+}
+
+void i2s_get_stats(I2S_STATS* stats){
+    i2s_inst_get_stats(i2s_default, stats);
+}
+
+void i2s_reset_stats(void){
+    i2s_inst_reset_stats(i2s_default);
+}
+
+void i2s_volume_change(int16_t v, int8_t ch){
+    i2s_inst_volume_change(i2s_default, v, ch);
 }
 
 void set_playback_handler(ExternalFunction func){
-    playback_handler = func;
+    i2s_inst_set_playback_handler(i2s_default, func);
 }
 
 void set_core1_main_function(Core1MainFunction func){
-    core1_main_funcion = func;
+    i2s_inst_set_core1_main_function(i2s_default, func);
 }
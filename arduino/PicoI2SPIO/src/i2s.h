@@ -16,14 +16,40 @@
 #define I2S_BUF_DEPTH   8
 #define I2S_START_LEVEL     (I2S_BUF_DEPTH / 4)
 #define I2S_TARGET_LEVEL    (I2S_BUF_DEPTH / 2)
-#define I2S_DATA_LEN    ((384 + 1) * 2 * 2)
+#define I2S_DATA_FRAMES (384 + 1)
+#define I2S_DATA_LEN    (I2S_DATA_FRAMES * 2 * 2)
+
+//Upper bound of the bytes i2s_set_buffer needs for frames x depth (dual mode with core1)
+#define I2S_BUFFER_SIZE(frames, depth)  (((depth) * ((frames) * 4 + 1) + (frames) * 8) * 4)
+
+//MODE_TDM slots per frame, and the bytes i2s_set_buffer needs for frames x depth in it (with core1)
+#define I2S_TDM_MAX_SLOTS   16
+#define I2S_TDM_BUFFER_SIZE(frames, depth, slots)   (((depth) * ((frames) * (slots) + 1) + (frames) * (slots) * 2) * 4)
+
+//Bytes i2s_set_capture_buffer needs for frames x depth
+#define I2S_CAPTURE_BUFFER_SIZE(frames, depth)  ((depth) * (frames) * 2 * 4)
+
+//Fade out and fade in around i2s_mclk_change_clock
+#define I2S_RAMP_US         1000
+//Time i2s_mclk_change_clock allows on top of the queued audio
+#define I2S_SWITCH_MARGIN_US    2000
+
+//Queue level histogram bins, the last bin also counts deeper levels
+#define I2S_STATS_HIST_LEN  16
+
+//Slave mode clock loss detector period, and the time allowed on top of the longest DMA transfer
+#define I2S_SLAVE_CHECK_US      1000
+#define I2S_SLAVE_TIMEOUT_US    2000
 
 typedef enum {
     MODE_I2S,
     MODE_PT8211,
     MODE_EXDF,
     MODE_I2S_DUAL,
-    MODE_PT8211_DUAL
+    MODE_PT8211_DUAL,
+    MODE_TDM,
+    MODE_DSD,
+    MODE_SPDIF
 } I2S_MODE;
 
 typedef enum {
@@ -34,6 +60,35 @@ typedef enum {
     CLOCK_MODE_EXTERNAL
 } CLOCK_MODE;
 
+typedef enum {
+    I2S_FORMAT_I2S,         //Data delayed one BCLK, LRCLK low for L
+    I2S_FORMAT_LJ,          //Left justified, LRCLK high for L
+    I2S_FORMAT_RJ           //Right justified, LRCLK high for L
+} I2S_FORMAT;
+
+typedef struct {
+    uint32_t underruns;                         //Queue ran dry during playback
+    uint32_t overruns;                          //Packets rejected because the queue was full
+    uint32_t clock_losses;                      //External BCLK/LRCLK stopped (slave mode)
+    uint32_t packets;                           //Packets consumed
+    uint8_t level_min;                          //Lowest queue level a packet was consumed at
+    uint8_t level_max;                          //Highest queue level a packet was consumed at
+    uint32_t level_hist[I2S_STATS_HIST_LEN];    //Queue level each packet was consumed at
+    uint64_t since_glitch_us;                   //Time since the last underrun, overrun or clock loss, UINT64_MAX if none
+    uint32_t init_us;                           //Time i2s_mclk_init took to start output
+    uint32_t first_packet_us;                   //From the start of i2s_mclk_init to the first packet handed to DMA, UINT32_MAX until then
+    uint32_t capture_overruns;                  //Captured packets dropped because the capture queue was full
+} I2S_STATS;
+
+//Output position for measuring the sampling frequency against the system timer
+typedef struct {
+    uint32_t frames;        //Frames handed to the PIO FIFO, mute included (wraps)
+    uint32_t time_us;       //time_us_32() at the DMA completion that handed over the last of them
+    uint32_t pending;       //Frames of the transfer started then, handed over during the next 1/audio_clock * pending (0 with chained DMA)
+    uint32_t audio_clock;   //Nominal sampling frequency
+    uint32_t epoch;         //Changes when the output restarts, frames are not comparable across epochs
+} I2S_TIMESTAMP;
+
 /**
  * @brief Function type for notifying playback state changes
  *
@@ -47,6 +102,15 @@ typedef void (*ExternalFunction)(bool state);
  */
 typedef void (*Core1MainFunction)(void);
 
+//Outputs that can run at the same time, one DMA interrupt each (DMA_IRQ_0 for the default instance, DMA_IRQ_1 for the next)
+#define I2S_MAX_INSTANCES   2
+
+/**
+ * @brief State of one i2s output, see i2s_instance_create
+ *
+ */
+typedef struct i2s_instance i2s_instance_t;
+
 /**
  * @brief Set i2s output pins
  *
@@ -55,6 +119,10 @@ typedef void (*Core1MainFunction)(void);
  * @param mclk_pin_pin MCLK output pin
  * @note BCLK=clock_pin_base+1
  * @note For MODE_EXDF, DOUTL = data_pin, DOUTR = data_pin + 1, WCK=clock_pin_base, BCK=clock_pin_base+1 MCLK=clock_pin_base+2
+ * @note For MODE_TDM, FSYNC=clock_pin_base
+ * @note For MODE_DSD, DSDL = data_pin, DSDR = data_pin + 1, DCLK=clock_pin_base+1, clock_pin_base is held low
+ * @note For MODE_SPDIF, the S/PDIF output is data_pin, clock_pin_base and mclk_pin are not used
+ * @note Called while i2s runs, it does i2s_deinit first
  */
 void i2s_mclk_set_pin(uint data_pin, uint clock_pin_base, uint mclk_pin);
 
@@ -66,27 +134,188 @@ void i2s_mclk_set_pin(uint data_pin, uint clock_pin_base, uint mclk_pin);
  * @param dma_ch DMA channel to use for i2s
  * @param use_core1 Whether to use core1 for sending data to PIO FIFO
  * @param clock_mode Clock mode selection (CLOCK_MODE_DEFAULT, CLOCK_MODE_LOW_JITTER, CLOCK_MODE_LOW_JITTER_OC, CLOCK_MODE_EXTERNAL)
- * @param mode Output format selection (MODE_I2S, MODE_PT8211, MODE_EXDF, MODE_I2S_DUAL, MODE_PT8211_DUAL)
+ * @param mode Output format selection (MODE_I2S, MODE_PT8211, MODE_EXDF, MODE_I2S_DUAL, MODE_PT8211_DUAL, MODE_TDM, MODE_DSD, MODE_SPDIF)
  * @note When using low jitter mode, call before uart, i2s, spi configuration
  * @note MODE_PT8211 is BCLK32fs lsbj16, no MCLK
+ * @note MODE_TDM sends i2s_set_tdm slots on one data pin, with MCLK like MODE_I2S
+ * @note MODE_DSD sends DoP (DSD over PCM) packets as native DSD, with MCLK like MODE_I2S. audio_clock is the DoP frame rate:
+ * 176400 for DSD64, 352800 for DSD128 and 705600 for DSD256 (DCLK 2.8224, 5.6448, 11.2896MHz)
+ * @note MODE_SPDIF sends biphase mark coded S/PDIF (IEC 60958 consumer) for a TOSLINK or coaxial transmitter, no MCLK.
+ * 24 bit audio, the channel status carries the sampling frequency. The line runs at 128fs (24.576MHz at 192kHz)
+ * @note Called while i2s runs, output stops until i2s_mclk_init restarts it with the new settings
  */
 void i2s_mclk_set_config(PIO pio, uint sm, int dma_ch, bool use_core1, CLOCK_MODE clock_mode, I2S_MODE mode);
 
+/**
+ * @brief Set the frame of MODE_TDM
+ *
+ * @param slots Slots per frame (4, 8, 16)
+ * @param slot_bits Bits per slot (16, 32)
+ * @return true Success
+ * @return false Unsupported slot count or width
+ * @note Call before i2s_set_buffer and i2s_mclk_init. Default is 8 slots of 32 bits
+ * @note BCLK is slots x slot_bits fs and FSYNC is one BCLK wide, high during the last bit of the previous frame
+ * (data delayed one BCLK like i2s). Each slot sends the upper slot_bits of an int32, MSB first
+ * @note Packets for i2s_enqueue and i2s_write carry one sample per slot in each frame. The frame takes slots x slot_bits x 2
+ * PIO cycles, so BCLK goes up to clk_sys / 2
+ */
+bool i2s_set_tdm(uint8_t slots, uint8_t slot_bits);
+
+/**
+ * @brief Set the justification and slot width of MODE_I2S
+ *
+ * @param format I2S_FORMAT_I2S, I2S_FORMAT_LJ or I2S_FORMAT_RJ
+ * @param slot_bits Bits per slot (16, 24, 32), BCLK is 2 x slot_bits fs
+ * @param sample_bits Bits per sample (16, 24, 32), not more than slot_bits. Only I2S_FORMAT_RJ uses it
+ * @return true Success
+ * @return false Unsupported format or width, or MODE_I2S is running at a rate slot_bits does not divide into
+ * (24 bit slots at 22.05kHz)
+ * @note Call before i2s_mclk_init. Default is I2S_FORMAT_I2S with 32 bit slots (BCLK64fs)
+ * @note Each slot sends the upper bits of an int32, MSB first. I2S_FORMAT_RJ sends the upper sample_bits after
+ * slot_bits - sample_bits zeros
+ * @note A frame takes slot_bits x 4 PIO cycles, so 16 bit slots run 768kHz at half the BCLK of 32 bit slots.
+ * MCLK is the one of 32 bit slots for 16 bit slots, and 3/4 of it for 24 bit slots (384fs at 48kHz)
+ * @note 24 bit slots need an audio_clock divisible by 4, which 11.025kHz and 22.05kHz are not. i2s_mclk_init and
+ * i2s_mclk_change_clock return false for them
+ * @note Master only, slave mode and capture need the default
+ */
+bool i2s_set_format(I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits);
+
+/**
+ * @brief Send both channels of a frame from one FIFO word
+ *
+ * @param enable true: one word per frame, the upper 16 bits of L in the upper half and of R in the lower half
+ * false: one word per channel (default)
+ * @note Call before i2s_set_buffer and i2s_mclk_init. MODE_PT8211 (also in slave mode) and master MODE_I2S with
+ * 16 bit slots (i2s_set_format) only, ignored in other modes
+ * @note The queue takes half the memory (i2s_get_buffer_size) and DMA moves half the words.
+ * 16bit packets at 0dB are stored with one rotate per frame
+ * @note i2s_enqueue_acquire slots and i2s_dequeue packets hold one word per frame
+ */
+void i2s_set_packed(bool enable);
+
+/**
+ * @brief Keep DMA running from a ring of control blocks
+ *
+ * @param enable true: chained DMA false: restart DMA from the interrupt after every packet (default)
+ * @note Call before i2s_mclk_init, ignored when use_core1 is true
+ * @note Claims two more DMA channels, the interrupt only reclaims finished packets so its latency does not cause gaps
+ */
+void i2s_set_chained_dma(bool enable);
+
+/**
+ * @brief Output MCLK from the clock generator of the MCLK pin instead of a state machine
+ *
+ * @param enable true: clk_gpout0-3 divides clk_sys false: MCLK state machine on sm + 1 (default)
+ * @note Call before i2s_mclk_init. MODE_I2S, MODE_I2S_DUAL, MODE_TDM and MODE_DSD only, other modes have no MCLK state machine
+ * @note mclk_pin has to be GPIO21 (clk_gpout0), 23 (clk_gpout1), 24 (clk_gpout2) or 25 (clk_gpout3), else i2s_mclk_init
+ * returns false. GPIO25 is the default playback LED, replace it with set_playback_handler
+ * @note Frees sm + 1 and its program space. Dividers are the same integers as the state machine in the low jitter modes,
+ * CLOCK_MODE_DEFAULT rounds clk_sys / MCLK to 1/256 (twice as fine as the state machine)
+ */
+void i2s_set_mclk_gpout(bool enable);
+
+/**
+ * @brief Run as slave of an external BCLK/LRCLK master
+ *
+ * @param enable true: BCLK and LRCLK are inputs on clock_pin_base + 1 and clock_pin_base, false: i2s generates them (default)
+ * @note Call before i2s_mclk_init, whose audio_clock is then the nominal rate of the master. MCLK is not output
+ * @note MODE_I2S and MODE_I2S_DUAL take BCLK 64fs, MODE_PT8211 and MODE_PT8211_DUAL BCLK 32fs. MODE_EXDF, MODE_TDM, MODE_DSD, MODE_SPDIF and use_core1 are not supported
+ * @note The state machine runs at clk_sys and changes data 1-2 cycles after the BCLK falling edge, BCLK up to clk_sys / 10
+ * @note When DMA stops moving for I2S_SLAVE_TIMEOUT_US longer than a transfer, the clocks are taken as lost:
+ * clock_losses counts up, the playback handler gets false, and the output restarts from the next whole frame with mute.
+ * Audio queued while the clocks are missing is dropped when they return
+ */
+void i2s_set_slave(bool enable);
+
+/**
+ * @brief Check the external clocks in slave mode
+ *
+ * @return true DMA has moved since the last I2S_SLAVE_CHECK_US period, or master mode
+ * @return false Clocks lost, or not seen yet since i2s_mclk_init
+ */
+bool i2s_get_clock_present(void);
+
 /**
  * @brief Initialize i2s
  *
  * @param audio_clock Sampling frequency
+ * @return true Output started
+ * @return false The configuration can not run, nothing was changed: the queue memory is missing or too small for the
+ * mode (i2s_set_buffer before i2s_mclk_set_config, i2s_set_packed or i2s_set_tdm changed the layout), the mode does
+ * not run in slave mode, a pin, sm (sm + 1 with the MCLK state machine) or the DMA channel is out of range, used twice,
+ * used by another running instance or (sm + 1) claimed elsewhere, clk_sys or core1 is taken by another instance,
+ * mclk_pin has no clock generator for i2s_set_mclk_gpout, 24 bit slots of i2s_set_format do not divide into
+ * audio_clock, or no clock plan of the clock mode reaches audio_clock (in CLOCK_MODE_DEFAULT: it or MCLK is too high
+ * for clk_sys)
  * @note i2s output starts immediately after calling
+ * @note Calling it again restarts output with the current settings, for example after i2s_mclk_set_config changed the mode.
+ * Loaded programs and claimed DMA channels are reused, and in the low jitter modes pll_sys is kept when it already suits audio_clock.
+ * The queue starts empty. init_us and first_packet_us of I2S_STATS tell how long the restart took
  */
-void i2s_mclk_init(uint32_t audio_clock);
+bool i2s_mclk_init(uint32_t audio_clock);
+
+/**
+ * @brief Stop i2s and release what i2s_mclk_init took
+ *
+ * @note Removes the PIO programs, gives back the DMA channels of chained DMA and the DMA interrupt, stops core1 and
+ * returns the pins to their reset function. clk_sys stays at the clock plan
+ */
+void i2s_deinit(void);
 
 /**
  * @brief Change i2s frequency
  *
  * @param audio_clock Sampling frequency
- * @note ToDo Mute processing function is called before and after execution
+ * @return true Switched to audio_clock
+ * @return false i2s is not running, 24 bit slots do not divide into audio_clock or no clock plan reaches audio_clock.
+ * Checked first, output goes on at the old rate
+ * @note Queued packets are old rate audio and are played out at the old rate, followed by a I2S_RAMP_US fade to zero.
+ * Then the state machines stop, the new dividers (and clock plan) are applied and MCLK and data restart in phase.
+ * The first I2S_RAMP_US of new packets are faded in. MODE_DSD is not faded, DSD silence fills the gap instead.
+ * @note Blocks for the queued audio plus I2S_RAMP_US and the PIO FIFO, never longer than
+ * (queued frames + 3 packets) / old rate + I2S_SWITCH_MARGIN_US. Call from the producer context, not from an interrupt
+ */
+bool i2s_mclk_change_clock(uint32_t audio_clock);
+
+/**
+ * @brief Supply the memory the i2s queue is carved from
+ *
+ * @param mem Memory region (4 byte aligned)
+ * @param size Size of mem in bytes
+ * @param frames Packet capacity in stereo frames, MODE_TDM frames of all slots (e.g. 48 + 1 for 48kHz 1ms packets)
+ * @param depth Queue depth in packets (1~127)
+ * @return true Success
+ * @return false Failed (invalid arguments or mem is smaller than i2s_get_buffer_size)
+ * @note Call after i2s_mclk_set_config and set_core1_main_function, before i2s_mclk_init
+ * @note Without it a static buffer of I2S_DATA_FRAMES x I2S_BUF_DEPTH is used, define I2S_NO_DEFAULT_BUFFER (CMake option
+ * PICO_I2S_DEFAULT_BUFFER=OFF) to drop it.
+ * It only holds MODE_TDM with 4 slots, size more slots with I2S_TDM_BUFFER_SIZE. 1ms packets of DSD256 DoP (705 frames) need one too
  */
-void i2s_mclk_change_clock(uint32_t audio_clock);
+bool i2s_set_buffer(void* mem, size_t size, uint32_t frames, uint8_t depth);
+
+/**
+ * @brief Get the bytes i2s_set_buffer needs for the current configuration
+ *
+ * @param frames Packet capacity in stereo frames
+ * @param depth Queue depth in packets
+ * @return size_t Required size in bytes
+ */
+size_t i2s_get_buffer_size(uint32_t frames, uint8_t depth);
+
+/**
+ * @brief Get the queue depth in packets
+ *
+ * @return uint8_t Queue depth
+ */
+uint8_t i2s_get_buf_depth(void);
+
+/**
+ * @brief Get the packet capacity in stereo frames
+ *
+ * @return uint32_t Packet capacity
+ */
+uint32_t i2s_get_buf_frames(void);
 
 /**
  * @brief Store uint8_t data sent from USB into i2s buffer
@@ -95,10 +324,82 @@ void i2s_mclk_change_clock(uint32_t audio_clock);
  * @param sample Number of bytes to store
  * @param resolution Sample bit depth (16, 24, 32)
  * @return true Success
- * @return false Failed (buffer full)
+ * @return false Failed (buffer full or packet larger than the packet capacity)
+ * @note In MODE_TDM a frame is one sample per slot, slot 0 first
+ * @note In MODE_DSD a frame is one DoP L/R pair (24 or 32bit). Frames without a DoP marker (0x05/0xFA, the same on L and R)
+ * are sent as DSD silence (0x69), 16bit packets are rejected
+ * @note In MODE_SPDIF the upper 24 bits of each sample are sent
  */
 bool i2s_enqueue(uint8_t* in, int sample, uint8_t resolution);
 
+/**
+ * @brief Check whether a packet is DoP (DSD over PCM)
+ *
+ * @param in Packet, L/R interleaved little endian
+ * @param sample Number of bytes
+ * @param resolution Sample bit depth (24, 32)
+ * @return true Every frame carries a DoP marker, alternating 0x05 and 0xFA and the same on L and R
+ * @return false PCM, or not a whole frame
+ * @note For switching between MODE_I2S and MODE_DSD, the DoP rate of DSD64 is 176.4kHz 24bit
+ */
+bool i2s_dop_detect(const uint8_t* in, int sample, uint8_t resolution);
+
+/**
+ * @brief Get the next free i2s buffer slot for rendering in place
+ *
+ * @param frames Capacity of the slot in stereo frames
+ * @return int32_t* Slot to write L/R int32 pairs into, NULL when the buffer is full
+ * @note For MODE_I2S and MODE_PT8211 the slot is in DMA word order and is sent as written at 0dB
+ * @note For MODE_EXDF and the dual modes i2s_enqueue_commit rearranges the slot in place
+ * @note For MODE_TDM each frame is one int32 per slot
+ * @note With i2s_set_packed each frame is one word, L in the upper 16 bits and R in the lower 16 bits
+ * @note For MODE_DSD each frame is a DoP L/R pair in the upper 24 bits, i2s_enqueue_commit unpacks it in place
+ * @note For MODE_SPDIF i2s_enqueue_commit encodes the slot in place
+ */
+int32_t* i2s_enqueue_acquire(uint32_t* frames);
+
+/**
+ * @brief Publish the slot returned by i2s_enqueue_acquire
+ *
+ * @param frames Number of stereo frames written
+ * @return true Success
+ * @return false Failed (no slot acquired or frames larger than the capacity)
+ * @note Volume is applied in place, skipped at 0dB
+ */
+bool i2s_enqueue_commit(uint32_t frames);
+
+/**
+ * @brief Stream data of any length into the i2s buffer
+ *
+ * @param in Data to store, L/R interleaved little endian (one sample per slot in MODE_TDM)
+ * @param len Number of bytes
+ * @param resolution Sample bit depth (16, 24, 32, MODE_DSD 24, 32)
+ * @return size_t Number of bytes accepted, less than len when the buffer is full
+ * @note A partial frame at the end is kept and completed by the next call
+ * @note A packet is published every i2s_set_write_period frames
+ * @note Do not mix with i2s_enqueue or i2s_enqueue_acquire while a packet is being filled
+ */
+size_t i2s_write(const uint8_t* in, size_t len, uint8_t resolution);
+
+/**
+ * @brief Publish the packet i2s_write is filling
+ *
+ * @return true Success
+ * @return false Nothing to publish
+ * @note A kept partial frame stays for the next i2s_write
+ */
+bool i2s_write_flush(void);
+
+/**
+ * @brief Set the packet size i2s_write cuts the stream at
+ *
+ * @param frames Packet size in stereo frames (1~packet capacity)
+ * @return true Success
+ * @return false Failed (out of range)
+ * @note Default is the packet capacity
+ */
+bool i2s_set_write_period(uint32_t frames);
+
 /**
  * @brief Retrieve data from i2s buffer
  *
@@ -107,6 +408,7 @@ bool i2s_enqueue(uint8_t* in, int sample, uint8_t resolution);
  * @return true Success
  * @return false Failed (buffer empty)
  * @note Called when use_core1 is true
+ * @note buff stays valid until the next call, which hands the slot back to i2s_enqueue
  */
 bool i2s_dequeue(int32_t** buff, int* sample);
 
@@ -114,14 +416,101 @@ bool i2s_dequeue(int32_t** buff, int* sample);
  * @brief Get i2s buffer length
  *
  * @return int8_t Buffer length
+ * @note Lock free, can be called from either side of the queue
  */
 int8_t i2s_get_buf_length(void);
 
+/**
+ * @brief Get the number of stereo frames waiting in the i2s buffer
+ *
+ * @return uint32_t Frames queued and not yet handed to DMA
+ * @note Lock free, can be called from either side of the queue
+ */
+uint32_t i2s_get_queued_frames(void);
+
+/**
+ * @brief Get the number of stereo frames not yet handed to the PIO
+ *
+ * @return uint32_t Frames queued plus the estimated rest of the running transfer
+ * @note Unlike i2s_get_queued_frames this does not step by a packet when DMA takes one, for rate control loops
+ */
+uint32_t i2s_get_buffered_frames(void);
+
+/**
+ * @brief Get the output position at the latest DMA completion
+ *
+ * @param ts Result
+ * @return true Success
+ * @return false No DMA completion since the output (re)started
+ * @note Taken in i2s_handler, the chained DMA handler or the core1 loop. The chained DMA handler runs at a lower priority and its timestamps are noisier
+ */
+bool i2s_get_timestamp(I2S_TIMESTAMP* ts);
+
+/**
+ * @brief Capture an i2s input on the clocks of the output
+ *
+ * @param din_pin Data input pin
+ * @param sm State machine for capture, on the PIO of i2s_mclk_set_config (not sm or the MCLK state machine sm + 1)
+ * @param dma_ch DMA channel for capture, -1 turns capture off (default)
+ * @note Call before i2s_mclk_init, together with i2s_set_capture_buffer. Called while i2s runs, output stops until i2s_mclk_init
+ * @note MODE_I2S and MODE_I2S_DUAL, master or slave. use_core1 is not supported
+ * @note The ADC shares BCLK and LRCLK with the output, so the input runs at exactly the output rate. Bits are taken on
+ * BCLK rising edges from the first whole frame after the output starts, BCLK up to clk_sys / 8
+ * @note Capture completions share the DMA interrupt of the output, which restarts DMA within the 4 frames the RX FIFO holds
+ */
+void i2s_set_capture(uint din_pin, uint sm, int dma_ch);
+
+/**
+ * @brief Supply the memory of the capture queue
+ *
+ * @param mem Memory region (4 byte aligned)
+ * @param size Size of mem in bytes
+ * @param frames Packet size in stereo frames
+ * @param depth Queue depth in packets (2~127), one of them is always being captured
+ * @return true Success
+ * @return false Failed (invalid arguments or mem is smaller than I2S_CAPTURE_BUFFER_SIZE)
+ * @note Call before i2s_mclk_init. There is no static capture buffer
+ */
+bool i2s_set_capture_buffer(void* mem, size_t size, uint32_t frames, uint8_t depth);
+
+/**
+ * @brief Retrieve a captured packet
+ *
+ * @param buff Captured data, L/R interleaved int32, the first bit after LRCLK in bit 31
+ * @param sample Number of words retrieved
+ * @return true Success
+ * @return false Failed (nothing captured yet)
+ * @note buff points into the capture queue and stays valid until the next call, which hands the slot back to DMA
+ * @note When the queue is full, newly captured packets are dropped and counted as capture_overruns
+ */
+bool i2s_capture_dequeue(int32_t** buff, int* sample);
+
+/**
+ * @brief Get the number of captured packets waiting
+ *
+ * @return int8_t Captured packets not yet retrieved
+ */
+int8_t i2s_capture_get_buf_length(void);
+
+/**
+ * @brief Get i2s buffer telemetry
+ *
+ * @param stats Copy of the counters since i2s_mclk_init or i2s_reset_stats
+ * @note Counters are updated by the consumer and the producer without locking, a copy taken during an update may be one event behind
+ */
+void i2s_get_stats(I2S_STATS* stats);
+
+/**
+ * @brief Clear i2s buffer telemetry
+ */
+void i2s_reset_stats(void);
+
 /**
  * @brief Change i2s volume
  *
  * @param v Volume
  * @param ch Channel 0:L&R 1:L 2:R
+ * @note In MODE_TDM L is the even slots and R the odd ones. MODE_DSD is not attenuated
  */
 void i2s_volume_change(int16_t v, int8_t ch);
 
@@ -139,6 +528,71 @@ void set_playback_handler(ExternalFunction func);
  */
 void set_core1_main_function(Core1MainFunction func);
 
+/**
+ * @brief Get the instance the functions without an instance argument act on
+ *
+ * @return i2s_instance_t* Default instance, its DMA interrupt is DMA_IRQ_0
+ */
+i2s_instance_t* i2s_get_default_instance(void);
+
+/**
+ * @brief Take another instance for an independent output
+ *
+ * @return i2s_instance_t* Instance with the default settings, NULL when all I2S_MAX_INSTANCES are taken
+ * @note Set it up with the i2s_inst_ functions in the same order as the default instance. It needs its own state machines,
+ * DMA channel and pins (pio1 keeps it clear of the default instance), and has no static buffer: call i2s_inst_set_buffer before i2s_inst_mclk_init
+ * @note Its DMA interrupt is DMA_IRQ_1, so the DMA interrupt handlers of the default instance and this one run independently
+ * @note clk_sys is shared. Instances running at the same time must use CLOCK_MODE_DEFAULT (or slave mode), the low jitter modes
+ * move clk_sys under the other outputs. Only one instance can use core1
+ */
+i2s_instance_t* i2s_instance_create(void);
+
+/**
+ * @brief Give back an instance taken with i2s_instance_create
+ *
+ * @param inst Instance
+ * @note Does i2s_inst_deinit first
+ */
+void i2s_instance_destroy(i2s_instance_t* inst);
+
+//Instance versions of the functions above, the functions without an instance argument act on i2s_get_default_instance()
+void i2s_inst_mclk_set_pin(i2s_instance_t* inst, uint data_pin, uint clock_pin_base, uint mclk_pin);
+void i2s_inst_mclk_set_config(i2s_instance_t* inst, PIO pio, uint sm, int dma_ch, bool use_core1, CLOCK_MODE clock_mode, I2S_MODE mode);
+bool i2s_inst_set_tdm(i2s_instance_t* inst, uint8_t slots, uint8_t slot_bits);
+bool i2s_inst_set_format(i2s_instance_t* inst, I2S_FORMAT format, uint8_t slot_bits, uint8_t sample_bits);
+void i2s_inst_set_packed(i2s_instance_t* inst, bool enable);
+void i2s_inst_set_chained_dma(i2s_instance_t* inst, bool enable);
+void i2s_inst_set_mclk_gpout(i2s_instance_t* inst, bool enable);
+void i2s_inst_set_slave(i2s_instance_t* inst, bool enable);
+bool i2s_inst_get_clock_present(i2s_instance_t* inst);
+bool i2s_inst_mclk_init(i2s_instance_t* inst, uint32_t audio_clock);
+void i2s_inst_deinit(i2s_instance_t* inst);
+bool i2s_inst_mclk_change_clock(i2s_instance_t* inst, uint32_t audio_clock);
+bool i2s_inst_set_buffer(i2s_instance_t* inst, void* mem, size_t size, uint32_t frames, uint8_t depth);
+size_t i2s_inst_get_buffer_size(i2s_instance_t* inst, uint32_t frames, uint8_t depth);
+uint8_t i2s_inst_get_buf_depth(i2s_instance_t* inst);
+uint32_t i2s_inst_get_buf_frames(i2s_instance_t* inst);
+bool i2s_inst_enqueue(i2s_instance_t* inst, uint8_t* in, int sample, uint8_t resolution);
+int32_t* i2s_inst_enqueue_acquire(i2s_instance_t* inst, uint32_t* frames);
+bool i2s_inst_enqueue_commit(i2s_instance_t* inst, uint32_t frames);
+size_t i2s_inst_write(i2s_instance_t* inst, const uint8_t* in, size_t len, uint8_t resolution);
+bool i2s_inst_write_flush(i2s_instance_t* inst);
+bool i2s_inst_set_write_period(i2s_instance_t* inst, uint32_t frames);
+bool i2s_inst_dequeue(i2s_instance_t* inst, int32_t** buff, int* sample);
+int8_t i2s_inst_get_buf_length(i2s_instance_t* inst);
+uint32_t i2s_inst_get_queued_frames(i2s_instance_t* inst);
+uint32_t i2s_inst_get_buffered_frames(i2s_instance_t* inst);
+bool i2s_inst_get_timestamp(i2s_instance_t* inst, I2S_TIMESTAMP* ts);
+void i2s_inst_set_capture(i2s_instance_t* inst, uint din_pin, uint sm, int dma_ch);
+bool i2s_inst_set_capture_buffer(i2s_instance_t* inst, void* mem, size_t size, uint32_t frames, uint8_t depth);
+bool i2s_inst_capture_dequeue(i2s_instance_t* inst, int32_t** buff, int* sample);
+int8_t i2s_inst_capture_get_buf_length(i2s_instance_t* inst);
+void i2s_inst_get_stats(i2s_instance_t* inst, I2S_STATS* stats);
+void i2s_inst_reset_stats(i2s_instance_t* inst);
+void i2s_inst_volume_change(i2s_instance_t* inst, int16_t v, int8_t ch);
+void i2s_inst_set_playback_handler(i2s_instance_t* inst, ExternalFunction func);
+void i2s_inst_set_core1_main_function(i2s_instance_t* inst, Core1MainFunction func);
+
 /**
  * @brief Fast function for alternately rearranging EXDF LR bits
  *
@@ -255,3 +255,380 @@ static inline pio_sm_config i2s_pt8211_dual_program_get_default_config(uint offs
 }
 #endif
 
+// ------- //
+// i2s_tdm //
+// ------- //
+
+#define i2s_tdm_wrap_target 1
+#define i2s_tdm_wrap 12
+
+static const uint16_t i2s_tdm_program_instructions[] = {
+    0xf846, //  0: set    y, 6            side 3     
+            //     .wrap_target
+    0x6001, //  1: out    pins, 1         side 0     
+    0xf03d, //  2: set    x, 29           side 2     
+    0x6001, //  3: out    pins, 1         side 0     
+    0x1043, //  4: jmp    x--, 3          side 2     
+    0x6001, //  5: out    pins, 1         side 0     
+    0x1081, //  6: jmp    y--, 1          side 2     
+    0x6001, //  7: out    pins, 1         side 0     
+    0xf03d, //  8: set    x, 29           side 2     
+    0x6001, //  9: out    pins, 1         side 0     
+    0x1049, // 10: jmp    x--, 9          side 2     
+    0x6801, // 11: out    pins, 1         side 1     
+    0xf846, // 12: set    y, 6            side 3     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_tdm_program = {
+    .instructions = i2s_tdm_program_instructions,
+    .length = 13,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_tdm_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_tdm_wrap_target, offset + i2s_tdm_wrap);
+    sm_config_set_sideset(&c, 2, false, false);
+    return c;
+}
+#endif
+
+// ------- //
+// i2s_dsd //
+// ------- //
+
+#define i2s_dsd_wrap_target 0
+#define i2s_dsd_wrap 1
+
+static const uint16_t i2s_dsd_program_instructions[] = {
+            //     .wrap_target
+    0x6002, //  0: out    pins, 2         side 0     
+    0xb042, //  1: nop                    side 2     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_dsd_program = {
+    .instructions = i2s_dsd_program_instructions,
+    .length = 2,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_dsd_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_dsd_wrap_target, offset + i2s_dsd_wrap);
+    sm_config_set_sideset(&c, 2, false, false);
+    return c;
+}
+#endif
+
+// ------ //
+// i2s_lj //
+// ------ //
+
+#define i2s_lj_wrap_target 0
+#define i2s_lj_wrap 11
+
+static const uint16_t i2s_lj_program_instructions[] = {
+            //     .wrap_target
+    0x90a0, //  0: pull   block           side 2     
+    0x6801, //  1: out    pins, 1         side 1     
+    0xf83d, //  2: set    x, 29           side 3     
+    0x6801, //  3: out    pins, 1         side 1     
+    0x1843, //  4: jmp    x--, 3          side 3     
+    0x6801, //  5: out    pins, 1         side 1     
+    0x98a0, //  6: pull   block           side 3     
+    0x6001, //  7: out    pins, 1         side 0     
+    0xf03d, //  8: set    x, 29           side 2     
+    0x6001, //  9: out    pins, 1         side 0     
+    0x1049, // 10: jmp    x--, 9          side 2     
+    0x6001, // 11: out    pins, 1         side 0     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_lj_program = {
+    .instructions = i2s_lj_program_instructions,
+    .length = 12,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_lj_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_lj_wrap_target, offset + i2s_lj_wrap);
+    sm_config_set_sideset(&c, 2, false, false);
+    return c;
+}
+#endif
+
+// ------ //
+// i2s_rj //
+// ------ //
+
+#define i2s_rj_wrap_target 0
+#define i2s_rj_wrap 19
+
+static const uint16_t i2s_rj_program_instructions[] = {
+            //     .wrap_target
+    0x90a0, //  0: pull   block           side 2     
+    0xa803, //  1: mov    pins, null      side 1     
+    0xf846, //  2: set    y, 6            side 3     
+    0xa803, //  3: mov    pins, null      side 1     
+    0x1883, //  4: jmp    y--, 3          side 3     
+    0x6801, //  5: out    pins, 1         side 1     
+    0xf835, //  6: set    x, 21           side 3     
+    0x6801, //  7: out    pins, 1         side 1     
+    0x1847, //  8: jmp    x--, 7          side 3     
+    0x6801, //  9: out    pins, 1         side 1     
+    0x98a0, // 10: pull   block           side 3     
+    0xa003, // 11: mov    pins, null      side 0     
+    0xf046, // 12: set    y, 6            side 2     
+    0xa003, // 13: mov    pins, null      side 0     
+    0x108d, // 14: jmp    y--, 13         side 2     
+    0x6001, // 15: out    pins, 1         side 0     
+    0xf035, // 16: set    x, 21           side 2     
+    0x6001, // 17: out    pins, 1         side 0     
+    0x1051, // 18: jmp    x--, 17         side 2     
+    0x6001, // 19: out    pins, 1         side 0     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_rj_program = {
+    .instructions = i2s_rj_program_instructions,
+    .length = 20,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_rj_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_rj_wrap_target, offset + i2s_rj_wrap);
+    sm_config_set_sideset(&c, 2, false, false);
+    return c;
+}
+#endif
+
+// --------- //
+// i2s_spdif //
+// --------- //
+
+#define i2s_spdif_wrap_target 0
+#define i2s_spdif_wrap 3
+
+static const uint16_t i2s_spdif_program_instructions[] = {
+            //     .wrap_target
+    0x7021, //  0: out    x, 1            side 1     
+    0x1020, //  1: jmp    !x, 0           side 1     
+    0x6021, //  2: out    x, 1            side 0     
+    0x0022, //  3: jmp    !x, 2           side 0     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_spdif_program = {
+    .instructions = i2s_spdif_program_instructions,
+    .length = 4,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_spdif_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_spdif_wrap_target, offset + i2s_spdif_wrap);
+    sm_config_set_sideset(&c, 1, false, false);
+    return c;
+}
+#endif
+
+// -------------- //
+// i2s_data_slave //
+// -------------- //
+
+#define i2s_data_slave_wrap_target 1
+#define i2s_data_slave_wrap 12
+
+static const uint16_t i2s_data_slave_program_instructions[] = {
+    0x20a0, //  0: wait   1 pin, 0                   
+            //     .wrap_target
+    0x2020, //  1: wait   0 pin, 0                   
+    0xe03f, //  2: set    x, 31                      
+    0x20a1, //  3: wait   1 pin, 1                   
+    0x2021, //  4: wait   0 pin, 1                   
+    0x6001, //  5: out    pins, 1                    
+    0x0043, //  6: jmp    x--, 3                     
+    0x20a0, //  7: wait   1 pin, 0                   
+    0xe03f, //  8: set    x, 31                      
+    0x20a1, //  9: wait   1 pin, 1                   
+    0x2021, // 10: wait   0 pin, 1                   
+    0x6001, // 11: out    pins, 1                    
+    0x0049, // 12: jmp    x--, 9                     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_data_slave_program = {
+    .instructions = i2s_data_slave_program_instructions,
+    .length = 13,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_data_slave_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_data_slave_wrap_target, offset + i2s_data_slave_wrap);
+    return c;
+}
+#endif
+
+// ---------------- //
+// i2s_pt8211_slave //
+// ---------------- //
+
+#define i2s_pt8211_slave_wrap_target 1
+#define i2s_pt8211_slave_wrap 14
+
+static const uint16_t i2s_pt8211_slave_program_instructions[] = {
+    0x2020, //  0: wait   0 pin, 0                   
+            //     .wrap_target
+    0x20a0, //  1: wait   1 pin, 0                   
+    0x6001, //  2: out    pins, 1                    
+    0xe02e, //  3: set    x, 14                      
+    0x20a1, //  4: wait   1 pin, 1                   
+    0x2021, //  5: wait   0 pin, 1                   
+    0x6001, //  6: out    pins, 1                    
+    0x0044, //  7: jmp    x--, 4                     
+    0x2020, //  8: wait   0 pin, 0                   
+    0x6001, //  9: out    pins, 1                    
+    0xe02e, // 10: set    x, 14                      
+    0x20a1, // 11: wait   1 pin, 1                   
+    0x2021, // 12: wait   0 pin, 1                   
+    0x6001, // 13: out    pins, 1                    
+    0x004b, // 14: jmp    x--, 11                    
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_pt8211_slave_program = {
+    .instructions = i2s_pt8211_slave_program_instructions,
+    .length = 15,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_pt8211_slave_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_pt8211_slave_wrap_target, offset + i2s_pt8211_slave_wrap);
+    return c;
+}
+#endif
+
+// ------------------- //
+// i2s_data_dual_slave //
+// ------------------- //
+
+#define i2s_data_dual_slave_wrap_target 1
+#define i2s_data_dual_slave_wrap 12
+
+static const uint16_t i2s_data_dual_slave_program_instructions[] = {
+    0x20a0, //  0: wait   1 pin, 0                   
+            //     .wrap_target
+    0x2020, //  1: wait   0 pin, 0                   
+    0xe03f, //  2: set    x, 31                      
+    0x20a1, //  3: wait   1 pin, 1                   
+    0x2021, //  4: wait   0 pin, 1                   
+    0x6002, //  5: out    pins, 2                    
+    0x0043, //  6: jmp    x--, 3                     
+    0x20a0, //  7: wait   1 pin, 0                   
+    0xe03f, //  8: set    x, 31                      
+    0x20a1, //  9: wait   1 pin, 1                   
+    0x2021, // 10: wait   0 pin, 1                   
+    0x6002, // 11: out    pins, 2                    
+    0x0049, // 12: jmp    x--, 9                     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_data_dual_slave_program = {
+    .instructions = i2s_data_dual_slave_program_instructions,
+    .length = 13,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_data_dual_slave_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_data_dual_slave_wrap_target, offset + i2s_data_dual_slave_wrap);
+    return c;
+}
+#endif
+
+// --------------------- //
+// i2s_pt8211_dual_slave //
+// --------------------- //
+
+#define i2s_pt8211_dual_slave_wrap_target 1
+#define i2s_pt8211_dual_slave_wrap 14
+
+static const uint16_t i2s_pt8211_dual_slave_program_instructions[] = {
+    0x2020, //  0: wait   0 pin, 0                   
+            //     .wrap_target
+    0x20a0, //  1: wait   1 pin, 0                   
+    0x6002, //  2: out    pins, 2                    
+    0xe02e, //  3: set    x, 14                      
+    0x20a1, //  4: wait   1 pin, 1                   
+    0x2021, //  5: wait   0 pin, 1                   
+    0x6002, //  6: out    pins, 2                    
+    0x0044, //  7: jmp    x--, 4                     
+    0x2020, //  8: wait   0 pin, 0                   
+    0x6002, //  9: out    pins, 2                    
+    0xe02e, // 10: set    x, 14                      
+    0x20a1, // 11: wait   1 pin, 1                   
+    0x2021, // 12: wait   0 pin, 1                   
+    0x6002, // 13: out    pins, 2                    
+    0x004b, // 14: jmp    x--, 11                    
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_pt8211_dual_slave_program = {
+    .instructions = i2s_pt8211_dual_slave_program_instructions,
+    .length = 15,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_pt8211_dual_slave_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_pt8211_dual_slave_wrap_target, offset + i2s_pt8211_dual_slave_wrap);
+    return c;
+}
+#endif
+
+// ----------- //
+// i2s_capture //
+// ----------- //
+
+#define i2s_capture_wrap_target 3
+#define i2s_capture_wrap 5
+
+static const uint16_t i2s_capture_program_instructions[] = {
+    0x2080, //  0: wait   1 gpio, 0                  
+    0x2000, //  1: wait   0 gpio, 0                  
+    0x2081, //  2: wait   1 gpio, 1                  
+            //     .wrap_target
+    0x2001, //  3: wait   0 gpio, 1                  
+    0x2081, //  4: wait   1 gpio, 1                  
+    0x4001, //  5: in     pins, 1                    
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program i2s_capture_program = {
+    .instructions = i2s_capture_program_instructions,
+    .length = 6,
+    .origin = -1,
+};
+
+static inline pio_sm_config i2s_capture_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + i2s_capture_wrap_target, offset + i2s_capture_wrap);
+    return c;
+}
+#endif
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_asrc.h
+ * @brief Asynchronous sample rate converter in front of the i2s buffer
+ *
+ */
+
+#ifndef I2S_ASRC_H
+#define I2S_ASRC_H
+#include "pico/types.h"
+
+//Filter taps per output frame
+#define I2S_ASRC_TAPS       32
+//Filter phases per input frame, coefficients are interpolated between them
+#define I2S_ASRC_PHASES     128
+//Cutoff (-6dB) as a fraction of the lower Nyquist frequency
+#define I2S_ASRC_CUTOFF     0.98f
+//Kaiser window beta, higher trades passband width for stopband attenuation and THD+N
+#define I2S_ASRC_BETA       12.0f
+//Largest ratio correction of the level controller
+#define I2S_ASRC_MAX_PPM    2000
+
+/**
+ * @brief Initialize the sample rate converter
+ *
+ * @param in_rate Nominal sampling frequency of the source
+ * @param out_rate Sampling frequency of the i2s output
+ * @param target_frames Buffer level to hold in stereo frames, 0 for half the queue: i2s_get_buf_depth() / 2 packets of
+ * 1ms (at most i2s_get_buf_frames() frames each)
+ * @return true Success
+ * @return false Unsupported ratio (in_rate above 2 * out_rate)
+ * @note Computes the filter table in float (some 10ms on RP2040) unless the cutoff is unchanged.
+ * Call again after i2s_mclk_change_clock
+ */
+bool i2s_asrc_init(uint32_t in_rate, uint32_t out_rate, uint32_t target_frames);
+
+/**
+ * @brief Set the level controller gains
+ *
+ * @param kp Proportional gain in ratio per frame of level error (default 2e-5)
+ * @param ki Integral gain in ratio per frame of level error and ms of input (default out_rate * kp * kp / 4000)
+ * @note The defaults settle in a few seconds
+ */
+void i2s_asrc_set_gain(float kp, float ki);
+
+/**
+ * @brief Resample source data into the i2s buffer
+ *
+ * @param in Data to store, L/R interleaved little endian
+ * @param len Number of bytes, whole frames
+ * @param resolution Sample bit depth (16, 24, 32)
+ * @return size_t Number of bytes accepted, less than len when the buffer is full
+ * @note Fills slots through i2s_enqueue_acquire and publishes one about every 1ms of output.
+ * The ratio follows the buffer level, so the buffer neither runs dry nor overflows while the source clock drifts.
+ * Do not mix with i2s_enqueue or i2s_write. Call from core1 to take the filter load off core0
+ */
+size_t i2s_asrc_write(const uint8_t* in, size_t len, uint8_t resolution);
+
+/**
+ * @brief Publish the packet i2s_asrc_write is filling
+ *
+ * @return true Success
+ * @return false Nothing to publish
+ */
+bool i2s_asrc_flush(void);
+
+/**
+ * @brief Resample without the i2s buffer
+ *
+ * @param in Source frames, int32 L/R pairs
+ * @param in_frames Number of source frames
+ * @param used Number of source frames consumed
+ * @param out Output frames, int32 L/R pairs
+ * @param out_frames Room in out
+ * @return uint32_t Number of output frames
+ * @note Runs at the current ratio, for benchmarks and other sinks
+ */
+uint32_t i2s_asrc_process(const int32_t* in, uint32_t in_frames, uint32_t* used, int32_t* out, uint32_t out_frames);
+
+/**
+ * @brief Get the ratio correction of the level controller
+ *
+ * @return int32_t Correction in ppb, positive when the source runs fast
+ */
+int32_t i2s_asrc_get_offset_ppb(void);
+
+#endif
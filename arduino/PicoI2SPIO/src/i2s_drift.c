@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_drift.c
+ * @brief Output sampling frequency estimate from DMA completion timestamps
+ *
+ */
+
+#include <math.h>
+#include "i2s.h"
+#include "i2s_drift.h"
+
+//Errors are clipped to this many sigma once the error variance is known, so a late interrupt does not pull the loop
+#define DRIFT_CLIP_SIGMA    3.0
+//Smoothing of the squared error
+#define DRIFT_VAR_ALPHA     0.02
+//1us timer resolution
+#define DRIFT_VAR_MIN       (1.0 / 12.0)
+
+static I2S_DRIFT_ESTIMATOR drift_est;
+static uint32_t drift_epoch;
+static bool drift_epoch_valid;
+
+void i2s_drift_init(I2S_DRIFT_ESTIMATOR* est, uint32_t nominal){
+    est->nominal = nominal;
+    est->started = false;
+    est->last_frames = 0;
+    est->last_time_us = 0;
+    est->offset_us = 0;
+    est->period_us = nominal != 0 ? 1000000.0 / nominal : 0;
+    est->err_var = 0;
+    est->elapsed_us = 0;
+    est->bandwidth = I2S_DRIFT_LOCK_BW_HZ;
+    est->a = 0;
+    est->b = 0;
+    est->interval_us = 0;
+}
+
+void i2s_drift_update(I2S_DRIFT_ESTIMATOR* est, uint32_t frames, uint32_t time_us){
+    uint32_t n = frames - est->last_frames;
+    uint32_t d = time_us - est->last_time_us;
+    double e, c, w, sigma;
+
+    if (est->nominal == 0){
+        return;
+    }
+    //Time going backwards, or too far apart to tell
+    if (est->started == false || (int32_t)d < 0){
+        i2s_drift_init(est, est->nominal);
+        est->started = true;
+        est->last_frames = frames;
+        est->last_time_us = time_us;
+        return;
+    }
+    //Same completion seen again
+    if (n == 0){
+        return;
+    }
+
+    //Filtered time of the last observation plus n periods against the measured time
+    e = (double)d - est->offset_us - n * est->period_us;
+    est->err_var += ((e * e) - est->err_var) * (est->interval_us == 0 ? 1.0 : DRIFT_VAR_ALPHA);
+    est->elapsed_us += d;
+    est->interval_us += (d - est->interval_us) * (est->interval_us == 0 ? 1.0 : DRIFT_VAR_ALPHA);
+
+    c = e;
+    if (est->err_var > DRIFT_VAR_MIN && est->elapsed_us > 1000000.0 / I2S_DRIFT_LOCK_BW_HZ){
+        sigma = DRIFT_CLIP_SIGMA * sqrt(est->err_var);
+        if (c > sigma){
+            c = sigma;
+        }
+        else if (c < -sigma){
+            c = -sigma;
+        }
+    }
+
+    //Bandwidth narrows as 1/elapsed while locking (a growing average), then stays at I2S_DRIFT_BW_HZ
+    est->bandwidth = 500000.0 / est->elapsed_us;
+    if (est->bandwidth > I2S_DRIFT_LOCK_BW_HZ){
+        est->bandwidth = I2S_DRIFT_LOCK_BW_HZ;
+    }
+    else if (est->bandwidth < I2S_DRIFT_BW_HZ){
+        est->bandwidth = I2S_DRIFT_BW_HZ;
+    }
+
+    //Second order DLL, critically damped
+    w = 2 * M_PI * est->bandwidth * d / 1000000.0;
+    if (w > 0.5){
+        w = 0.5;
+    }
+    est->a = M_SQRT2 * w;
+    est->b = w * w;
+    est->offset_us = est->a * c - e;
+    est->period_us += est->b * c / n;
+
+    est->last_frames = frames;
+    est->last_time_us = time_us;
+}
+
+void i2s_drift_result(const I2S_DRIFT_ESTIMATOR* est, I2S_DRIFT* drift){
+    double var, window, t, u;
+
+    if (est->started == false || est->elapsed_us == 0 || est->period_us <= 0){
+        drift->frames_per_second = est->nominal;
+        drift->ppm = 0;
+        drift->uncertainty_ppm = INFINITY;
+        drift->confidence = 0;
+        return;
+    }
+
+    drift->frames_per_second = 1000000.0 / est->period_us;
+    drift->ppm = (drift->frames_per_second / est->nominal - 1.0) * 1000000.0;
+
+    //Slope of a least squares line through window / t points with error sigma
+    var = est->err_var > DRIFT_VAR_MIN ? est->err_var : DRIFT_VAR_MIN;
+    window = 1.0 / (2 * est->bandwidth);
+    if (window > est->elapsed_us / 1000000.0){
+        window = est->elapsed_us / 1000000.0;
+    }
+    t = est->interval_us / 1000000.0;
+    u = sqrt(12 * t * var) / (window * sqrt(window));
+    drift->uncertainty_ppm = u;
+    drift->confidence = 1.0 / (1.0 + (u / I2S_DRIFT_CONF_PPM) * (u / I2S_DRIFT_CONF_PPM));
+}
+
+void i2s_get_drift(I2S_DRIFT* drift){
+    I2S_TIMESTAMP ts;
+
+    if (i2s_get_timestamp(&ts) == true){
+        if (drift_epoch_valid == false || ts.epoch != drift_epoch){
+            i2s_drift_init(&drift_est, ts.audio_clock);
+            drift_epoch = ts.epoch;
+            drift_epoch_valid = true;
+        }
+        i2s_drift_update(&drift_est, ts.frames, ts.time_us);
+    }
+    i2s_drift_result(&drift_est, drift);
+}
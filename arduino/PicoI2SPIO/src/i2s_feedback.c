@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_feedback.c
+ * @brief USB asynchronous feedback value from the i2s buffer level
+ *
+ */
+
+#include "i2s.h"
+#include "i2s_feedback.h"
+
+//Gains and integral in Q32 frames/ms
+static int64_t fb_kp = (int64_t)1 << 24;
+static int64_t fb_ki = (int64_t)1 << 14;
+static int64_t fb_integral;
+
+//Q16 frames/ms
+static uint32_t fb_nominal;
+static uint32_t fb_limit;
+
+static uint32_t fb_target;
+static FEEDBACK_FORMAT fb_format;
+static uint32_t fb_value;
+
+/**
+ * @brief Convert Q16 frames/ms to the feedback format
+ *
+ * @param q16 Q16 frames/ms
+ */
+static uint32_t i2s_feedback_format(uint32_t q16){
+    if (fb_format == FEEDBACK_FORMAT_16_16){
+        return q16 >> 3;
+    }
+    return q16 >> 2;
+}
+
+void i2s_feedback_init(uint32_t audio_clock, uint32_t target_frames, FEEDBACK_FORMAT format){
+    uint32_t packet = audio_clock / 1000 < i2s_get_buf_frames() ? audio_clock / 1000 : i2s_get_buf_frames();
+
+    fb_nominal = (uint32_t)(((uint64_t)audio_clock << 16) / 1000);
+    //±3%, well inside what hosts accept
+    fb_limit = fb_nominal >> 5;
+    //Half the queue of 1ms packets, as configured by i2s_set_buffer
+    fb_target = target_frames != 0 ? target_frames : i2s_get_buf_depth() * packet / 2;
+    fb_format = format;
+    fb_integral = 0;
+    fb_value = i2s_feedback_format(fb_nominal);
+}
+
+void i2s_feedback_set_gain(float kp, float ki){
+    fb_kp = (int64_t)(kp * 4294967296.0f);
+    fb_ki = (int64_t)(ki * 4294967296.0f);
+}
+
+uint32_t i2s_feedback_update_level(uint32_t level_frames){
+    int32_t error = (int32_t)fb_target - (int32_t)level_frames;
+    int64_t limit = (int64_t)fb_limit << 16;
+    int64_t dev;
+
+    //Integral is clamped to the output range so it can not wind up
+    fb_integral += fb_ki * error;
+    if (fb_integral > limit){
+        fb_integral = limit;
+    }
+    else if (fb_integral < -limit){
+        fb_integral = -limit;
+    }
+
+    dev = (fb_kp * error + fb_integral) >> 16;
+    if (dev > (int64_t)fb_limit){
+        dev = fb_limit;
+    }
+    else if (dev < -(int64_t)fb_limit){
+        dev = -(int64_t)fb_limit;
+    }
+
+    fb_value = i2s_feedback_format((uint32_t)((int64_t)fb_nominal + dev));
+    return fb_value;
+}
+
+uint32_t i2s_feedback_update(void){
+    //Counts the running transfer too, so the level does not step by a packet each time DMA takes one
+    return i2s_feedback_update_level(i2s_get_buffered_frames());
+}
+
+uint32_t i2s_feedback_get(void){
+    return fb_value;
+}
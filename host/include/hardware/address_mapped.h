@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/address_mapped.h
+ * @brief Host stub of hardware_base register access; registers are plain variables
+ */
+
+#ifndef PICO_HOST_ADDRESS_MAPPED_H
+#define PICO_HOST_ADDRESS_MAPPED_H
+#include "pico/types.h"
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+
+static inline void hw_set_bits(io_rw_32* addr, uint32_t mask) { *addr |= mask; }
+static inline void hw_clear_bits(io_rw_32* addr, uint32_t mask) { *addr &= ~mask; }
+
+#endif
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/clocks.h
+ * @brief Host stub of hardware_clocks; clock frequencies are plain variables
+ */
+
+#ifndef PICO_HOST_CLOCKS_H
+#define PICO_HOST_CLOCKS_H
+#include "pico/types.h"
+#include "hardware/address_mapped.h"
+
+enum clock_index {
+    clk_gpout0 = 0,
+    clk_gpout1,
+    clk_gpout2,
+    clk_gpout3,
+    clk_ref,
+    clk_sys,
+    clk_peri,
+    clk_usb,
+    clk_adc,
+    clk_rtc,
+    CLK_COUNT
+};
+
+#define USB_CLK_HZ (48 * MHZ)
+#define XOSC_HZ (12 * MHZ)
+
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX 0x1
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS 0x0
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x1
+#define CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS 0x6
+#define CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_LSB 5
+#define CLOCKS_CLK_GPOUT0_CTRL_ENABLE_BITS 0x00000800
+#define CLOCKS_CLK_GPOUT0_CTRL_DC50_BITS 0x00001000
+
+//GPOUT generators divide by DIV / 256 while CTRL.ENABLE is set
+typedef struct {
+    io_rw_32 ctrl;
+    io_rw_32 div;
+    io_ro_32 selected;
+} clock_hw_t;
+
+typedef struct {
+    clock_hw_t clk[CLK_COUNT];
+} clocks_hw_t;
+
+extern clocks_hw_t pico_host_clocks_hw;
+#define clocks_hw (&pico_host_clocks_hw)
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq);
+void clock_configure_undivided(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq);
+void clock_configure_int_divider(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t int_divider);
+bool clock_configure_gpin(enum clock_index clk_index, uint gpio, uint32_t src_freq, uint32_t freq);
+void clock_stop(enum clock_index clk_index);
+
+#endif
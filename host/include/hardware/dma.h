@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/dma.h
+ * @brief Host stub of hardware_dma; transfers are recorded and completed on demand
+ */
+
+#ifndef PICO_HOST_DMA_H
+#define PICO_HOST_DMA_H
+#include "pico/types.h"
+#include "hardware/irq.h"
+
+#define NUM_DMA_CHANNELS 12
+#define DREQ_FORCE 0x3f
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+    bool read_increment;
+    bool write_increment;
+    enum dma_channel_transfer_size size;
+    uint dreq;
+    uint chain_to;
+    bool ring_sel;
+    uint ring_size_bits;
+    bool irq_quiet;
+    bool enable;
+} dma_channel_config;
+
+//Registers are pointer sized so that control blocks written by DMA can hold host addresses
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uintptr_t transfer_count;
+    volatile uintptr_t ctrl_trig;
+    volatile uintptr_t al1_ctrl;
+    volatile uintptr_t al1_read_addr;
+    volatile uintptr_t al1_write_addr;
+    volatile uintptr_t al1_transfer_count_trig;
+    volatile uintptr_t al2_ctrl;
+    volatile uintptr_t al2_transfer_count;
+    volatile uintptr_t al2_read_addr;
+    volatile uintptr_t al2_write_addr_trig;
+    volatile uintptr_t al3_ctrl;
+    volatile uintptr_t al3_write_addr;
+    volatile uintptr_t al3_transfer_count;
+    volatile uintptr_t al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    volatile uint32_t intr;
+    volatile uint32_t inte0;
+    volatile uint32_t intf0;
+    volatile uint32_t ints0;
+    volatile uint32_t inte1;
+    volatile uint32_t intf1;
+    volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t pico_host_dma_hw;
+#define dma_hw (&pico_host_dma_hw)
+
+static inline dma_channel_hw_t* dma_channel_hw_addr(uint channel) { return &dma_hw->ch[channel]; }
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr) { c->read_increment = incr; }
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr) { c->write_increment = incr; }
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size) { c->size = size; }
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq) { c->dreq = dreq; }
+static inline void channel_config_set_chain_to(dma_channel_config* c, uint chain_to) { c->chain_to = chain_to; }
+static inline void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits) { c->ring_sel = write; c->ring_size_bits = size_bits; }
+static inline void channel_config_set_irq_quiet(dma_channel_config* c, bool irq_quiet) { c->irq_quiet = irq_quiet; }
+static inline void channel_config_set_enable(dma_channel_config* c, bool enable) { c->enable = enable; }
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+bool dma_channel_is_claimed(uint channel);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr, const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_config(uint channel, const dma_channel_config* config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void* read_addr, uint32_t transfer_count);
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void* write_addr, uint32_t transfer_count);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+void dma_start_channel_mask(uint32_t chan_mask);
+static inline bool dma_channel_get_irq0_status(uint channel) { return dma_hw->ints0 & (1u << channel); }
+static inline bool dma_channel_get_irq1_status(uint channel) { return dma_hw->ints1 & (1u << channel); }
+static inline void dma_channel_acknowledge_irq0(uint channel) { dma_hw->ints0 &= ~(1u << channel); }
+static inline void dma_channel_acknowledge_irq1(uint channel) { dma_hw->ints1 &= ~(1u << channel); }
+static inline void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled) {
+    if (irq_index == 0) dma_channel_set_irq0_enabled(channel, enabled);
+    else dma_channel_set_irq1_enabled(channel, enabled);
+}
+static inline bool dma_irqn_get_channel_status(uint irq_index, uint channel) {
+    return irq_index == 0 ? dma_channel_get_irq0_status(channel) : dma_channel_get_irq1_status(channel);
+}
+static inline void dma_irqn_acknowledge_channel(uint irq_index, uint channel) {
+    if (irq_index == 0) dma_channel_acknowledge_irq0(channel);
+    else dma_channel_acknowledge_irq1(channel);
+}
+
+#endif
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/irq.h
+ * @brief Host stub of hardware_irq; handlers are recorded and fired on demand
+ */
+
+#ifndef PICO_HOST_IRQ_H
+#define PICO_HOST_IRQ_H
+#include "pico/types.h"
+
+typedef void (*irq_handler_t)(void);
+
+enum {
+    DMA_IRQ_0 = 11,
+    DMA_IRQ_1 = 12,
+    NUM_IRQS = 32
+};
+
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_priority(uint num, uint8_t hardware_priority);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
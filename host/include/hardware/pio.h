@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/pio.h
+ * @brief Host stub of hardware_pio
+ *
+ * State machine configurations, loaded instruction memory, FIFO writes and
+ * clock dividers are recorded in pico_host_pio[] for inspection.
+ */
+
+#ifndef PICO_HOST_PIO_H
+#define PICO_HOST_PIO_H
+#include "pico/types.h"
+#include "hardware/pio_instructions.h"
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+typedef struct {
+    uint16_t clkdiv_int;
+    uint8_t clkdiv_frac;
+    uint wrap_target;
+    uint wrap;
+    uint sideset_count;
+    bool sideset_optional;
+    bool sideset_pindirs;
+    uint out_base;
+    uint out_count;
+    uint set_base;
+    uint set_count;
+    uint in_base;
+    uint sideset_base;
+    uint jmp_pin;
+    bool out_shift_right;
+    bool autopull;
+    uint pull_threshold;
+    bool in_shift_right;
+    bool autopush;
+    uint push_threshold;
+    enum pio_fifo_join fifo_join;
+    uint exec_ctrl;
+} pio_sm_config;
+
+typedef struct pio_program {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+typedef struct {
+    volatile uint32_t txf[NUM_PIO_STATE_MACHINES];
+    volatile uint32_t rxf[NUM_PIO_STATE_MACHINES];
+    uint16_t instr_mem[PIO_INSTRUCTION_COUNT];
+    uint32_t used_instruction_space;
+    pio_sm_config sm_config[NUM_PIO_STATE_MACHINES];
+    uint sm_offset[NUM_PIO_STATE_MACHINES];
+    uint sm_enabled_mask;
+    uint32_t sm_pindirs;
+    uint32_t sm_pins;
+    uint32_t sm_exec_count[NUM_PIO_STATE_MACHINES];
+    uint16_t sm_last_exec[NUM_PIO_STATE_MACHINES];
+    uint32_t sm_restart_count[NUM_PIO_STATE_MACHINES];
+    uint32_t sm_claimed_mask;
+    volatile uint32_t input_sync_bypass;   //1: GPIO read without the 2 cycle synchronizer
+} pio_hw_t;
+
+typedef pio_hw_t* PIO;
+
+extern pio_hw_t pico_host_pio[NUM_PIOS];
+#define pio0 (&pico_host_pio[0])
+#define pio1 (&pico_host_pio[1])
+
+static inline uint pio_get_index(PIO pio) { return pio == pio1 ? 1 : 0; }
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) { return pio_get_index(pio) * 8 + (is_tx ? 0 : 4) + sm; }
+
+pio_sm_config pio_get_default_sm_config(void);
+static inline void sm_config_set_wrap(pio_sm_config* c, uint wrap_target, uint wrap) { c->wrap_target = wrap_target; c->wrap = wrap; }
+static inline void sm_config_set_sideset(pio_sm_config* c, uint bit_count, bool optional, bool pindirs) { c->sideset_count = bit_count; c->sideset_optional = optional; c->sideset_pindirs = pindirs; }
+static inline void sm_config_set_sideset_pins(pio_sm_config* c, uint sideset_base) { c->sideset_base = sideset_base; }
+static inline void sm_config_set_out_pins(pio_sm_config* c, uint out_base, uint out_count) { c->out_base = out_base; c->out_count = out_count; }
+static inline void sm_config_set_set_pins(pio_sm_config* c, uint set_base, uint set_count) { c->set_base = set_base; c->set_count = set_count; }
+static inline void sm_config_set_in_pins(pio_sm_config* c, uint in_base) { c->in_base = in_base; }
+static inline void sm_config_set_jmp_pin(pio_sm_config* c, uint pin) { c->jmp_pin = pin; }
+static inline void sm_config_set_out_shift(pio_sm_config* c, bool shift_right, bool autopull, uint pull_threshold) { c->out_shift_right = shift_right; c->autopull = autopull; c->pull_threshold = pull_threshold; }
+static inline void sm_config_set_in_shift(pio_sm_config* c, bool shift_right, bool autopush, uint push_threshold) { c->in_shift_right = shift_right; c->autopush = autopush; c->push_threshold = push_threshold; }
+static inline void sm_config_set_fifo_join(pio_sm_config* c, enum pio_fifo_join join) { c->fifo_join = join; }
+static inline void sm_config_set_clkdiv_int_frac8(pio_sm_config* c, uint32_t div_int, uint8_t div_frac) { c->clkdiv_int = (uint16_t)div_int; c->clkdiv_frac = div_frac; }
+static inline void sm_config_set_clkdiv_int_frac(pio_sm_config* c, uint16_t div_int, uint8_t div_frac) { sm_config_set_clkdiv_int_frac8(c, div_int, div_frac); }
+void sm_config_set_clkdiv(pio_sm_config* c, float div);
+
+bool pio_can_add_program(PIO pio, const pio_program_t* program);
+int pio_add_program(PIO pio, const pio_program_t* program);
+void pio_remove_program(PIO pio, const pio_program_t* program, uint loaded_offset);
+void pio_clear_instruction_memory(PIO pio);
+
+void pio_sm_claim(PIO pio, uint sm);
+void pio_sm_unclaim(PIO pio, uint sm);
+bool pio_sm_is_claimed(PIO pio, uint sm);
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config* config);
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config* config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled);
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+void pio_sm_set_clkdiv_int_frac8(PIO pio, uint sm, uint32_t div_int, uint8_t div_frac);
+static inline void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) { pio_sm_set_clkdiv_int_frac8(pio, sm, div_int, div_frac); }
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_drain_tx_fifo(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+static inline void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) { pio_sm_put(pio, sm, data); }
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values);
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+void pio_gpio_init(PIO pio, uint pin);
+
+#endif
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/pll.h
+ * @brief Host stub of hardware_pll; pll_init only records its arguments and counts the calls
+ */
+
+#ifndef PICO_HOST_PLL_H
+#define PICO_HOST_PLL_H
+#include "pico/types.h"
+
+typedef struct {
+    uint refdiv;
+    uint32_t vco_freq;
+    uint post_div1;
+    uint post_div2;
+    bool enabled;
+    uint32_t inits;         //pll_init calls, each one a relock on hardware
+} pll_hw_t;
+
+typedef pll_hw_t* PLL;
+
+extern pll_hw_t pico_host_pll[2];
+#define pll_sys (&pico_host_pll[0])
+#define pll_usb (&pico_host_pll[1])
+
+void pll_init(PLL pll, uint refdiv, uint vco_freq, uint post_div1, uint post_div2);
+void pll_deinit(PLL pll);
+
+#endif
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/sync.h
+ * @brief Host stub of hardware_sync (fences, interrupt masking, spin locks)
+ */
+
+#ifndef PICO_HOST_SYNC_H
+#define PICO_HOST_SYNC_H
+#include "pico/types.h"
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __mem_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+static inline void __mem_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+static inline void __wfe(void) {}
+static inline void __sev(void) {}
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+uint spin_lock_claim_unused(bool required);
+spin_lock_t* spin_lock_init(uint lock_num);
+uint32_t spin_lock_blocking(spin_lock_t* lock);
+void spin_unlock(spin_lock_t* lock, uint32_t saved_irq);
+
+#endif
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file hardware/vreg.h
+ * @brief Host stub of hardware_vreg
+ */
+
+#ifndef PICO_HOST_VREG_H
+#define PICO_HOST_VREG_H
+#include "pico/types.h"
+
+enum vreg_voltage {
+    VREG_VOLTAGE_0_85 = 6,
+    VREG_VOLTAGE_0_90,
+    VREG_VOLTAGE_0_95,
+    VREG_VOLTAGE_1_00,
+    VREG_VOLTAGE_1_05,
+    VREG_VOLTAGE_1_10,
+    VREG_VOLTAGE_1_15,
+    VREG_VOLTAGE_1_20,
+    VREG_VOLTAGE_1_25,
+    VREG_VOLTAGE_1_30,
+    VREG_VOLTAGE_DEFAULT = VREG_VOLTAGE_1_10
+};
+
+void vreg_set_voltage(enum vreg_voltage voltage);
+
+#endif
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico/multicore.h
+ * @brief Host stub of pico_multicore; core1 entry points are recorded, not run
+ */
+
+#ifndef PICO_HOST_MULTICORE_H
+#define PICO_HOST_MULTICORE_H
+#include "pico/types.h"
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+#endif
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico/stdlib.h
+ * @brief Host stub of pico_stdlib (gpio, time)
+ */
+
+#ifndef PICO_HOST_STDLIB_H
+#define PICO_HOST_STDLIB_H
+#include "pico/types.h"
+#include "hardware/gpio.h"
+#include "pico/time.h"
+
+//Advances the system timer by 1us and runs the idle handler, see pico_host_set_idle_handler
+void tight_loop_contents(void);
+static inline bool running_on_fpga(void) { return false; }
+
+#endif
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico/time.h
+ * @brief Host stub of pico_time, backed by a settable 1MHz counter
+ */
+
+#ifndef PICO_HOST_TIME_H
+#define PICO_HOST_TIME_H
+#include "pico/types.h"
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t* rt);
+
+struct repeating_timer {
+    int64_t delay_us;
+    int32_t alarm_id;
+    repeating_timer_callback_t callback;
+    void* user_data;
+};
+
+//Timers run from sleep_us, tight_loop_contents and pico_host_advance_time_us when they are due
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out);
+static inline bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out) {
+    return add_repeating_timer_us((int64_t)delay_ms * 1000, callback, user_data, out);
+}
+bool cancel_repeating_timer(repeating_timer_t* timer);
+
+#endif
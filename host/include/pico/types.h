@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico/types.h
+ * @brief Host stub of the pico-sdk base types
+ */
+
+#ifndef PICO_HOST_TYPES_H
+#define PICO_HOST_TYPES_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+#ifndef __force_inline
+#define __force_inline inline __attribute__((always_inline))
+#endif
+#define __isr
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+#define __aligned(x) __attribute__((aligned(x)))
+#define __unused __attribute__((unused))
+
+#define KHZ 1000
+#define MHZ 1000000
+
+#define PICO_NO_HARDWARE 0
+#define PICO_ON_DEVICE 0
+#define PICO_DEFAULT_LED_PIN 25
+
+#define hard_assert(x) ((void)(x))
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#endif
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico_host.h
+ * @brief Inspection and stimulus API of the host hardware stubs
+ *
+ * The stubs keep every register-level side effect of the library in plain
+ * structures (pico_host_pio[], pico_host_dma_hw, pico_host_pll[], clocks_hw) so host
+ * programs can check configurations and drive DMA completions by hand.
+ */
+
+#ifndef PICO_HOST_H
+#define PICO_HOST_H
+#include "pico/types.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/irq.h"
+#include "hardware/vreg.h"
+#include "hardware/gpio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const volatile void* read_addr;
+    volatile void* write_addr;
+    uint32_t transfer_count;
+    uint32_t transfers;
+    bool busy;
+    bool irq0_enabled;
+    bool irq1_enabled;
+    bool claimed;
+    dma_channel_config config;
+} pico_host_dma_channel_t;
+
+extern pico_host_dma_channel_t pico_host_dma[NUM_DMA_CHANNELS];
+
+/**
+ * @brief Restore every stub to its power-on state
+ *
+ * @param sys_hz clk_sys frequency to report
+ */
+void pico_host_reset(uint32_t sys_hz);
+
+/**
+ * @brief Advance the 1MHz system timer
+ *
+ * @param us Microseconds to add
+ * @note Runs the repeating timers that became due
+ */
+void pico_host_advance_time_us(uint64_t us);
+
+/**
+ * @brief Register a function run while the library waits
+ *
+ * @param handler Called from tight_loop_contents, sleep_us and sleep_ms with the current time, NULL to remove
+ * @note Lets host programs complete DMA transfers while a blocking call polls for them
+ */
+void pico_host_set_idle_handler(void (*handler)(uint64_t now_us));
+
+/**
+ * @brief Finish the transfer running on a DMA channel
+ *
+ * @param channel DMA channel
+ * @note Raises DMA_IRQ_0/1 and calls the registered handlers when enabled
+ */
+void pico_host_dma_complete(uint channel);
+
+/**
+ * @brief Call every handler registered for an interrupt
+ *
+ * @param num IRQ number
+ */
+void pico_host_irq_fire(uint num);
+
+/**
+ * @brief Entry point handed to multicore_launch_core1, or NULL
+ */
+void (*pico_host_core1_entry(void))(void);
+
+/**
+ * @brief Run the function launched on core1 until it waits for a DMA transfer
+ *
+ * @note core1 is a coroutine on the calling thread. It resumes where dma_channel_wait_for_finish_blocking suspended it
+ * once the host program has completed the transfer with pico_host_dma_complete, so a host program calls this from its
+ * idle handler. multicore_reset_core1 drops it
+ */
+void pico_host_core1_run(void);
+
+/**
+ * @brief Last voltage passed to vreg_set_voltage
+ */
+enum vreg_voltage pico_host_vreg_voltage(void);
+
+/**
+ * @brief Clock divider of a state machine as a float
+ */
+float pico_host_sm_clkdiv(PIO pio, uint sm);
+
+/**
+ * @brief Drive the level returned by gpio_get
+ */
+void pico_host_gpio_set_input(uint gpio, bool value);
+
+/**
+ * @brief Level written by gpio_put
+ */
+bool pico_host_gpio_output(uint gpio);
+
+/**
+ * @brief Function selected by gpio_set_function or pio_gpio_init, GPIO_FUNC_NULL after reset
+ */
+enum gpio_function pico_host_gpio_function(uint gpio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
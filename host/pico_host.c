@@ -0,0 +1,750 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pico_host.c
+ * @brief Host (Linux) stubs of the pico-sdk hardware APIs used by pico-i2s-pio
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/pll.h"
+#include "hardware/vreg.h"
+#include "hardware/irq.h"
+#include "pico_host.h"
+
+#define HOST_MAX_SHARED_HANDLERS 4
+#define HOST_MAX_TIMERS 4
+#define HOST_CORE1_STACK (256 * 1024)
+
+pio_hw_t pico_host_pio[NUM_PIOS];
+dma_hw_t pico_host_dma_hw;
+pll_hw_t pico_host_pll[2];
+clocks_hw_t pico_host_clocks_hw;
+pico_host_dma_channel_t pico_host_dma[NUM_DMA_CHANNELS];
+
+static uint64_t host_time_us;
+static uint32_t host_clock_hz[CLK_COUNT];
+static uint32_t host_gpio_out;
+static uint32_t host_gpio_in;
+static uint32_t host_gpio_dir;
+static uint8_t host_gpio_func[32];
+static uint32_t host_spin_lock_claimed;
+static spin_lock_t host_spin_locks[32];
+static enum vreg_voltage host_vreg = VREG_VOLTAGE_DEFAULT;
+static void (*host_core1_entry)(void);
+static ucontext_t host_core0_context;
+static ucontext_t host_core1_context;
+static void* host_core1_stack;
+static bool host_on_core1;
+static void (*host_idle_handler)(uint64_t now_us);
+static repeating_timer_t* host_timers[HOST_MAX_TIMERS];
+static uint64_t host_timer_due[HOST_MAX_TIMERS];
+
+static irq_handler_t host_irq_handlers[NUM_IRQS][HOST_MAX_SHARED_HANDLERS];
+static uint8_t host_irq_priority[NUM_IRQS];
+static uint32_t host_irq_enabled;
+
+void pico_host_reset(uint32_t sys_hz){
+    memset(pico_host_pio, 0, sizeof(pico_host_pio));
+    memset(&pico_host_dma_hw, 0, sizeof(pico_host_dma_hw));
+    memset(pico_host_pll, 0, sizeof(pico_host_pll));
+    memset(&pico_host_clocks_hw, 0, sizeof(pico_host_clocks_hw));
+    memset(pico_host_dma, 0, sizeof(pico_host_dma));
+    memset(host_irq_handlers, 0, sizeof(host_irq_handlers));
+    memset(host_irq_priority, 0, sizeof(host_irq_priority));
+    memset(host_clock_hz, 0, sizeof(host_clock_hz));
+    host_irq_enabled = 0;
+    host_time_us = 0;
+    host_gpio_out = host_gpio_in = host_gpio_dir = 0;
+    memset(host_gpio_func, GPIO_FUNC_NULL, sizeof(host_gpio_func));
+    host_spin_lock_claimed = 0;
+    host_vreg = VREG_VOLTAGE_DEFAULT;
+    multicore_reset_core1();
+    host_idle_handler = NULL;
+    memset(host_timers, 0, sizeof(host_timers));
+
+    host_clock_hz[clk_ref] = XOSC_HZ;
+    host_clock_hz[clk_sys] = sys_hz;
+    host_clock_hz[clk_peri] = sys_hz;
+    host_clock_hz[clk_usb] = USB_CLK_HZ;
+    host_clock_hz[clk_adc] = USB_CLK_HZ;
+}
+
+//time
+uint64_t time_us_64(void){
+    return host_time_us;
+}
+
+/**
+ * @brief Run the repeating timers that are due, in the order they were added
+ */
+static void host_run_timers(void){
+    for (int i = 0; i < HOST_MAX_TIMERS; i++){
+        repeating_timer_t* t = host_timers[i];
+        while (t != NULL && host_time_us >= host_timer_due[i]){
+            host_timer_due[i] += t->delay_us < 0 ? -t->delay_us : t->delay_us;
+            if (t->callback(t) == false){
+                host_timers[i] = NULL;
+            }
+            t = host_timers[i];
+        }
+    }
+}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void* user_data, repeating_timer_t* out){
+    if (delay_us == 0){
+        return false;
+    }
+    for (int i = 0; i < HOST_MAX_TIMERS; i++){
+        if (host_timers[i] == NULL){
+            out->delay_us = delay_us;
+            out->alarm_id = i + 1;
+            out->callback = callback;
+            out->user_data = user_data;
+            host_timers[i] = out;
+            host_timer_due[i] = host_time_us + (delay_us < 0 ? -delay_us : delay_us);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cancel_repeating_timer(repeating_timer_t* timer){
+    for (int i = 0; i < HOST_MAX_TIMERS; i++){
+        if (host_timers[i] == timer){
+            host_timers[i] = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+void sleep_us(uint64_t us){
+    host_time_us += us;
+    host_run_timers();
+    if (host_idle_handler != NULL){
+        host_idle_handler(host_time_us);
+    }
+}
+
+void sleep_ms(uint32_t ms){
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void tight_loop_contents(void){
+    sleep_us(1);
+}
+
+void pico_host_set_idle_handler(void (*handler)(uint64_t now_us)){
+    host_idle_handler = handler;
+}
+
+void pico_host_advance_time_us(uint64_t us){
+    host_time_us += us;
+    host_run_timers();
+}
+
+//gpio
+void gpio_init(uint gpio){
+    host_gpio_dir &= ~(1u << gpio);
+    host_gpio_out &= ~(1u << gpio);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn){
+    host_gpio_func[gpio] = fn;
+}
+
+void gpio_set_dir(uint gpio, bool out){
+    if (out) host_gpio_dir |= 1u << gpio;
+    else host_gpio_dir &= ~(1u << gpio);
+}
+
+void gpio_put(uint gpio, bool value){
+    if (value) host_gpio_out |= 1u << gpio;
+    else host_gpio_out &= ~(1u << gpio);
+}
+
+bool gpio_get(uint gpio){
+    return (host_gpio_in >> gpio) & 1u;
+}
+
+void pico_host_gpio_set_input(uint gpio, bool value){
+    if (value) host_gpio_in |= 1u << gpio;
+    else host_gpio_in &= ~(1u << gpio);
+}
+
+bool pico_host_gpio_output(uint gpio){
+    return (host_gpio_out >> gpio) & 1u;
+}
+
+enum gpio_function pico_host_gpio_function(uint gpio){
+    return (enum gpio_function)host_gpio_func[gpio];
+}
+
+//sync
+uint32_t save_and_disable_interrupts(void){
+    return 0;
+}
+
+void restore_interrupts(uint32_t status){
+    (void)status;
+}
+
+uint spin_lock_claim_unused(bool required){
+    (void)required;
+    for (uint i = 0; i < 32; i++){
+        if (!(host_spin_lock_claimed & (1u << i))){
+            host_spin_lock_claimed |= 1u << i;
+            return i;
+        }
+    }
+    return 0;
+}
+
+spin_lock_t* spin_lock_init(uint lock_num){
+    host_spin_locks[lock_num] = 0;
+    return &host_spin_locks[lock_num];
+}
+
+uint32_t spin_lock_blocking(spin_lock_t* lock){
+    *lock = 1;
+    return 0;
+}
+
+void spin_unlock(spin_lock_t* lock, uint32_t saved_irq){
+    (void)saved_irq;
+    *lock = 0;
+}
+
+//multicore
+void multicore_launch_core1(void (*entry)(void)){
+    multicore_reset_core1();
+    host_core1_entry = entry;
+}
+
+void multicore_reset_core1(void){
+    //A suspended core1 is dropped with its stack
+    free(host_core1_stack);
+    host_core1_stack = NULL;
+    host_core1_entry = NULL;
+}
+
+static void host_core1_start(void){
+    host_core1_entry();
+    //Returning resumes core0 through uc_link
+    host_core1_entry = NULL;
+}
+
+void pico_host_core1_run(void){
+    if (host_core1_entry == NULL || host_on_core1){
+        return;
+    }
+    if (host_core1_stack == NULL){
+        host_core1_stack = malloc(HOST_CORE1_STACK);
+        getcontext(&host_core1_context);
+        host_core1_context.uc_stack.ss_sp = host_core1_stack;
+        host_core1_context.uc_stack.ss_size = HOST_CORE1_STACK;
+        host_core1_context.uc_link = &host_core0_context;
+        makecontext(&host_core1_context, host_core1_start, 0);
+    }
+    host_on_core1 = true;
+    swapcontext(&host_core0_context, &host_core1_context);
+    host_on_core1 = false;
+}
+
+void (*pico_host_core1_entry(void))(void){
+    return host_core1_entry;
+}
+
+//vreg
+void vreg_set_voltage(enum vreg_voltage voltage){
+    host_vreg = voltage;
+}
+
+enum vreg_voltage pico_host_vreg_voltage(void){
+    return host_vreg;
+}
+
+//pll
+void pll_init(PLL pll, uint refdiv, uint vco_freq, uint post_div1, uint post_div2){
+    pll->refdiv = refdiv;
+    pll->vco_freq = vco_freq;
+    pll->post_div1 = post_div1;
+    pll->post_div2 = post_div2;
+    pll->enabled = true;
+    pll->inits++;
+}
+
+void pll_deinit(PLL pll){
+    pll->enabled = false;
+}
+
+//clocks
+static uint32_t host_clock_source_hz(uint32_t auxsrc, uint32_t src_freq){
+    (void)auxsrc;
+    return src_freq;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index){
+    return host_clock_hz[clk_index];
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq){
+    (void)src;
+    (void)auxsrc;
+    if (freq > src_freq) return false;
+    host_clock_hz[clk_index] = freq;
+    return true;
+}
+
+void clock_configure_undivided(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq){
+    (void)src;
+    host_clock_hz[clk_index] = host_clock_source_hz(auxsrc, src_freq);
+}
+
+void clock_configure_int_divider(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t int_divider){
+    (void)src;
+    host_clock_hz[clk_index] = host_clock_source_hz(auxsrc, src_freq) / int_divider;
+}
+
+bool clock_configure_gpin(enum clock_index clk_index, uint gpio, uint32_t src_freq, uint32_t freq){
+    (void)gpio;
+    host_clock_hz[clk_index] = freq <= src_freq ? freq : src_freq;
+    return true;
+}
+
+void clock_stop(enum clock_index clk_index){
+    host_clock_hz[clk_index] = 0;
+}
+
+//irq
+void irq_set_exclusive_handler(uint num, irq_handler_t handler){
+    host_irq_handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority){
+    (void)order_priority;
+    for (int i = 0; i < HOST_MAX_SHARED_HANDLERS; i++){
+        if (host_irq_handlers[num][i] == NULL){
+            host_irq_handlers[num][i] = handler;
+            return;
+        }
+    }
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler){
+    for (int i = 0; i < HOST_MAX_SHARED_HANDLERS; i++){
+        if (host_irq_handlers[num][i] == handler){
+            host_irq_handlers[num][i] = NULL;
+        }
+    }
+}
+
+void irq_set_priority(uint num, uint8_t hardware_priority){
+    host_irq_priority[num] = hardware_priority;
+}
+
+void irq_set_enabled(uint num, bool enabled){
+    if (enabled) host_irq_enabled |= 1u << num;
+    else host_irq_enabled &= ~(1u << num);
+}
+
+void pico_host_irq_fire(uint num){
+    if (!(host_irq_enabled & (1u << num))) return;
+    for (int i = 0; i < HOST_MAX_SHARED_HANDLERS; i++){
+        if (host_irq_handlers[num][i]) host_irq_handlers[num][i]();
+    }
+}
+
+//dma
+dma_channel_config dma_channel_get_default_config(uint channel){
+    dma_channel_config c;
+    memset(&c, 0, sizeof(c));
+    c.read_increment = true;
+    c.write_increment = false;
+    c.size = DMA_SIZE_32;
+    c.dreq = 0x3f;
+    c.chain_to = channel;
+    c.enable = true;
+    return c;
+}
+
+int dma_claim_unused_channel(bool required){
+    (void)required;
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++){
+        if (!pico_host_dma[i].claimed){
+            pico_host_dma[i].claimed = true;
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void dma_channel_claim(uint channel){
+    pico_host_dma[channel].claimed = true;
+}
+
+void dma_channel_unclaim(uint channel){
+    pico_host_dma[channel].claimed = false;
+}
+
+bool dma_channel_is_claimed(uint channel){
+    return pico_host_dma[channel].claimed;
+}
+
+static void host_dma_run(uint channel);
+
+static void host_dma_trigger(uint channel){
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+    c->busy = true;
+    c->transfers++;
+    dma_hw->ch[channel].read_addr = (uintptr_t)c->read_addr;
+    dma_hw->ch[channel].write_addr = (uintptr_t)c->write_addr;
+    dma_hw->ch[channel].transfer_count = c->transfer_count;
+
+    //Unpaced channels (control blocks) finish at once, paced ones wait for pico_host_dma_complete
+    if (c->config.dreq == DREQ_FORCE){
+        host_dma_run(channel);
+    }
+}
+
+static bool host_dma_is_reg(const volatile void* addr){
+    return (uintptr_t)addr >= (uintptr_t)dma_hw->ch && (uintptr_t)addr < (uintptr_t)&dma_hw->ch[NUM_DMA_CHANNELS];
+}
+
+//Register write with the side effects of the aliases, trigger registers start the channel
+static void host_dma_reg_write(volatile uintptr_t* reg, uintptr_t value){
+    size_t index = reg - (volatile uintptr_t*)dma_hw->ch;
+    uint channel = (uint)(index / 16);
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+
+    *reg = value;
+    switch (index % 16){
+    case 0: case 5: case 10: case 15:
+        c->read_addr = (const volatile void*)value;
+        break;
+    case 1: case 6: case 11: case 13:
+        c->write_addr = (volatile void*)value;
+        break;
+    case 2: case 7: case 9: case 14:
+        c->transfer_count = (uint32_t)value;
+        break;
+    default:
+        break;
+    }
+    //ctrl_trig, al1_transfer_count_trig, al2_write_addr_trig, al3_read_addr_trig
+    if (index % 4 == 3 && value != 0){
+        host_dma_trigger(channel);
+    }
+}
+
+static uintptr_t host_dma_advance(uintptr_t addr, uint size, uint ring_bits){
+    uintptr_t mask = ring_bits ? ((uintptr_t)1 << ring_bits) - 1 : ~(uintptr_t)0;
+    return (addr & ~mask) | ((addr + size) & mask);
+}
+
+//Copy a whole unpaced transfer, register writes use pointer sized elements
+static void host_dma_run(uint channel){
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+    dma_channel_config conf = c->config;
+    uintptr_t rd = (uintptr_t)c->read_addr;
+    uintptr_t wr = (uintptr_t)c->write_addr;
+    bool reg = host_dma_is_reg(c->write_addr);
+    uint size = reg ? sizeof(uintptr_t) : 1u << conf.size;
+
+    for (uint32_t i = 0; i < c->transfer_count; i++){
+        if (reg){
+            host_dma_reg_write((volatile uintptr_t*)wr, *(const volatile uintptr_t*)rd);
+        }
+        else {
+            memcpy((void*)wr, (const void*)rd, size);
+        }
+        if (conf.read_increment){
+            rd = host_dma_advance(rd, size, conf.ring_sel ? 0 : conf.ring_size_bits);
+        }
+        if (conf.write_increment){
+            wr = host_dma_advance(wr, size, conf.ring_sel ? conf.ring_size_bits : 0);
+        }
+    }
+    c->read_addr = (const volatile void*)rd;
+    c->write_addr = (volatile void*)wr;
+    dma_hw->ch[channel].read_addr = rd;
+    dma_hw->ch[channel].write_addr = wr;
+    pico_host_dma_complete(channel);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr, const volatile void* read_addr, uint transfer_count, bool trigger){
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+    c->config = *config;
+    c->write_addr = write_addr;
+    c->read_addr = read_addr;
+    c->transfer_count = transfer_count;
+    if (trigger) host_dma_trigger(channel);
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config* config, bool trigger){
+    pico_host_dma[channel].config = *config;
+    if (trigger) host_dma_trigger(channel);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void* read_addr, bool trigger){
+    pico_host_dma[channel].read_addr = read_addr;
+    if (trigger) host_dma_trigger(channel);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void* write_addr, bool trigger){
+    pico_host_dma[channel].write_addr = write_addr;
+    if (trigger) host_dma_trigger(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger){
+    pico_host_dma[channel].transfer_count = trans_count;
+    if (trigger) host_dma_trigger(channel);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void* read_addr, uint32_t transfer_count){
+    pico_host_dma[channel].read_addr = read_addr;
+    pico_host_dma[channel].transfer_count = transfer_count;
+    host_dma_trigger(channel);
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void* write_addr, uint32_t transfer_count){
+    pico_host_dma[channel].write_addr = write_addr;
+    pico_host_dma[channel].transfer_count = transfer_count;
+    host_dma_trigger(channel);
+}
+
+void dma_channel_start(uint channel){
+    host_dma_trigger(channel);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask){
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++){
+        if (chan_mask & (1u << i)) host_dma_trigger(i);
+    }
+}
+
+void dma_channel_abort(uint channel){
+    pico_host_dma[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel){
+    return pico_host_dma[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel){
+    //core1 sleeps until the host program completes the transfer, core0 finishes it at once
+    while (host_on_core1 && pico_host_dma[channel].busy){
+        swapcontext(&host_core1_context, &host_core0_context);
+    }
+    pico_host_dma[channel].busy = false;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled){
+    pico_host_dma[channel].irq0_enabled = enabled;
+    if (enabled) dma_hw->inte0 |= 1u << channel;
+    else dma_hw->inte0 &= ~(1u << channel);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled){
+    pico_host_dma[channel].irq1_enabled = enabled;
+    if (enabled) dma_hw->inte1 |= 1u << channel;
+    else dma_hw->inte1 &= ~(1u << channel);
+}
+
+void pico_host_dma_complete(uint channel){
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+    c->busy = false;
+    dma_hw->ch[channel].transfer_count = 0;
+    if (c->config.chain_to != channel){
+        host_dma_trigger(c->config.chain_to);
+    }
+    if (c->config.irq_quiet) return;
+    if (c->irq0_enabled){
+        dma_hw->ints0 |= 1u << channel;
+        pico_host_irq_fire(DMA_IRQ_0);
+    }
+    if (c->irq1_enabled){
+        dma_hw->ints1 |= 1u << channel;
+        pico_host_irq_fire(DMA_IRQ_1);
+    }
+}
+
+//pio
+pio_sm_config pio_get_default_sm_config(void){
+    pio_sm_config c;
+    memset(&c, 0, sizeof(c));
+    c.clkdiv_int = 1;
+    c.wrap = 31;
+    c.out_count = 32;
+    c.out_shift_right = true;
+    c.in_shift_right = true;
+    c.pull_threshold = 32;
+    c.push_threshold = 32;
+    return c;
+}
+
+void sm_config_set_clkdiv(pio_sm_config* c, float div){
+    uint32_t d = (uint32_t)(div * 256.0f + 0.5f);
+    c->clkdiv_int = (uint16_t)(d >> 8);
+    c->clkdiv_frac = (uint8_t)(d & 0xff);
+}
+
+static int host_find_offset(PIO pio, const pio_program_t* program){
+    uint32_t mask = (1u << program->length) - 1;
+    if (program->origin >= 0){
+        return (pio->used_instruction_space & (mask << program->origin)) ? -1 : program->origin;
+    }
+    for (int i = PIO_INSTRUCTION_COUNT - program->length; i >= 0; i--){
+        if (!(pio->used_instruction_space & (mask << i))) return i;
+    }
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t* program){
+    return host_find_offset(pio, program) >= 0;
+}
+
+int pio_add_program(PIO pio, const pio_program_t* program){
+    int offset = host_find_offset(pio, program);
+    if (offset < 0) return -1;
+    for (uint i = 0; i < program->length; i++){
+        uint16_t instr = program->instructions[i];
+        pio->instr_mem[offset + i] = (instr & 0xe000) == pio_instr_bits_jmp ? instr + offset : instr;
+    }
+    pio->used_instruction_space |= ((1u << program->length) - 1) << offset;
+    return offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t* program, uint loaded_offset){
+    pio->used_instruction_space &= ~(((1u << program->length) - 1) << loaded_offset);
+}
+
+void pio_clear_instruction_memory(PIO pio){
+    pio->used_instruction_space = 0;
+    memset(pio->instr_mem, 0, sizeof(pio->instr_mem));
+}
+
+void pio_sm_claim(PIO pio, uint sm){
+    pio->sm_claimed_mask |= 1u << sm;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm){
+    pio->sm_claimed_mask &= ~(1u << sm);
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm){
+    return pio->sm_claimed_mask & (1u << sm);
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config* config){
+    pio_sm_set_enabled(pio, sm, false);
+    pio->sm_config[sm] = *config;
+    pio->sm_offset[sm] = initial_pc;
+    pio->txf[sm] = 0;
+    return 0;
+}
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config* config){
+    pio->sm_config[sm] = *config;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled){
+    if (enabled) pio->sm_enabled_mask |= 1u << sm;
+    else pio->sm_enabled_mask &= ~(1u << sm);
+}
+
+void pio_set_sm_mask_enabled(PIO pio, uint32_t mask, bool enabled){
+    if (enabled) pio->sm_enabled_mask |= mask;
+    else pio->sm_enabled_mask &= ~mask;
+}
+
+void pio_enable_sm_mask_in_sync(PIO pio, uint32_t mask){
+    pio->sm_enabled_mask |= mask;
+}
+
+void pio_sm_restart(PIO pio, uint sm){
+    pio->sm_restart_count[sm]++;
+}
+
+void pio_clkdiv_restart_sm_mask(PIO pio, uint32_t mask){
+    (void)pio;
+    (void)mask;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr){
+    pio->sm_exec_count[sm]++;
+    pio->sm_last_exec[sm] = (uint16_t)instr;
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div){
+    sm_config_set_clkdiv(&pio->sm_config[sm], div);
+}
+
+void pio_sm_set_clkdiv_int_frac8(PIO pio, uint sm, uint32_t div_int, uint8_t div_frac){
+    pio->sm_config[sm].clkdiv_int = (uint16_t)div_int;
+    pio->sm_config[sm].clkdiv_frac = div_frac;
+}
+
+float pico_host_sm_clkdiv(PIO pio, uint sm){
+    return (float)pio->sm_config[sm].clkdiv_int + (float)pio->sm_config[sm].clkdiv_frac / 256.0f;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm){
+    pio->txf[sm] = 0;
+    pio->rxf[sm] = 0;
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm){
+    pio->txf[sm] = 0;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm){
+    (void)pio;
+    (void)sm;
+    return true;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm){
+    (void)pio;
+    (void)sm;
+    return 0;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data){
+    pio->txf[sm] = data;
+}
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values){
+    (void)sm;
+    pio->sm_pins = pin_values;
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask){
+    (void)sm;
+    pio->sm_pins = (pio->sm_pins & ~pin_mask) | (pin_values & pin_mask);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask){
+    (void)sm;
+    pio->sm_pindirs = (pio->sm_pindirs & ~pin_mask) | (pin_dirs & pin_mask);
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out){
+    uint32_t mask = ((1u << pin_count) - 1) << pin_base;
+    pio_sm_set_pindirs_with_mask(pio, sm, is_out ? mask : 0, mask);
+    return 0;
+}
+
+void pio_gpio_init(PIO pio, uint pin){
+    host_gpio_func[pin] = pio == pio1 ? GPIO_FUNC_PIO1 : GPIO_FUNC_PIO0;
+    host_gpio_dir |= 1u << pin;
+}
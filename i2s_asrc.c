@@ -0,0 +1,351 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_asrc.c
+ * @brief Asynchronous sample rate converter in front of the i2s buffer
+ *
+ */
+
+#include <math.h>
+#include "i2s.h"
+#include "i2s_asrc.h"
+
+//Source frames converted per block in i2s_asrc_write
+#define ASRC_CHUNK          32
+//Level smoothing in updates (ms)
+#define ASRC_LEVEL_SHIFT    5
+
+//History of one source frame, samples split into the upper 16 bits and the next 8 so the taps fit 32 bit multiplies
+typedef struct {
+    int16_t lh;
+    int16_t rh;
+    int16_t ll;
+    int16_t rl;
+} ASRCFrame;
+
+//Windowed sinc in Q23, one row per phase plus one for interpolating past the last, rows sum to 1.0
+static int32_t asrc_coef[I2S_ASRC_PHASES + 1][I2S_ASRC_TAPS];
+static float asrc_fc;
+
+//Written twice, TAPS apart, so the newest TAPS frames are contiguous from asrc_hist[asrc_wpos]
+static ASRCFrame asrc_hist[I2S_ASRC_TAPS * 2];
+static uint32_t asrc_wpos;
+
+//Source position in Q32 source frames, the integer part is the number of frames still to read
+static uint64_t asrc_pos;
+static uint64_t asrc_nominal;
+static uint64_t asrc_step;
+
+//Level controller in Q48 ratio
+static int64_t asrc_kp;
+static int64_t asrc_ki;
+static bool asrc_gain_set;
+static int64_t asrc_integral;
+static int64_t asrc_dev;
+static int32_t asrc_level;          //Smoothed level error in Q16 frames
+static uint32_t asrc_target;
+static uint32_t asrc_ctrl_period;
+static uint32_t asrc_ctrl_count;
+
+//Slot being filled
+static int32_t* asrc_slot;
+static uint32_t asrc_filled;
+static uint32_t asrc_period;
+
+/**
+ * @brief Modified Bessel function of the first kind, order 0
+ */
+static float asrc_bessel_i0(float x){
+    float sum = 1.0f, term = 1.0f;
+
+    for (int k = 1; k < 32 && term > sum * 1e-9f; k++){
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/**
+ * @brief Compute the filter table
+ *
+ * @param fc Cutoff in cycles per source frame
+ */
+static void asrc_design(float fc){
+    const float half = I2S_ASRC_TAPS / 2;
+    const float norm = 1.0f / asrc_bessel_i0(I2S_ASRC_BETA);
+    float h[I2S_ASRC_TAPS];
+
+    for (int p = 0; p <= I2S_ASRC_PHASES; p++){
+        float mu = (float)p / I2S_ASRC_PHASES;
+        float sum = 0.0f;
+        int32_t qsum = 0, peak = 0;
+
+        //Tap j is source frame j of the window, the output sits mu past frame TAPS/2 - 1
+        for (int j = 0; j < I2S_ASRC_TAPS; j++){
+            float t = j - half + 1.0f - mu;
+            float x = t / half;
+            float s = t == 0.0f ? 1.0f : sinf((float)M_PI * 2.0f * fc * t) / ((float)M_PI * 2.0f * fc * t);
+
+            h[j] = x * x < 1.0f ? 2.0f * fc * s * asrc_bessel_i0(I2S_ASRC_BETA * sqrtf(1.0f - x * x)) * norm : 0.0f;
+            sum += h[j];
+        }
+        for (int j = 0; j < I2S_ASRC_TAPS; j++){
+            asrc_coef[p][j] = lrintf(h[j] / sum * 8388608.0f);
+            qsum += asrc_coef[p][j];
+            if (asrc_coef[p][j] > asrc_coef[p][peak]){
+                peak = j;
+            }
+        }
+        //Exact unity gain at DC after rounding
+        asrc_coef[p][peak] += 8388608 - qsum;
+    }
+    asrc_fc = fc;
+}
+
+/**
+ * @brief Add a source frame to the history
+ */
+static __force_inline void asrc_push(int32_t l, int32_t r){
+    ASRCFrame f;
+
+    f.lh = l >> 16;
+    f.rh = r >> 16;
+    f.ll = (l >> 8) & 0xff;
+    f.rl = (r >> 8) & 0xff;
+    asrc_hist[asrc_wpos] = f;
+    asrc_hist[asrc_wpos + I2S_ASRC_TAPS] = f;
+    asrc_wpos = asrc_wpos + 1 < I2S_ASRC_TAPS ? asrc_wpos + 1 : 0;
+}
+
+static __force_inline int32_t asrc_saturate(int64_t x){
+    if (x > INT32_MAX){
+        return INT32_MAX;
+    }
+    if (x < INT32_MIN){
+        return INT32_MIN;
+    }
+    return (int32_t)x;
+}
+
+/**
+ * @brief Compute one output frame
+ *
+ * @param out Output frame
+ * @param phase Position past the middle of the window in Q32
+ */
+static void __time_critical_func(asrc_filter)(int32_t* out, uint32_t phase){
+    uint64_t t = (uint64_t)phase * I2S_ASRC_PHASES;
+    const int32_t* c0 = asrc_coef[t >> 32];
+    const int32_t* c1 = c0 + I2S_ASRC_TAPS;
+    const int32_t f = (uint32_t)t >> 20;
+    const ASRCFrame* x = &asrc_hist[asrc_wpos];
+    int32_t lh = 0, rh = 0, lm = 0, rm = 0;
+
+    for (int j = 0; j < I2S_ASRC_TAPS; j++){
+        //Q23 coefficient split into Q15 and the 8 bits below, the product of the two low parts is dropped
+        int32_t c = c0[j] + (((c1[j] - c0[j]) * f) >> 12);
+        int32_t ch = c >> 8;
+        int32_t cl = c & 0xff;
+        lh += ch * x[j].lh;
+        rh += ch * x[j].rh;
+        lm += ch * x[j].ll + cl * x[j].lh;
+        rm += ch * x[j].rl + cl * x[j].rh;
+    }
+
+    //(hi << 16 + lo << 8) * c >> 23
+    out[0] = asrc_saturate((int64_t)lh * 2 + (lm >> 7));
+    out[1] = asrc_saturate((int64_t)rh * 2 + (rm >> 7));
+}
+
+uint32_t i2s_asrc_process(const int32_t* in, uint32_t in_frames, uint32_t* used, int32_t* out, uint32_t out_frames){
+    uint32_t i = 0, o = 0;
+
+    while (o < out_frames){
+        while ((asrc_pos >> 32) != 0){
+            if (i >= in_frames){
+                *used = i;
+                return o;
+            }
+            asrc_push(in[i * 2], in[i * 2 + 1]);
+            i++;
+            asrc_pos -= (uint64_t)1 << 32;
+        }
+        asrc_filter(&out[o * 2], (uint32_t)asrc_pos);
+        asrc_pos += asrc_step;
+        o++;
+    }
+
+    *used = i;
+    return o;
+}
+
+/**
+ * @brief Update the ratio from the buffer level
+ *
+ * @param frames Source frames consumed since the last call
+ * @note Called after each write so the level is sampled at the same point of the packet cycle, the gains are per 1ms of source
+ */
+static void asrc_control(uint32_t frames){
+    const int64_t limit = (int64_t)I2S_ASRC_MAX_PPM * ((int64_t)1 << 48) / 1000000;
+    uint32_t updates = 0;
+    int32_t error;
+    int64_t dev;
+
+    asrc_ctrl_count += frames;
+    while (asrc_ctrl_count >= asrc_ctrl_period){
+        asrc_ctrl_count -= asrc_ctrl_period;
+        updates++;
+    }
+    if (updates == 0){
+        return;
+    }
+
+    //Too full: read the source faster
+    error = (int32_t)(i2s_get_buffered_frames() + asrc_filled) - (int32_t)asrc_target;
+    asrc_level += ((error << 16) - asrc_level) >> ASRC_LEVEL_SHIFT;
+
+    //Integral is clamped to the output range so it can not wind up
+    asrc_integral += ((asrc_ki * asrc_level) >> 16) * (int64_t)updates;
+    if (asrc_integral > limit){
+        asrc_integral = limit;
+    }
+    else if (asrc_integral < -limit){
+        asrc_integral = -limit;
+    }
+
+    dev = ((asrc_kp * asrc_level) >> 16) + asrc_integral;
+    if (dev > limit){
+        dev = limit;
+    }
+    else if (dev < -limit){
+        dev = -limit;
+    }
+    asrc_dev = dev;
+
+    //nominal * (1 + dev)
+    asrc_step = asrc_nominal + (((int64_t)(asrc_nominal >> 16) * (asrc_dev >> 16)) >> 16);
+}
+
+bool i2s_asrc_init(uint32_t in_rate, uint32_t out_rate, uint32_t target_frames){
+    float fc;
+
+    if (in_rate == 0 || out_rate == 0 || in_rate > out_rate * 2){
+        return false;
+    }
+
+    //Below the lower of the two Nyquist frequencies
+    fc = 0.5f * I2S_ASRC_CUTOFF;
+    if (out_rate < in_rate){
+        fc = fc * out_rate / in_rate;
+    }
+    if (fc != asrc_fc){
+        asrc_design(fc);
+    }
+
+    for (int i = 0; i < I2S_ASRC_TAPS * 2; i++){
+        asrc_hist[i] = (ASRCFrame){0, 0, 0, 0};
+    }
+    asrc_wpos = 0;
+    asrc_pos = 0;
+    asrc_nominal = ((uint64_t)in_rate << 32) / out_rate;
+    asrc_step = asrc_nominal;
+
+    if (asrc_gain_set == false){
+        asrc_kp = (int64_t)(2e-5 * 281474976710656.0);
+        asrc_ki = (int64_t)(out_rate * 4e-10 / 4000 * 281474976710656.0);
+    }
+    asrc_integral = 0;
+    asrc_dev = 0;
+    asrc_level = 0;
+    //Packets of 1ms, as far as the queue configured by i2s_set_buffer holds them
+    asrc_period = out_rate / 1000 != 0 ? out_rate / 1000 : 1;
+    if (asrc_period > i2s_get_buf_frames()){
+        asrc_period = i2s_get_buf_frames();
+    }
+    //Half the queue
+    asrc_target = target_frames != 0 ? target_frames : i2s_get_buf_depth() * asrc_period / 2;
+    asrc_ctrl_period = in_rate / 1000 != 0 ? in_rate / 1000 : 1;
+    asrc_ctrl_count = 0;
+
+    asrc_slot = NULL;
+    asrc_filled = 0;
+    return true;
+}
+
+void i2s_asrc_set_gain(float kp, float ki){
+    asrc_kp = (int64_t)(kp * 281474976710656.0);
+    asrc_ki = (int64_t)(ki * 281474976710656.0);
+    asrc_gain_set = true;
+}
+
+bool i2s_asrc_flush(void){
+    if (asrc_slot == NULL){
+        return false;
+    }
+    if (asrc_filled == 0){
+        return false;
+    }
+
+    i2s_enqueue_commit(asrc_filled);
+    asrc_slot = NULL;
+    asrc_filled = 0;
+    return true;
+}
+
+size_t i2s_asrc_write(const uint8_t* in, size_t len, uint8_t resolution){
+    const uint32_t frame_bytes = resolution / 4;
+    int32_t buf[ASRC_CHUNK * 2];
+    uint32_t frames, done = 0, n, k, used, cap;
+    const uint8_t* p;
+
+    if ((resolution != 16 && resolution != 24 && resolution != 32) || asrc_step == 0){
+        return 0;
+    }
+    frames = len / frame_bytes;
+
+    while (done < frames){
+        n = frames - done < ASRC_CHUNK ? frames - done : ASRC_CHUNK;
+        p = in + done * frame_bytes;
+        for (uint32_t i = 0; i < n * 2; i++){
+            if (resolution == 16){
+                buf[i] = (int32_t)((uint32_t)p[0] << 16 | (uint32_t)p[1] << 24);
+                p += 2;
+            }
+            else if (resolution == 24){
+                buf[i] = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+                p += 3;
+            }
+            else {
+                buf[i] = (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+                p += 4;
+            }
+        }
+
+        k = 0;
+        while (k < n){
+            if (asrc_slot == NULL){
+                asrc_slot = i2s_enqueue_acquire(&cap);
+                if (asrc_slot == NULL){
+                    asrc_control(done + k);
+                    return (done + k) * frame_bytes;
+                }
+                if (asrc_period > cap){
+                    asrc_period = cap;
+                }
+            }
+            asrc_filled += i2s_asrc_process(&buf[k * 2], n - k, &used, asrc_slot + asrc_filled * 2, asrc_period - asrc_filled);
+            k += used;
+            if (asrc_filled >= asrc_period){
+                i2s_asrc_flush();
+            }
+        }
+        done += n;
+    }
+
+    asrc_control(done);
+    return done * frame_bytes;
+}
+
+int32_t i2s_asrc_get_offset_ppb(void){
+    return (int32_t)(((asrc_dev >> 16) * 1000000000) >> 32);
+}
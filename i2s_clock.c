@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_clock.c
+ * @brief Clock plans with integer PIO dividers for the low jitter clock modes
+ *
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+
+#include "i2s_clock.h"
+
+//RP2040 datasheet pll_sys limits
+#define PLL_REF_MIN_HZ      (5 * MHZ)
+#define PLL_VCO_MIN_HZ      (750 * MHZ)
+#define PLL_VCO_MAX_HZ      (1600 * MHZ)
+#define PLL_FBDIV_MIN       16
+#define PLL_FBDIV_MAX       320
+#define PLL_POSTDIV_MAX     7
+
+#define GPIN0_HZ            45158400
+#define GPIN1_HZ            (49152 * KHZ)
+
+static I2S_CLOCK_PLAN clock_plan;
+static bool clock_plan_valid;
+static I2S_CLOCK_DIV clock_div;
+static bool clock_div_valid;
+
+#include "i2s_clock_table.h"
+
+static uint32_t gcd(uint32_t a, uint32_t b){
+    while (b != 0){
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+uint32_t i2s_clock_mclk_hz(uint32_t audio_clock){
+    uint32_t mclk;
+
+    if (24576 * KHZ % audio_clock == 0){
+        return 24576 * KHZ;
+    }
+    if (22579200 % audio_clock == 0){
+        return 22579200;
+    }
+    mclk = audio_clock;
+    while (mclk <= 24576 * KHZ / 2){
+        mclk *= 2;
+    }
+    return mclk;
+}
+
+/**
+ * @brief Frequency error of clk_sys against the nearest multiple of the common clock
+ *
+ * @param sys_num clk_sys numerator
+ * @param sys_den clk_sys denominator
+ * @param common Smallest clk_sys that divides into the data and MCLK clocks
+ * @param mult Multiple of common
+ * @return int32_t Error in ppb
+ */
+static int32_t clock_error_ppb(uint32_t sys_num, uint32_t sys_den, uint32_t common, uint32_t* mult){
+    uint64_t den = (uint64_t)sys_den * common;
+    uint32_t k = (uint32_t)((sys_num + den / 2) / den);
+
+    if (k == 0){
+        k = 1;
+    }
+    *mult = k;
+    return (int32_t)((int64_t)((uint64_t)sys_num * 1000000000u / (den * k)) - 1000000000);
+}
+
+/**
+ * @brief Search pll_sys settings for clk_sys in [sys_min, sys_max]
+ *
+ * @param mult Multiple of common clk_sys is closest to
+ * @return true Found
+ */
+static bool clock_solve_pll(uint32_t common, uint32_t sys_min, uint32_t sys_max, I2S_CLOCK_PLAN* plan, uint32_t* mult){
+    bool found = false;
+    uint32_t best_err = UINT32_MAX;
+
+    for (uint refdiv = 1; XOSC_HZ / refdiv >= PLL_REF_MIN_HZ; refdiv++){
+        for (uint fbdiv = PLL_FBDIV_MIN; fbdiv <= PLL_FBDIV_MAX; fbdiv++){
+            uint32_t vco = XOSC_HZ / refdiv * fbdiv;
+            if (vco < PLL_VCO_MIN_HZ || vco > PLL_VCO_MAX_HZ){
+                continue;
+            }
+            for (uint pd1 = 1; pd1 <= PLL_POSTDIV_MAX; pd1++){
+                for (uint pd2 = 1; pd2 <= pd1; pd2++){
+                    uint32_t sys = vco / (pd1 * pd2);
+                    uint32_t k, err;
+                    int32_t e;
+
+                    if (sys < sys_min || sys > sys_max){
+                        continue;
+                    }
+                    e = clock_error_ppb(vco, pd1 * pd2, common, &k);
+                    err = e < 0 ? -e : e;
+
+                    //Ties keep the lower VCO, then the lower clk_sys, then the lower refdiv
+                    if (found == true){
+                        if (err > best_err) continue;
+                        if (err == best_err && vco > plan->vco_hz) continue;
+                        if (err == best_err && vco == plan->vco_hz && sys >= plan->sys_hz) continue;
+                    }
+                    found = true;
+                    best_err = err;
+                    plan->src = I2S_CLOCK_SRC_PLL;
+                    plan->refdiv = refdiv;
+                    plan->post_div1 = pd1;
+                    plan->post_div2 = pd2;
+                    plan->vco_hz = vco;
+                    plan->sys_hz = sys;
+                    plan->error_ppb = e;
+                    *mult = k;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+bool i2s_clock_solve(uint32_t audio_clock, CLOCK_MODE clock_mode, bool mclk, I2S_CLOCK_PLAN* plan){
+    uint32_t data_hz = audio_clock * 128;
+    uint32_t mclk_hz = mclk == true ? i2s_clock_mclk_hz(audio_clock) : 0;
+    uint32_t common = data_hz;
+    uint32_t sys_min, sys_max, k;
+    bool reuse = false;
+
+    if (audio_clock == 0){
+        return false;
+    }
+    //PIO runs data at 128 cycles per frame and MCLK at 2 cycles per period
+    if (mclk == true){
+        common = data_hz / gcd(data_hz, mclk_hz * 2) * (mclk_hz * 2);
+    }
+
+    switch (clock_mode){
+    case CLOCK_MODE_LOW_JITTER_LOW:
+    case CLOCK_MODE_LOW_JITTER:
+        //Default core voltage
+        sys_min = 120 * MHZ;
+        sys_max = 150 * MHZ;
+        break;
+    case CLOCK_MODE_LOW_JITTER_OC:
+        //VREG_VOLTAGE_1_20, set by i2s_mclk_set_config
+        sys_min = 240 * MHZ;
+        sys_max = 300 * MHZ;
+        break;
+    case CLOCK_MODE_EXTERNAL:
+        plan->src = GPIN1_HZ % common == 0 || GPIN0_HZ % common != 0 ? I2S_CLOCK_SRC_GPIN1 : I2S_CLOCK_SRC_GPIN0;
+        plan->refdiv = 0;
+        plan->post_div1 = 0;
+        plan->post_div2 = 0;
+        plan->vco_hz = 0;
+        plan->sys_hz = plan->src == I2S_CLOCK_SRC_GPIN1 ? GPIN1_HZ : GPIN0_HZ;
+        plan->error_ppb = clock_error_ppb(plan->sys_hz, 1, common, &k);
+        sys_min = 0;
+        sys_max = 0;
+        break;
+    default:
+        return false;
+    }
+
+    //pll_sys that is running already and serves the new rate no worse keeps its lock, rates of a family share it
+    if (clock_mode != CLOCK_MODE_EXTERNAL && clock_plan_valid == true && clock_plan.src == I2S_CLOCK_SRC_PLL &&
+        clock_plan.sys_hz >= sys_min && clock_plan.sys_hz <= sys_max && clock_get_hz(clk_sys) == clock_plan.sys_hz){
+        int32_t e = clock_error_ppb(clock_plan.vco_hz, clock_plan.post_div1 * clock_plan.post_div2, common, &k);
+        if ((e < 0 ? -e : e) <= (clock_plan.error_ppb < 0 ? -clock_plan.error_ppb : clock_plan.error_ppb)){
+            *plan = clock_plan;
+            plan->error_ppb = e;
+            reuse = true;
+        }
+    }
+
+    if (clock_mode != CLOCK_MODE_EXTERNAL && reuse == false){
+        bool found = clock_solve_pll(common, sys_min, sys_max, plan, &k);
+        //High rates may have no good multiple of common in range, allow a slower clk_sys
+        if (found == false || plan->error_ppb > I2S_CLOCK_MAX_ERROR_PPM * 1000 || plan->error_ppb < -I2S_CLOCK_MAX_ERROR_PPM * 1000){
+            if (clock_solve_pll(common, 0, sys_max, plan, &k) == false){
+                return false;
+            }
+        }
+    }
+
+    if (plan->error_ppb > I2S_CLOCK_MAX_ERROR_PPM * 1000 || plan->error_ppb < -I2S_CLOCK_MAX_ERROR_PPM * 1000){
+        return false;
+    }
+    if ((uint64_t)common * k / data_hz > 0xffff){
+        return false;
+    }
+    plan->data_div = (uint64_t)common * k / data_hz;
+    plan->mclk_div = mclk == true ? (uint64_t)common * k / (mclk_hz * 2) : 0;
+    plan->mclk_hz = mclk_hz;
+    return true;
+}
+
+void i2s_clock_apply(const I2S_CLOCK_PLAN* plan){
+    //clk_sys is checked too in case something else changed it since
+    if (clock_plan_valid == true && clock_plan.src == plan->src && clock_plan.refdiv == plan->refdiv &&
+        clock_plan.vco_hz == plan->vco_hz && clock_plan.post_div1 == plan->post_div1 && clock_plan.post_div2 == plan->post_div2 &&
+        clock_get_hz(clk_sys) == plan->sys_hz){
+        clock_plan = *plan;
+        clock_div_valid = false;
+        return;
+    }
+
+    //Run clk_sys from pll_usb while pll_sys changes
+    while (running_on_fpga()) tight_loop_contents();
+    clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLK_HZ);
+    switch (plan->src){
+    case I2S_CLOCK_SRC_PLL:
+        pll_init(pll_sys, plan->refdiv, plan->vco_hz, plan->post_div1, plan->post_div2);
+        clock_configure_undivided(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, plan->sys_hz);
+        break;
+    case I2S_CLOCK_SRC_GPIN0:
+        clock_configure_gpin(clk_sys, 20, GPIN0_HZ, GPIN0_HZ);
+        break;
+    case I2S_CLOCK_SRC_GPIN1:
+        clock_configure_gpin(clk_sys, 22, GPIN1_HZ, GPIN1_HZ);
+        break;
+    }
+    clock_plan = *plan;
+    clock_plan_valid = true;
+    clock_div_valid = false;
+}
+
+const I2S_CLOCK_PLAN* i2s_get_clock_plan(void){
+    return clock_plan_valid == true ? &clock_plan : NULL;
+}
+
+/**
+ * @brief Period of the pattern a fractional divider repeats
+ *
+ * @param frac Fractional part in 1/256
+ * @return uint16_t State machine clocks, 0 for an integer divider
+ */
+static uint16_t clock_jitter_period(uint8_t frac){
+    return frac == 0 ? 0 : 256 / gcd(frac, 256);
+}
+
+bool i2s_clock_compute_div(uint32_t sys_hz, uint32_t audio_clock, I2S_CLOCK_DIV* div){
+    uint32_t mclk_hz, d8;
+    uint64_t m8;
+
+    //Padding included, results are compared with memcmp
+    memset(div, 0, sizeof(*div));
+    if (audio_clock == 0){
+        return false;
+    }
+    mclk_hz = i2s_clock_mclk_hz(audio_clock);
+
+    //sys_hz / (audio_clock * 128) in 1/256 steps, rounded
+    d8 = (uint32_t)(((uint64_t)sys_hz * 2 + audio_clock / 2) / audio_clock);
+    //sys_hz / (mclk_hz * 2) in 1/256 steps, rounded
+    m8 = ((uint64_t)sys_hz * 128 + mclk_hz / 2) / mclk_hz;
+    if (d8 < 256 || d8 >= 0x10000 * 256){
+        return false;
+    }
+    if (m8 < 256){
+        m8 = 256;
+    }
+    else if (m8 >= 0x10000 * 256){
+        m8 = 0x10000 * 256 - 1;
+    }
+
+    div->sys_hz = sys_hz;
+    div->audio_clock = audio_clock;
+    div->mclk_hz = mclk_hz;
+    div->data_int = d8 >> 8;
+    div->data_frac = d8 & 0xff;
+    div->mclk_int = m8 >> 8;
+    div->mclk_frac = m8 & 0xff;
+    div->data_jitter = clock_jitter_period(div->data_frac);
+    div->mclk_jitter = clock_jitter_period(div->mclk_frac);
+    div->error_ppb = (int32_t)(((int64_t)sys_hz * 2 - (int64_t)audio_clock * d8) * 1000000000 / ((int64_t)audio_clock * d8));
+    div->mclk_error_ppb = (int32_t)(((int64_t)sys_hz * 128 - (int64_t)mclk_hz * (int64_t)m8) * 1000000000 / ((int64_t)mclk_hz * (int64_t)m8));
+    return true;
+}
+
+bool i2s_clock_default_div(uint32_t sys_hz, uint32_t audio_clock, I2S_CLOCK_DIV* div){
+    memset(div, 0, sizeof(*div));
+    for (uint i = 0; i < sizeof(i2s_clock_table) / sizeof(i2s_clock_table[0]); i++){
+        if (i2s_clock_table[i].sys_hz == sys_hz && i2s_clock_table[i].audio_clock == audio_clock){
+            *div = i2s_clock_table[i];
+            return true;
+        }
+    }
+    return i2s_clock_compute_div(sys_hz, audio_clock, div);
+}
+
+const I2S_CLOCK_DIV* i2s_get_clock_div(void){
+    return clock_div_valid == true ? &clock_div : NULL;
+}
+
+void i2s_clock_set_div(const I2S_CLOCK_DIV* div){
+    clock_div = *div;
+    clock_div_valid = true;
+    clock_plan_valid = false;
+}
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_clock.h
+ * @brief Clock plans with integer PIO dividers for the low jitter clock modes
+ *
+ */
+
+#ifndef I2S_CLOCK_H
+#define I2S_CLOCK_H
+#include "pico/types.h"
+#include "i2s.h"
+
+//Largest sampling frequency error of a plan. Above it the clk_sys floor of the mode is dropped, then the rate is rejected
+#define I2S_CLOCK_MAX_ERROR_PPM 1000
+
+typedef enum {
+    I2S_CLOCK_SRC_PLL,      //pll_sys from XOSC
+    I2S_CLOCK_SRC_GPIN0,    //45.1584MHz on GPIO20
+    I2S_CLOCK_SRC_GPIN1     //49.152MHz on GPIO22
+} I2S_CLOCK_SRC;
+
+typedef struct {
+    I2S_CLOCK_SRC src;
+    uint8_t refdiv;         //pll_sys settings, unused for GPIN
+    uint8_t post_div1;
+    uint8_t post_div2;
+    uint32_t vco_hz;
+    uint32_t sys_hz;        //clk_sys
+    uint32_t mclk_hz;       //Nominal MCLK, 0 without MCLK
+    uint16_t data_div;      //Integer clock divider of the data state machine
+    uint16_t mclk_div;      //Integer clock divider of the MCLK state machine
+    int32_t error_ppb;      //Sampling frequency error
+} I2S_CLOCK_PLAN;
+
+//PIO dividers for CLOCK_MODE_DEFAULT, where clk_sys is not changed
+typedef struct {
+    uint32_t sys_hz;
+    uint32_t audio_clock;
+    uint32_t mclk_hz;       //Nominal MCLK
+    uint16_t data_int;      //Data state machine divider, data_int + data_frac / 256
+    uint16_t mclk_int;      //MCLK state machine divider, mclk_int + mclk_frac / 256
+    uint8_t data_frac;
+    uint8_t mclk_frac;
+    uint16_t data_jitter;   //Period of the fractional divider pattern in state machine clocks, 0 for an integer divider
+    uint16_t mclk_jitter;
+    int32_t error_ppb;      //Sampling frequency error
+    int32_t mclk_error_ppb; //MCLK error
+} I2S_CLOCK_DIV;
+
+/**
+ * @brief Nominal MCLK for a sampling frequency
+ *
+ * @param audio_clock Sampling frequency
+ * @return uint32_t 24.576MHz or 22.5792MHz when they are a multiple of audio_clock, otherwise the largest power of two multiple of audio_clock up to 24.576MHz
+ */
+uint32_t i2s_clock_mclk_hz(uint32_t audio_clock);
+
+/**
+ * @brief Find the clock plan for a sampling frequency
+ *
+ * @param audio_clock Sampling frequency
+ * @param clock_mode CLOCK_MODE_LOW_JITTER(_LOW), CLOCK_MODE_LOW_JITTER_OC or CLOCK_MODE_EXTERNAL
+ * @param mclk true: MCLK state machine is used, its divider has to be an integer too
+ * @param plan Result
+ * @return true Success
+ * @return false No plan within I2S_CLOCK_MAX_ERROR_PPM (unsupported clock mode or sampling frequency too high)
+ * @note Searches pll_sys refdiv, VCO and post dividers within the datasheet limits and clk_sys within the range of the clock mode.
+ * Picks the smallest frequency error, then the lowest VCO, then the lowest clk_sys.
+ * @note The plan applied last is kept without a search when clk_sys still runs from it, it is in the range of the mode
+ * and its error at audio_clock is no larger than at its own rate. pll_sys then does not relock
+ */
+bool i2s_clock_solve(uint32_t audio_clock, CLOCK_MODE clock_mode, bool mclk, I2S_CLOCK_PLAN* plan);
+
+/**
+ * @brief Compute the CLOCK_MODE_DEFAULT dividers
+ *
+ * @param sys_hz clk_sys
+ * @param audio_clock Sampling frequency
+ * @param div Result
+ * @return true Success
+ * @return false audio_clock too high for sys_hz
+ * @note Dividers are rounded to 1/256. An exact integer divider is used when sys_hz allows it
+ */
+bool i2s_clock_compute_div(uint32_t sys_hz, uint32_t audio_clock, I2S_CLOCK_DIV* div);
+
+/**
+ * @brief Get the CLOCK_MODE_DEFAULT dividers
+ *
+ * @param sys_hz clk_sys
+ * @param audio_clock Sampling frequency
+ * @param div Result
+ * @return true Success
+ * @return false audio_clock too high for sys_hz
+ * @note Standard rates at 125, 133, 150 and 200MHz come from a table generated by tools/clock_plan, others are computed
+ */
+bool i2s_clock_default_div(uint32_t sys_hz, uint32_t audio_clock, I2S_CLOCK_DIV* div);
+
+/**
+ * @brief Get the CLOCK_MODE_DEFAULT dividers applied last, for logging
+ *
+ * @return const I2S_CLOCK_DIV* Dividers, NULL if none have been applied (low jitter modes)
+ */
+const I2S_CLOCK_DIV* i2s_get_clock_div(void);
+
+/**
+ * @brief Record the CLOCK_MODE_DEFAULT dividers applied by i2s.c
+ *
+ * @param div Dividers
+ * @note i2s_get_clock_plan returns NULL afterwards, i2s_clock_apply clears it again
+ */
+void i2s_clock_set_div(const I2S_CLOCK_DIV* div);
+
+/**
+ * @brief Switch clk_sys to the plan
+ *
+ * @param plan Plan from i2s_clock_solve
+ * @note Does nothing if clk_sys already runs from the same source and PLL settings
+ */
+void i2s_clock_apply(const I2S_CLOCK_PLAN* plan);
+
+/**
+ * @brief Get the plan applied last, for logging
+ *
+ * @return const I2S_CLOCK_PLAN* Plan, NULL if none has been applied (CLOCK_MODE_DEFAULT)
+ */
+const I2S_CLOCK_PLAN* i2s_get_clock_plan(void);
+
+#endif
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_clock_table.h
+ * @brief CLOCK_MODE_DEFAULT dividers for common clk_sys and standard rates
+ *
+ * Generated by tools/clock_plan -t, do not edit
+ */
+
+//sys_hz, audio_clock, mclk_hz, data_int, mclk_int, data_frac, mclk_frac, data_jitter, mclk_jitter, error_ppb, mclk_error_ppb
+static const I2S_CLOCK_DIV i2s_clock_table[] = {
+    {125000000, 8000, 24576000, 122, 2, 18, 139, 128, 256, 0, 64004},
+    {125000000, 11025, 22579200, 88, 2, 148, 197, 64, 256, -11599, -540507},
+    {125000000, 16000, 24576000, 61, 2, 9, 139, 256, 256, 0, 64004},
+    {125000000, 22050, 22579200, 44, 2, 74, 197, 128, 256, -11599, -540507},
+    {125000000, 32000, 24576000, 30, 2, 133, 139, 256, 256, -63995, 64004},
+    {125000000, 44100, 22579200, 22, 2, 37, 197, 256, 256, -11599, -540507},
+    {125000000, 48000, 24576000, 20, 2, 88, 139, 32, 256, 64004, 64004},
+    {125000000, 64000, 24576000, 15, 2, 66, 139, 128, 256, 64004, 64004},
+    {125000000, 88200, 22579200, 11, 2, 18, 197, 128, 256, 164827, -540507},
+    {125000000, 96000, 24576000, 10, 2, 44, 139, 64, 256, 64004, 64004},
+    {125000000, 176400, 22579200, 5, 2, 137, 197, 256, 256, 164827, -540507},
+    {125000000, 192000, 24576000, 5, 2, 22, 139, 128, 256, 64004, 64004},
+    {125000000, 352800, 22579200, 2, 2, 197, 197, 256, 256, -540507, -540507},
+    {125000000, 384000, 24576000, 2, 2, 139, 139, 256, 256, 64004, 64004},
+    {125000000, 705600, 22579200, 1, 2, 98, 197, 128, 256, 871158, -540507},
+    {125000000, 768000, 24576000, 1, 2, 70, 139, 128, 256, -1469836, 64004},
+    {133000000, 8000, 24576000, 129, 2, 226, 181, 128, 256, 0, -420875},
+    {133000000, 11025, 22579200, 94, 2, 63, 242, 256, 128, -657, -42103},
+    {133000000, 16000, 24576000, 64, 2, 241, 181, 256, 256, 0, -420875},
+    {133000000, 22050, 22579200, 47, 2, 31, 242, 256, 128, 40791, -42103},
+    {133000000, 32000, 24576000, 32, 2, 121, 181, 256, 256, -60146, -420875},
+    {133000000, 44100, 22579200, 23, 2, 144, 242, 16, 128, -42103, -42103},
+    {133000000, 48000, 24576000, 21, 2, 166, 181, 128, 256, -60146, -420875},
+    {133000000, 64000, 24576000, 16, 2, 60, 181, 64, 256, 60153, -420875},
+    {133000000, 88200, 22579200, 11, 2, 200, 242, 32, 128, -42103, -42103},
+    {133000000, 96000, 24576000, 10, 2, 211, 181, 256, 256, -60146, -420875},
+    {133000000, 176400, 22579200, 5, 2, 228, 242, 64, 128, -42103, -42103},
+    {133000000, 192000, 24576000, 5, 2, 105, 181, 256, 256, 300842, -420875},
+    {133000000, 352800, 22579200, 2, 2, 242, 242, 128, 128, -42103, -42103},
+    {133000000, 384000, 24576000, 2, 2, 181, 181, 256, 256, -420875, -420875},
+    {133000000, 705600, 22579200, 1, 2, 121, 242, 256, 128, -42103, -42103},
+    {133000000, 768000, 24576000, 1, 2, 90, 181, 128, 256, 1023603, -420875},
+    {150000000, 8000, 24576000, 146, 3, 124, 13, 64, 256, 0, 320102},
+    {150000000, 11025, 22579200, 106, 3, 75, 82, 256, 128, -4249, 400160},
+    {150000000, 16000, 24576000, 73, 3, 62, 13, 128, 256, 0, 320102},
+    {150000000, 22050, 22579200, 53, 3, 37, 82, 256, 128, 32501, 400160},
+    {150000000, 32000, 24576000, 36, 3, 159, 13, 256, 256, 0, 320102},
+    {150000000, 44100, 22579200, 26, 3, 147, 82, 256, 128, -40998, 400160},
+    {150000000, 48000, 24576000, 24, 3, 106, 13, 128, 256, 0, 320102},
+    {150000000, 64000, 24576000, 18, 3, 80, 13, 16, 256, -106655, 320102},
+    {150000000, 88200, 22579200, 13, 3, 73, 82, 256, 128, 106011, 400160},
+    {150000000, 96000, 24576000, 12, 3, 53, 13, 256, 256, 0, 320102},
+    {150000000, 176400, 22579200, 6, 3, 165, 82, 256, 128, -187964, 400160},
+    {150000000, 192000, 24576000, 6, 3, 27, 13, 256, 256, -319897, 320102},
+    {150000000, 352800, 22579200, 3, 3, 82, 82, 128, 128, 400160, 400160},
+    {150000000, 384000, 24576000, 3, 3, 13, 13, 256, 256, 320102, 320102},
+    {150000000, 705600, 22579200, 1, 3, 169, 82, 256, 128, 400160, 400160},
+    {150000000, 768000, 24576000, 1, 3, 135, 13, 256, 256, -959079, 320102},
+    {200000000, 8000, 24576000, 195, 4, 80, 18, 16, 128, 0, -319897},
+    {200000000, 11025, 22579200, 141, 4, 185, 110, 256, 128, 4937, -187964},
+    {200000000, 16000, 24576000, 97, 4, 168, 18, 32, 128, 0, -319897},
+    {200000000, 22050, 22579200, 70, 4, 221, 110, 256, 128, -22624, -187964},
+    {200000000, 32000, 24576000, 48, 4, 212, 18, 64, 128, 0, -319897},
+    {200000000, 44100, 22579200, 35, 4, 110, 110, 128, 128, 32501, -187964},
+    {200000000, 48000, 24576000, 32, 4, 141, 18, 256, 128, 40001, -319897},
+    {200000000, 64000, 24576000, 24, 4, 106, 18, 128, 128, 0, -319897},
+    {200000000, 88200, 22579200, 17, 4, 183, 110, 256, 128, 32501, -187964},
+    {200000000, 96000, 24576000, 16, 4, 71, 18, 256, 128, -79993, -319897},
+    {200000000, 176400, 22579200, 8, 4, 220, 110, 64, 128, -187964, -187964},
+    {200000000, 192000, 24576000, 8, 4, 35, 18, 256, 128, 160025, -319897},
+    {200000000, 352800, 22579200, 4, 4, 110, 110, 128, 128, -187964, -187964},
+    {200000000, 384000, 24576000, 4, 4, 18, 18, 128, 128, -319897, -319897},
+    {200000000, 705600, 22579200, 2, 4, 55, 110, 256, 128, -187964, -187964},
+    {200000000, 768000, 24576000, 2, 4, 9, 18, 256, 128, -319897, -319897},
+};
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_drift.h
+ * @brief Output sampling frequency estimate from DMA completion timestamps
+ *
+ */
+
+#ifndef I2S_DRIFT_H
+#define I2S_DRIFT_H
+#include "pico/types.h"
+
+//Loop bandwidth of the estimator once settled, lower is smoother and slower
+#define I2S_DRIFT_BW_HZ     0.1
+//Bandwidth while the estimator locks
+#define I2S_DRIFT_LOCK_BW_HZ    2.0
+//1 sigma uncertainty at which confidence is 0.5
+#define I2S_DRIFT_CONF_PPM  2.0
+
+typedef struct {
+    double frames_per_second;   //Measured output sampling frequency
+    double ppm;                 //Drift against the nominal frequency
+    double uncertainty_ppm;     //1 sigma estimate of the ppm error
+    double confidence;          //0 (no estimate) ~ 1 (settled, well below I2S_DRIFT_CONF_PPM)
+} I2S_DRIFT;
+
+//Delay locked loop on frame timestamps, the state is plain data so it also runs on the host
+typedef struct {
+    uint32_t nominal;
+    bool started;
+    uint32_t last_frames;
+    uint32_t last_time_us;
+    double offset_us;           //Filtered minus measured time of the last observation
+    double period_us;           //Time per frame
+    double err_var;             //Smoothed squared timing error
+    double elapsed_us;          //Time observed since the first observation
+    double bandwidth;           //Current loop bandwidth in Hz
+    double a;                   //Gains of the last update
+    double b;
+    double interval_us;         //Smoothed time between observations
+} I2S_DRIFT_ESTIMATOR;
+
+/**
+ * @brief Reset an estimator
+ *
+ * @param est Estimator
+ * @param nominal Nominal sampling frequency
+ */
+void i2s_drift_init(I2S_DRIFT_ESTIMATOR* est, uint32_t nominal);
+
+/**
+ * @brief Add an observation
+ *
+ * @param est Estimator
+ * @param frames Frames output so far (wraps)
+ * @param time_us Time the last of those frames left DMA (wraps)
+ * @note Observations can be irregular but must be less than 35 minutes apart
+ */
+void i2s_drift_update(I2S_DRIFT_ESTIMATOR* est, uint32_t frames, uint32_t time_us);
+
+/**
+ * @brief Read the estimate
+ *
+ * @param est Estimator
+ * @param drift Result
+ */
+void i2s_drift_result(const I2S_DRIFT_ESTIMATOR* est, I2S_DRIFT* drift);
+
+/**
+ * @brief Estimate the drift of the i2s output
+ *
+ * @param drift Result
+ * @note Feeds the timestamps of the i2s output into a library owned estimator, call every 10~100ms from one context.
+ * The estimator restarts after i2s_mclk_init and i2s_mclk_change_clock
+ */
+void i2s_get_drift(I2S_DRIFT* drift);
+
+#endif
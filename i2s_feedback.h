@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file i2s_feedback.h
+ * @brief USB asynchronous feedback value from the i2s buffer level
+ *
+ * There is one controller and it follows the default instance (i2s_mclk_init, i2s_set_buffer). For another instance,
+ * pass i2s_inst_get_buffered_frames() to i2s_feedback_update_level.
+ */
+
+#ifndef I2S_FEEDBACK_H
+#define I2S_FEEDBACK_H
+#include "pico/types.h"
+
+typedef enum {
+    FEEDBACK_FORMAT_10_14,  //Full speed, frames per 1ms in 10.14 (3 bytes)
+    FEEDBACK_FORMAT_16_16   //High speed, frames per 125us in 16.16 (4 bytes)
+} FEEDBACK_FORMAT;
+
+/**
+ * @brief Initialize the feedback controller
+ *
+ * @param audio_clock Sampling frequency
+ * @param target_frames Buffer level to hold in stereo frames, 0 for half the queue: i2s_get_buf_depth() / 2 packets of
+ * 1ms (at most i2s_get_buf_frames() frames each)
+ * @param format Feedback value format
+ * @note Call again after i2s_mclk_change_clock
+ */
+void i2s_feedback_init(uint32_t audio_clock, uint32_t target_frames, FEEDBACK_FORMAT format);
+
+/**
+ * @brief Set the PI controller gains
+ *
+ * @param kp Proportional gain in frames/ms per frame of level error (default 1/256)
+ * @param ki Integral gain in frames/ms per frame of level error and update (default 1/262144)
+ * @note ki = kp * kp / 4 is critically damped
+ */
+void i2s_feedback_set_gain(float kp, float ki);
+
+/**
+ * @brief Update the controller from the i2s buffer level
+ *
+ * @return uint32_t Feedback value in the format set by i2s_feedback_init
+ * @note Call every 1ms, e.g. on SOF. The level is i2s_get_buffered_frames() of the default instance
+ */
+uint32_t i2s_feedback_update(void);
+
+/**
+ * @brief Update the controller from a given buffer level
+ *
+ * @param level_frames Buffer level in stereo frames
+ * @return uint32_t Feedback value in the format set by i2s_feedback_init
+ * @note For simulations and buffers other than the i2s buffer
+ */
+uint32_t i2s_feedback_update_level(uint32_t level_frames);
+
+/**
+ * @brief Get the last feedback value without updating
+ *
+ * @return uint32_t Feedback value in the format set by i2s_feedback_init
+ */
+uint32_t i2s_feedback_get(void);
+
+#endif
@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Benchmark and closed loop simulation of the sample rate converter
+ *
+ * Default: converts a -1dBFS 24 bit sine at 44.1, 48 and 96kHz with the
+ * source 100ppm fast, and from 44.1kHz to 48kHz, and prints THD+N at 997Hz
+ * and 10kHz together with the host time and cycles per output frame.
+ *
+ * -l: a source with its own clock, off by the given ppm, writes 1ms packets
+ * through i2s_asrc_write while DMA consumes the i2s buffer at the output
+ * rate. Prints the buffer level and the ratio correction the converter
+ * settled on, and the underruns/overruns the library counted.
+ *
+ * usage: asrc_bench [-l] [-r fs] [-p ppm] [-t seconds] [-v]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#include "pico_host.h"
+#include "i2s.h"
+#include "i2s_asrc.h"
+
+#define BENCH_SECONDS   2
+
+static void usage(void){
+    fprintf(stderr, "usage: asrc_bench [-l] [-r fs] [-p ppm] [-t seconds] [-v]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+static uint64_t cycles(void){
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief THD+N of a sine of known frequency
+ *
+ * @param y Samples
+ * @param n Number of samples
+ * @param w Frequency in radians per sample
+ * @param gain Amplitude of the fitted sine
+ * @return double THD+N in dB, residual after a least squares fit of the sine and DC
+ */
+static double thd_n(const double* y, uint32_t n, double w, double* gain){
+    double m[3][4] = {{0}};
+
+    for (uint32_t i = 0; i < n; i++){
+        double b[3] = {cos(w * i), sin(w * i), 1.0};
+        for (int r = 0; r < 3; r++){
+            for (int c = 0; c < 3; c++){
+                m[r][c] += b[r] * b[c];
+            }
+            m[r][3] += b[r] * y[i];
+        }
+    }
+    //Gauss-Jordan on the normal equations
+    for (int r = 0; r < 3; r++){
+        for (int k = 0; k < 3; k++){
+            if (k == r) continue;
+            double f = m[k][r] / m[r][r];
+            for (int c = 0; c < 4; c++){
+                m[k][c] -= f * m[r][c];
+            }
+        }
+    }
+    double a = m[0][3] / m[0][0], b = m[1][3] / m[1][1], dc = m[2][3] / m[2][2];
+    double res = 0.0;
+    for (uint32_t i = 0; i < n; i++){
+        double e = y[i] - a * cos(w * i) - b * sin(w * i) - dc;
+        res += e * e;
+    }
+    *gain = sqrt(a * a + b * b);
+    return 10.0 * log10(res / n / ((a * a + b * b) / 2));
+}
+
+/**
+ * @brief Convert a sine and measure it
+ *
+ * @param ns Host time per output frame
+ * @param cyc Host cycles per output frame
+ * @param gain Gain at freq in dB
+ */
+static double bench_tone(uint32_t in_rate, uint32_t out_rate, double freq, double* ns, double* cyc, double* gain){
+    const uint32_t in_frames = in_rate * BENCH_SECONDS;
+    const uint32_t out_max = (uint32_t)((uint64_t)in_frames * out_rate / in_rate) + 64;
+    int32_t* in = malloc(in_frames * 2 * sizeof(int32_t));
+    int32_t* out = malloc(out_max * 2 * sizeof(int32_t));
+    double* y = malloc(out_max * sizeof(double));
+    const double amp = pow(10.0, -1.0 / 20.0) * 8388607.0;
+    uint32_t used, frames, skip = I2S_ASRC_TAPS * 2;
+    struct timespec t0, t1;
+    uint64_t c0, c1;
+
+    for (uint32_t i = 0; i < in_frames; i++){
+        int32_t s = (int32_t)lrint(amp * sin(2.0 * M_PI * freq * i / in_rate));
+        in[i * 2] = s * 256;
+        in[i * 2 + 1] = -s * 256;
+    }
+
+    i2s_asrc_init(in_rate, out_rate, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    c0 = cycles();
+    frames = i2s_asrc_process(in, in_frames, &used, out, out_max);
+    c1 = cycles();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    *ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / frames;
+    *cyc = (double)(c1 - c0) / frames;
+
+    //Left channel, past the filter delay
+    for (uint32_t i = skip; i < frames; i++){
+        y[i - skip] = out[i * 2] / 2147483648.0;
+    }
+    double r = thd_n(y, frames - skip, 2.0 * M_PI * freq / out_rate, gain);
+    *gain = 20.0 * log10(*gain * 2147483648.0 / (amp * 256.0));
+
+    free(in);
+    free(out);
+    free(y);
+    return r;
+}
+
+static int bench(void){
+    static const uint32_t rates[][2] = {
+        {44100, 44104}, {48000, 48005}, {96000, 96010}, {44100, 48000}, {48000, 44100}
+    };
+    int fail = 0;
+
+    printf("taps %u, phases %u, %u multiplies per output frame\n", I2S_ASRC_TAPS, I2S_ASRC_PHASES, I2S_ASRC_TAPS * 7);
+    printf("in_hz   out_hz  thd+n_997hz  thd+n_10khz  gain_20khz  ns/frame  cycles/frame\n");
+    for (uint i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        double ns, cyc, ns2, cyc2, gain, gain20;
+        //Source 100ppm fast: the converter sees a source rate above the output rate
+        uint32_t in = rates[i][1] > rates[i][0] && rates[i][1] - rates[i][0] < 100 ? rates[i][1] : rates[i][0];
+        uint32_t out = rates[i][1] > rates[i][0] && rates[i][1] - rates[i][0] < 100 ? rates[i][0] : rates[i][1];
+        double a = bench_tone(in, out, 997.0, &ns, &cyc, &gain);
+        double b = bench_tone(in, out, 10000.0, &ns2, &cyc2, &gain);
+        bench_tone(in, out, 20000.0, &ns2, &cyc2, &gain20);
+        printf("%-7u %-7u %8.1f dB  %8.1f dB  %6.2f dB  %8.1f  %8.0f\n", in, out, a, b, gain20, (ns + ns2) / 2, (cyc + cyc2) / 2);
+        if (a > -100.0 || b > -90.0){
+            fail = 1;
+        }
+    }
+    return fail;
+}
+
+static int loop(uint32_t fs, double ppm, double seconds, bool verbose){
+    static int32_t packet[I2S_DATA_FRAMES * 2];
+    const double source_fs = fs * (1.0 + ppm * 1e-6);
+    const uint32_t target = i2s_get_buf_depth() * (fs / 1000) / 2;
+    double now = 0.0, dma_end = 0.0, next_packet = 0.0, src_acc = 0.0;
+    uint32_t level_min = UINT32_MAX, level_max = 0, phase = 0;
+    uint64_t host_us = 0;
+
+    pico_host_reset(125000000);
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_config(pio0, 0, 0, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+    i2s_volume_change(0, 0);
+    i2s_mclk_init(fs);
+    i2s_asrc_init(fs, fs, 0);
+    dma_end = pico_host_dma[0].transfer_count / 2 / (double)fs;
+
+    if (verbose){
+        printf("t_ms,level,offset_ppm\n");
+    }
+
+    while (now < seconds){
+        if (dma_end <= next_packet){
+            //DMA finished, i2s_handler starts the next transfer
+            now = dma_end;
+            if ((uint64_t)(now * 1e6) > host_us){
+                pico_host_advance_time_us((uint64_t)(now * 1e6) - host_us);
+                host_us = (uint64_t)(now * 1e6);
+            }
+            pico_host_dma_complete(0);
+            dma_end = now + pico_host_dma[0].transfer_count / 2 / (double)fs;
+            continue;
+        }
+
+        now = next_packet;
+        next_packet += 0.001;
+        if ((uint64_t)(now * 1e6) > host_us){
+            pico_host_advance_time_us((uint64_t)(now * 1e6) - host_us);
+            host_us = (uint64_t)(now * 1e6);
+        }
+
+        //Source: 1ms of its own clock, a 997Hz tone
+        src_acc += source_fs / 1000.0;
+        uint32_t frames = (uint32_t)src_acc;
+        src_acc -= frames;
+        for (uint32_t i = 0; i < frames; i++){
+            int32_t s = (int32_t)(sin(2.0 * M_PI * 997.0 * phase++ / fs) * 1e9);
+            packet[i * 2] = s;
+            packet[i * 2 + 1] = s;
+        }
+        i2s_asrc_write((const uint8_t*)packet, frames * 8, 32);
+
+        uint32_t level = i2s_get_buffered_frames();
+        if (now > seconds / 2){
+            if (level < level_min) level_min = level;
+            if (level > level_max) level_max = level;
+        }
+        if (verbose){
+            printf("%.0f,%u,%.3f\n", now * 1000.0, level, i2s_asrc_get_offset_ppb() / 1000.0);
+        }
+    }
+
+    I2S_STATS stats;
+    i2s_get_stats(&stats);
+    fprintf(verbose ? stderr : stdout,
+            "fs %u Hz, source %+.1f ppm, target %u frames\n"
+            "level over the second half: min %u max %u frames\n"
+            "ratio correction %+.3f ppm\n"
+            "underruns %u overruns %u\n",
+            fs, ppm, target, level_min, level_max, i2s_asrc_get_offset_ppb() / 1000.0,
+            stats.underruns, stats.overruns);
+
+    return stats.underruns == 0 && stats.overruns == 0 && fabs(i2s_asrc_get_offset_ppb() / 1000.0 - ppm) < 5.0 ? 0 : 1;
+}
+
+int main(int argc, char** argv){
+    uint32_t fs = 48000;
+    double ppm = 300.0, seconds = 30.0;
+    bool closed_loop = false, verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "lr:p:t:v")) != -1){
+        switch (opt){
+        case 'l': closed_loop = true; break;
+        case 'r': fs = strtoul(optarg, NULL, 0); break;
+        case 'p': ppm = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'v': verbose = true; break;
+        default: usage();
+        }
+    }
+    if (fs < 1000 || seconds <= 0.0) usage();
+
+    return closed_loop ? loop(fs, ppm, seconds, verbose) : bench();
+}
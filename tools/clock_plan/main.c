@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Print and check the clock plans of every standard sampling frequency
+ *
+ * For each clock mode, solves the plan with and without MCLK, recomputes
+ * clk_sys from the PLL settings and checks the datasheet limits, the integer
+ * dividers and the frequency error. Then runs i2s_mclk_init and
+ * i2s_mclk_change_clock through the host stubs and checks the dividers and
+ * clk_sys they apply.
+ *
+ * CLOCK_MODE_DEFAULT keeps clk_sys, its dividers are checked against the
+ * table in i2s_clock_table.h for the common clk_sys values.
+ *
+ * usage: clock_plan [-r fs] [-q] [-t]
+ *
+ * -t prints i2s_clock_table.h instead
+ *
+ * Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico_host.h"
+#include "i2s.h"
+#include "i2s_clock.h"
+
+static const uint32_t standard_rates[] = {
+    8000, 11025, 16000, 22050, 32000, 44100, 48000, 64000, 88200, 96000,
+    176400, 192000, 352800, 384000, 705600, 768000,
+};
+
+//clk_sys the CLOCK_MODE_DEFAULT table is generated for (SDK defaults and common overclocks)
+static const uint32_t default_sys_hz[] = {
+    125 * MHZ, 133 * MHZ, 150 * MHZ, 200 * MHZ,
+};
+
+static const struct {
+    const char* name;
+    CLOCK_MODE mode;
+    uint32_t sys_max;
+} clock_modes[] = {
+    {"low_jitter_low",  CLOCK_MODE_LOW_JITTER_LOW,  150 * MHZ},
+    {"low_jitter",      CLOCK_MODE_LOW_JITTER,      150 * MHZ},
+    {"low_jitter_oc",   CLOCK_MODE_LOW_JITTER_OC,   300 * MHZ},
+    {"external",        CLOCK_MODE_EXTERNAL,        49152 * KHZ},
+};
+
+static int failures;
+
+static void fail(const char* mode, uint32_t fs, bool mclk, const char* what){
+    printf("FAIL %s %u Hz%s: %s\n", mode, fs, mclk ? " mclk" : "", what);
+    failures++;
+}
+
+static void check_plan(const char* mode, uint32_t sys_max, uint32_t fs, bool mclk, const I2S_CLOCK_PLAN* p){
+    double sys = p->sys_hz;
+    double err;
+
+    if (p->src == I2S_CLOCK_SRC_PLL){
+        uint32_t ref = XOSC_HZ / p->refdiv;
+        if (ref < 5 * MHZ) fail(mode, fs, mclk, "reference below 5MHz");
+        if (p->vco_hz % ref != 0) fail(mode, fs, mclk, "VCO not a multiple of the reference");
+        if (p->vco_hz / ref < 16 || p->vco_hz / ref > 320) fail(mode, fs, mclk, "feedback divider out of range");
+        if (p->vco_hz < 750 * MHZ || p->vco_hz > 1600 * MHZ) fail(mode, fs, mclk, "VCO out of range");
+        if (p->post_div1 < 1 || p->post_div1 > 7 || p->post_div2 < 1 || p->post_div2 > 7) fail(mode, fs, mclk, "post divider out of range");
+        if (p->sys_hz != p->vco_hz / (p->post_div1 * p->post_div2)) fail(mode, fs, mclk, "clk_sys does not match the PLL");
+        sys = (double)p->vco_hz / (p->post_div1 * p->post_div2);
+    }
+    if (p->sys_hz > sys_max) fail(mode, fs, mclk, "clk_sys above the limit of the mode");
+    if (p->data_div == 0) fail(mode, fs, mclk, "data divider is 0");
+    if (mclk && p->mclk_div == 0) fail(mode, fs, mclk, "MCLK divider is 0");
+    if (mclk && (uint64_t)p->data_div * fs * 128 * p->mclk_hz * 2 / p->mclk_div / (fs * 128) != (uint64_t)p->data_div * p->mclk_hz * 2 / p->mclk_div){
+        fail(mode, fs, mclk, "data and MCLK dividers disagree");
+    }
+    if (mclk && (uint64_t)p->data_div * fs * 128 != (uint64_t)p->mclk_div * p->mclk_hz * 2){
+        fail(mode, fs, mclk, "data and MCLK dividers are not from the same clk_sys");
+    }
+
+    err = (sys / (128.0 * p->data_div) / fs - 1.0) * 1e9;
+    if (err - p->error_ppb > 2.0 || p->error_ppb - err > 2.0) fail(mode, fs, mclk, "reported error is wrong");
+    if (err > I2S_CLOCK_MAX_ERROR_PPM * 1000.0 || err < -I2S_CLOCK_MAX_ERROR_PPM * 1000.0) fail(mode, fs, mclk, "error above I2S_CLOCK_MAX_ERROR_PPM");
+}
+
+static void print_plan(const char* mode, uint32_t fs, bool mclk, const I2S_CLOCK_PLAN* p){
+    if (p->src == I2S_CLOCK_SRC_PLL){
+        printf("%-14s %6u %-4s  pll %u/%4u/%u/%u  %12.6f  %3u  %3u  %+9.3f\n", mode, fs, mclk ? "mclk" : "",
+               p->refdiv, p->vco_hz / MHZ, p->post_div1, p->post_div2, p->sys_hz / 1e6,
+               p->data_div, p->mclk_div, p->error_ppb / 1000.0);
+    }
+    else{
+        printf("%-14s %6u %-4s  gpin%u               %12.6f  %3u  %3u  %+9.3f\n", mode, fs, mclk ? "mclk" : "",
+               p->src == I2S_CLOCK_SRC_GPIN0 ? 0 : 1, p->sys_hz / 1e6,
+               p->data_div, p->mclk_div, p->error_ppb / 1000.0);
+    }
+}
+
+static void print_table(void){
+    printf("// SPDX-License-Identifier: MIT\n\n");
+    printf("/**\n * @file i2s_clock_table.h\n * @brief CLOCK_MODE_DEFAULT dividers for common clk_sys and standard rates\n *\n");
+    printf(" * Generated by tools/clock_plan -t, do not edit\n */\n\n");
+    printf("//sys_hz, audio_clock, mclk_hz, data_int, mclk_int, data_frac, mclk_frac, data_jitter, mclk_jitter, error_ppb, mclk_error_ppb\n");
+    printf("static const I2S_CLOCK_DIV i2s_clock_table[] = {\n");
+    for (uint s = 0; s < sizeof(default_sys_hz) / sizeof(default_sys_hz[0]); s++){
+        for (uint i = 0; i < sizeof(standard_rates) / sizeof(standard_rates[0]); i++){
+            I2S_CLOCK_DIV d;
+            if (i2s_clock_compute_div(default_sys_hz[s], standard_rates[i], &d) == false){
+                continue;
+            }
+            printf("    {%u, %u, %u, %u, %u, %u, %u, %u, %u, %d, %d},\n", d.sys_hz, d.audio_clock, d.mclk_hz,
+                   d.data_int, d.mclk_int, d.data_frac, d.mclk_frac, d.data_jitter, d.mclk_jitter, d.error_ppb, d.mclk_error_ppb);
+        }
+    }
+    printf("};\n");
+}
+
+static void check_default(uint32_t sys_hz, uint32_t fs, bool quiet){
+    I2S_CLOCK_DIV table, computed;
+    bool in_table = i2s_clock_default_div(sys_hz, fs, &table);
+    double div, err;
+
+    if (i2s_clock_compute_div(sys_hz, fs, &computed) == false){
+        if (in_table){
+            fail("default", fs, true, "table entry for an unsupported rate");
+        }
+        return;
+    }
+    if (in_table == false || memcmp(&table, &computed, sizeof(table)) != 0){
+        fail("default", fs, true, "table differs from i2s_clock_compute_div, regenerate i2s_clock_table.h");
+    }
+
+    div = computed.data_int + computed.data_frac / 256.0;
+    err = ((double)sys_hz / (128.0 * div) / fs - 1.0) * 1e9;
+    if (err - computed.error_ppb > 2.0 || computed.error_ppb - err > 2.0) fail("default", fs, true, "reported error is wrong");
+    if ((uint64_t)sys_hz % ((uint64_t)fs * 128) == 0 && computed.data_frac != 0) fail("default", fs, true, "exact integer divider not used");
+    if ((computed.data_frac == 0) != (computed.data_jitter == 0)) fail("default", fs, true, "jitter period does not match the divider");
+
+    if (!quiet){
+        printf("%-14s %6u mclk  sys %3u MHz           %3u+%3u/256  %3u+%3u/256  %+9.3f  jitter %3u/%3u clocks\n", "default", fs, sys_hz / MHZ,
+               computed.data_int, computed.data_frac, computed.mclk_int, computed.mclk_frac,
+               computed.error_ppb / 1000.0, computed.data_jitter, computed.mclk_jitter);
+    }
+}
+
+static void check_default_init(const uint32_t* rates, uint n){
+    for (uint s = 0; s < sizeof(default_sys_hz) / sizeof(default_sys_hz[0]); s++){
+        bool started = false;
+
+        pico_host_reset(default_sys_hz[s]);
+        i2s_mclk_set_config(pio0, 0, 0, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+        for (uint i = 0; i < n; i++){
+            I2S_CLOCK_DIV div;
+
+            if (i2s_clock_default_div(default_sys_hz[s], rates[i], &div) == false){
+                continue;
+            }
+            if ((started == false ? i2s_mclk_init(rates[i]) : i2s_mclk_change_clock(rates[i])) == false){
+                fail("default", rates[i], true, "rejected by i2s_mclk_init or i2s_mclk_change_clock");
+            }
+            started = true;
+            if (i2s_get_clock_div() == NULL || i2s_get_clock_div()->audio_clock != rates[i]){
+                fail("default", rates[i], true, "dividers not recorded");
+            }
+            if (pico_host_sm_clkdiv(pio0, 0) != div.data_int + div.data_frac / 256.0f){
+                fail("default", rates[i], true, "data state machine divider not applied");
+            }
+            if (pico_host_sm_clkdiv(pio0, 1) != div.mclk_int + div.mclk_frac / 256.0f){
+                fail("default", rates[i], true, "MCLK state machine divider not applied");
+            }
+        }
+    }
+}
+
+static void check_init(const char* mode, CLOCK_MODE clock_mode, const uint32_t* rates, uint n){
+    bool started = false;
+
+    pico_host_reset(125 * MHZ);
+    i2s_mclk_set_config(pio0, 0, 0, false, clock_mode, MODE_I2S);
+
+    for (uint i = 0; i < n; i++){
+        I2S_CLOCK_PLAN plan;
+        const I2S_CLOCK_PLAN* applied;
+
+        if (i2s_clock_solve(rates[i], clock_mode, true, &plan) == false){
+            continue;
+        }
+        if ((started == false ? i2s_mclk_init(rates[i]) : i2s_mclk_change_clock(rates[i])) == false){
+            fail(mode, rates[i], true, "rejected by i2s_mclk_init or i2s_mclk_change_clock");
+        }
+        started = true;
+        applied = i2s_get_clock_plan();
+        if (applied == NULL || applied->sys_hz != plan.sys_hz || applied->data_div != plan.data_div){
+            fail(mode, rates[i], true, "applied plan differs from the solved plan");
+        }
+        if (clock_get_hz(clk_sys) != plan.sys_hz){
+            fail(mode, rates[i], true, "clk_sys not applied");
+        }
+        if (pico_host_sm_clkdiv(pio0, 0) != (float)plan.data_div){
+            fail(mode, rates[i], true, "data state machine divider not applied");
+        }
+        if (pico_host_sm_clkdiv(pio0, 1) != (float)plan.mclk_div){
+            fail(mode, rates[i], true, "MCLK state machine divider not applied");
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    const uint32_t* rates = standard_rates;
+    uint n = sizeof(standard_rates) / sizeof(standard_rates[0]);
+    uint32_t one_rate;
+    bool quiet = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:qt")) != -1){
+        switch (opt){
+        case 'r':
+            one_rate = strtoul(optarg, NULL, 0);
+            rates = &one_rate;
+            n = 1;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 't':
+            print_table();
+            return 0;
+        default:
+            fprintf(stderr, "usage: clock_plan [-r fs] [-q] [-t]\n");
+            return 2;
+        }
+    }
+
+    if (!quiet){
+        printf("%-14s %6s %-4s  %-19s %12s  %3s  %3s  %9s\n", "mode", "fs", "", "source", "clk_sys MHz", "div", "mck", "error ppm");
+    }
+    for (uint m = 0; m < sizeof(clock_modes) / sizeof(clock_modes[0]); m++){
+        for (uint i = 0; i < n; i++){
+            for (int mclk = 1; mclk >= 0; mclk--){
+                I2S_CLOCK_PLAN plan;
+                bool supported = (uint64_t)rates[i] * 128 <= clock_modes[m].sys_max;
+                if (i2s_clock_solve(rates[i], clock_modes[m].mode, mclk, &plan) == false){
+                    if (supported){
+                        fail(clock_modes[m].name, rates[i], mclk, "no plan");
+                    }
+                    else if (!quiet){
+                        printf("%-14s %6u %-4s  unsupported\n", clock_modes[m].name, rates[i], mclk ? "mclk" : "");
+                    }
+                    continue;
+                }
+                if (!supported){
+                    fail(clock_modes[m].name, rates[i], mclk, "plan for a rate above clk_sys / 128");
+                }
+                if (!quiet){
+                    print_plan(clock_modes[m].name, rates[i], mclk, &plan);
+                }
+                check_plan(clock_modes[m].name, clock_modes[m].sys_max, rates[i], mclk, &plan);
+            }
+        }
+        check_init(clock_modes[m].name, clock_modes[m].mode, rates, n);
+    }
+    for (uint s = 0; s < sizeof(default_sys_hz) / sizeof(default_sys_hz[0]); s++){
+        for (uint i = 0; i < n; i++){
+            check_default(default_sys_hz[s], rates[i], quiet);
+        }
+    }
+    check_default_init(rates, n);
+
+    printf("%s: %d failure%s\n", failures == 0 ? "PASS" : "FAIL", failures, failures == 1 ? "" : "s");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,516 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Check that configurations the hardware can not run are rejected without side effects
+ *
+ * Each case configures the library through the host stubs and expects
+ * i2s_mclk_init to return false with no program loaded, no state machine
+ * running, no pin taken and no DMA transfer started. Valid configurations next
+ * to them must still start.
+ *
+ * i2s_mclk_change_clock must reject rates it can not reach before it plays the
+ * queue out, with the output still running at the old rate.
+ *
+ * A second instance must not start on state machines, DMA channels or pins of
+ * a running one, and the running one must go on untouched.
+ *
+ * usage: config_check [-v]
+ *
+ * Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "pico_host.h"
+#include "i2s.h"
+
+#define CHECK_DMA 0
+#define DATA_PIN 18
+#define CLOCK_PIN 20
+#define MCLK_PIN 22
+#define SECOND_DMA 1
+#define SECOND_DATA_PIN 10
+#define SECOND_CLOCK_PIN 12
+#define SECOND_MCLK_PIN 14
+
+typedef struct {
+    const char* name;
+    bool (*setup)(void);    //Configures the default instance, false when a setter already refused
+    uint32_t sys_hz;        //clk_sys at init
+    uint32_t audio_clock;
+    bool valid;
+} init_case_t;
+
+typedef struct {
+    const char* name;
+    bool (*setup)(void);
+    uint32_t audio_clock;   //Started at
+    uint32_t new_clock;     //Then changed to
+    bool valid;
+} change_case_t;
+
+typedef struct {
+    const char* name;
+    bool first_core1;                       //The default instance runs on core1
+    void (*setup)(i2s_instance_t* inst);    //Configures the second instance
+    bool valid;
+} second_case_t;
+
+static int failures;
+static bool verbose;
+
+static void fail(const char* name, const char* what){
+    printf("FAIL %s: %s\n", name, what);
+    failures++;
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+//The library keeps its settings across cases, start each one from the defaults
+static void configure(I2S_MODE mode){
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_pin(DATA_PIN, CLOCK_PIN, MCLK_PIN);
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, false, CLOCK_MODE_DEFAULT, mode);
+    i2s_set_slave(false);
+    i2s_set_mclk_gpout(false);
+    i2s_set_chained_dma(false);
+    i2s_set_packed(false);
+    i2s_set_tdm(8, 32);
+    i2s_set_format(I2S_FORMAT_I2S, 32, 32);
+}
+
+static bool setup_i2s(void){
+    configure(MODE_I2S);
+    return true;
+}
+
+static bool setup_i2s_low_jitter(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, false, CLOCK_MODE_LOW_JITTER, MODE_I2S);
+    return true;
+}
+
+static bool setup_slave(I2S_MODE mode){
+    configure(mode);
+    i2s_set_slave(true);
+    return true;
+}
+
+static bool setup_slave_tdm(void){
+    return setup_slave(MODE_TDM);
+}
+
+static bool setup_slave_spdif(void){
+    return setup_slave(MODE_SPDIF);
+}
+
+static bool setup_slave_pt8211(void){
+    return setup_slave(MODE_PT8211);
+}
+
+//The slave program only takes i2s framing of 32 bit slots
+static bool setup_slave_lj(void){
+    setup_slave(MODE_I2S);
+    return i2s_set_format(I2S_FORMAT_LJ, 32, 32);
+}
+
+static bool setup_slave_core1(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, true, CLOCK_MODE_DEFAULT, MODE_I2S);
+    i2s_set_slave(true);
+    return true;
+}
+
+//GPIO22 has no clock generator
+static bool setup_gpout_22(void){
+    configure(MODE_I2S);
+    i2s_set_mclk_gpout(true);
+    return true;
+}
+
+static bool setup_gpout_23(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_pin(DATA_PIN, CLOCK_PIN, 23);
+    i2s_set_mclk_gpout(true);
+    return true;
+}
+
+static bool setup_data_pin_30(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_pin(30, CLOCK_PIN, MCLK_PIN);
+    return true;
+}
+
+//GPIO21 is BCLK
+static bool setup_mclk_on_bclk(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_pin(DATA_PIN, CLOCK_PIN, 21);
+    return true;
+}
+
+//The MCLK state machine would be sm 4
+static bool setup_sm3(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 3, CHECK_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+    return true;
+}
+
+static bool setup_sm3_gpout(void){
+    setup_gpout_23();
+    i2s_mclk_set_config(pio0, 3, CHECK_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+    return true;
+}
+
+static bool setup_sm1_claimed(void){
+    configure(MODE_I2S);
+    pio_sm_claim(pio0, 1);
+    return true;
+}
+
+static bool setup_dma_12(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 0, NUM_DMA_CHANNELS, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+    return true;
+}
+
+//Every channel but the data one is claimed elsewhere
+static bool setup_chained_no_channels(void){
+    configure(MODE_I2S);
+    i2s_set_chained_dma(true);
+    for (uint chan = 0; chan < NUM_DMA_CHANNELS; chan++){
+        if (chan != CHECK_DMA){
+            dma_channel_claim(chan);
+        }
+    }
+    return true;
+}
+
+//A frame of 24 bit slots is 96 cycles, the rate has to be divisible by 4
+static bool setup_i2s_24(void){
+    configure(MODE_I2S);
+    return i2s_set_format(I2S_FORMAT_I2S, 24, 24);
+}
+
+static bool setup_i2s_external(void){
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, false, CLOCK_MODE_EXTERNAL, MODE_I2S);
+    return true;
+}
+
+//The static buffer only holds 4 slots
+static bool setup_tdm16_static(void){
+    configure(MODE_TDM);
+    return i2s_set_tdm(16, 32);
+}
+
+static bool setup_tdm4_static(void){
+    configure(MODE_TDM);
+    return i2s_set_tdm(4, 32);
+}
+
+//Sized for MODE_I2S, then switched to 16 TDM slots. The arena stays for the cases after it
+static bool setup_buffer_then_tdm16(void){
+    static int32_t mem[I2S_BUFFER_SIZE(49, 4) / sizeof(int32_t)];
+
+    configure(MODE_I2S);
+    if (i2s_set_buffer(mem, sizeof(mem), 49, 4) == false){
+        return false;
+    }
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, false, CLOCK_MODE_DEFAULT, MODE_TDM);
+    return i2s_set_tdm(16, 32);
+}
+
+static const init_case_t init_cases[] = {
+    {"i2s 48kHz",                               setup_i2s,                  125000000, 48000, true},
+    {"low jitter 96kHz",                        setup_i2s_low_jitter,       125000000, 96000, true},
+    {"low jitter 1.536MHz, above clk_sys",      setup_i2s_low_jitter,       125000000, 1536000, false},
+    {"external 12345Hz, no integer divider",    setup_i2s_external,         125000000, 12345, false},
+    {"default 1.536MHz, divider below 1",       setup_i2s,                   125000000, 1536000, false},
+    {"gpout mclk on GPIO23",                    setup_gpout_23,             125000000, 48000, true},
+    {"gpout mclk on GPIO22, no generator",      setup_gpout_22,             125000000, 48000, false},
+    {"mclk state machine at a 20MHz clk_sys",   setup_i2s,                  20000000, 48000, true},
+    {"gpout mclk above a 20MHz clk_sys",        setup_gpout_23,             20000000, 48000, false},
+    {"24 bit slots at 44.1kHz",                 setup_i2s_24,               125000000, 44100, true},
+    {"24 bit slots at 22.05kHz",                setup_i2s_24,               125000000, 22050, false},
+    {"data pin 30, past the last GPIO",         setup_data_pin_30,          125000000, 48000, false},
+    {"mclk pin on BCLK",                        setup_mclk_on_bclk,         125000000, 48000, false},
+    {"sm 3, no sm 4 for MCLK",                  setup_sm3,                  125000000, 48000, false},
+    {"sm 3, gpout mclk",                        setup_sm3_gpout,            125000000, 48000, true},
+    {"sm 1 claimed elsewhere",                  setup_sm1_claimed,          125000000, 48000, false},
+    {"dma channel 12",                          setup_dma_12,               125000000, 48000, false},
+    {"chained dma, no channels left",           setup_chained_no_channels,  125000000, 48000, false},
+    {"slave pt8211",                            setup_slave_pt8211,         125000000, 48000, true},
+    {"slave tdm",                               setup_slave_tdm,            125000000, 48000, false},
+    {"slave spdif",                             setup_slave_spdif,          125000000, 48000, false},
+    {"slave lj",                                setup_slave_lj,             125000000, 48000, false},
+    {"slave on core1",                          setup_slave_core1,          125000000, 48000, false},
+    {"tdm 4 slots in the static buffer",        setup_tdm4_static,          125000000, 48000, true},
+    {"tdm 16 slots in the static buffer",       setup_tdm16_static,         125000000, 48000, false},
+    {"buffer sized for i2s, then tdm 16 slots", setup_buffer_then_tdm16,    125000000, 48000, false},
+};
+
+static const change_case_t change_cases[] = {
+    {"low jitter 48kHz to 96kHz",               setup_i2s_low_jitter,       48000, 96000, true},
+    {"low jitter 48kHz to 1.536MHz",            setup_i2s_low_jitter,       48000, 1536000, false},
+    {"external 48kHz to 12345Hz",               setup_i2s_external,         48000, 12345, false},
+    {"default 48kHz to 1.536MHz",               setup_i2s,                  48000, 1536000, false},
+    {"24 bit slots 48kHz to 22.05kHz",          setup_i2s_24,               48000, 22050, false},
+    {"gpout mclk 48kHz to 44.1kHz",             setup_gpout_23,             48000, 44100, true},
+};
+
+//Its own state machine, DMA channel and pins on pio1
+static void second_own(i2s_instance_t* inst){
+    i2s_inst_mclk_set_pin(inst, SECOND_DATA_PIN, SECOND_CLOCK_PIN, SECOND_MCLK_PIN);
+    i2s_inst_mclk_set_config(inst, pio1, 0, SECOND_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+static void second_same_sm(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio0, 0, SECOND_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+//sm 1 runs MCLK of the first
+static void second_on_mclk_sm(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio0, 1, SECOND_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+static void second_pio0_sm2(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio0, 2, SECOND_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+static void second_same_dma(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio1, 0, CHECK_DMA, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+static void second_same_pins(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_pin(inst, SECOND_DATA_PIN, CLOCK_PIN, SECOND_MCLK_PIN);
+}
+
+static void second_low_jitter(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio1, 0, SECOND_DMA, false, CLOCK_MODE_LOW_JITTER, MODE_I2S);
+}
+
+static void second_core1(i2s_instance_t* inst){
+    second_own(inst);
+    i2s_inst_mclk_set_config(inst, pio1, 0, SECOND_DMA, true, CLOCK_MODE_DEFAULT, MODE_I2S);
+}
+
+static const second_case_t second_cases[] = {
+    {"second on pio1, own pins and dma",        false,  second_own,         true},
+    {"second on pio0 sm 2",                     false,  second_pio0_sm2,    true},
+    {"second on the same sm",                   false,  second_same_sm,     false},
+    {"second on the mclk sm of the first",      false,  second_on_mclk_sm,  false},
+    {"second on the same dma channel",          false,  second_same_dma,    false},
+    {"second on the same clock pins",           false,  second_same_pins,   false},
+    {"second in low jitter mode",               false,  second_low_jitter,  false},
+    {"second on core1 next to the first",       true,   second_core1,       false},
+    {"second on core1 alone",                   false,  second_core1,       true},
+};
+
+//Nothing of the output may be left behind by a rejected init
+static void check_untouched(const char* name, uint32_t sys_hz){
+    if (pico_host_pio[0].used_instruction_space != 0){
+        fail(name, "a program was loaded");
+    }
+    if (pico_host_pio[0].sm_enabled_mask != 0){
+        fail(name, "a state machine was started");
+    }
+    if (pico_host_gpio_function(DATA_PIN) != GPIO_FUNC_NULL || pico_host_gpio_function(CLOCK_PIN) != GPIO_FUNC_NULL ||
+        pico_host_gpio_function(MCLK_PIN) != GPIO_FUNC_NULL || pico_host_gpio_function(23) != GPIO_FUNC_NULL){
+        fail(name, "a pin was taken");
+    }
+    if (pico_host_dma[CHECK_DMA].busy || pico_host_dma[CHECK_DMA].transfers != 0){
+        fail(name, "DMA was started");
+    }
+    if (clock_get_hz(clk_sys) != sys_hz){
+        fail(name, "clk_sys was changed");
+    }
+}
+
+static void run_init_case(const init_case_t* c){
+    bool ok;
+
+    pico_host_reset(c->sys_hz);
+    if (c->setup() == false){
+        //The setter refused it, init is not reached
+        if (c->valid){
+            fail(c->name, "setup rejected");
+        }
+        else if (verbose){
+            printf("%-48s rejected by the setter\n", c->name);
+        }
+        return;
+    }
+    ok = i2s_mclk_init(c->audio_clock);
+    if (verbose){
+        printf("%-48s i2s_mclk_init %s\n", c->name, ok ? "true" : "false");
+    }
+    if (ok != c->valid){
+        fail(c->name, c->valid ? "rejected" : "accepted");
+    }
+    if (ok == false){
+        check_untouched(c->name, c->sys_hz);
+    }
+    i2s_deinit();
+}
+
+//A rejected rate returns at once and leaves the output running at the old one
+static void run_change_case(const change_case_t* c){
+    uint32_t sys_hz, enabled;
+    float clkdiv;
+    uint64_t start;
+    bool ok;
+
+    pico_host_reset(125000000);
+    if (c->setup() == false || i2s_mclk_init(c->audio_clock) == false){
+        fail(c->name, "first init rejected");
+        i2s_deinit();
+        return;
+    }
+    sys_hz = clock_get_hz(clk_sys);
+    enabled = pico_host_pio[0].sm_enabled_mask;
+    clkdiv = pico_host_sm_clkdiv(pio0, 0);
+
+    start = time_us_64();
+    ok = i2s_mclk_change_clock(c->new_clock);
+    if (verbose){
+        printf("%-48s i2s_mclk_change_clock %s after %llu us\n", c->name, ok ? "true" : "false",
+               (unsigned long long)(time_us_64() - start));
+    }
+    if (ok != c->valid){
+        fail(c->name, c->valid ? "rejected" : "accepted");
+    }
+    if (ok == false){
+        if (time_us_64() != start){
+            fail(c->name, "waited before rejecting");
+        }
+        if (clock_get_hz(clk_sys) != sys_hz || pico_host_sm_clkdiv(pio0, 0) != clkdiv){
+            fail(c->name, "clocks were changed");
+        }
+        if (pico_host_pio[0].sm_enabled_mask != enabled){
+            fail(c->name, "output was stopped");
+        }
+    }
+    i2s_deinit();
+}
+
+//24 bit slots are refused while 22.05kHz runs, the output goes on with 32 bit slots
+static void run_format_case(void){
+    const char* name = "24 bit slots while 22.05kHz runs";
+    bool ok;
+
+    pico_host_reset(125000000);
+    configure(MODE_I2S);
+    if (i2s_mclk_init(22050) == false){
+        fail(name, "first init rejected");
+        i2s_deinit();
+        return;
+    }
+    ok = i2s_set_format(I2S_FORMAT_I2S, 24, 24);
+    if (verbose){
+        printf("%-48s i2s_set_format %s\n", name, ok ? "true" : "false");
+    }
+    if (ok == true){
+        fail(name, "accepted");
+    }
+    if (pico_host_pio[0].sm_enabled_mask == 0 || i2s_mclk_init(22050) == false){
+        fail(name, "output was stopped");
+    }
+    if (i2s_set_format(I2S_FORMAT_I2S, 16, 16) == false){
+        fail(name, "16 bit slots rejected");
+    }
+    i2s_deinit();
+}
+
+//A rejected second instance takes nothing, the first one goes on
+static void run_second_case(const second_case_t* c){
+    static int32_t mem[I2S_BUFFER_SIZE(49, 4) / sizeof(int32_t)];
+    i2s_instance_t* inst;
+    uint32_t programs;
+    bool ok, busy;
+
+    pico_host_reset(125000000);
+    configure(MODE_I2S);
+    i2s_mclk_set_config(pio0, 0, CHECK_DMA, c->first_core1, CLOCK_MODE_DEFAULT, MODE_I2S);
+    inst = i2s_instance_create();
+    if (inst == NULL || i2s_mclk_init(48000) == false){
+        fail(c->name, "first init rejected");
+        i2s_instance_destroy(inst);
+        i2s_deinit();
+        return;
+    }
+    programs = pico_host_pio[0].used_instruction_space;
+    busy = pico_host_dma[CHECK_DMA].busy;
+    i2s_inst_set_playback_handler(inst, no_playback_handler);
+    c->setup(inst);
+    i2s_inst_set_buffer(inst, mem, sizeof(mem), 49, 4);
+
+    ok = i2s_inst_mclk_init(inst, 48000);
+    if (verbose){
+        printf("%-48s i2s_inst_mclk_init %s\n", c->name, ok ? "true" : "false");
+    }
+    if (ok != c->valid){
+        fail(c->name, c->valid ? "rejected" : "accepted");
+    }
+    if (ok == false){
+        if (pico_host_pio[0].used_instruction_space != programs || pico_host_pio[1].used_instruction_space != 0){
+            fail(c->name, "a program was loaded");
+        }
+        if (pico_host_pio[0].sm_enabled_mask != 3 || pico_host_pio[1].sm_enabled_mask != 0){
+            fail(c->name, "state machines were changed");
+        }
+        if (pico_host_gpio_function(SECOND_DATA_PIN) != GPIO_FUNC_NULL || pico_host_gpio_function(SECOND_MCLK_PIN) != GPIO_FUNC_NULL ||
+            pico_host_gpio_function(CLOCK_PIN) != GPIO_FUNC_PIO0){
+            fail(c->name, "a pin was taken");
+        }
+        if (pico_host_dma[SECOND_DMA].transfers != 0 || pico_host_dma[CHECK_DMA].busy != busy){
+            fail(c->name, "DMA was changed");
+        }
+    }
+    i2s_instance_destroy(inst);
+    i2s_deinit();
+}
+
+int main(int argc, char** argv){
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1){
+        switch (opt){
+        case 'v': verbose = true; break;
+        default:
+            fprintf(stderr, "usage: config_check [-v]\n");
+            return 2;
+        }
+    }
+
+    for (uint i = 0; i < sizeof(init_cases) / sizeof(init_cases[0]); i++){
+        run_init_case(&init_cases[i]);
+    }
+    for (uint i = 0; i < sizeof(change_cases) / sizeof(change_cases[0]); i++){
+        run_change_case(&change_cases[i]);
+    }
+    run_format_case();
+    for (uint i = 0; i < sizeof(second_cases) / sizeof(second_cases[0]); i++){
+        run_second_case(&second_cases[i]);
+    }
+
+    if (failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
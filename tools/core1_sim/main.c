@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Run the default core1 loop on the host and change the rate after the queue drains
+ *
+ * core1 runs as a coroutine of the host stubs, woken whenever the DMA transfer
+ * it waits for completes at the audio rate. For queue depths 1, 2 and 8 the
+ * tool queues packets, lets core1 play them out and idle in mute, then calls
+ * i2s_mclk_change_clock and plays as many packets at the new rate.
+ *
+ * Checks that every queued frame leaves through DMA exactly once, that the
+ * producer gets every slot back and that the rate change only waits for the
+ * tail of the DMA buffers, not for its deadline.
+ *
+ * usage: core1_sim [-r fs] [-R fs] [-n frames] [-p packets]
+ *
+ * Exits with 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "pico_host.h"
+#include "i2s.h"
+
+#define SIM_DMA 0
+
+static uint32_t fs_now;
+static uint32_t last_transfers;
+static uint64_t transfer_end;
+static uint64_t frames_played;
+static int failures;
+
+static void usage(void){
+    fprintf(stderr, "usage: core1_sim [-r fs] [-R fs] [-n frames] [-p packets]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+//DMA moves a transfer in frames / fs, core1 runs whenever it may have work
+static void idle(uint64_t now_us){
+    pico_host_dma_channel_t* c = &pico_host_dma[SIM_DMA];
+
+    pico_host_core1_run();
+    if (c->busy == false){
+        return;
+    }
+    if (c->transfers != last_transfers){
+        last_transfers = c->transfers;
+        transfer_end = now_us + (uint64_t)c->transfer_count / 2 * 1000000 / fs_now;
+    }
+    if (now_us >= transfer_end){
+        //Mute is all zeros, every queued sample is not
+        for (uint32_t i = 0; i < c->transfer_count; i += 2){
+            const volatile int32_t* w = (const volatile int32_t*)c->read_addr + i;
+            frames_played += w[0] != 0 || w[1] != 0;
+        }
+        pico_host_dma_complete(SIM_DMA);
+        pico_host_core1_run();
+    }
+}
+
+static bool wait_until(bool (*done)(void), uint64_t timeout_us){
+    uint64_t deadline = time_us_64() + timeout_us;
+
+    while (done() == false){
+        if (time_us_64() >= deadline){
+            return false;
+        }
+        tight_loop_contents();
+    }
+    return true;
+}
+
+//sleep_us calls the idle handler once, DMA needs it every microsecond
+static void play_us(uint64_t us){
+    uint64_t end = time_us_64() + us;
+
+    while (time_us_64() < end){
+        tight_loop_contents();
+    }
+}
+
+static bool drained(void){
+    return i2s_get_buf_length() == 0;
+}
+
+static bool produce(uint32_t frames, uint packets, int16_t* packet){
+    for (uint p = 0; p < packets; p++){
+        for (uint32_t i = 0; i < frames * 2; i++){
+            packet[i] = (int16_t)(0x1000 + ((p * frames * 2 + i) & 0x3fff));
+        }
+        uint64_t deadline = time_us_64() + 1000000;
+        while (i2s_enqueue((uint8_t*)packet, frames * 2 * sizeof(int16_t), 16) == false){
+            if (time_us_64() >= deadline){
+                return false;
+            }
+            tight_loop_contents();
+        }
+    }
+    return true;
+}
+
+static void run(uint8_t depth, uint32_t fs, uint32_t fs2, uint32_t frames, uint packets){
+    static int32_t arena[64 * 1024];
+    int16_t* packet = malloc(frames * 2 * sizeof(int16_t));
+    uint64_t start, elapsed, tail_us;
+
+    pico_host_reset(125000000);
+    pico_host_set_idle_handler(idle);
+    last_transfers = 0;
+    frames_played = 0;
+    fs_now = fs;
+
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_config(pio0, 0, SIM_DMA, true, CLOCK_MODE_DEFAULT, MODE_I2S);
+    if (i2s_set_buffer(arena, sizeof(arena), frames, depth) == false){
+        printf("FAIL depth %u: buffer does not fit\n", depth);
+        failures++;
+        free(packet);
+        return;
+    }
+    i2s_volume_change(0, 0);
+    if (i2s_mclk_init(fs) == false){
+        printf("FAIL depth %u: i2s_mclk_init(%u) failed\n", depth, fs);
+        failures++;
+        free(packet);
+        return;
+    }
+
+    if (produce(frames, packets, packet) == false){
+        printf("FAIL depth %u: the producer never got a slot back at %u Hz\n", depth, fs);
+        failures++;
+    }
+    else if (wait_until(drained, 1000000) == false){
+        printf("FAIL depth %u: core1 did not drain the queue\n", depth);
+        failures++;
+    }
+    //Play the DMA buffers out and idle in mute for a while
+    play_us(10000);
+
+    //Only the FIFO and the two DMA buffers of core1 are left to play
+    tail_us = (uint64_t)(8 / 2 + 1 + 2 * frames) * 1000000 / fs + 1;
+    start = time_us_64();
+    if (i2s_mclk_change_clock(fs2) == false){
+        printf("FAIL depth %u: i2s_mclk_change_clock(%u) rejected\n", depth, fs2);
+        failures++;
+    }
+    elapsed = time_us_64() - start;
+    fs_now = fs2;
+    if (elapsed > tail_us + 100){
+        printf("FAIL depth %u: i2s_mclk_change_clock took %llu us, the tail is %llu us\n",
+               depth, (unsigned long long)elapsed, (unsigned long long)tail_us);
+        failures++;
+    }
+
+    if (produce(frames, packets, packet) == false){
+        printf("FAIL depth %u: the producer never got a slot back at %u Hz\n", depth, fs2);
+        failures++;
+    }
+    else if (wait_until(drained, 1000000) == false){
+        printf("FAIL depth %u: core1 did not drain the queue at %u Hz\n", depth, fs2);
+        failures++;
+    }
+    play_us(10000);
+
+    if (frames_played != 2ull * packets * frames){
+        printf("FAIL depth %u: %llu frames played, %llu queued\n",
+               depth, (unsigned long long)frames_played, 2ull * packets * frames);
+        failures++;
+    }
+    printf("depth %u: %u -> %u Hz, change_clock %llu us (tail %llu us), %llu frames played\n",
+           depth, fs, fs2, (unsigned long long)elapsed, (unsigned long long)tail_us, (unsigned long long)frames_played);
+
+    i2s_deinit();
+    pico_host_set_idle_handler(NULL);
+    free(packet);
+}
+
+int main(int argc, char** argv){
+    static const uint8_t depths[] = {1, 2, 8};
+    uint32_t fs = 48000, fs2 = 44100, frames = 96;
+    uint packets = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:R:n:p:")) != -1){
+        switch (opt){
+        case 'r': fs = strtoul(optarg, NULL, 0); break;
+        case 'R': fs2 = strtoul(optarg, NULL, 0); break;
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'p': packets = strtoul(optarg, NULL, 0); break;
+        default: usage();
+        }
+    }
+    if (fs < 1000 || fs2 < 1000 || frames == 0 || frames > 1024 || packets == 0) usage();
+
+    for (uint i = 0; i < sizeof(depths) / sizeof(depths[0]); i++){
+        run(depths[i], fs, fs2, frames, packets);
+    }
+    if (failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
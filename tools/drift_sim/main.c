@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Simulation of the sampling frequency drift estimator
+ *
+ * The device clock is off by the given ppm against the system timer. DMA
+ * completions are timestamped with gaussian interrupt latency, occasional
+ * late interrupts and 1us timer resolution, and the estimator is polled
+ * every few ms. By default the timestamps go straight into an estimator,
+ * with -e they are taken by i2s_handler and read back with i2s_get_drift.
+ * Prints the estimate over time, the settling time and the final error.
+ *
+ * usage: drift_sim [-r fs] [-p ppm] [-d ppm] [-j sigma_us] [-s spike_rate] [-S spike_us] [-i poll_ms] [-t seconds] [-e] [-v]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pico_host.h"
+#include "i2s.h"
+#include "i2s_drift.h"
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static double uniform(void){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void){
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static void usage(void){
+    fprintf(stderr, "usage: drift_sim [-r fs] [-p ppm] [-d ppm] [-j sigma_us] [-s spike_rate] [-S spike_us] [-i poll_ms] [-t seconds] [-e] [-v]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+int main(int argc, char** argv){
+    uint32_t fs = 48000;
+    double ppm = 150.0, step = 0.0, jitter = 3.0, spike_rate = 0.01, spike_us = 200.0;
+    double poll_ms = 10.0, seconds = 60.0;
+    bool end_to_end = false, verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:p:d:j:s:S:i:t:ev")) != -1){
+        switch (opt){
+        case 'r': fs = strtoul(optarg, NULL, 0); break;
+        case 'p': ppm = atof(optarg); break;
+        case 'd': step = atof(optarg); break;
+        case 'j': jitter = atof(optarg); break;
+        case 's': spike_rate = atof(optarg); break;
+        case 'S': spike_us = atof(optarg); break;
+        case 'i': poll_ms = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'e': end_to_end = true; break;
+        case 'v': verbose = true; break;
+        default: usage();
+        }
+    }
+    if (fs < 1000 || seconds <= 0.0 || poll_ms <= 0.0) usage();
+
+    I2S_DRIFT_ESTIMATOR est;
+    I2S_DRIFT drift = {0};
+    static int16_t packet[I2S_DATA_FRAMES * 2];
+    const uint32_t packet_frames = fs / 1000 < I2S_DATA_FRAMES ? fs / 1000 : I2S_DATA_FRAMES;
+    //Frames per DMA transfer in the direct mode, one USB packet
+    uint32_t frames = 0, transfer = packet_frames;
+    double now = 0.0, dma_end = 0.0, next_poll = 0.0, device_ppm = ppm, settled = -1.0, max_after = 0.0;
+    uint64_t host_us = 0;
+
+    pico_host_reset(125000000);
+    if (end_to_end){
+        set_playback_handler(no_playback_handler);
+        i2s_mclk_set_config(pio0, 0, 0, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+        i2s_mclk_init(fs);
+        transfer = pico_host_dma[0].transfer_count / 2;
+        dma_end = transfer / (fs * (1.0 + ppm * 1e-6));
+    }
+    else {
+        i2s_drift_init(&est, fs);
+        i2s_drift_update(&est, 0, 0);
+        dma_end = transfer / (fs * (1.0 + ppm * 1e-6));
+    }
+
+    if (verbose){
+        printf("t_ms,true_ppm,ppm,uncertainty_ppm,confidence\n");
+    }
+
+    while (now < seconds){
+        if (dma_end > next_poll){
+            //Poll
+            now = next_poll;
+            next_poll += poll_ms / 1000.0;
+            if (end_to_end){
+                uint64_t t = (uint64_t)(now * 1e6);
+                if (t > host_us){
+                    pico_host_advance_time_us(t - host_us);
+                    host_us = t;
+                }
+                i2s_get_drift(&drift);
+                //Keep the queue fed so the handler plays packets
+                while (i2s_get_buf_length() < I2S_BUF_DEPTH - 1){
+                    i2s_enqueue((uint8_t*)packet, packet_frames * 4, 16);
+                }
+            }
+            else {
+                i2s_drift_result(&est, &drift);
+            }
+
+            double err = fabs(drift.ppm - device_ppm);
+            if (err > 1.0 || drift.confidence < 0.5){
+                settled = -1.0;
+            }
+            else if (settled < 0.0){
+                settled = now;
+            }
+            if (settled >= 0.0 && err > max_after){
+                max_after = err;
+            }
+            if (verbose){
+                printf("%.0f,%.3f,%.3f,%.3f,%.3f\n", now * 1000.0, device_ppm, drift.ppm, drift.uncertainty_ppm, drift.confidence);
+            }
+            continue;
+        }
+
+        //DMA finished, the interrupt is taken after some latency
+        now = dma_end;
+        if (step != 0.0 && now >= seconds / 2 && device_ppm == ppm){
+            device_ppm = ppm + step;
+            settled = -1.0;
+            max_after = 0.0;
+        }
+        double latency = 2.0 + jitter * fabs(gaussian());
+        if (uniform() < spike_rate){
+            latency += spike_us * uniform();
+        }
+        uint64_t t = (uint64_t)(now * 1e6 + latency);
+        uint32_t started;
+
+        if (end_to_end){
+            if (t > host_us){
+                pico_host_advance_time_us(t - host_us);
+                host_us = t;
+            }
+            pico_host_dma_complete(0);
+            started = pico_host_dma[0].transfer_count / 2;
+        }
+        else {
+            frames += transfer;
+            i2s_drift_update(&est, frames, (uint32_t)t);
+            started = transfer;
+        }
+        //The PIO FIFO covers the latency, the next transfer finishes one transfer of audio later
+        transfer = started;
+        dma_end += transfer / (fs * (1.0 + device_ppm * 1e-6));
+    }
+
+    fprintf(verbose ? stderr : stdout,
+            "fs %u Hz, device %+.3f ppm, jitter %.1f us, spikes %.3f x %.0f us, poll %.1f ms%s\n"
+            "estimate %+.3f ppm (error %.3f), uncertainty %.3f ppm, confidence %.3f\n"
+            "within 1 ppm and confident since %.3f s, max error since %.3f ppm\n",
+            fs, device_ppm, jitter, spike_rate, spike_us, poll_ms, end_to_end ? ", through i2s_handler" : "",
+            drift.ppm, drift.ppm - device_ppm, drift.uncertainty_ppm, drift.confidence,
+            settled, max_after);
+
+    return settled >= 0.0 ? 0 : 1;
+}
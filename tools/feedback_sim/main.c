@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Closed loop simulation of the asynchronous feedback controller
+ *
+ * A USB host sends one packet per 1ms, sized by the last feedback value the
+ * device reported, while DMA consumes the i2s buffer at the device's clock,
+ * which is off by the given ppm. Prints the buffer level and feedback over
+ * time and the underruns/overruns the library counted.
+ *
+ * usage: feedback_sim [-r fs] [-p ppm] [-t seconds] [-k kp] [-i ki] [-f 10.14|16.16] [-v]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico_host.h"
+#include "i2s.h"
+#include "i2s_feedback.h"
+
+static void usage(void){
+    fprintf(stderr, "usage: feedback_sim [-r fs] [-p ppm] [-t seconds] [-k kp] [-i ki] [-f 10.14|16.16] [-v]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+//The host clock follows the simulated time, i2s_get_buffered_frames reads the running transfer from it
+static uint64_t advance_to(double now, uint64_t host_us){
+    uint64_t us = (uint64_t)(now * 1e6);
+
+    pico_host_advance_time_us(us - host_us);
+    return us;
+}
+
+int main(int argc, char** argv){
+    uint32_t fs = 48000;
+    double ppm = 200.0, seconds = 20.0;
+    float kp = 1.0f / 256.0f, ki = 1.0f / 262144.0f;
+    FEEDBACK_FORMAT format = FEEDBACK_FORMAT_10_14;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:p:t:k:i:f:v")) != -1){
+        switch (opt){
+        case 'r': fs = strtoul(optarg, NULL, 0); break;
+        case 'p': ppm = atof(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'k': kp = (float)atof(optarg); break;
+        case 'i': ki = (float)atof(optarg); break;
+        case 'f':
+            if (strcmp(optarg, "16.16") == 0) format = FEEDBACK_FORMAT_16_16;
+            else if (strcmp(optarg, "10.14") == 0) format = FEEDBACK_FORMAT_10_14;
+            else usage();
+            break;
+        case 'v': verbose = true; break;
+        default: usage();
+        }
+    }
+    if (fs < 1000 || seconds <= 0.0) usage();
+
+    pico_host_reset(125000000);
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_config(pio0, 0, 0, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+    i2s_volume_change(0, 0);
+    if (i2s_mclk_init(fs) == false){
+        fprintf(stderr, "i2s_mclk_init(%u) failed\n", fs);
+        return 1;
+    }
+    i2s_feedback_init(fs, 0, format);
+    i2s_feedback_set_gain(kp, ki);
+
+    //Feedback back to Q16 frames/ms
+    const uint shift = format == FEEDBACK_FORMAT_16_16 ? 3 : 2;
+    const double device_fs = fs * (1.0 + ppm * 1e-6);
+    const uint32_t target = i2s_get_buf_depth() * (fs / 1000) / 2;
+    static int16_t packet[I2S_DATA_FRAMES * 2];
+
+    double now = 0.0, dma_end = 0.0, next_sof = 0.0;
+    uint64_t host_us = 0;
+    uint64_t acc = 0;
+    uint32_t fb = i2s_feedback_get();
+    uint32_t level_min = UINT32_MAX, level_max = 0;
+    double settled = -1.0;
+    uint32_t band = fs / 1000;
+
+    if (verbose){
+        printf("t_ms,level,feedback_frames_per_ms\n");
+    }
+
+    while (now < seconds){
+        if (dma_end <= next_sof){
+            //DMA finished, i2s_handler starts the next transfer
+            now = dma_end;
+            host_us = advance_to(now, host_us);
+            pico_host_dma_complete(0);
+            dma_end = now + pico_host_dma[0].transfer_count / 2 / device_fs;
+            continue;
+        }
+
+        now = next_sof;
+        next_sof += 0.001;
+        host_us = advance_to(now, host_us);
+
+        //Host: frames for this packet from the last reported feedback
+        acc += (uint64_t)fb << shift;
+        uint32_t frames = (uint32_t)(acc >> 16);
+        acc -= (uint64_t)frames << 16;
+        if (frames > I2S_DATA_FRAMES) frames = I2S_DATA_FRAMES;
+        i2s_enqueue((uint8_t*)packet, frames * 4, 16);
+
+        //Device: SOF
+        fb = i2s_feedback_update();
+
+        uint32_t level = i2s_get_buffered_frames();
+        if (now > 1.0){
+            if (level < level_min) level_min = level;
+            if (level > level_max) level_max = level;
+        }
+        if ((int32_t)(level - target) > (int32_t)band || (int32_t)(target - level) > (int32_t)band){
+            settled = -1.0;
+        }
+        else if (settled < 0.0){
+            settled = now;
+        }
+        if (verbose){
+            printf("%.0f,%u,%.6f\n", now * 1000.0, level, (double)((uint64_t)fb << shift) / 65536.0);
+        }
+    }
+
+    I2S_STATS stats;
+    i2s_get_stats(&stats);
+    fprintf(verbose ? stderr : stdout,
+            "fs %u Hz, device %+.1f ppm, kp %g, ki %g, target %u frames\n"
+            "level after 1s: min %u max %u frames, within +-%u frames since %.3f s\n"
+            "feedback %.6f frames/ms (device %.6f)\n"
+            "underruns %u overruns %u\n",
+            fs, ppm, kp, ki, target, level_min, level_max, band, settled,
+            (double)((uint64_t)fb << shift) / 65536.0, device_fs / 1000.0,
+            stats.underruns, stats.overruns);
+
+    return stats.underruns == 0 && stats.overruns == 0 && settled >= 0.0 ? 0 : 1;
+}
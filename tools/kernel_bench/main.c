@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Cycles per frame of the fused enqueue kernels against the three pass path they replaced
+ *
+ * The three pass path is kept here as i2s_enqueue had it: unpack into L and R
+ * work buffers, apply volume to both, then interleave (or rearrange for EXDF
+ * and the dual modes) into the slot. The fused path is i2s_enqueue itself,
+ * with the cost of an empty packet through the queue taken off.
+ *
+ * For MODE_I2S, MODE_EXDF and MODE_I2S_DUAL at 16, 24 and 32 bits, at 0dB and
+ * -6dB, checks that both paths give the same words and prints host cycles and
+ * nanoseconds per frame. Build with -DCMAKE_BUILD_TYPE=Release for meaningful
+ * timing.
+ *
+ * usage: kernel_bench [-n frames] [-p packets]
+ *
+ * Exits with 1 if the paths differ.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#include "pico/stdlib.h"
+#include "pico_host.h"
+#include "i2s.h"
+
+#define BENCH_DMA   0
+#define BENCH_RUNS  5           //The fastest run counts
+
+//db_to_vol of i2s.c at 0dB and -6dB, Q29
+#define VOL_0DB     0x20000000
+#define VOL_6DB     0x1009b9cf
+
+typedef struct {
+    const char* name;
+    I2S_MODE mode;
+} bench_mode_t;
+
+typedef struct {
+    double cycles;
+    double ns;
+} bench_time_t;
+
+static int failures;
+
+static void usage(void){
+    fprintf(stderr, "usage: kernel_bench [-n frames] [-p packets]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+static uint64_t cycles(void){
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static double now_ns(void){
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static inline int32_t old_apply_volume(int32_t x, int32_t mul){
+    return (int32_t)(((int64_t)x * mul) >> 29u);
+}
+
+static inline void old_store_exdf(int32_t* d, int32_t l, int32_t r){
+    uint64_t merged = (part1by1_32(l) << 1) | part1by1_32(r);
+
+    d[0] = (uint32_t)(merged >> 32);
+    d[1] = (uint32_t)(merged & 0xFFFFFFFF);
+}
+
+static inline void old_store_dual(int32_t* d, int32_t l, int32_t r){
+    old_store_exdf(d, l, r);
+    old_store_exdf(d + 2, l == INT32_MIN ? INT32_MAX : -l, r == INT32_MIN ? INT32_MAX : -r);
+}
+
+/**
+ * @brief The three passes of i2s_enqueue before the kernels were fused
+ *
+ * @return int Words written to slot
+ */
+static int old_enqueue(int32_t* slot, const uint8_t* in, int sample, uint8_t resolution, I2S_MODE mode,
+                       int32_t mul_l, int32_t mul_r, int32_t* lch_buf, int32_t* rch_buf){
+    int i, j;
+
+    if (resolution == 16){
+        const int16_t* d = (const int16_t*)in;
+        sample /= 2;
+        for (i = 0; i < sample / 2; i++){
+            lch_buf[i] = (int32_t)((uint32_t)(uint16_t)*d++ << 16);
+            rch_buf[i] = (int32_t)((uint32_t)(uint16_t)*d++ << 16);
+        }
+    }
+    else if (resolution == 24){
+        const uint8_t* d = in;
+        uint32_t e;
+        sample /= 3;
+        for (i = 0; i < sample / 2; i++){
+            e = 0;
+            e |= (uint32_t)*d++ << 8;
+            e |= (uint32_t)*d++ << 16;
+            e |= (uint32_t)*d++ << 24;
+            lch_buf[i] = (int32_t)e;
+            e = 0;
+            e |= (uint32_t)*d++ << 8;
+            e |= (uint32_t)*d++ << 16;
+            e |= (uint32_t)*d++ << 24;
+            rch_buf[i] = (int32_t)e;
+        }
+    }
+    else {
+        const int32_t* d = (const int32_t*)in;
+        sample /= 4;
+        for (i = 0; i < sample / 2; i++){
+            lch_buf[i] = *d++;
+            rch_buf[i] = *d++;
+        }
+    }
+
+    //Volume processing
+    for (i = 0; i < sample / 2; i++){
+        lch_buf[i] = old_apply_volume(lch_buf[i], mul_l);
+        rch_buf[i] = old_apply_volume(rch_buf[i], mul_r);
+    }
+
+    //Store in i2s buffer
+    if (mode == MODE_EXDF){
+        for (i = 0; i < sample / 2; i++){
+            old_store_exdf(&slot[i * 2], lch_buf[i], rch_buf[i]);
+        }
+    }
+    else if (mode == MODE_I2S_DUAL){
+        for (i = 0; i < sample / 2; i++){
+            old_store_dual(&slot[i * 4], lch_buf[i], rch_buf[i]);
+        }
+        sample *= 2;
+    }
+    else {
+        j = 0;
+        for (i = 0; i < sample / 2; i++){
+            slot[j++] = lch_buf[i];
+            slot[j++] = rch_buf[i];
+        }
+    }
+    return sample;
+}
+
+//i2s_enqueue of one packet and i2s_dequeue to hand the slot back
+static bool fused_enqueue(const uint8_t* in, int sample, uint8_t resolution, int32_t** out, int* words){
+    return i2s_enqueue((uint8_t*)in, sample, resolution) == true && i2s_dequeue(out, words) == true;
+}
+
+static bench_time_t time_old(const uint8_t* in, int sample, uint8_t resolution, I2S_MODE mode, int32_t mul,
+                             uint32_t frames, uint32_t packets, int32_t* slot, int32_t* lch, int32_t* rch){
+    bench_time_t best = {0, 0};
+
+    for (int run = 0; run < BENCH_RUNS; run++){
+        double t0 = now_ns();
+        uint64_t c0 = cycles();
+        for (uint32_t p = 0; p < packets; p++){
+            old_enqueue(slot, in, sample, resolution, mode, mul, mul, lch, rch);
+            __asm__ volatile("" ::: "memory");
+        }
+        uint64_t c1 = cycles();
+        double t1 = now_ns();
+        bench_time_t t = {(double)(c1 - c0) / packets / frames, (t1 - t0) / packets / frames};
+        if (run == 0 || t.ns < best.ns){
+            best = t;
+        }
+    }
+    return best;
+}
+
+static bench_time_t time_fused(const uint8_t* in, int sample, uint8_t resolution, uint32_t packets){
+    bench_time_t best = {0, 0};
+    int32_t* out;
+    int words;
+
+    for (int run = 0; run < BENCH_RUNS; run++){
+        double t0 = now_ns();
+        uint64_t c0 = cycles();
+        for (uint32_t p = 0; p < packets; p++){
+            fused_enqueue(in, sample, resolution, &out, &words);
+        }
+        uint64_t c1 = cycles();
+        double t1 = now_ns();
+        bench_time_t t = {(double)(c1 - c0) / packets, (t1 - t0) / packets};
+        if (run == 0 || t.ns < best.ns){
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void run(const bench_mode_t* m, uint8_t resolution, int32_t mul, uint32_t frames, uint32_t packets){
+    static int32_t arena[64 * 1024];
+    int sample = frames * 2 * resolution / 8;
+    uint8_t* in = malloc(sample);
+    int32_t* slot = malloc(frames * 4 * sizeof(int32_t));
+    int32_t* lch = malloc(frames * sizeof(int32_t));
+    int32_t* rch = malloc(frames * sizeof(int32_t));
+    bench_time_t old, fused, queue;
+    int32_t* out;
+    int words, old_words;
+
+    pico_host_reset(125000000);
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_config(pio0, 0, BENCH_DMA, false, CLOCK_MODE_DEFAULT, m->mode);
+    if (i2s_set_buffer(arena, sizeof(arena), frames, 8) == false){
+        printf("FAIL %s %u bit: buffer does not fit\n", m->name, resolution);
+        failures++;
+        goto done;
+    }
+    i2s_volume_change(mul == VOL_0DB ? 0 : -6 * 256, 0);
+    if (i2s_mclk_init(48000) == false){
+        printf("FAIL %s %u bit: i2s_mclk_init failed\n", m->name, resolution);
+        failures++;
+        goto done;
+    }
+
+    //Full scale noise, the extremes included
+    srand(resolution * 7 + m->mode);
+    for (int i = 0; i < sample; i++){
+        in[i] = (uint8_t)rand();
+    }
+    in[0] = in[1] = 0;
+    in[resolution / 8 - 1] = 0x80;
+
+    old_words = old_enqueue(slot, in, sample, resolution, m->mode, mul, mul, lch, rch);
+    if (fused_enqueue(in, sample, resolution, &out, &words) == false || words != old_words){
+        printf("FAIL %s %u bit: %d words, the three pass path wrote %d\n", m->name, resolution, words, old_words);
+        failures++;
+        goto done;
+    }
+    for (int i = 0; i < words; i++){
+        if (out[i] != slot[i]){
+            printf("FAIL %s %u bit %s: word %d is %08x, the three pass path wrote %08x\n",
+                   m->name, resolution, mul == VOL_0DB ? "0dB" : "-6dB", i, (unsigned)out[i], (unsigned)slot[i]);
+            failures++;
+            goto done;
+        }
+    }
+
+    old = time_old(in, sample, resolution, m->mode, mul, frames, packets, slot, lch, rch);
+    fused = time_fused(in, sample, resolution, packets);
+    queue = time_fused(in, 0, resolution, packets);
+    fused.cycles = (fused.cycles - queue.cycles) / frames;
+    fused.ns = (fused.ns - queue.ns) / frames;
+    printf("%-9s %2u bit %4s  %8.2f %8.2f   %8.2f %8.2f   %5.2fx\n", m->name, resolution, mul == VOL_0DB ? "0dB" : "-6dB",
+           old.cycles, old.ns, fused.cycles, fused.ns, old.ns / fused.ns);
+
+done:
+    i2s_deinit();
+    free(in);
+    free(slot);
+    free(lch);
+    free(rch);
+}
+
+int main(int argc, char** argv){
+    static const bench_mode_t modes[] = {
+        {"i2s",         MODE_I2S},
+        {"exdf",        MODE_EXDF},
+        {"i2s_dual",    MODE_I2S_DUAL},
+    };
+    static const uint8_t resolutions[] = {16, 24, 32};
+    uint32_t frames = 48, packets = 20000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1){
+        switch (opt){
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'p': packets = strtoul(optarg, NULL, 0); break;
+        default: usage();
+        }
+    }
+    if (frames == 0 || frames > 1024 || packets == 0) usage();
+
+    printf("%u frames per packet, fastest of %d runs of %u packets\n", frames, BENCH_RUNS, packets);
+    printf("                        three pass        fused\n");
+    printf("mode      res    vol    cyc/frm   ns/frm    cyc/frm   ns/frm   speedup\n");
+    for (uint i = 0; i < sizeof(modes) / sizeof(modes[0]); i++){
+        for (uint j = 0; j < sizeof(resolutions); j++){
+            run(&modes[i], resolutions[j], VOL_0DB, frames, packets);
+            run(&modes[i], resolutions[j], VOL_6DB, frames, packets);
+        }
+    }
+    if (failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,1202 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Run the i2s PIO programs on the PIO simulator and check their output
+ *
+ * Configures the library through the host stubs exactly like firmware does,
+ * feeds the data state machine from the DMA transfers i2s_handler starts and
+ * samples the pins every clk_sys cycle.
+ *
+ * usage: pio_sim [-m mode] [-r fs] [-c clock_mode] [-s clk_sys] [-n frames] [-o trace.vcd] [-d] [-g] [-S] [-L ms] [-R fs] [-M fs] [-t slots] [-w bits] [-C]
+ *                [-f format] [-j bits] [-p]
+ *
+ * -d runs the data channel from the chained DMA control block ring
+ * -g takes MCLK from clk_gpout1 on GPIO23, modelled from its CTRL and DIV registers
+ * -S runs the library in slave mode, the tool drives BCLK and LRCLK as the master
+ * -L stops the master clocks for LOSS_MS after ms, then restarts them from a new frame
+ * -R starts at another rate first, so the run checks the restart path of i2s_mclk_init
+ * -M runs a second instance in MODE_I2S on pio1 at fs next to the first one, its DMA completions go to DMA_IRQ_1
+ * -t, -w set the slot count and width of -m tdm (default 8 x 32). FSYNC is checked to precede slot 0 of every frame
+ * -m dsd feeds DoP at fs (default 176400, DSD64) with some frames lacking the marker. The DSD bits sent are checked
+ * against the DoP payload, frames without the marker must come out as DSD silence. There is no LRCLK, frames are
+ * counted as 16 DCLK
+ * -C captures on CAPTURE_PIN, wired to the data output, and checks the captured words against the words sent (MODE_I2S)
+ * -f i2s|lj|rj, -w and -j set the justification, slot width and RJ sample width of -m i2s (default i2s, 32, 32).
+ * RJ pad bits must come out as zeros and LRCLK is checked on every bit
+ * -p packs each frame into one FIFO word (-m pt8211, -m i2s -w 16) and queues 16bit packets. The words DMA moves are
+ * checked against the packets, one word per frame
+ * -m spdif decodes the S/PDIF line from its edge spacing: biphase mark cells, B/M/W preambles, parity, the channel
+ * status of every whole block and the samples against the 24 bits queued. "frame" and "cell" count state machine cycles
+ *
+ * i2s_deinit runs at the end and must leave no program or DMA channel behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico_host.h"
+#include "i2s.h"
+#include "i2s_clock.h"
+#include "pio_sim.h"
+
+#define DATA_PIN    18
+#define CLOCK_PIN   20
+#define MCLK_PIN    22
+#define GPOUT_PIN   23
+#define GPOUT_CLK   clk_gpout1
+
+#define SIM_SM      0
+#define SIM_DMA     0
+
+//Second instance
+#define LINE_DATA_PIN   10
+#define LINE_CLOCK_PIN  12
+#define LINE_MCLK_PIN   14
+
+#define LOSS_MS     20
+
+//Capture loopback
+#define CAPTURE_PIN     17
+#define CAPTURE_SM      2
+#define CAPTURE_DMA     6
+#define CAPTURE_DEPTH   8
+
+typedef struct {
+    const char* name;
+    I2S_MODE mode;
+    uint data_pins;
+    uint bits_per_word;     //bits a state machine sends from each FIFO word
+    bool mclk;
+    uint bclk_per_frame;    //of a master in slave mode, 0: no slave mode
+} sim_mode_t;
+
+static const sim_mode_t sim_modes[] = {
+    {"i2s",         MODE_I2S,           1, 32, true,  64},
+    {"pt8211",      MODE_PT8211,        1, 16, false, 32},
+    {"exdf",        MODE_EXDF,          2, 32, true,  0},
+    {"i2s_dual",    MODE_I2S_DUAL,      2, 32, true,  64},
+    {"pt8211_dual", MODE_PT8211_DUAL,   2, 16, false, 32},
+    {"tdm",         MODE_TDM,           1, 32, true,  0},
+    {"dsd",         MODE_DSD,           2, 16, true,  0},
+    {"spdif",       MODE_SPDIF,         1, 32, false, 0},
+};
+
+static const struct {
+    const char* name;
+    I2S_FORMAT format;
+} sim_formats[] = {
+    {"i2s", I2S_FORMAT_I2S},
+    {"lj",  I2S_FORMAT_LJ},
+    {"rj",  I2S_FORMAT_RJ},
+};
+
+static const struct {
+    const char* name;
+    CLOCK_MODE mode;
+} sim_clock_modes[] = {
+    {"default",         CLOCK_MODE_DEFAULT},
+    {"low_jitter",      CLOCK_MODE_LOW_JITTER},
+    {"low_jitter_oc",   CLOCK_MODE_LOW_JITTER_OC},
+};
+
+typedef struct {
+    uint gpio;
+    char id;
+    const char* name;
+    bool level;
+    uint64_t rises;
+    uint64_t first_rise;
+    uint64_t last_rise;
+    uint64_t high;          //cycles high since first_rise
+    uint64_t high_at_last_rise;
+} sim_signal_t;
+
+static uint32_t* fed;
+static size_t fed_len, fed_cap;
+
+//DoP payload queued on the first instance in -m dsd, L bits << 16 | R bits, DSD silence for frames without the marker
+#define DSD_SILENCE 0x69696969u
+#define DOP_BAD_EVERY   97
+static bool dop;
+static uint32_t* dop_sent;
+static size_t dop_len, dop_cap;
+
+//Words taken with i2s_capture_dequeue in -C
+static uint32_t* captured;
+static size_t captured_len, captured_cap;
+
+//Frames queued on the first instance in -p, L << 16 | R
+static bool packed;
+static uint32_t* packed_sent;
+static size_t packed_len, packed_cap;
+
+//Samples queued on the first instance in -m spdif, upper 24 bits, L then R
+static bool spdif;
+static uint32_t* spdif_sent;
+static size_t spdif_len, spdif_cap;
+
+//Half cell levels recovered from the S/PDIF line
+static uint8_t* spdif_cells;
+static size_t spdif_cells_len, spdif_cells_cap;
+
+static void usage(void){
+    fprintf(stderr, "usage: pio_sim [-m i2s|pt8211|exdf|i2s_dual|pt8211_dual|tdm|dsd|spdif] [-r fs] "
+                    "[-c default|low_jitter|low_jitter_oc] [-s clk_sys] [-n frames] [-o trace.vcd] [-d] [-g] [-S] [-L ms] [-R fs] [-M fs] "
+                    "[-t slots] [-w bits] [-C] [-f i2s|lj|rj] [-j bits] [-p]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+//Keep the i2s queue full with a pseudo random 32bit pattern, DoP with random DSD bits, or 16bit L/R pairs in -p
+static void produce(i2s_instance_t* inst, uint32_t packet_frames, uint channels){
+    static uint32_t lfsr = 0x12345678, dop_frame;
+    static int32_t packet[384 * I2S_TDM_MAX_SLOTS];
+    static uint32_t payload[384];
+    bool dsd = dop && inst == i2s_get_default_instance();
+    bool pcm24 = spdif && inst == i2s_get_default_instance();
+
+    while (packed && inst == i2s_get_default_instance()){
+        uint16_t* pairs = (uint16_t*)packet;
+        for (uint32_t i = 0; i < packet_frames * 2; i++){
+            lfsr = lfsr * 1664525u + 1013904223u;
+            pairs[i] = (uint16_t)(lfsr >> 16);
+        }
+        if (i2s_inst_enqueue(inst, (uint8_t*)packet, packet_frames * 2 * 2, 16) == false){
+            return;
+        }
+        for (uint32_t i = 0; i < packet_frames; i++){
+            if (packed_len == packed_cap){
+                packed_cap = packed_cap ? packed_cap * 2 : 4096;
+                packed_sent = realloc(packed_sent, packed_cap * sizeof(uint32_t));
+            }
+            packed_sent[packed_len++] = (uint32_t)pairs[i * 2] << 16 | pairs[i * 2 + 1];
+        }
+    }
+
+    for (;;){
+        for (uint32_t i = 0; i < packet_frames * channels; i++){
+            lfsr = lfsr * 1664525u + 1013904223u;
+            packet[i] = (int32_t)lfsr;
+        }
+        //DoP in 32bit containers: marker, 16 DSD bits, 8 zero bits
+        for (uint32_t i = 0; dsd && i < packet_frames; i++){
+            uint32_t marker = (dop_frame + i) & 1 ? 0xFA : 0x05;
+            if ((dop_frame + i) % DOP_BAD_EVERY == 0){
+                marker = 0x00;
+            }
+            payload[i] = marker == 0x00 ? DSD_SILENCE : ((uint32_t)packet[i * 2] & 0xFFFF0000) | (uint32_t)packet[i * 2 + 1] >> 16;
+            packet[i * 2] = (int32_t)(marker << 24 | (payload[i] >> 16) << 8);
+            packet[i * 2 + 1] = (int32_t)(marker << 24 | (payload[i] & 0xFFFF) << 8);
+        }
+        if (i2s_inst_enqueue(inst, (uint8_t*)packet, packet_frames * channels * 4, 32) == false){
+            break;
+        }
+        for (uint32_t i = 0; pcm24 && i < packet_frames * 2; i++){
+            if (spdif_len == spdif_cap){
+                spdif_cap = spdif_cap ? spdif_cap * 2 : 4096;
+                spdif_sent = realloc(spdif_sent, spdif_cap * sizeof(uint32_t));
+            }
+            spdif_sent[spdif_len++] = (uint32_t)packet[i] & 0xFFFFFF00;
+        }
+        for (uint32_t i = 0; dsd && i < packet_frames; i++){
+            if (dop_len == dop_cap){
+                dop_cap = dop_cap ? dop_cap * 2 : 4096;
+                dop_sent = realloc(dop_sent, dop_cap * sizeof(uint32_t));
+            }
+            dop_sent[dop_len++] = payload[i];
+        }
+        if (dsd){
+            dop_frame += packet_frames;
+        }
+    }
+}
+
+/**
+ * @brief Compare the DSD bits sent with the DoP payload queued
+ *
+ * @param checked Frames compared
+ * @param muted Frames without the marker in the payload
+ * @return uint64_t Mismatches
+ * @note Silence is skipped on both sides, mute before the first packet is not part of the payload
+ */
+static uint64_t dop_check(uint64_t* checked, uint64_t* muted){
+    uint64_t errors = 0;
+    size_t sent = 0;
+
+    *checked = 0;
+    *muted = 0;
+    for (size_t i = 0; i + 1 < fed_len; i += 2){
+        uint32_t bits = (fed[i] & 0xFFFF0000) | fed[i + 1] >> 16;
+        uint32_t l = 0, r = 0;
+        for (uint b = 0; b < 16; b++){
+            l |= ((bits >> (b * 2)) & 1) << b;
+            r |= ((bits >> (b * 2 + 1)) & 1) << b;
+        }
+        if ((l << 16 | r) == DSD_SILENCE){
+            continue;
+        }
+        while (sent < dop_len && dop_sent[sent] == DSD_SILENCE){
+            sent++;
+            (*muted)++;
+        }
+        if (sent >= dop_len){
+            break;
+        }
+        if ((l << 16 | r) != dop_sent[sent]){
+            if (errors < 8){
+                fprintf(stderr, "dsd mismatch at frame %zu: expected %08x got %08x\n", sent, dop_sent[sent], l << 16 | r);
+            }
+            errors++;
+        }
+        sent++;
+        (*checked)++;
+    }
+    return errors;
+}
+
+/**
+ * @brief Compare the words DMA moved with the 16bit frames queued in -p
+ *
+ * @param checked Frames compared
+ * @return uint64_t Mismatches
+ * @note Mute before the first packet is skipped. Slave mode drops what was queued before the clocks were seen,
+ * so the frames are aligned on the first one played
+ */
+static uint64_t packed_check(uint64_t* checked){
+    uint64_t errors = 0;
+    size_t i = 0, sent = 0;
+
+    *checked = 0;
+    while (i < fed_len && fed[i] == 0){
+        i++;
+    }
+    while (i < fed_len && sent < packed_len && packed_sent[sent] != fed[i]){
+        sent++;
+    }
+    for (; i < fed_len && sent < packed_len; i++, sent++){
+        if (fed[i] != packed_sent[sent]){
+            if (errors < 8){
+                fprintf(stderr, "packed mismatch at frame %zu: expected %08x got %08x\n", sent, packed_sent[sent], fed[i]);
+            }
+            errors++;
+        }
+        (*checked)++;
+    }
+    return errors;
+}
+
+/**
+ * @brief Add the half cells since the last edge of the S/PDIF line
+ *
+ * @param level Level before the edge
+ * @param cycles clk_sys cycles since the last edge
+ * @param ui clk_sys cycles per half cell
+ */
+static void spdif_edge(bool level, uint64_t cycles, double ui){
+    uint64_t n = (uint64_t)((double)cycles / ui + 0.5);
+
+    while (n-- > 0){
+        if (spdif_cells_len == spdif_cells_cap){
+            spdif_cells_cap = spdif_cells_cap ? spdif_cells_cap * 2 : 65536;
+            spdif_cells = realloc(spdif_cells, spdif_cells_cap);
+        }
+        spdif_cells[spdif_cells_len++] = level;
+    }
+}
+
+/**
+ * @brief Preamble at a half cell
+ *
+ * @return char 'B', 'M', 'W', or 0 for none
+ * @note Compared as toggles, so either polarity matches
+ */
+static char spdif_preamble(size_t p){
+    static const struct {
+        char name;
+        uint8_t toggles;    //half cell k in bit k
+    } preambles[] = {{'B', 0x39}, {'M', 0xC9}, {'W', 0x69}};
+    uint8_t toggles = 0;
+
+    for (uint k = 0; k < 8; k++){
+        toggles |= (spdif_cells[p + k] != spdif_cells[p + k - 1]) << k;
+    }
+    for (uint i = 0; i < 3; i++){
+        if (preambles[i].toggles == toggles){
+            return preambles[i].name;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode the S/PDIF line and compare it with the samples queued
+ *
+ * @param fs Sampling frequency the channel status has to carry
+ * @param checked Frames compared
+ * @param blocks Whole channel status blocks checked
+ * @param bits Time slots decoded
+ * @return uint64_t Biphase, preamble, parity, channel status and sample errors
+ * @note Mute before the first packet has no block start and is not compared, the samples are aligned on the first
+ * frame that is not silence
+ */
+static uint64_t spdif_check(uint32_t fs, uint64_t* checked, uint64_t* blocks, uint64_t* bits){
+    //IEC 60958-3 consumer: PCM, copy permitted, sampling frequency in byte 3, 24 bit words in byte 4
+    static const uint32_t codes[][2] = {
+        {32000, 0x3}, {44100, 0x0}, {48000, 0x2}, {88200, 0x8}, {96000, 0xA}, {176400, 0xC}, {192000, 0xE},
+    };
+    uint32_t expect[6] = {0x04 | 0x1u << 24, 0x0B}, status[6] = {0};
+    uint64_t errors = 0;
+    size_t p = 1, sent = 0;
+    int block = -1;
+    bool aligned = false;
+
+    for (uint i = 0; i < sizeof(codes) / sizeof(codes[0]); i++){
+        if (codes[i][0] == fs){
+            expect[0] = 0x04 | codes[i][1] << 24;
+        }
+    }
+    *checked = 0;
+    *blocks = 0;
+    *bits = 0;
+    //Lock on the first L subframe
+    while (p + 8 < spdif_cells_len && spdif_preamble(p) != 'B' && spdif_preamble(p) != 'M'){
+        p++;
+    }
+    for (; p + 128 < spdif_cells_len; p += 128){
+        uint32_t word[2] = {0, 0};
+        char pre[2];
+
+        for (uint sub = 0; sub < 2; sub++){
+            size_t q = p + sub * 64;
+            pre[sub] = spdif_preamble(q);
+            for (uint slot = 4; slot < 32; slot++){
+                //Every slot starts with a toggle, a 1 toggles again in the middle
+                if (spdif_cells[q + slot * 2] == spdif_cells[q + slot * 2 - 1]){
+                    if (errors < 8){
+                        fprintf(stderr, "spdif biphase violation at half cell %zu\n", q + slot * 2);
+                    }
+                    errors++;
+                }
+                word[sub] |= (uint32_t)(spdif_cells[q + slot * 2 + 1] != spdif_cells[q + slot * 2]) << slot;
+                (*bits)++;
+            }
+            if (__builtin_parity(word[sub] >> 4) || (word[sub] >> 28 & 3) != 0){
+                if (errors < 8){
+                    fprintf(stderr, "spdif parity or validity error at half cell %zu\n", q);
+                }
+                errors++;
+            }
+        }
+        if ((pre[0] != 'B' && pre[0] != 'M') || pre[1] != 'W'){
+            fprintf(stderr, "spdif lost the preambles at half cell %zu (%c%c)\n", p, pre[0] ? pre[0] : '-', pre[1] ? pre[1] : '-');
+            errors++;
+            break;
+        }
+
+        //The C bit is the same in both subframes, B every 192 frames
+        if (pre[0] == 'B'){
+            if (block == 192 && memcmp(status, expect, sizeof(status)) != 0){
+                fprintf(stderr, "spdif channel status %08x %08x, expected %08x %08x\n", status[0], status[1], expect[0], expect[1]);
+                errors++;
+            }
+            if (block > 0 && block != 192){
+                fprintf(stderr, "spdif block of %d frames\n", block);
+                errors++;
+            }
+            *blocks += block == 192;
+            block = 0;
+            memset(status, 0, sizeof(status));
+        }
+        if (block >= 0){
+            if (block >= 192 || (word[0] >> 30 & 1) != (word[1] >> 30 & 1)){
+                errors++;
+            }
+            else {
+                status[block / 32] |= (word[0] >> 30 & 1) << (block % 32);
+            }
+            block++;
+        }
+
+        //Slots 4-27 are the sample LSB first
+        uint32_t l = (word[0] & 0x0FFFFFF0) << 4;
+        uint32_t r = (word[1] & 0x0FFFFFF0) << 4;
+        if (aligned == false){
+            if (l == 0 && r == 0){
+                continue;
+            }
+            while (sent + 1 < spdif_len && (spdif_sent[sent] != l || spdif_sent[sent + 1] != r)){
+                sent += 2;
+            }
+            aligned = true;
+        }
+        if (sent + 1 >= spdif_len){
+            break;
+        }
+        if (l != spdif_sent[sent] || r != spdif_sent[sent + 1]){
+            if (errors < 8){
+                fprintf(stderr, "spdif mismatch at frame %zu: expected %08x %08x got %08x %08x\n",
+                        sent / 2, spdif_sent[sent], spdif_sent[sent + 1], l, r);
+            }
+            errors++;
+        }
+        sent += 2;
+        (*checked)++;
+    }
+    return errors;
+}
+
+/**
+ * @brief Check i2s_dop_detect on DoP and PCM packets
+ *
+ * @return uint64_t Wrong answers
+ */
+static uint64_t dop_detect_check(void){
+    uint8_t packet[8 * 3];
+    uint64_t errors = 0;
+
+    //4 frames of 24bit DoP, markers 0x05, 0xFA, 0x05, 0xFA
+    for (uint i = 0; i < 8; i++){
+        packet[i * 3] = 0x69;
+        packet[i * 3 + 1] = 0x96;
+        packet[i * 3 + 2] = (i / 2) & 1 ? 0xFA : 0x05;
+    }
+    errors += i2s_dop_detect(packet, sizeof(packet), 24) == false;
+    //The marker repeats
+    packet[2 * 3 + 2] = 0x05;
+    packet[3 * 3 + 2] = 0x05;
+    errors += i2s_dop_detect(packet, sizeof(packet), 24) == true;
+    //L and R differ
+    packet[2 * 3 + 2] = 0xFA;
+    errors += i2s_dop_detect(packet, sizeof(packet), 24) == true;
+    return errors;
+}
+
+//DMA paced by DREQ: one word per clk_sys cycle while the TX FIFO has room
+static void dma_feed(pio_sim_t* sim, uint channel, i2s_instance_t* inst, uint32_t packet_frames, uint channels){
+    static uint32_t transfers[NUM_DMA_CHANNELS], index[NUM_DMA_CHANNELS];
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+
+    if (c->transfers != transfers[channel]){
+        transfers[channel] = c->transfers;
+        index[channel] = 0;
+    }
+    if (c->busy == false){
+        return;
+    }
+
+    if (index[channel] < c->transfer_count && pio_sim_tx_free(sim, SIM_SM) > 0){
+        uint32_t word = ((const volatile uint32_t*)c->read_addr)[index[channel]++];
+        pio_sim_tx_put(sim, SIM_SM, word);
+        //Only the first instance is checked bit by bit
+        if (channel != SIM_DMA){
+            return;
+        }
+        if (fed_len == fed_cap){
+            fed_cap = fed_cap ? fed_cap * 2 : 4096;
+            fed = realloc(fed, fed_cap * sizeof(uint32_t));
+        }
+        fed[fed_len++] = word;
+    }
+    if (index[channel] >= c->transfer_count){
+        //i2s_handler starts the next transfer
+        pico_host_dma_complete(channel);
+        produce(inst, packet_frames, channels);
+    }
+}
+
+//DMA paced by DREQ: one word per clk_sys cycle while the RX FIFO has data
+static void dma_drain(pio_sim_t* sim, uint channel, uint sm){
+    static uint32_t transfers, index;
+    pico_host_dma_channel_t* c = &pico_host_dma[channel];
+    uint32_t word;
+
+    if (c->transfers != transfers){
+        transfers = c->transfers;
+        index = 0;
+    }
+    if (c->busy == false){
+        return;
+    }
+
+    if (index < c->transfer_count && pio_sim_rx_get(sim, sm, &word)){
+        ((volatile uint32_t*)c->write_addr)[index++] = word;
+    }
+    if (index >= c->transfer_count){
+        //The capture handler starts the next transfer
+        pico_host_dma_complete(channel);
+    }
+}
+
+//Take every captured packet
+static void capture_consume(void){
+    int32_t* buff;
+    int sample;
+
+    while (i2s_capture_dequeue(&buff, &sample)){
+        if (captured_len + sample > captured_cap){
+            captured_cap = captured_cap ? captured_cap * 2 : 4096;
+            captured = realloc(captured, captured_cap * sizeof(uint32_t));
+        }
+        memcpy(captured + captured_len, buff, sample * sizeof(uint32_t));
+        captured_len += sample;
+    }
+}
+
+/**
+ * @brief Compare the captured words with the words sent
+ *
+ * @param checked Words compared
+ * @param offset Words sent before the first captured one
+ * @return uint64_t Mismatches, 1 when the first captured frame is not found
+ * @note Capture starts at a whole frame after the output, the first captured frame that is not mute is searched for
+ * a few frames later in the words sent
+ */
+static uint64_t capture_check(uint64_t* checked, size_t* offset){
+    uint64_t errors = 0;
+    size_t first = 0;
+
+    *checked = 0;
+    while (first + 1 < captured_len && captured[first] == 0 && captured[first + 1] == 0){
+        first += 2;
+    }
+    for (*offset = 0; *offset < 64; *offset += 2){
+        size_t i = first + *offset;
+        if (i + 1 < fed_len && first + 1 < captured_len && captured[first] == fed[i] && captured[first + 1] == fed[i + 1]){
+            break;
+        }
+    }
+    if (*offset >= 64){
+        return 1;
+    }
+    for (size_t i = 0; i < captured_len && *offset + i < fed_len; i++){
+        if (captured[i] != fed[*offset + i]){
+            if (errors < 8){
+                fprintf(stderr, "capture mismatch at word %zu: expected %08x got %08x\n", i, fed[*offset + i], captured[i]);
+            }
+            errors++;
+        }
+        (*checked)++;
+    }
+    return errors;
+}
+
+/**
+ * @brief Level of a GPOUT generator, counted from clk_sys cycle 0
+ *
+ * @note Fractional dividers are modelled by their average period, the hardware stretches single cycles instead
+ */
+static bool gpout_level(enum clock_index clk, uint64_t cycle){
+    uint32_t div8 = clocks_hw->clk[clk].div;
+
+    if ((clocks_hw->clk[clk].ctrl & CLOCKS_CLK_GPOUT0_CTRL_ENABLE_BITS) == 0 || div8 == 0){
+        return false;
+    }
+    return (cycle * 256) % div8 < div8 / 2;
+}
+
+/**
+ * @brief BCLK and LRCLK of the master in slave mode
+ *
+ * @param m Mode
+ * @param fs Sampling frequency
+ * @param sys_hz clk_sys
+ * @param cycle clk_sys cycles since the master started
+ * @return uint32_t Levels on the pins from CLOCK_PIN on
+ * @note LRCLK changes on BCLK falling edges. It is low for the first word in i2s, high in lsbj16 (PT8211)
+ */
+static uint32_t master_clocks(const sim_mode_t* m, uint32_t fs, uint32_t sys_hz, uint64_t cycle){
+    uint64_t half = (uint64_t)((unsigned __int128)cycle * fs * m->bclk_per_frame * 2 / sys_hz);
+    uint64_t word = half / m->bclk_per_frame;
+    bool bclk = half & 1;
+    bool lrclk = (word & 1) != (m->bits_per_word == 16);
+
+    return (uint32_t)lrclk << (CLOCK_PIN % 32) | (uint32_t)bclk << ((CLOCK_PIN + 1) % 32);
+}
+
+static uint64_t cycle_ps(uint64_t cycle, uint32_t sys_hz){
+    return (uint64_t)((unsigned __int128)cycle * 1000000000000ull / sys_hz);
+}
+
+int main(int argc, char** argv){
+    const sim_mode_t* m = &sim_modes[0];
+    CLOCK_MODE clock_mode = CLOCK_MODE_DEFAULT;
+    uint32_t fs = 48000, sys_hz = 125000000, frames = 256;
+    bool chained = false, gpout = false, slave = false, fs_set = false, capture = false;
+    uint32_t loss_ms = 0, first_fs = 0, line_fs = 0, slots = 8, slot_bits = 32, sample_bits = 0;
+    I2S_FORMAT format = I2S_FORMAT_I2S;
+    const char* vcd_path = NULL;
+    FILE* vcd = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:r:c:s:n:o:dgSL:R:M:t:w:Cf:j:p")) != -1){
+        size_t i;
+        switch (opt){
+        case 'm':
+            for (i = 0; i < sizeof(sim_modes) / sizeof(sim_modes[0]); i++){
+                if (strcmp(optarg, sim_modes[i].name) == 0) break;
+            }
+            if (i == sizeof(sim_modes) / sizeof(sim_modes[0])) usage();
+            m = &sim_modes[i];
+            break;
+        case 'c':
+            for (i = 0; i < sizeof(sim_clock_modes) / sizeof(sim_clock_modes[0]); i++){
+                if (strcmp(optarg, sim_clock_modes[i].name) == 0) break;
+            }
+            if (i == sizeof(sim_clock_modes) / sizeof(sim_clock_modes[0])) usage();
+            clock_mode = sim_clock_modes[i].mode;
+            break;
+        case 'f':
+            for (i = 0; i < sizeof(sim_formats) / sizeof(sim_formats[0]); i++){
+                if (strcmp(optarg, sim_formats[i].name) == 0) break;
+            }
+            if (i == sizeof(sim_formats) / sizeof(sim_formats[0])) usage();
+            format = sim_formats[i].format;
+            break;
+        case 'r': fs = strtoul(optarg, NULL, 0); fs_set = true; break;
+        case 's': sys_hz = strtoul(optarg, NULL, 0); break;
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'o': vcd_path = optarg; break;
+        case 'd': chained = true; break;
+        case 'g': gpout = true; break;
+        case 'S': slave = true; break;
+        case 'L': loss_ms = strtoul(optarg, NULL, 0); break;
+        case 'R': first_fs = strtoul(optarg, NULL, 0); break;
+        case 'M': line_fs = strtoul(optarg, NULL, 0); break;
+        case 't': slots = strtoul(optarg, NULL, 0); break;
+        case 'w': slot_bits = strtoul(optarg, NULL, 0); break;
+        case 'C': capture = true; break;
+        case 'j': sample_bits = strtoul(optarg, NULL, 0); break;
+        case 'p': packed = true; break;
+        default: usage();
+        }
+    }
+    if (fs == 0 || sys_hz == 0 || frames == 0) usage();
+    if ((slave && m->bclk_per_frame == 0) || (loss_ms > 0 && slave == false)) usage();
+    //Outputs running together share clk_sys, which the low jitter modes change
+    if (line_fs > 0 && (clock_mode != CLOCK_MODE_DEFAULT || slave)) usage();
+    //The loopback compares against one continuous stream
+    if (capture && (m->mode != MODE_I2S || loss_ms > 0)) usage();
+    if (sample_bits == 0){
+        sample_bits = slot_bits;
+    }
+    //-w is the TDM slot width in -m tdm, the slave and capture programs only take the default format
+    if ((format != I2S_FORMAT_I2S || sample_bits != slot_bits) && m->mode != MODE_I2S) usage();
+    if (m->mode == MODE_I2S && (format != I2S_FORMAT_I2S || slot_bits != 32) && (slave || capture)) usage();
+    //The packed check follows one continuous stream
+    if (packed && (m->mode != MODE_PT8211 || loss_ms > 0) && (m->mode != MODE_I2S || slot_bits != 16)) usage();
+    if (m->mode == MODE_DSD && fs_set == false){
+        fs = 176400;
+    }
+    dop = m->mode == MODE_DSD;
+    spdif = m->mode == MODE_SPDIF;
+    uint channels = m->mode == MODE_TDM ? slots : 2;
+    uint word_bits = m->mode == MODE_TDM || m->mode == MODE_I2S ? slot_bits : m->bits_per_word;
+    //Bits of one channel, a packed word carries two
+    uint channel_bits = word_bits;
+    if (packed){
+        word_bits = 32;
+    }
+    uint pad_bits = format == I2S_FORMAT_RJ ? slot_bits - sample_bits : 0;
+
+    //Configure exactly like firmware
+    pico_host_reset(sys_hz);
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_pin(DATA_PIN, CLOCK_PIN, gpout ? GPOUT_PIN : MCLK_PIN);
+    i2s_mclk_set_config(pio0, SIM_SM, SIM_DMA, false, clock_mode, m->mode);
+    i2s_set_chained_dma(chained);
+    i2s_set_mclk_gpout(gpout);
+    i2s_set_slave(slave);
+    if (m->mode == MODE_TDM && i2s_set_tdm(slots, slot_bits) == false) usage();
+    if (m->mode == MODE_I2S && i2s_set_format(format, slot_bits, sample_bits) == false) usage();
+    i2s_set_packed(packed);
+    i2s_volume_change(0, 0);
+    uint32_t packet_frames = fs / 1000 > 384 ? 384 : fs / 1000;
+    if (packet_frames == 0) packet_frames = 1;
+    //The static buffer only holds 4 slots
+    static int32_t tdm_buffer[I2S_TDM_BUFFER_SIZE(384 + 1, I2S_BUF_DEPTH, I2S_TDM_MAX_SLOTS) / sizeof(int32_t)];
+    if (m->mode == MODE_TDM && i2s_set_buffer(tdm_buffer, sizeof(tdm_buffer), packet_frames + 1, I2S_BUF_DEPTH) == false){
+        fprintf(stderr, "tdm buffer rejected\n");
+        return 1;
+    }
+    static int32_t capture_buffer[I2S_CAPTURE_BUFFER_SIZE(384, CAPTURE_DEPTH) / sizeof(int32_t)];
+    if (capture){
+        dma_channel_claim(CAPTURE_DMA);
+        i2s_set_capture(CAPTURE_PIN, CAPTURE_SM, CAPTURE_DMA);
+        if (i2s_set_capture_buffer(capture_buffer, sizeof(capture_buffer), packet_frames, CAPTURE_DEPTH) == false){
+            fprintf(stderr, "capture buffer rejected\n");
+            return 1;
+        }
+    }
+    uint32_t space = 0, pll_inits = 0;
+    if (first_fs > 0){
+        if (i2s_mclk_init(first_fs) == false){
+            fprintf(stderr, "i2s_mclk_init(%u) failed\n", first_fs);
+            return 1;
+        }
+        space = pico_host_pio[0].used_instruction_space;
+        pll_inits = pico_host_pll[0].inits;
+    }
+    if (i2s_mclk_init(fs) == false){
+        fprintf(stderr, "i2s_mclk_init(%u) failed\n", fs);
+        return 1;
+    }
+    sys_hz = clock_get_hz(clk_sys);
+    if (first_fs > 0){
+        printf("restart from %u Hz: programs %s, pll_sys %s\n", first_fs,
+               pico_host_pio[0].used_instruction_space == space ? "reused" : "leaked",
+               pico_host_pll[0].inits == pll_inits ? "kept" : "relocked");
+        if (pico_host_pio[0].used_instruction_space != space){
+            return 1;
+        }
+    }
+
+    //The generator replaces the MCLK state machine, which must stay free
+    gpout = gpout && m->mclk && m->mode != MODE_EXDF && slave == false;
+    if (gpout && (pico_host_gpio_function(GPOUT_PIN) != GPIO_FUNC_GPCK || (pico_host_pio[0].sm_enabled_mask & (1u << (SIM_SM + 1))) != 0)){
+        fprintf(stderr, "GPOUT MCLK not configured\n");
+        return 1;
+    }
+
+    produce(i2s_get_default_instance(), packet_frames, channels);
+
+    pio_sim_t sim;
+    pio_sim_load(&sim, pio0);
+
+    //Second output on its own PIO, DMA channel and interrupt
+    static int32_t line_buffer[I2S_BUFFER_SIZE(384 + 1, I2S_BUF_DEPTH) / sizeof(int32_t)];
+    i2s_instance_t* line = NULL;
+    uint32_t line_packet_frames = 0;
+    int line_dma = -1;
+    pio_sim_t line_sim;
+    sim_signal_t line_sig[2] = {
+        {.gpio = LINE_CLOCK_PIN,     .id = 'L', .name = "lrclk2"},
+        {.gpio = LINE_CLOCK_PIN + 1, .id = 'B', .name = "bclk2"},
+    };
+    if (line_fs > 0){
+        line = i2s_instance_create();
+        line_packet_frames = line_fs / 1000 > 384 ? 384 : line_fs / 1000;
+        if (line == NULL || line_packet_frames == 0){
+            usage();
+        }
+        //A free channel besides SIM_DMA, which the tool does not claim, and the channels of chained DMA
+        for (line_dma = 0; line_dma == SIM_DMA || dma_channel_is_claimed(line_dma); line_dma++);
+        dma_channel_claim(line_dma);
+        i2s_inst_set_playback_handler(line, no_playback_handler);
+        i2s_inst_mclk_set_pin(line, LINE_DATA_PIN, LINE_CLOCK_PIN, LINE_MCLK_PIN);
+        i2s_inst_mclk_set_config(line, pio1, SIM_SM, line_dma, false, CLOCK_MODE_DEFAULT, MODE_I2S);
+        i2s_inst_set_chained_dma(line, chained);
+        if (i2s_inst_set_buffer(line, line_buffer, sizeof(line_buffer), line_packet_frames + 1, I2S_BUF_DEPTH) == false){
+            fprintf(stderr, "second instance buffer rejected\n");
+            return 1;
+        }
+        i2s_inst_volume_change(line, 0, 0);
+        if (i2s_inst_mclk_init(line, line_fs) == false){
+            fprintf(stderr, "second instance i2s_inst_mclk_init(%u) failed\n", line_fs);
+            return 1;
+        }
+        produce(line, line_packet_frames, 2);
+        pio_sim_load(&line_sim, pio1);
+
+        //Each instance completes on its own DMA interrupt
+        if (pico_host_dma[SIM_DMA].irq0_enabled == false || pico_host_dma[SIM_DMA].irq1_enabled ||
+            pico_host_dma[line_dma].irq1_enabled == false || pico_host_dma[line_dma].irq0_enabled){
+            fprintf(stderr, "DMA interrupts not routed per instance\n");
+            return 1;
+        }
+    }
+
+    sim_signal_t sig[5] = {
+        {.gpio = CLOCK_PIN,     .id = 'l', .name = "lrclk"},
+        {.gpio = CLOCK_PIN + 1, .id = 'b', .name = "bclk"},
+        {.gpio = DATA_PIN,      .id = 'd', .name = "data0"},
+    };
+    uint nsig = 3;
+    //DSD has no frame clock, "frame" toggles every 8 DCLK
+    if (m->mode == MODE_DSD){
+        sig[0].name = "frame";
+    }
+    //Nor S/PDIF, "frame" toggles every 128 state machine cycles and "cell" every one
+    if (m->mode == MODE_SPDIF){
+        sig[0].name = "frame";
+        sig[1].name = "cell";
+    }
+    double spdif_ui = 2.0 * pico_host_sm_clkdiv(pio0, SIM_SM);
+    uint64_t spdif_last_edge = 0;
+    bool spdif_level = false;
+    if (m->data_pins == 2){
+        sig[nsig++] = (sim_signal_t){.gpio = DATA_PIN + 1, .id = 'e', .name = "data1"};
+    }
+    if (m->mclk && slave == false){
+        sig[nsig++] = (sim_signal_t){.gpio = m->mode == MODE_EXDF ? CLOCK_PIN + 2 : gpout ? GPOUT_PIN : MCLK_PIN, .id = 'm', .name = "mclk"};
+    }
+
+    if (vcd_path != NULL){
+        vcd = fopen(vcd_path, "w");
+        if (vcd == NULL){
+            perror(vcd_path);
+            return 1;
+        }
+        fprintf(vcd, "$timescale 1ps $end\n$scope module i2s $end\n");
+        for (uint i = 0; i < nsig; i++){
+            fprintf(vcd, "$var wire 1 %c %s $end\n", sig[i].id, sig[i].name);
+        }
+        fprintf(vcd, "$upscope $end\n$enddefinitions $end\n#0\n");
+        for (uint i = 0; i < nsig; i++){
+            fprintf(vcd, "0%c\n", sig[i].id);
+        }
+    }
+
+    //Run until the requested number of frames has been measured, the first one is warm-up
+    uint64_t loss_start = (uint64_t)sys_hz / 1000 * loss_ms;
+    uint64_t loss_end = loss_start + (uint64_t)sys_hz / 1000 * LOSS_MS;
+    uint64_t limit = (uint64_t)sys_hz / fs * (frames + 4) * 4 + 1000000 + loss_end;
+    uint64_t bits = 0, errors = 0, fsync_errors = 0, lrclk_errors = 0;
+    size_t word = 0;
+    uint bit = 0;
+    bool fsync = false;
+    uint64_t cycle, lrclk_rises = 0, dclk_rises = 0, us = 0;
+    uint32_t restarts = pico_host_pio[0].sm_restart_count[SIM_SM];
+
+    for (cycle = 1; cycle < limit && (sig[0].rises <= frames || cycle < loss_end); cycle++){
+        bool bclk_prev = sig[1].level;
+        bool pulled = sim.sm[SIM_SM].pulls > 0;
+        bool changed = false;
+
+        if (slave){
+            if (loss_ms == 0 || cycle < loss_start){
+                sim.pins_in = master_clocks(m, fs, sys_hz, cycle);
+            }
+            else if (cycle < loss_end){
+                sim.pins_in = 0;
+            }
+            else {
+                sim.pins_in = master_clocks(m, fs, sys_hz, cycle - loss_end);
+            }
+            //Measure the restarted clocks on their own
+            if (cycle == loss_end){
+                for (uint i = 0; i < nsig; i++){
+                    sig[i].rises = 0;
+                    sig[i].high = 0;
+                }
+                lrclk_rises = 0;
+            }
+        }
+
+        //Host time drives the clock loss detector
+        if (cycle * 1000000 / sys_hz != us){
+            pico_host_advance_time_us(cycle * 1000000 / sys_hz - us);
+            us = cycle * 1000000 / sys_hz;
+        }
+        //The library restarted the state machine, what was in the FIFO is never sent
+        if (pico_host_pio[0].sm_restart_count[SIM_SM] != restarts){
+            pio_sim_sm_t* s = &sim.sm[SIM_SM];
+            restarts = pico_host_pio[0].sm_restart_count[SIM_SM];
+            s->tx_level = 0;
+            s->osr_count = 32;
+            s->delay = 0;
+            s->exec_pending = false;
+            s->pc = pico_host_pio[0].sm_last_exec[SIM_SM] & 0x1f;
+            s->pulls = 0;
+            sim.pins = pico_host_pio[0].sm_pins;
+            word = fed_len;
+            bit = 0;
+            pulled = false;
+        }
+        sim.enabled_mask = pico_host_pio[0].sm_enabled_mask;
+
+        //Loopback wire from the data output to the capture input
+        if (capture){
+            sim.pins_in = (sim.pins_in & ~(1u << CAPTURE_PIN)) | (uint32_t)pio_sim_gpio(&sim, DATA_PIN) << CAPTURE_PIN;
+        }
+        dma_feed(&sim, SIM_DMA, i2s_get_default_instance(), packet_frames, channels);
+        pio_sim_step(&sim);
+        if (capture){
+            dma_drain(&sim, CAPTURE_DMA, CAPTURE_SM);
+            capture_consume();
+        }
+        if (line != NULL){
+            line_sim.enabled_mask = pico_host_pio[1].sm_enabled_mask;
+            dma_feed(&line_sim, line_dma, line, line_packet_frames, 2);
+            pio_sim_step(&line_sim);
+            for (uint i = 0; i < 2; i++){
+                bool level = pio_sim_gpio(&line_sim, line_sig[i].gpio);
+                //Measure from the first LRCLK rising edge on
+                if (level && line_sig[i].level == false && (i == 0 || line_sig[0].rises > 0)){
+                    if (line_sig[i].rises == 0){
+                        line_sig[i].first_rise = cycle;
+                    }
+                    line_sig[i].last_rise = cycle;
+                    line_sig[i].rises++;
+                }
+                line_sig[i].level = level;
+            }
+        }
+
+        if (pio_sim_gpio(&sim, CLOCK_PIN + 1) && bclk_prev == false){
+            dclk_rises++;
+        }
+        for (uint i = 0; i < nsig; i++){
+            bool level = gpout && sig[i].gpio == GPOUT_PIN ? gpout_level(GPOUT_CLK, cycle) : pio_sim_gpio(&sim, sig[i].gpio);
+            if (i == 0 && m->mode == MODE_DSD){
+                level = (dclk_rises / 8) & 1;
+            }
+            if (i < 2 && m->mode == MODE_SPDIF){
+                level = (sim.sm[SIM_SM].cycles >> (i == 0 ? 7 : 0)) & 1;
+            }
+            if (level != sig[i].level && vcd != NULL){
+                if (changed == false){
+                    fprintf(vcd, "#%llu\n", (unsigned long long)cycle_ps(cycle, sys_hz));
+                    changed = true;
+                }
+                fprintf(vcd, "%d%c\n", level, sig[i].id);
+            }
+            if (i == 0 && level && sig[i].level == false){
+                lrclk_rises++;
+            }
+            //Measure from the second LRCLK rising edge on
+            if (level && sig[i].level == false && lrclk_rises >= 2){
+                if (sig[i].rises == 0){
+                    sig[i].first_rise = cycle;
+                }
+                sig[i].last_rise = cycle;
+                sig[i].high_at_last_rise = sig[i].high;
+                sig[i].rises++;
+            }
+            if (level && sig[i].rises > 0){
+                sig[i].high++;
+            }
+            sig[i].level = level;
+        }
+
+        //The S/PDIF decoder only sees the line, from its first edge on
+        if (m->mode == MODE_SPDIF && pio_sim_gpio(&sim, DATA_PIN) != spdif_level){
+            if (spdif_last_edge > 0){
+                spdif_edge(spdif_level, cycle - spdif_last_edge, spdif_ui);
+            }
+            spdif_last_edge = cycle;
+            spdif_level = !spdif_level;
+        }
+
+        //Data is sampled on the BCLK rising edge, MSB first from each FIFO word.
+        //The first pull raises BCLK before any bit is out, so that edge does not count
+        if (m->mode != MODE_SPDIF && sig[1].level && bclk_prev == false && pulled && word < fed_len){
+            uint32_t mask = (1u << m->data_pins) - 1;
+            uint32_t expect = bit < pad_bits ? 0 : (fed[word] >> (32 - (bit - pad_bits) - m->data_pins)) & mask;
+            uint32_t got = pio_sim_gpio(&sim, DATA_PIN);
+            if (m->data_pins == 2){
+                got |= (uint32_t)pio_sim_gpio(&sim, DATA_PIN + 1) << 1;
+            }
+            if (got != expect){
+                if (errors < 8){
+                    fprintf(stderr, "data mismatch at word %zu bit %u: expected %u got %u\n", word, bit, expect, got);
+                }
+                errors++;
+            }
+            //FSYNC is high on the BCLK rising edge before the MSB of slot 0
+            if (m->mode == MODE_TDM && fsync != (bit == 0 && word % slots == 0)){
+                if (fsync_errors < 8){
+                    fprintf(stderr, "fsync %s at word %zu bit %u\n", fsync ? "early" : "missing", word, bit);
+                }
+                fsync_errors++;
+            }
+            //i2s LRCLK is low for L and changes one bit early, LJ and RJ hold it high for L
+            size_t channel = packed ? word * 2 + bit / channel_bits : word;
+            uint channel_bit = bit % channel_bits;
+            bool lrclk_expect = format == I2S_FORMAT_I2S ? (channel & 1) != (channel_bit == channel_bits - 1) : (channel & 1) == 0;
+            if (m->mode == MODE_I2S && slave == false && sig[0].level != lrclk_expect){
+                if (lrclk_errors < 8){
+                    fprintf(stderr, "lrclk %u at channel %zu bit %u\n", sig[0].level, channel, channel_bit);
+                }
+                lrclk_errors++;
+            }
+            bits += m->data_pins;
+            bit += m->data_pins;
+            if (bit >= word_bits){
+                bit = 0;
+                word++;
+            }
+        }
+        if (sig[1].level && bclk_prev == false){
+            fsync = sig[0].level;
+        }
+    }
+    if (vcd != NULL){
+        fprintf(vcd, "#%llu\n", (unsigned long long)cycle_ps(cycle, sys_hz));
+        fclose(vcd);
+    }
+
+    printf("mode %s, fs %u Hz, clk_sys %u Hz, clkdiv %.4f\n", m->name, fs, sys_hz, pico_host_sm_clkdiv(pio0, SIM_SM));
+    if (sig[0].rises < 2){
+        printf("no frames after %llu cycles\n", (unsigned long long)cycle);
+        return 1;
+    }
+
+    double frame_cycles = (double)(sig[0].last_rise - sig[0].first_rise) / (double)(sig[0].rises - 1);
+    double frame_rate = (double)sys_hz / frame_cycles;
+    double bclk_per_frame = 0.0;
+
+    for (uint i = 0; i < nsig; i++){
+        sim_signal_t* s = &sig[i];
+        if (s->id == 'd' || s->id == 'e'){
+            continue;
+        }
+        if (s->rises < 2){
+            printf("%-6s no edges\n", s->name);
+            continue;
+        }
+        double period = (double)(s->last_rise - s->first_rise) / (double)(s->rises - 1);
+        double duty = (double)s->high_at_last_rise / (double)(s->last_rise - s->first_rise) * 100.0;
+        printf("%-6s %.2f Hz, duty %.2f %%", s->name, (double)sys_hz / period, duty);
+        if (s->id == 'l'){
+            printf(", %+.1f ppm", (frame_rate / fs - 1.0) * 1e6);
+        }
+        else {
+            printf(", %.2f per frame", frame_cycles / period);
+        }
+        printf("\n");
+        if (s->id == 'b'){
+            bclk_per_frame = frame_cycles / period;
+        }
+    }
+    //S/PDIF has no bit clock to sample on, its line is decoded below
+    if (m->mode != MODE_SPDIF){
+        printf("data   %llu bits checked, %llu errors\n", (unsigned long long)bits, (unsigned long long)errors);
+    }
+    if (m->mode == MODE_TDM){
+        printf("tdm    %u slots x %u bits, %llu frame sync errors\n", slots, slot_bits, (unsigned long long)fsync_errors);
+        if (bclk_per_frame < slots * slot_bits - 0.1 || bclk_per_frame > slots * slot_bits + 0.1){
+            errors++;
+        }
+        errors += fsync_errors;
+    }
+    if (m->mode == MODE_I2S && slave == false){
+        printf("format %s, %u bit slots, %u bit samples, %llu lrclk errors\n", sim_formats[format].name,
+               slot_bits, format == I2S_FORMAT_RJ ? sample_bits : slot_bits, (unsigned long long)lrclk_errors);
+        if (bclk_per_frame < slot_bits * 2 - 0.1 || bclk_per_frame > slot_bits * 2 + 0.1){
+            errors++;
+        }
+        errors += lrclk_errors;
+    }
+    if (packed){
+        uint64_t checked;
+        uint64_t packed_errors = packed_check(&checked);
+        printf("packed %llu frames checked, %llu errors, queue %zu bytes\n", (unsigned long long)checked,
+               (unsigned long long)packed_errors, i2s_get_buffer_size(packet_frames + 1, I2S_BUF_DEPTH));
+        if (checked == 0){
+            errors++;
+        }
+        errors += packed_errors;
+    }
+    if (m->mode == MODE_DSD){
+        uint64_t checked, muted, dsd_errors = dop_check(&checked, &muted);
+        uint64_t detect_errors = dop_detect_check();
+        printf("dsd    %llu DoP frames checked, %llu without marker muted, %llu errors, dop detect %s\n",
+               (unsigned long long)checked, (unsigned long long)muted, (unsigned long long)dsd_errors,
+               detect_errors == 0 ? "ok" : "wrong");
+        if (bclk_per_frame < 15.9 || bclk_per_frame > 16.1 || checked == 0 || muted == 0){
+            errors++;
+        }
+        errors += dsd_errors + detect_errors;
+    }
+    if (m->mode == MODE_SPDIF){
+        uint64_t checked, blocks;
+        uint64_t spdif_errors = spdif_check(fs, &checked, &blocks, &bits);
+        printf("spdif  %llu frames checked, %llu channel status blocks, %llu errors\n",
+               (unsigned long long)checked, (unsigned long long)blocks, (unsigned long long)spdif_errors);
+        if (bclk_per_frame < 127.9 || bclk_per_frame > 128.1 || checked == 0 || blocks == 0){
+            errors++;
+        }
+        errors += spdif_errors;
+    }
+    if (capture){
+        I2S_STATS stats;
+        uint64_t checked;
+        size_t offset;
+        uint64_t capture_errors = capture_check(&checked, &offset);
+        i2s_get_stats(&stats);
+        printf("capture %llu words checked from word %zu, %llu errors, %u overruns\n",
+               (unsigned long long)checked, offset, (unsigned long long)capture_errors, stats.capture_overruns);
+        if (checked == 0 || stats.capture_overruns != 0){
+            errors++;
+        }
+        errors += capture_errors;
+    }
+    if (slave){
+        I2S_STATS stats;
+        i2s_get_stats(&stats);
+        printf("slave  %u clock losses, clock %s\n", stats.clock_losses, i2s_get_clock_present() ? "present" : "lost");
+        if (stats.clock_losses != (loss_ms > 0 ? 1u : 0u) || i2s_get_clock_present() == false){
+            errors++;
+        }
+    }
+
+    if (line != NULL){
+        I2S_STATS line_stats;
+        i2s_inst_get_stats(line, &line_stats);
+        if (line_sig[0].rises < 2 || line_sig[1].rises < 2){
+            printf("lrclk2 no frames\n");
+            errors++;
+        }
+        else {
+            double line_frame = (double)(line_sig[0].last_rise - line_sig[0].first_rise) / (double)(line_sig[0].rises - 1);
+            double line_bclk = (double)(line_sig[1].last_rise - line_sig[1].first_rise) / (double)(line_sig[1].rises - 1);
+            double ppm = ((double)sys_hz / line_frame / line_fs - 1.0) * 1e6;
+            printf("lrclk2 %.2f Hz, %+.1f ppm, bclk2 %.2f per frame, %u packets\n",
+                   (double)sys_hz / line_frame, ppm, line_frame / line_bclk, line_stats.packets);
+            if (ppm > I2S_CLOCK_MAX_ERROR_PPM || ppm < -I2S_CLOCK_MAX_ERROR_PPM ||
+                line_frame / line_bclk < 63.9 || line_frame / line_bclk > 64.1 || line_stats.packets == 0){
+                errors++;
+            }
+        }
+        i2s_instance_destroy(line);
+        dma_channel_unclaim(line_dma);
+    }
+
+    //Nothing may stay claimed
+    i2s_deinit();
+    if (capture){
+        dma_channel_unclaim(CAPTURE_DMA);
+        if (pico_host_gpio_function(CAPTURE_PIN) != GPIO_FUNC_NULL){
+            printf("deinit left the capture pin set up\n");
+            errors++;
+        }
+    }
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++){
+        if (pico_host_dma[i].claimed){
+            printf("deinit left DMA channel %u claimed\n", i);
+            errors++;
+        }
+    }
+    for (uint i = 0; i < NUM_PIOS; i++){
+        if (pico_host_pio[i].used_instruction_space != 0 || pico_host_pio[i].sm_enabled_mask != 0){
+            printf("deinit left programs 0x%08x, state machines 0x%x on pio%u\n",
+                   (unsigned)pico_host_pio[i].used_instruction_space, pico_host_pio[i].sm_enabled_mask, i);
+            errors++;
+        }
+    }
+
+    //clkdiv can not go below 1, so a frame takes at least this many clk_sys cycles
+    if (slave){
+        free(fed);
+        free(captured);
+        free(packed_sent);
+        return errors == 0 && bits > 0 ? 0 : 1;
+    }
+    double frame_pio_cycles = frame_cycles / pico_host_sm_clkdiv(pio0, SIM_SM);
+    printf("top    fs %.0f Hz, BCLK %.0f Hz at this clk_sys (%.0f PIO cycles per frame)\n",
+           sys_hz / frame_pio_cycles, sys_hz / frame_pio_cycles * bclk_per_frame, frame_pio_cycles);
+
+    free(fed);
+    free(dop_sent);
+    free(captured);
+    free(packed_sent);
+    free(spdif_sent);
+    free(spdif_cells);
+    return errors == 0 && bits > 0 ? 0 : 1;
+}
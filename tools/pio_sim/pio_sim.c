@@ -0,0 +1,455 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pio_sim.c
+ * @brief Cycle accurate PIO state machine simulator for the host build
+ */
+
+#include <string.h>
+
+#include "pio_sim.h"
+
+static uint pio_sim_fifo_depth(const pio_sim_sm_t* s, bool tx){
+    if (s->config.fifo_join == (tx ? PIO_FIFO_JOIN_TX : PIO_FIFO_JOIN_RX)){
+        return 8;
+    }
+    else if (s->config.fifo_join != PIO_FIFO_JOIN_NONE){
+        return 0;
+    }
+    return 4;
+}
+
+static void pio_sim_write_pins(pio_sim_t* sim, uint base, uint count, uint32_t value){
+    for (uint i = 0; i < count; i++){
+        uint pin = (base + i) & 31;
+        if ((value >> i) & 1){
+            sim->pins |= 1u << pin;
+        }
+        else {
+            sim->pins &= ~(1u << pin);
+        }
+    }
+}
+
+static void pio_sim_write_pindirs(pio_sim_t* sim, uint base, uint count, uint32_t value){
+    for (uint i = 0; i < count; i++){
+        uint pin = (base + i) & 31;
+        if ((value >> i) & 1){
+            sim->pindirs |= 1u << pin;
+        }
+        else {
+            sim->pindirs &= ~(1u << pin);
+        }
+    }
+}
+
+//Pin levels as the state machines see them, external inputs arrive through the synchronizer
+static uint32_t pio_sim_read_pins(const pio_sim_t* sim, uint base){
+    uint32_t in = (sim->pins_in & sim->sync_bypass) | (sim->sync[1] & ~sim->sync_bypass);
+    uint32_t level = (sim->pins & sim->pindirs) | (in & ~sim->pindirs);
+    return base == 0 ? level : (level >> base) | (level << (32 - base));
+}
+
+static uint32_t pio_sim_bit_reverse(uint32_t x){
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+static bool pio_sim_tx_pop(pio_sim_sm_t* s, uint32_t* data){
+    if (s->tx_level == 0){
+        return false;
+    }
+    *data = s->tx_fifo[s->tx_head];
+    s->tx_head = (s->tx_head + 1) % PIO_SIM_FIFO_DEPTH;
+    s->tx_level--;
+    s->pulls++;
+    return true;
+}
+
+static bool pio_sim_rx_push(pio_sim_sm_t* s, uint32_t data){
+    if (s->rx_level >= pio_sim_fifo_depth(s, false)){
+        return false;
+    }
+    s->rx_fifo[(s->rx_head + s->rx_level) % PIO_SIM_FIFO_DEPTH] = data;
+    s->rx_level++;
+    return true;
+}
+
+static uint pio_sim_irq_index(uint sm, uint index){
+    //rel: the low two bits are added to the state machine number
+    if (index & 0x10){
+        return (index & 4) | ((index + sm) & 3);
+    }
+    return index & 7;
+}
+
+static uint32_t pio_sim_shift_out(pio_sim_sm_t* s, uint count){
+    uint32_t data;
+
+    if (s->config.out_shift_right){
+        data = count == 32 ? s->osr : s->osr & ((1u << count) - 1);
+        s->osr = count == 32 ? 0 : s->osr >> count;
+    }
+    else {
+        data = count == 32 ? s->osr : s->osr >> (32 - count);
+        s->osr = count == 32 ? 0 : s->osr << count;
+    }
+    s->osr_count = s->osr_count + count > 32 ? 32 : s->osr_count + count;
+    return data;
+}
+
+static void pio_sim_shift_in(pio_sim_sm_t* s, uint32_t data, uint count){
+    if (count < 32){
+        data &= (1u << count) - 1;
+    }
+
+    if (s->config.in_shift_right){
+        s->isr = count == 32 ? data : (s->isr >> count) | (data << (32 - count));
+    }
+    else {
+        s->isr = count == 32 ? data : (s->isr << count) | data;
+    }
+    s->isr_count = s->isr_count + count > 32 ? 32 : s->isr_count + count;
+}
+
+static uint32_t pio_sim_threshold(uint threshold){
+    return threshold == 0 ? 32 : threshold;
+}
+
+/**
+ * @brief Execute one instruction
+ *
+ * @return true Completed
+ * @return false Stalled, retried on the next clock enable
+ */
+static bool pio_sim_exec(pio_sim_t* sim, uint smi, uint16_t instr, bool* jumped){
+    pio_sim_sm_t* s = &sim->sm[smi];
+    uint op = instr >> 13;
+    uint arg1 = (instr >> 5) & 7;
+    uint arg2 = instr & 0x1f;
+    uint count = arg2 == 0 ? 32 : arg2;
+    uint32_t data = 0;
+
+    switch (op){
+    case 0: //jmp
+        {
+            bool cond;
+            switch (arg1){
+            case 0: cond = true; break;
+            case 1: cond = s->x == 0; break;
+            case 2: cond = s->x != 0; s->x--; break;
+            case 3: cond = s->y == 0; break;
+            case 4: cond = s->y != 0; s->y--; break;
+            case 5: cond = s->x != s->y; break;
+            case 6: cond = pio_sim_read_pins(sim, 0) >> (s->config.jmp_pin & 31) & 1; break;
+            default: cond = s->osr_count < pio_sim_threshold(s->config.pull_threshold); break;
+            }
+            if (cond){
+                s->pc = arg2;
+                *jumped = true;
+            }
+        }
+        return true;
+
+    case 1: //wait
+        {
+            bool pol = (instr >> 7) & 1;
+            uint src = (instr >> 5) & 3;
+            bool level;
+            if (src == 0){
+                level = pio_sim_read_pins(sim, 0) >> arg2 & 1;
+            }
+            else if (src == 1){
+                level = pio_sim_read_pins(sim, s->config.in_base) >> arg2 & 1;
+            }
+            else {
+                uint irq = pio_sim_irq_index(smi, arg2);
+                level = (sim->irq >> irq) & 1;
+                if (level == pol && pol){
+                    sim->irq &= ~(1u << irq);
+                }
+            }
+            return level == pol;
+        }
+
+    case 2: //in
+        if (s->config.autopush && s->isr_count >= pio_sim_threshold(s->config.push_threshold)){
+            if (pio_sim_rx_push(s, s->isr) == false){
+                return false;
+            }
+            s->isr = 0;
+            s->isr_count = 0;
+        }
+        switch (arg1){
+        case 0: data = pio_sim_read_pins(sim, s->config.in_base); break;
+        case 1: data = s->x; break;
+        case 2: data = s->y; break;
+        case 6: data = s->isr; break;
+        case 7: data = s->osr; break;
+        default: data = 0; break;
+        }
+        pio_sim_shift_in(s, data, count);
+        if (s->config.autopush && s->isr_count >= pio_sim_threshold(s->config.push_threshold)){
+            if (pio_sim_rx_push(s, s->isr) == true){
+                s->isr = 0;
+                s->isr_count = 0;
+            }
+        }
+        return true;
+
+    case 3: //out
+        if (s->config.autopull && s->osr_count >= pio_sim_threshold(s->config.pull_threshold)){
+            if (pio_sim_tx_pop(s, &s->osr) == false){
+                return false;
+            }
+            s->osr_count = 0;
+        }
+        data = pio_sim_shift_out(s, count);
+        switch (arg1){
+        case 0: pio_sim_write_pins(sim, s->config.out_base, s->config.out_count, data); break;
+        case 1: s->x = data; break;
+        case 2: s->y = data; break;
+        case 4: pio_sim_write_pindirs(sim, s->config.out_base, s->config.out_count, data); break;
+        case 5: s->pc = data & 0x1f; *jumped = true; break;
+        case 6: s->isr = data; s->isr_count = count; break;
+        case 7: s->exec_pending = true; s->exec_instr = (uint16_t)data; break;
+        default: break;
+        }
+        if (s->config.autopull && s->osr_count >= pio_sim_threshold(s->config.pull_threshold)){
+            if (pio_sim_tx_pop(s, &s->osr) == true){
+                s->osr_count = 0;
+            }
+        }
+        return true;
+
+    case 4: //push, pull
+        {
+            bool is_pull = (instr >> 7) & 1;
+            bool if_cond = (instr >> 6) & 1;
+            bool block = (instr >> 5) & 1;
+            if (is_pull){
+                if (if_cond && s->osr_count < pio_sim_threshold(s->config.pull_threshold)){
+                    return true;
+                }
+                if (pio_sim_tx_pop(s, &data) == false){
+                    if (block){
+                        return false;
+                    }
+                    data = s->x;
+                }
+                s->osr = data;
+                s->osr_count = 0;
+            }
+            else {
+                if (if_cond && s->isr_count < pio_sim_threshold(s->config.push_threshold)){
+                    return true;
+                }
+                if (pio_sim_rx_push(s, s->isr) == false && block){
+                    return false;
+                }
+                s->isr = 0;
+                s->isr_count = 0;
+            }
+        }
+        return true;
+
+    case 5: //mov
+        {
+            uint mov_op = (instr >> 3) & 3;
+            switch (instr & 7){
+            case 0: data = pio_sim_read_pins(sim, s->config.in_base); break;
+            case 1: data = s->x; break;
+            case 2: data = s->y; break;
+            case 5: data = s->tx_level < 1 ? 0xFFFFFFFFu : 0; break;
+            case 6: data = s->isr; break;
+            case 7: data = s->osr; break;
+            default: data = 0; break;
+            }
+            if (mov_op == 1){
+                data = ~data;
+            }
+            else if (mov_op == 2){
+                data = pio_sim_bit_reverse(data);
+            }
+            switch (arg1){
+            case 0: pio_sim_write_pins(sim, s->config.out_base, s->config.out_count, data); break;
+            case 1: s->x = data; break;
+            case 2: s->y = data; break;
+            case 4: s->exec_pending = true; s->exec_instr = (uint16_t)data; break;
+            case 5: s->pc = data & 0x1f; *jumped = true; break;
+            case 6: s->isr = data; s->isr_count = 0; break;
+            case 7: s->osr = data; s->osr_count = 0; break;
+            default: break;
+            }
+        }
+        return true;
+
+    case 6: //irq
+        {
+            bool clr = (instr >> 6) & 1;
+            bool wait = (instr >> 5) & 1;
+            uint irq = pio_sim_irq_index(smi, arg2);
+            if (s->irq_waiting){
+                if ((sim->irq >> irq) & 1){
+                    return false;
+                }
+                s->irq_waiting = false;
+                return true;
+            }
+            if (clr){
+                sim->irq &= ~(1u << irq);
+                return true;
+            }
+            sim->irq |= 1u << irq;
+            if (wait){
+                s->irq_waiting = true;
+                return false;
+            }
+        }
+        return true;
+
+    default: //set
+        switch (arg1){
+        case 0: pio_sim_write_pins(sim, s->config.set_base, s->config.set_count, arg2); break;
+        case 1: s->x = arg2; break;
+        case 2: s->y = arg2; break;
+        case 4: pio_sim_write_pindirs(sim, s->config.set_base, s->config.set_count, arg2); break;
+        default: break;
+        }
+        return true;
+    }
+}
+
+static void pio_sim_sm_tick(pio_sim_t* sim, uint smi){
+    pio_sim_sm_t* s = &sim->sm[smi];
+    uint sideset_count = s->config.sideset_count;
+    uint delay_bits = 5 - sideset_count;
+    uint16_t instr;
+    uint field, delay;
+    bool jumped = false;
+    bool from_exec;
+
+    s->cycles++;
+    if (s->delay > 0){
+        s->delay--;
+        return;
+    }
+
+    from_exec = s->exec_pending;
+    instr = from_exec ? s->exec_instr : sim->instr_mem[s->pc];
+    s->exec_pending = false;
+
+    //Side-set takes effect on the first cycle, stalled or not
+    field = (instr >> 8) & 0x1f;
+    delay = field & ((1u << delay_bits) - 1);
+    if (sideset_count > 0){
+        uint side = field >> delay_bits;
+        uint bits = sideset_count;
+        bool enable = true;
+        if (s->config.sideset_optional){
+            bits--;
+            enable = (side >> bits) & 1;
+            side &= (1u << bits) - 1;
+        }
+        if (enable){
+            if (s->config.sideset_pindirs){
+                pio_sim_write_pindirs(sim, s->config.sideset_base, bits, side);
+            }
+            else {
+                pio_sim_write_pins(sim, s->config.sideset_base, bits, side);
+            }
+        }
+    }
+
+    if (pio_sim_exec(sim, smi, instr, &jumped) == false){
+        if (from_exec){
+            s->exec_pending = true;
+        }
+        s->stalls++;
+        return;
+    }
+
+    s->delay = (uint8_t)delay;
+    if (jumped == false && from_exec == false){
+        s->pc = s->pc == s->config.wrap ? (uint8_t)s->config.wrap_target : (uint8_t)((s->pc + 1) & 0x1f);
+    }
+}
+
+void pio_sim_load(pio_sim_t* sim, PIO pio){
+    memset(sim, 0, sizeof(*sim));
+    memcpy(sim->instr_mem, pio->instr_mem, sizeof(sim->instr_mem));
+    sim->enabled_mask = pio->sm_enabled_mask;
+    sim->pins = pio->sm_pins;
+    sim->pindirs = pio->sm_pindirs;
+    sim->sync_bypass = pio->input_sync_bypass;
+
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++){
+        pio_sim_sm_t* s = &sim->sm[i];
+        s->config = pio->sm_config[i];
+        s->pc = (uint8_t)pio->sm_offset[i];
+
+        //pio_sm_exec(jmp) is how the library points a state machine at its program
+        if (pio->sm_exec_count[i] > 0 && (pio->sm_last_exec[i] & 0xe0e0) == 0){
+            s->pc = pio->sm_last_exec[i] & 0x1f;
+        }
+        //pull_threshold 32 is encoded as 0, an empty OSR reads as fully shifted out
+        s->osr_count = 32;
+    }
+}
+
+void pio_sim_step(pio_sim_t* sim){
+    sim->sync[1] = sim->sync[0];
+    sim->sync[0] = sim->pins_in;
+
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++){
+        pio_sim_sm_t* s = &sim->sm[i];
+        uint32_t div;
+
+        if (((sim->enabled_mask >> i) & 1) == 0){
+            continue;
+        }
+
+        //16.8 fractional divider, an integer part of 0 means 65536
+        div = ((s->config.clkdiv_int == 0 ? 65536u : s->config.clkdiv_int) << 8) | s->config.clkdiv_frac;
+        s->div_acc += 256;
+        if (s->div_acc >= div){
+            s->div_acc -= div;
+            pio_sim_sm_tick(sim, i);
+        }
+    }
+}
+
+bool pio_sim_gpio(const pio_sim_t* sim, uint gpio){
+    uint32_t level = (sim->pins & sim->pindirs) | (sim->pins_in & ~sim->pindirs);
+    return (level >> (gpio & 31)) & 1;
+}
+
+uint pio_sim_tx_free(const pio_sim_t* sim, uint sm){
+    return pio_sim_fifo_depth(&sim->sm[sm], true) - sim->sm[sm].tx_level;
+}
+
+bool pio_sim_tx_put(pio_sim_t* sim, uint sm, uint32_t data){
+    pio_sim_sm_t* s = &sim->sm[sm];
+
+    if (pio_sim_tx_free(sim, sm) == 0){
+        return false;
+    }
+    s->tx_fifo[(s->tx_head + s->tx_level) % PIO_SIM_FIFO_DEPTH] = data;
+    s->tx_level++;
+    return true;
+}
+
+bool pio_sim_rx_get(pio_sim_t* sim, uint sm, uint32_t* data){
+    pio_sim_sm_t* s = &sim->sm[sm];
+
+    if (s->rx_level == 0){
+        return false;
+    }
+    *data = s->rx_fifo[s->rx_head];
+    s->rx_head = (s->rx_head + 1) % PIO_SIM_FIFO_DEPTH;
+    s->rx_level--;
+    return true;
+}
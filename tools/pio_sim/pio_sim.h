@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file pio_sim.h
+ * @brief Cycle accurate PIO state machine simulator for the host build
+ *
+ * Runs the instruction memory and state machine configuration recorded by the
+ * host stubs (pico_host_pio[]) one clk_sys cycle at a time, including the
+ * fractional clock divider, side-set, delay, FIFO stalls and the input synchronizer.
+ */
+
+#ifndef PIO_SIM_H
+#define PIO_SIM_H
+#include "pico_host.h"
+
+#define PIO_SIM_FIFO_DEPTH 8
+
+typedef struct {
+    pio_sm_config config;
+    uint8_t pc;
+    uint32_t x;
+    uint32_t y;
+    uint32_t osr;
+    uint32_t isr;
+    uint8_t osr_count;      //bits shifted out of osr
+    uint8_t isr_count;      //bits shifted into isr
+    uint8_t delay;
+    uint32_t div_acc;
+    bool exec_pending;
+    uint16_t exec_instr;
+    bool irq_waiting;
+    uint32_t tx_fifo[PIO_SIM_FIFO_DEPTH];
+    uint8_t tx_head;
+    uint8_t tx_level;
+    uint32_t rx_fifo[PIO_SIM_FIFO_DEPTH];
+    uint8_t rx_head;
+    uint8_t rx_level;
+    uint64_t cycles;        //state machine clock enables
+    uint64_t stalls;        //cycles spent stalled
+    uint32_t pulls;         //words taken from the TX FIFO
+} pio_sim_sm_t;
+
+typedef struct {
+    uint16_t instr_mem[PIO_INSTRUCTION_COUNT];
+    pio_sim_sm_t sm[NUM_PIO_STATE_MACHINES];
+    uint32_t enabled_mask;
+    uint32_t pins;          //levels driven by the PIO
+    uint32_t pindirs;       //1: driven by the PIO
+    uint32_t pins_in;       //levels driven from outside
+    uint32_t sync_bypass;   //1: input read without the 2 cycle synchronizer
+    uint32_t sync[2];       //synchronizer stages
+    uint8_t irq;
+} pio_sim_t;
+
+/**
+ * @brief Load program memory, configurations and enabled state machines from a stubbed PIO
+ *
+ * @param sim Simulator
+ * @param pio PIO configured by the library through the host stubs
+ */
+void pio_sim_load(pio_sim_t* sim, PIO pio);
+
+/**
+ * @brief Advance one clk_sys cycle
+ *
+ * @param sim Simulator
+ */
+void pio_sim_step(pio_sim_t* sim);
+
+/**
+ * @brief Level seen on a GPIO
+ *
+ * @param sim Simulator
+ * @param gpio GPIO number
+ */
+bool pio_sim_gpio(const pio_sim_t* sim, uint gpio);
+
+/**
+ * @brief Number of free TX FIFO entries
+ */
+uint pio_sim_tx_free(const pio_sim_t* sim, uint sm);
+
+/**
+ * @brief Write a word to the TX FIFO
+ *
+ * @return true Success
+ * @return false FIFO full
+ */
+bool pio_sim_tx_put(pio_sim_t* sim, uint sm, uint32_t data);
+
+/**
+ * @brief Read a word from the RX FIFO
+ *
+ * @return true Success
+ * @return false FIFO empty
+ */
+bool pio_sim_rx_get(pio_sim_t* sim, uint sm, uint32_t* data);
+
+#endif
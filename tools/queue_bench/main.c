@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file main.c
+ * @brief Stress and throughput test of the packet queue with a producer and a consumer thread
+ *
+ * The default instance is set up with use_core1, core1 is never run, so a
+ * consumer thread takes every packet with i2s_dequeue while the main thread
+ * produces with i2s_enqueue or i2s_enqueue_acquire/commit. Both run flat out
+ * on their own host core (or yield to each other on one), the queue counters
+ * and fences are all they share.
+ *
+ * Every packet carries its sequence number in each word and a length that
+ * changes from packet to packet. The consumer checks that packets arrive in
+ * order with their length, that no word is torn, and that the slot it holds
+ * is not written again before it asks for the next one. Queue depths 1, 2, 3
+ * and 8 wrap the ring many times over.
+ *
+ * Prints packets per second and the producer spins on a full queue.
+ *
+ * usage: queue_bench [-n frames] [-p packets]
+ *
+ * Exits with 1 if any check fails.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "pico_host.h"
+#include "i2s.h"
+
+#define BENCH_DMA       0
+#define BENCH_TIMEOUT_S 20
+
+typedef struct {
+    uint32_t packets;
+    uint32_t frames;            //Packet capacity, packet n carries n % frames + 1
+    uint32_t received;
+    uint32_t errors;
+    volatile bool stalled;      //Set by the consumer, the producer gives up
+} bench_t;
+
+static int failures;
+
+static void usage(void){
+    fprintf(stderr, "usage: queue_bench [-n frames] [-p packets]\n");
+    exit(2);
+}
+
+static void no_playback_handler(bool state){
+    (void)state;
+}
+
+static double now_s(void){
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+//Word i of packet seq, every word differs so a torn or stale slot shows
+static inline int32_t word(uint32_t seq, uint32_t i){
+    return (int32_t)(seq * 0x9e3779b1u + i);
+}
+
+static inline uint32_t packet_frames(const bench_t* b, uint32_t seq){
+    return seq % b->frames + 1;
+}
+
+static void* consume(void* arg){
+    bench_t* b = arg;
+    double deadline = now_s() + BENCH_TIMEOUT_S;
+    int32_t* buff;
+    int sample;
+
+    while (b->received < b->packets){
+        if (i2s_dequeue(&buff, &sample) == false){
+            if (now_s() > deadline){
+                b->stalled = true;
+                break;
+            }
+            //Let the producer run when both share one host core
+            sched_yield();
+            continue;
+        }
+        const volatile int32_t* w = buff;
+        uint32_t seq = b->received;
+        uint32_t len = packet_frames(b, seq) * 2;
+        bool ok = (uint32_t)sample == len;
+
+        for (uint32_t i = 0; ok && i < len; i++){
+            ok = w[i] == word(seq, i);
+        }
+        //The slot is held until the next i2s_dequeue, the producer must not have it back yet
+        sched_yield();
+        if (ok && (w[0] != word(seq, 0) || w[len - 1] != word(seq, len - 1))){
+            ok = false;
+        }
+        if (ok == false && b->errors++ < 5){
+            printf("packet %u: %d words, expected %u, first word %08x\n", seq, sample, len, (unsigned)w[0]);
+        }
+        b->received++;
+    }
+    return NULL;
+}
+
+static bool produce_enqueue(bench_t* b, uint32_t seq, int32_t* packet, uint64_t* full){
+    uint32_t len = packet_frames(b, seq) * 2;
+
+    for (uint32_t i = 0; i < len; i++){
+        packet[i] = word(seq, i);
+    }
+    while (i2s_enqueue((uint8_t*)packet, len * sizeof(int32_t), 32) == false){
+        (*full)++;
+        if (b->stalled == true){
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+static bool produce_acquire(bench_t* b, uint32_t seq, uint64_t* full){
+    uint32_t len = packet_frames(b, seq) * 2;
+    uint32_t capacity;
+    int32_t* slot;
+
+    while ((slot = i2s_enqueue_acquire(&capacity)) == NULL){
+        (*full)++;
+        if (b->stalled == true){
+            return false;
+        }
+        sched_yield();
+    }
+    for (uint32_t i = 0; i < len; i++){
+        slot[i] = word(seq, i);
+    }
+    return i2s_enqueue_commit(len / 2);
+}
+
+static void run(uint8_t depth, uint32_t frames, uint32_t packets, bool acquire){
+    static int32_t arena[64 * 1024];
+    const char* api = acquire ? "acquire" : "enqueue";
+    int32_t* packet = malloc(frames * 2 * sizeof(int32_t));
+    bench_t b = {.packets = packets, .frames = frames};
+    uint64_t full = 0;
+    pthread_t consumer;
+    double start, elapsed;
+    uint32_t sent;
+
+    pico_host_reset(125000000);
+    set_playback_handler(no_playback_handler);
+    i2s_mclk_set_config(pio0, 0, BENCH_DMA, true, CLOCK_MODE_DEFAULT, MODE_I2S);
+    if (i2s_set_buffer(arena, sizeof(arena), frames, depth) == false){
+        printf("FAIL %s depth %u: buffer does not fit\n", api, depth);
+        failures++;
+        free(packet);
+        return;
+    }
+    //0dB passes 32 bit words through unchanged
+    i2s_volume_change(0, 0);
+    if (i2s_mclk_init(48000) == false){
+        printf("FAIL %s depth %u: i2s_mclk_init failed\n", api, depth);
+        failures++;
+        free(packet);
+        return;
+    }
+
+    start = now_s();
+    pthread_create(&consumer, NULL, consume, &b);
+    for (sent = 0; sent < packets; sent++){
+        bool ok = acquire ? produce_acquire(&b, sent, &full) : produce_enqueue(&b, sent, packet, &full);
+        if (ok == false){
+            break;
+        }
+    }
+    pthread_join(consumer, NULL);
+    elapsed = now_s() - start;
+
+    if (b.stalled == true || sent != packets || b.received != packets){
+        printf("FAIL %s depth %u: %u packets sent, %u received\n", api, depth, sent, b.received);
+        failures++;
+    }
+    if (b.errors > 0){
+        printf("FAIL %s depth %u: %u packets out of order or overwritten\n", api, depth, b.errors);
+        failures++;
+    }
+    //The consumer still holds the last slot
+    if (i2s_get_buf_length() != 0){
+        printf("FAIL %s depth %u: %d packets left in the queue\n", api, depth, i2s_get_buf_length());
+        failures++;
+    }
+    printf("%s depth %u: %u packets, %.2f Mpackets/s, %.0f ns/packet, %.2f full spins/packet\n",
+           api, depth, b.received, b.received / elapsed * 1e-6, elapsed * 1e9 / b.received, (double)full / packets);
+
+    i2s_deinit();
+    free(packet);
+}
+
+int main(int argc, char** argv){
+    static const uint8_t depths[] = {1, 2, 3, 8};
+    uint32_t frames = 48, packets = 200000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:")) != -1){
+        switch (opt){
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'p': packets = strtoul(optarg, NULL, 0); break;
+        default: usage();
+        }
+    }
+    if (frames == 0 || frames > 1024 || packets == 0) usage();
+
+    for (uint i = 0; i < sizeof(depths) / sizeof(depths[0]); i++){
+        run(depths[i], frames, packets, false);
+        run(depths[i], frames, packets, true);
+    }
+    if (failures > 0){
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}